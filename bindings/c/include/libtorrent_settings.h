@@ -80,6 +80,12 @@ enum settings_tags_t {
 	SET_SOCKS5_UDP_SEND_LOCAL_EP, // int (0 or 1)
 	SET_PROXY_SEND_HOST_IN_CONNECT, // int (0 or 1)
 	SET_DISK_DISABLE_COPY_ON_WRITE, // int (0 or 1)
+	SET_DISK_BUFFER_HUGE_PAGES, // int (0 or 1)
+	SET_DISK_BUFFER_NUMA_ARENAS, // int (0 or 1)
+	SET_ZERO_COPY_SEND, // int (0 or 1)
+	SET_INCREMENTAL_PIECE_AVAILABILITY, // int (0 or 1)
+	SET_HASHED_PEER_LIST, // int (0 or 1)
+	SET_COMPACT_PEER_STORAGE, // int (0 or 1)
 	SET_TRACKER_COMPLETION_TIMEOUT, // int
 	SET_TRACKER_RECEIVE_TIMEOUT, // int
 	SET_STOP_TRACKER_TIMEOUT, // int
@@ -85,6 +85,12 @@ int settings_key(int const tag)
 		case SET_SOCKS5_UDP_SEND_LOCAL_EP: return sp::socks5_udp_send_local_ep;
 		case SET_PROXY_SEND_HOST_IN_CONNECT: return sp::proxy_send_host_in_connect;
 		case SET_DISK_DISABLE_COPY_ON_WRITE: return sp::disk_disable_copy_on_write;
+		case SET_DISK_BUFFER_HUGE_PAGES: return sp::disk_buffer_huge_pages;
+		case SET_DISK_BUFFER_NUMA_ARENAS: return sp::disk_buffer_numa_arenas;
+		case SET_ZERO_COPY_SEND: return sp::zero_copy_send;
+		case SET_INCREMENTAL_PIECE_AVAILABILITY: return sp::incremental_piece_availability;
+		case SET_HASHED_PEER_LIST: return sp::hashed_peer_list;
+		case SET_COMPACT_PEER_STORAGE: return sp::compact_peer_storage;
 		case SET_TRACKER_COMPLETION_TIMEOUT: return sp::tracker_completion_timeout;
 		case SET_TRACKER_RECEIVE_TIMEOUT: return sp::tracker_receive_timeout;
 		case SET_STOP_TRACKER_TIMEOUT: return sp::stop_tracker_timeout;
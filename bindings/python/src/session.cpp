@@ -31,6 +31,8 @@
 
 #include <libtorrent/mmap_disk_io.hpp>
 #include <libtorrent/posix_disk_io.hpp>
+#include <libtorrent/pread_disk_io.hpp>
+#include <libtorrent/io_uring_disk_io.hpp>
 
 namespace boost
 {
@@ -897,6 +899,12 @@ namespace
 #endif
         if (disk_io == "posix_disk_io_constructor")
             s.disk_io_constructor = &lt::posix_disk_io_constructor;
+        else if (disk_io == "pread_disk_io_constructor")
+            s.disk_io_constructor = &lt::pread_disk_io_constructor;
+#if TORRENT_HAVE_IO_URING
+        else if (disk_io == "io_uring_disk_io_constructor")
+            s.disk_io_constructor = &lt::io_uring_disk_io_constructor;
+#endif
         else
             s.disk_io_constructor = &lt::default_disk_io_constructor;
     }
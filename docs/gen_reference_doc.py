@@ -120,6 +120,8 @@ category_mapping = {
     'mmap_disk_io.hpp': 'Storage',
     'disabled_disk_io.hpp': 'Storage',
     'posix_disk_io.hpp': 'Storage',
+    'pread_disk_io.hpp': 'Storage',
+    'io_uring_disk_io.hpp': 'Storage',
     'extensions.hpp': 'Plugins',
     'ut_metadata.hpp': 'Plugins',
     'ut_pex.hpp': 'Plugins',
@@ -56,6 +56,8 @@ see LICENSE file.
 
 #include "libtorrent/mmap_disk_io.hpp"
 #include "libtorrent/posix_disk_io.hpp"
+#include "libtorrent/pread_disk_io.hpp"
+#include "libtorrent/io_uring_disk_io.hpp"
 #include "libtorrent/disabled_disk_io.hpp"
 
 #include "torrent_view.hpp"
@@ -1357,7 +1359,7 @@ CLIENT OPTIONS
   -O <log file>         print session stats counters to the specified log file
   -1                    exit on first torrent completing (useful for benchmarks)
   -i <disk-io>          specify which disk I/O back-end to use. One of:
-                        mmap, posix, disabled
+                        mmap, posix, pread, uring, disabled
 )"
 #ifdef TORRENT_UTP_LOG_ENABLE
 R"(
@@ -1571,6 +1573,12 @@ int main(int argc, char* argv[])
 #endif
 				if (arg == "posix"_sv)
 					params.disk_io_constructor = lt::posix_disk_io_constructor;
+				else if (arg == "pread"_sv)
+					params.disk_io_constructor = lt::pread_disk_io_constructor;
+#if TORRENT_HAVE_IO_URING
+				else if (arg == "uring"_sv)
+					params.disk_io_constructor = lt::io_uring_disk_io_constructor;
+#endif
 				else if (arg == "disabled"_sv)
 					params.disk_io_constructor = lt::disabled_disk_io_constructor;
 				else
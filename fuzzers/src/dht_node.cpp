@@ -39,6 +39,8 @@ struct obs : dht::dht_observer
 	bool on_dht_request(string_view
 		, dht::msg const&, entry&) override
 	{ return false; }
+	void indexer_results(std::vector<sha1_hash> const&
+		, std::vector<std::pair<sha1_hash, tcp::endpoint>> const&) override {}
 
 #ifndef TORRENT_DISABLE_LOGGING
 
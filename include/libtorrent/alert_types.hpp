@@ -77,7 +77,7 @@ namespace libtorrent {
 	constexpr int user_alert_id = 10000;
 
 	// this constant represents "max_alert_index" + 1
-	constexpr int num_alert_types = 105;
+	constexpr int num_alert_types = 107;
 
 	// internal
 	constexpr int abi_alert_count = 128;
@@ -3253,6 +3253,67 @@ TORRENT_VERSION_NAMESPACE_4_END
 		std::vector<announce_entry> trackers;
 	};
 
+	// This alert is only posted when requested by the user, by calling
+	// session::post_status_deltas(). It contains the frequently changing
+	// status fields of the torrents whose state changed since the last
+	// state_update_alert or state_delta_alert, and which have a field that
+	// changed since the last state_delta_alert. Unlike state_update_alert,
+	// no torrent_status objects are built, which makes this a lot cheaper
+	// with many torrents. Its category is ``alert_category::status``, but
+	// it's not subject to filtering, since it's only manually posted anyway.
+	struct TORRENT_EXPORT state_delta_alert final : alert
+	{
+		// internal
+		TORRENT_UNEXPORT state_delta_alert(aux::stack_allocator& alloc
+			, torrent_status_deltas d);
+
+		TORRENT_DEFINE_ALERT_PRIO(state_delta_alert, 105, alert_priority::high)
+
+		static inline constexpr alert_category_t static_category = alert_category::status;
+		std::string message() const override;
+
+		// the torrents with changed fields, and the fields that changed
+		torrent_status_deltas deltas;
+	};
+
+	// posted by the DHT indexer (enabled by settings_pack::dht_indexer_requests)
+	// with the info-hashes it has discovered, and the peers it has found for
+	// them, since the previous dht_indexer_alert. Info-hashes are deduplicated
+	// on a best-effort basis: an info-hash that was reported a while ago may
+	// be reported again.
+	struct TORRENT_EXPORT dht_indexer_alert final : alert
+	{
+		// internal
+		TORRENT_UNEXPORT dht_indexer_alert(aux::stack_allocator& alloc
+			, std::vector<sha1_hash> const& info_hashes
+			, std::vector<std::pair<sha1_hash, tcp::endpoint>> const& peers);
+
+		static inline constexpr alert_category_t static_category = alert_category::dht_operation;
+		TORRENT_DEFINE_ALERT(dht_indexer_alert, 106)
+
+		std::string message() const override;
+
+		// the info-hashes sampled from DHT nodes. ``num_info_hashes()`` is
+		// more efficient than ``info_hashes().size()``.
+		int num_info_hashes() const;
+		std::vector<sha1_hash> info_hashes() const;
+
+		// the peers returned by the nodes that sampled the info-hashes, as
+		// (info-hash, peer) pairs. ``num_peers()`` is more efficient than
+		// ``peers().size()``.
+		int num_peers() const;
+		std::vector<std::pair<sha1_hash, tcp::endpoint>> peers() const;
+
+	private:
+		std::reference_wrapper<aux::stack_allocator> m_alloc;
+		int m_num_info_hashes;
+		aux::allocation_slot m_info_hashes_idx;
+		int m_v4_num_peers = 0;
+		int m_v6_num_peers = 0;
+		aux::allocation_slot m_v4_peers_idx;
+		aux::allocation_slot m_v6_peers_idx;
+	};
+
 	// internal
 	TORRENT_EXTRA_EXPORT char const* performance_warning_str(performance_alert::performance_warning_t i);
 
@@ -25,6 +25,8 @@ see LICENSE file.
 #include <condition_variable>
 #include <atomic>
 #include <bitset>
+#include <cstdint>
+#include <vector>
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
 #include "libtorrent/extensions.hpp"
@@ -48,30 +50,54 @@ namespace aux {
 		template <class T, typename... Args>
 		void emplace_alert(Args&&... args) try
 		{
-			std::unique_lock<std::recursive_mutex> lock(m_mutex);
-
-			heterogeneous_queue<alert>& queue = m_alerts[m_generation & 1];
-
 			// don't add more than this number of alerts, unless it's a
 			// high priority alert, in which case we try harder to deliver it
 			// for high priority alerts, double the upper limit
-			if (queue.size() / (1 + static_cast<int>(T::priority)) >= m_queue_size_limit)
+			int const queued = m_num_queued.fetch_add(1, std::memory_order_relaxed);
+			if (queued / (1 + static_cast<int>(T::priority))
+				>= m_queue_size_limit.load(std::memory_order_relaxed))
 			{
+				m_num_queued.fetch_sub(1, std::memory_order_relaxed);
 				// record that we dropped an alert of this type
-				m_dropped.set(T::alert_type);
+				mark_dropped(T::alert_type);
 				return;
 			}
 
-			T& alert = queue.emplace_back<T>(
-				m_allocations[m_generation & 1], std::forward<Args>(args)...);
+#ifndef TORRENT_DISABLE_EXTENSIONS
+			// extensions see every alert, one at a time. Holding m_mutex also
+			// keeps get_all() from handing out (and the client from freeing) the
+			// alert while they look at it
+			std::unique_lock<std::recursive_mutex> ext_lock(m_mutex, std::defer_lock);
+			if (!m_ses_extensions.empty()) ext_lock.lock();
+#endif
+
+			alert* a = nullptr;
+			{
+				shard& s = current_shard();
+				std::lock_guard<std::mutex> l(s.mutex);
+				int const idx = s.generation & 1;
+				std::vector<std::uint64_t>& seq = s.sequence[idx];
+				seq.push_back(m_sequence.fetch_add(1, std::memory_order_relaxed));
+				try
+				{
+					a = &s.alerts[idx].emplace_back<T>(
+						s.allocations[idx], std::forward<Args>(args)...);
+				}
+				catch (...)
+				{
+					seq.pop_back();
+					throw;
+				}
+			}
 
-			maybe_notify(&alert);
+			maybe_notify(a, queued == 0);
 		}
 		catch (std::bad_alloc const&)
 		{
+			// the alert was counted, but never queued
+			m_num_queued.fetch_sub(1, std::memory_order_relaxed);
 			// record that we dropped an alert of this type
-			std::unique_lock<std::recursive_mutex> lock(m_mutex);
-			m_dropped.set(T::alert_type);
+			mark_dropped(T::alert_type);
 		}
 
 		bool pending() const;
@@ -96,6 +122,10 @@ namespace aux {
 		}
 
 		int alert_queue_size_limit() const noexcept { return m_queue_size_limit; }
+
+		// the number of shards alerts are posted to. Each posting thread is
+		// assigned one, round-robin
+		static constexpr int num_shards = 16;
 		int set_alert_queue_size_limit(int queue_size_limit_);
 
 		void set_notify_function(std::function<void()> const& fun);
@@ -106,15 +136,58 @@ namespace aux {
 
 	private:
 
-		void maybe_notify(alert* a);
-
-		// this mutex protects everything. Since it's held while executing user
+		// alerts are posted to one of a number of shards, picked by the
+		// posting thread. Each shard has its own lock, which is only contended
+		// by threads sharing the shard and by get_all(), so threads posting
+		// alerts don't contend with each other
+		struct alignas(64) shard
+		{
+			std::mutex mutex;
+
+			// this is either 0 or 1, it indicates which alerts and allocations
+			// the producers are allowed to use right now. This is swapped when
+			// the client calls get_all(), at which point all of the alert
+			// objects passed to the client will be owned by libtorrent again,
+			// and reset.
+			std::uint32_t generation = 0;
+
+			// there are two heterogeneous queues to double buffer the thread
+			// access. The shard's mutex gives exclusive access to
+			// alerts[generation & 1] and allocations[generation & 1] whereas the
+			// other copy is exclusively used by the client thread.
+			aux::array<heterogeneous_queue<alert>, 2> alerts;
+
+			// this is a stack where alerts can allocate variable length
+			// content, such as strings, to go with the alerts.
+			aux::array<aux::stack_allocator, 2> allocations;
+
+			// the sequence number of each alert in ``alerts``, used to merge
+			// the shards back into the order the alerts were posted in
+			aux::array<std::vector<std::uint64_t>, 2> sequence;
+		};
+
+		shard& current_shard();
+
+		void mark_dropped(int type);
+		void maybe_notify(alert* a, bool first);
+
+		// protects the notify function, the dropped alerts mask and the client
+		// side of the shards. get_all() holds it, and so does posting an alert
+		// while there are extensions. Since it's held while executing user
 		// callbacks (the notify function and extension on_alert()) it must be
-		// recursive to support recursively post new alerts.
+		// recursive to support recursively post new alerts. It's always locked
+		// before a shard mutex.
 		mutable std::recursive_mutex m_mutex;
 		std::condition_variable_any m_condition;
 		std::atomic<alert_category_t> m_alert_mask;
-		int m_queue_size_limit;
+		std::atomic<int> m_queue_size_limit;
+
+		// the number of alerts in the shards' active queues. This is what the
+		// queue size limit applies to
+		std::atomic<int> m_num_queued{0};
+
+		// the next alert sequence number
+		std::atomic<std::uint64_t> m_sequence{0};
 
 		// a bitfield where each bit represents an alert type. Every time we drop
 		// an alert (because the queue is full or of some other error) we set the
@@ -127,25 +200,18 @@ namespace aux {
 		// its main message loop for it to poll for alerts (using get_alerts()).
 		// That call will drain every alert in one atomic operation and this
 		// notification function will be called again the next time an alert is
-		// posted to the queue
+		// posted to the queue. It's also called at the end of get_all() if
+		// alerts were posted while it was draining the queue
 		std::function<void()> m_notify;
 
-		// this is either 0 or 1, it indicates which m_alerts and m_allocations
-		// the alert_manager is allowed to use right now. This is swapped when
-		// the client calls get_all(), at which point all of the alert objects
-		// passed to the client will be owned by libtorrent again, and reset.
+		// every stack allocator is given a unique generation number when it's
+		// reset, since cached_slot relies on it to tell allocators apart
 		std::uint32_t m_generation = 0;
 
-		// this is where all alerts are queued up. There are two heterogeneous
-		// queues to double buffer the thread access. The std::mutex in the alert
-		// manager gives exclusive access to m_alerts[m_generation & 1] and
-		// m_allocations[m_generation & 1] whereas the other copy is exclusively
-		// used by the client thread.
-		aux::array<heterogeneous_queue<alert>, 2> m_alerts;
+		aux::array<shard, num_shards> m_shards;
 
-		// this is a stack where alerts can allocate variable length content,
-		// such as strings, to go with the alerts.
-		aux::array<aux::stack_allocator, 2> m_allocations;
+		// scratch space for merging the shards in get_all()
+		std::vector<std::pair<std::uint64_t, alert*>> m_merge;
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
 		std::list<std::shared_ptr<plugin>> m_ses_extensions;
@@ -59,6 +59,11 @@ private:
 	// the number of bytes all the requests in queue are for
 	std::int64_t m_queued_bytes;
 
+	// scratch space for update_quotas(). The requests that are satisfied
+	// in a tick and the channels that have requests waiting for them
+	std::vector<bw_request> m_done;
+	std::vector<bandwidth_channel*> m_channels;
+
 	// this is the channel within the consumers
 	// that bandwidth is assigned to (upload or download)
 	int m_channel;
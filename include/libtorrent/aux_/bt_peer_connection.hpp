@@ -170,6 +170,7 @@ namespace libtorrent::aux {
 
 		void get_specific_peer_info(peer_info& p) const override;
 		bool in_handshake() const override;
+		bool supports_zero_copy_send() const override;
 		bool packet_finished() const { return m_recv_buffer.packet_finished(); }
 
 		bool supports_holepunch() const { return m_holepunch_id != 0; }
@@ -21,6 +21,7 @@ see LICENSE file.
 #if TORRENT_DEBUG_BUFFER_POOL
 #include <map>
 #endif
+#include <atomic>
 #include <vector>
 #include <mutex>
 #include <functional>
@@ -29,11 +30,13 @@ see LICENSE file.
 #include "libtorrent/io_context.hpp"
 #include "libtorrent/span.hpp"
 #include "libtorrent/disk_buffer_holder.hpp" // for buffer_allocator_interface
+#include "libtorrent/aux_/slab_allocator.hpp"
 
 namespace libtorrent {
 
 	struct settings_interface;
 	struct disk_observer;
+	struct counters;
 
 namespace aux {
 
@@ -52,32 +55,40 @@ namespace aux {
 		void free_buffer(char* buf);
 		void free_multiple_buffers(span<char*> bufvec);
 
-		int in_use() const
-		{
-			std::unique_lock<std::mutex> l(m_pool_mutex);
-			return m_in_use;
-		}
+		int in_use() const { return m_in_use; }
 
 		void set_settings(settings_interface const& sett);
 
+		// see slab_allocator::set_slab_observer()
+		void set_slab_observer(slab_allocator::slab_observer o)
+		{ m_allocator.set_slab_observer(std::move(o)); }
+
+		// sets the gauges for the number of blocks in use and the slab
+		// allocator's occupancy
+		void update_stats_counters(counters& c) const;
+
 #if TORRENT_DEBUG_BUFFER_POOL
 		void rename_buffer(char* buf, char const* category) override;
 #endif
 	private:
 
-		void free_buffer_impl(char* buf, std::unique_lock<std::mutex>& l);
-		char* allocate_buffer_impl(std::unique_lock<std::mutex>& l, char const* category);
+		void free_buffer_impl(char* buf);
+		char* allocate_buffer_impl(char const* category);
+
+		// the blocks are allocated from slabs. The allocator is thread safe,
+		// and allocating or freeing a block does not need m_pool_mutex
+		slab_allocator m_allocator;
 
 		// number of disk buffers currently allocated
-		int m_in_use;
+		std::atomic<int> m_in_use;
 
 		// cache size limit
-		int m_max_use;
+		std::atomic<int> m_max_use;
 
 		// if we have exceeded the limit, we won't start
 		// allowing allocations again until we drop below
 		// this low watermark
-		int m_low_watermark;
+		std::atomic<int> m_low_watermark;
 
 		// if we exceed the max number of buffers, we start
 		// adding up callbacks to this queue. Once the number
@@ -85,17 +96,19 @@ namespace aux {
 		// we start calling these functions back
 		std::vector<std::weak_ptr<disk_observer>> m_observers;
 
-		// set to true to throttle more allocations
-		bool m_exceeded_max_size;
+		// set to true to throttle more allocations. It's only cleared while
+		// holding m_pool_mutex, since that's when the observers are called
+		std::atomic<bool> m_exceeded_max_size;
 
 		// this is the main thread io_context. Callbacks are
 		// posted on this in order to have them execute in
 		// the main thread.
 		io_context& m_ios;
 
-		void check_buffer_level(std::unique_lock<std::mutex>& l);
+		void check_buffer_level();
 		void remove_buffer_in_use(char* buf);
 
+		// protects m_observers and clearing m_exceeded_max_size
 		mutable std::mutex m_pool_mutex;
 
 		// this is specifically exempt from release_asserts
@@ -0,0 +1,238 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#ifndef TORRENT_DISK_CACHE_HPP
+#define TORRENT_DISK_CACHE_HPP
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/units.hpp"
+#include "libtorrent/span.hpp"
+#include "libtorrent/storage_defs.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/time.hpp"
+#include "libtorrent/aux_/disk_io_thread_pool.hpp" // for jobqueue_t
+
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <boost/functional/hash.hpp>
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+
+namespace libtorrent::aux {
+
+	struct pread_disk_job;
+
+	// uniquely identifies a piece in a torrent. It is used as the key in the
+	// disk cache
+	struct piece_location
+	{
+		piece_location(storage_index_t const t, piece_index_t const p)
+			: torrent(t), piece(p) {}
+		storage_index_t torrent;
+		piece_index_t piece;
+		bool operator==(piece_location const& rhs) const
+		{
+			return std::tie(torrent, piece)
+				== std::tie(rhs.torrent, rhs.piece);
+		}
+	};
+
+}
+
+namespace std {
+
+template <>
+struct hash<libtorrent::aux::piece_location>
+{
+	using argument_type = libtorrent::aux::piece_location;
+	using result_type = std::size_t;
+	std::size_t operator()(argument_type const& l) const
+	{
+		using namespace libtorrent;
+		std::size_t ret = 0;
+		boost::hash_combine(ret, std::hash<storage_index_t>{}(l.torrent));
+		boost::hash_combine(ret, std::hash<piece_index_t>{}(l.piece));
+		return ret;
+	}
+};
+
+}
+
+namespace libtorrent::aux {
+
+	struct cached_block_entry
+	{
+		// the buffer holding the data for this block. This is owned by the
+		// write job, which is completed (and the buffer freed) once the block
+		// has been flushed to disk. nullptr if the block isn't in the cache.
+		pread_disk_job* write_job = nullptr;
+
+		// set while a disk thread is writing this block to disk. The block may
+		// not be freed or flushed by anyone else while this is set
+		bool flushing = false;
+
+		// set once the block has been written to disk. The block is removed
+		// from the cache as soon as there are no readers of the piece
+		bool flushed = false;
+
+		span<char const> buf() const;
+	};
+
+	struct cached_piece_entry
+	{
+		cached_piece_entry(piece_location const& loc, int num_blocks);
+
+		piece_location piece;
+
+		// the last time a block was added to this piece. Pieces that haven't
+		// received any new blocks in a while are flushed, even if they haven't
+		// been hashed yet
+		time_point last_write;
+
+		// the number of blocks that have a write job (and buffer) in the cache
+		int num_blocks = 0;
+
+		// the number of threads currently reading from the block buffers of
+		// this piece, without holding the cache mutex (e.g. to hash them).
+		// flushed blocks may not be removed while this is non-zero
+		int readers = 0;
+
+		int blocks_in_piece;
+		std::unique_ptr<cached_block_entry[]> blocks;
+	};
+
+	// the write cache used by pread_disk_io. Incoming blocks are held in
+	// the cache until the piece they belong to has been hashed, at which
+	// point all of its blocks are written to disk in as few (vectored) write
+	// calls as possible. Under memory pressure, or when a fence job needs all
+	// outstanding writes of a storage to complete, blocks are flushed early,
+	// regardless of whether they have been hashed yet.
+	//
+	// Write jobs are owned by the cache while their block is cached. They are
+	// handed back to the caller (to be completed) once they have been flushed.
+	// All member functions are thread safe.
+	struct TORRENT_EXTRA_EXPORT disk_cache
+	{
+		// this is called to write a run of adjacent blocks to disk.
+		// ``first_job`` is the write job of the first block in the run, its
+		// storage is the one to write to. ``offset`` is the byte offset into
+		// the piece of the first block.
+		using write_fun = std::function<void(pread_disk_job* first_job
+			, int offset, span<span<char const> const> bufs, storage_error& err)>;
+
+		// add the write job ``j`` to the cache. Returns the number of blocks in
+		// the cache, after inserting this one. If a flushed copy of the block
+		// is still held in the cache (because the piece is pinned), the job is
+		// not added and -1 is returned.
+		int insert(piece_location loc, int block_idx, int blocks_in_piece
+			, pread_disk_job* j);
+
+		// if the specified block is in the cache, call ``f`` with a pointer to
+		// its buffer, while holding the cache mutex, and return true.
+		template <typename Fun>
+		bool get(piece_location const loc, int const block_idx, Fun f) const
+		{
+			std::unique_lock<std::mutex> l(m_mutex);
+			char const* buf = block_buffer(loc, block_idx);
+			if (buf == nullptr) return false;
+			f(buf);
+			return true;
+		}
+
+		// look up two adjacent blocks, ``block_idx`` and ``block_idx + 1``. If
+		// at least one of them is in the cache, ``f`` is called with pointers
+		// to both buffers (nullptr for the one that isn't in the cache), while
+		// holding the cache mutex. The return value of ``f`` is returned, or 0
+		// if neither block was found.
+		template <typename Fun>
+		int get2(piece_location const loc, int const block_idx, Fun f) const
+		{
+			std::unique_lock<std::mutex> l(m_mutex);
+			char const* buf1 = block_buffer(loc, block_idx);
+			char const* buf2 = block_buffer(loc, block_idx + 1);
+
+			if (buf1 == nullptr && buf2 == nullptr)
+				return 0;
+
+			return f(buf1, buf2);
+		}
+
+		// if the piece is in the cache, ``bufs`` is filled in with the buffers
+		// of the blocks ``first_block`` and forward (empty spans for blocks
+		// that aren't in the cache). The buffers are guaranteed to stay valid
+		// until unpin() is called for the same piece. Returns false if the
+		// piece is not in the cache, in which case unpin() must not be called.
+		bool pin(piece_location loc, int first_block, span<span<char const>> bufs);
+
+		// releases a pin taken by pin(). Any blocks that were flushed while the
+		// piece was pinned, have their write jobs appended to ``completed``
+		void unpin(piece_location loc, jobqueue_t& completed);
+
+		// write all blocks of the specified piece to disk, that haven't been
+		// written yet. The write jobs are appended to ``completed``.
+		void flush_piece(piece_location loc, write_fun const& f, jobqueue_t& completed);
+
+		// write all blocks belonging to the specified storage
+		void flush_storage(storage_index_t st, write_fun const& f, jobqueue_t& completed);
+
+		// flush pieces until there are no more than ``target`` blocks in the
+		// cache (not counting blocks currently being flushed by other threads).
+		// The pieces with the most blocks are flushed first, to maximize
+		// the sizes of the writes.
+		void flush_to_limit(int target, write_fun const& f, jobqueue_t& completed);
+
+		// flush all pieces that haven't had any blocks added to them since
+		// ``cutoff``
+		void flush_stale(time_point cutoff, write_fun const& f, jobqueue_t& completed);
+
+		// flush everything
+		void flush_all(write_fun const& f, jobqueue_t& completed);
+
+		// drop all blocks of the specified piece without writing them to disk.
+		// This is used when a piece failed the hash check. The write jobs are
+		// appended to ``completed``, and will be completed as if they
+		// succeeded.
+		void clear_piece(piece_location loc, jobqueue_t& completed);
+
+		// the number of blocks in the cache, including ones that are currently
+		// being flushed
+		int size() const;
+
+		// returns true if there are any blocks in the cache for the
+		// specified storage
+		bool has_storage(storage_index_t st) const;
+
+	private:
+
+		char const* block_buffer(piece_location loc, int block_idx) const;
+
+		void flush_piece_impl(std::unique_lock<std::mutex>& l
+			, cached_piece_entry& pe, write_fun const& f, jobqueue_t& completed);
+
+		// remove flushed blocks from the piece, if there are no readers, and
+		// remove the piece itself if it's empty. Returns true if the piece was
+		// removed. The iterator is invalidated if true is returned
+		bool release_flushed(cached_piece_entry& pe, jobqueue_t& completed);
+
+		mutable std::mutex m_mutex;
+		std::unordered_map<piece_location, cached_piece_entry> m_pieces;
+
+		// the total number of blocks in the cache (sum of num_blocks of all
+		// pieces)
+		int m_blocks = 0;
+
+		// the number of blocks currently being written by a disk thread
+		int m_flushing_blocks = 0;
+	};
+}
+
+#endif
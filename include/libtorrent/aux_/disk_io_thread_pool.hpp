@@ -145,6 +145,9 @@ namespace libtorrent::aux {
 		{
 			m_interrupt = true;
 			m_job_cond.notify_one();
+			// idle threads may have been reaped. Make sure there's a thread
+			// around to receive the interrupt
+			job_queued(1);
 		}
 
 		template<typename Fun>
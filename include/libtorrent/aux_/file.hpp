@@ -75,6 +75,14 @@ namespace libtorrent::aux {
 		, std::int64_t file_offset
 		, error_code& ec);
 
+	// writes all buffers in ``bufs`` to consecutive offsets in the file,
+	// starting at ``file_offset``. Where supported, this is a single vectored
+	// write system call.
+	int pwritev_all(handle_type handle
+		, span<span<char const> const> bufs
+		, std::int64_t file_offset
+		, error_code& ec);
+
 	struct TORRENT_EXTRA_EXPORT file_handle
 	{
 		file_handle(): m_fd(invalid_handle) {}
@@ -87,6 +87,16 @@ namespace libtorrent::aux {
 			, piece_index_t piece, int offset, aux::open_mode_t mode
 			, disk_job_flags_t flags
 			, storage_error&);
+
+		// if the range lies within a single memory mapped file, this returns
+		// the mapping and sets ``view`` to the range within it. The pages are
+		// faulted in, so that accessing them doesn't block on disk I/O.
+		// Otherwise (pad files, the part file, unmapped files, or ranges
+		// spanning files) it returns nullptr, and the caller is expected to
+		// fall back to read().
+		std::shared_ptr<aux::file_mapping> read_view(settings_interface const&
+			, piece_index_t piece, int offset, int length, aux::open_mode_t mode
+			, span<char const>& view, storage_error&);
 		int hash(settings_interface const&, hasher& ph, std::ptrdiff_t len
 			, piece_index_t piece, int offset, aux::open_mode_t mode
 			, disk_job_flags_t flags, storage_error&);
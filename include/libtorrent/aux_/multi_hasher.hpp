@@ -0,0 +1,75 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#ifndef TORRENT_MULTI_HASHER_HPP_INCLUDED
+#define TORRENT_MULTI_HASHER_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/sha1_hash.hpp"
+#include "libtorrent/span.hpp"
+
+#include <cstdint>
+
+namespace libtorrent::aux {
+
+	// the implementations available for hashing many buffers at a time
+	enum class hash_kernel : std::uint8_t
+	{
+		// hash one buffer at a time using hasher/hasher256, i.e. whichever
+		// crypto backend libtorrent was built with
+		generic,
+
+		// hash two buffers at a time, interleaved, using the x86 SHA
+		// extensions
+		sha_ni,
+
+		// hash 8 buffers in parallel, one in each 32 bit lane of the AVX2
+		// registers
+		avx2,
+	};
+
+	// the number of buffers it takes for multi_sha1() and multi_sha256() to
+	// make full use of the fastest kernel supported by this CPU. Callers
+	// that batch up buffers should use batches of (a multiple of) this size
+	TORRENT_EXTRA_EXPORT int hash_lanes();
+
+	// returns true if the kernel can be used on this CPU (and with this
+	// compiler)
+	TORRENT_EXTRA_EXPORT bool hash_kernel_supported(hash_kernel k);
+
+	// hashes each buffer in ``bufs`` independently, and stores its digest in
+	// the corresponding entry in ``out``. The buffers may have different
+	// lengths. ``out`` must be at least as large as ``bufs``. The kernel is
+	// selected at run time, based on the CPU features and the number of
+	// buffers.
+	TORRENT_EXTRA_EXPORT void multi_sha1(span<span<char const> const> bufs
+		, span<sha1_hash> out);
+	TORRENT_EXTRA_EXPORT void multi_sha256(span<span<char const> const> bufs
+		, span<sha256_hash> out);
+
+	// the same as above, but uses the specified kernel. It must be
+	// supported. This is used by tests and benchmarks
+	TORRENT_EXTRA_EXPORT void multi_sha1(span<span<char const> const> bufs
+		, span<sha1_hash> out, hash_kernel k);
+	TORRENT_EXTRA_EXPORT void multi_sha256(span<span<char const> const> bufs
+		, span<sha256_hash> out, hash_kernel k);
+
+	// computes the parent of each pair of siblings in a merkle tree layer,
+	// i.e. ``parents[i] = SHA-256(children[2 * i], children[2 * i + 1])``.
+	// ``children`` must hold an even number of hashes, and ``parents`` must
+	// have room for half as many. ``parents`` may point to the start of
+	// ``children``, to reduce a layer in place. Since every message is 64
+	// bytes, the padding block is the same for all of them.
+	TORRENT_EXTRA_EXPORT void multi_sha256_pairs(span<sha256_hash const> children
+		, span<sha256_hash> parents);
+	TORRENT_EXTRA_EXPORT void multi_sha256_pairs(span<sha256_hash const> children
+		, span<sha256_hash> parents, hash_kernel k);
+}
+
+#endif
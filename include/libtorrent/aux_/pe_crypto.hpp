@@ -39,13 +39,23 @@ namespace libtorrent::aux {
 
 	TORRENT_EXTRA_EXPORT std::array<char, 96> export_key(key_t const& k);
 
-	// RC4 state from libtomcrypt
+	// RC4 state. The permutation is stored as 32 bit words rather than
+	// bytes, this avoids byte loads and stores (and the partial register
+	// dependencies they cause) in the keystream loop, at the cost of 768
+	// bytes per state
 	struct rc4 {
 		int x;
 		int y;
-		aux::array<std::uint8_t, 256> buf;
+		aux::array<std::uint32_t, 256> buf;
 	};
 
+	// initialize ``state`` with the key ``in``, of ``len`` bytes (at most 256)
+	TORRENT_EXTRA_EXPORT void rc4_init(unsigned char const* in, std::size_t len, rc4* state);
+
+	// XOR ``outlen`` bytes of keystream into ``out``, in place. Returns
+	// ``outlen``
+	TORRENT_EXTRA_EXPORT std::size_t rc4_encrypt(unsigned char* out, std::size_t outlen, rc4* state);
+
 	// TODO: 3 dh_key_exchange should probably move into its own file
 	class TORRENT_EXTRA_EXPORT dh_key_exchange
 	{
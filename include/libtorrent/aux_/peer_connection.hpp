@@ -290,6 +290,7 @@ namespace libtorrent::aux {
 			TORRENT_ASSERT(m_peer_info == nullptr || pi == nullptr );
 			TORRENT_ASSERT(pi != nullptr || m_disconnect_started);
 			m_peer_info = pi;
+			m_peer_rank = 0;
 		}
 
 		aux::torrent_peer* peer_info_struct() const override
@@ -359,7 +360,12 @@ namespace libtorrent::aux {
 		bool ignore_stats() const { return m_ignore_stats; }
 		void ignore_stats(bool b) { m_ignore_stats = b; }
 
+		// the priority of keeping this connection, given our external
+		// address. It's computed the first time it's asked for, and cached
+		// until clear_peer_rank() is called, when our external address
+		// changes
 		std::uint32_t peer_rank() const;
+		void clear_peer_rank() { m_peer_rank = 0; }
 
 		void fast_reconnect(bool r);
 		bool fast_reconnect() const override { return m_fast_reconnect; }
@@ -457,6 +463,10 @@ namespace libtorrent::aux {
 		// is called once every second by the main loop
 		void second_tick(int tick_interval_ms);
 
+		// is called by the session once the time passed to
+		// session_interface::schedule_timeout() has passed
+		void on_timeout(time_point at);
+
 		aux::socket_type const& get_socket() const { return m_socket; }
 		aux::socket_type& get_socket() { return m_socket; }
 		tcp::endpoint const& remote() const override { return m_remote; }
@@ -630,6 +640,12 @@ namespace libtorrent::aux {
 		// speaks our protocol (be it bittorrent or http).
 		virtual bool in_handshake() const = 0;
 
+		// returns true if the blocks we upload are passed straight to the
+		// kernel, without being copied or transformed in user space. In that
+		// case they may be read from disk as references into memory mapped
+		// files (see disk_interface::zero_copy)
+		virtual bool supports_zero_copy_send() const;
+
 		// returns the block currently being
 		// downloaded. And the progress of that
 		// block. If the peer isn't downloading
@@ -779,8 +795,23 @@ namespace libtorrent::aux {
 			, sha256_hash const& hash);
 #endif
 		int request_timeout() const;
+		int connect_timeout() const;
+		int handshake_timeout() const;
 		void check_graceful_pause();
 
+		// disconnects (or snubs) this peer if any of its timeouts has
+		// passed, and sends a keep-alive if one is due
+		void check_timeouts();
+
+		// the earliest time check_timeouts() may have something to do,
+		// given the current state of the connection
+		time_point next_timeout() const;
+
+		// make sure the session calls on_timeout() no later than
+		// next_timeout(). This must be called whenever the state changes in a
+		// way that may make the next timeout earlier
+		void schedule_timeout();
+
 		int wanted_transfer(int channel);
 		int request_bandwidth(int channel, int bytes = 0);
 
@@ -915,6 +946,10 @@ namespace libtorrent::aux {
 		// or when the incoming connection was established
 		time_point m_connect = aux::time_now();
 
+		// the time we've asked the session to call on_timeout() at, or max()
+		// if we haven't. Calls for any other time are stale and ignored
+		time_point m_timeout_at = time_point::max();
+
 		// the total payload download bytes
 		// at the last unchoke round. This is used to
 		// measure the number of bytes transferred during
@@ -1052,6 +1087,10 @@ namespace libtorrent::aux {
 		int m_download_rate_peak = 0;
 		int m_upload_rate_peak = 0;
 
+		// as computed by hashing our IP with the remote IP of this peer.
+		// calculated lazily by peer_rank(), 0 means it hasn't been yet
+		mutable std::uint32_t m_peer_rank = 0;
+
 		// stop sending data after this many bytes, INT_MAX = inf
 		int m_send_barrier = INT_MAX;
 
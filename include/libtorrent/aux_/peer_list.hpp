@@ -17,6 +17,9 @@ see LICENSE file.
 #define TORRENT_POLICY_HPP_INCLUDED
 
 #include <algorithm>
+#include <limits>
+#include <set>
+#include <unordered_map>
 
 #include "libtorrent/fwd.hpp"
 #include "libtorrent/aux_/string_util.hpp" // for allocate_string_copy
@@ -74,6 +77,12 @@ namespace libtorrent::aux {
 		std::vector<torrent_peer*> erased;
 	};
 
+	// hashes the IP of a peer, for the peer_list's address index
+	struct TORRENT_EXTRA_EXPORT peer_address_hash
+	{
+		std::size_t operator()(address const& a) const;
+	};
+
 	struct erase_peer_flags_tag;
 	using erase_peer_flags_t = flags::bitfield_flag<std::uint8_t, erase_peer_flags_tag>;
 
@@ -84,6 +93,15 @@ namespace libtorrent::aux {
 
 		void clear();
 
+		// when enabled, m_peers is no longer kept sorted by address. Instead
+		// peers are looked up by a hash of their address and connect
+		// candidates are kept in order of how good they are, rather than
+		// found by scanning the peer list. This makes adding, removing and
+		// connecting to peers cheap in very large peer lists. This may only
+		// be changed while the peer list is empty
+		void set_hash_index(bool enable);
+		bool hash_index() const { return m_hash_index; }
+
 		// not copyable
 		peer_list(peer_list const&) = delete;
 		peer_list& operator=(peer_list const&) = delete;
@@ -130,8 +148,8 @@ namespace libtorrent::aux {
 
 		void set_seed(torrent_peer* p, bool s);
 
-		// this clears all cached peer priorities. It's called when
-		// our external IP changes
+		// this is called when our external IP changes, which changes the
+		// peers' ranks
 		void clear_peer_prio();
 
 #if TORRENT_USE_ASSERTS
@@ -152,21 +170,8 @@ namespace libtorrent::aux {
 		const_iterator begin() const { return m_peers.begin(); }
 		const_iterator end() const { return m_peers.end(); }
 
-		std::pair<iterator, iterator> find_peers(address const& a)
-		{
-#if TORRENT_USE_I2P
-			if (a == address())
-				return std::pair<iterator, iterator>(m_peers.end(), m_peers.end());
-#endif
-			return std::equal_range(
-				m_peers.begin(), m_peers.end(), a, peer_address_compare());
-		}
-
-		std::pair<const_iterator, const_iterator> find_peers(address const& a) const
-		{
-			return std::equal_range(
-				m_peers.begin(), m_peers.end(), a, peer_address_compare());
-		}
+		// returns all peers with the IP address a
+		std::vector<torrent_peer*> find_peers(address const& a) const;
 
 		torrent_peer* connect_one_peer(int session_time, torrent_state* state);
 
@@ -188,11 +193,37 @@ namespace libtorrent::aux {
 
 		void update_peer(torrent_peer* p, peer_source_flags_t src
 			, pex_flags_t flags, tcp::endpoint const& remote);
-		bool insert_peer(torrent_peer* p, iterator iter
+		bool insert_peer(torrent_peer* p
 			, pex_flags_t flags, torrent_state* state);
 
 		void find_connect_candidates(std::vector<torrent_peer*>& peers
 			, int session_time, torrent_state* state);
+		void find_indexed_candidates(std::vector<torrent_peer*>& peers
+			, int session_time, torrent_state* state);
+
+		// these look up peers in m_peers, either by binary search or through
+		// the hash index. They return end() if there is no such peer
+		iterator find_address(address const& a);
+		iterator find_endpoint(address const& a, std::uint16_t port);
+#if TORRENT_USE_I2P
+		iterator find_i2p(string_view dest);
+#endif
+		iterator find_entry(torrent_peer const* p);
+
+		// adds p to m_peers (and the hash index) and removes the peer at i
+		// from it. Neither allocates or frees the torrent_peer object itself
+		iterator add_entry(torrent_peer* p);
+		void remove_entry(iterator i);
+
+		// in hash index mode, the order of p in m_candidates. Lower is a
+		// better connect candidate. This mirrors compare_peer()
+		std::uint64_t candidate_key(torrent_peer const& p, std::uint32_t rank) const;
+
+		// in hash index mode, adds, moves or removes p in m_candidates,
+		// based on whether it's a connect candidate and its current key.
+		// If state is specified, the peer's rank is (re)computed first
+		void update_candidate(torrent_peer* p, torrent_state const* state = nullptr);
+		void rebuild_candidates(torrent_state const* state);
 
 		bool is_connect_candidate(torrent_peer const& p) const;
 		bool is_erase_candidate(torrent_peer const& p) const;
@@ -216,6 +247,10 @@ namespace libtorrent::aux {
 		// this must be available in the destructor to free all peers
 		torrent_peer_allocator_interface& m_peer_allocator;
 
+		// true if m_peer_allocator keeps a slot for the rank of each peer,
+		// used to cache it in the sorted peer list
+		bool m_rank_slots;
+
 		// the number of seeds in the torrent_peer list
 		std::uint32_t m_num_seeds:31;
 
@@ -247,6 +282,43 @@ namespace libtorrent::aux {
 		// if a peer has failed this many times or more, we don't consider
 		// it a connect candidate anymore.
 		int m_max_failcount = 3;
+
+		// true if the hash index is used. See set_hash_index()
+		bool m_hash_index = false;
+
+		// set when our external IP has changed, and the ranks and order of
+		// m_candidates need to be recomputed the next time it's used
+		bool m_rebuild_candidates = false;
+
+		// the key a peer is not in m_candidates with. Real keys are only 61
+		// bits
+		static inline constexpr std::uint64_t not_queued
+			= (std::numeric_limits<std::uint64_t>::max)();
+
+		// the position in m_peers, the rank and the key in m_candidates of
+		// every peer, in hash index mode. The rank is only known once the
+		// peer has been seen with a torrent_state
+		struct peer_slot
+		{
+			int pos;
+			std::uint32_t rank;
+			std::uint64_t key;
+		};
+		std::unordered_map<torrent_peer const*, peer_slot> m_slots;
+
+		// in hash index mode, all peers by IP address (except i2p peers)
+		std::unordered_multimap<address, torrent_peer*, peer_address_hash> m_address_index;
+#if TORRENT_USE_I2P
+		// in hash index mode, all i2p peers by destination. The keys refer
+		// to the destination strings owned by the peers
+		std::unordered_map<string_view, torrent_peer*> m_i2p_index;
+#endif
+
+		// in hash index mode, all connect candidates ordered by
+		// candidate_key(), best first. Keys may be stale if the peer was
+		// modified outside of the peer_list, these are fixed up as they are
+		// encountered
+		std::set<std::pair<std::uint64_t, torrent_peer*>> m_candidates;
 	};
 
 }
@@ -242,6 +242,15 @@ namespace libtorrent::aux {
 		// seed
 		void we_have_all();
 
+		// when enabled, bitfields and seeds joining or leaving the swarm
+		// don't invalidate the list of pieces sorted by priority (which would
+		// be rebuilt from scratch the next time pieces are picked). Instead
+		// the pieces whose priority changed are moved to their new priority
+		// buckets, either one at a time or in a single pass over the part of
+		// the list that's affected, whichever is cheaper. Changes that affect
+		// most of the list still invalidate it.
+		void set_incremental_availability(bool enable);
+
 		// A piece completes when it has passed the hash check *and* been
 		// completely written to disk. The piece picker no longer need to track
 		// the state of individual blocks
@@ -756,6 +765,37 @@ namespace libtorrent::aux {
 
 		void update_pieces() const;
 
+		// moves pieces whose priority changed to their new priority buckets,
+		// without rebuilding the whole piece list. All pieces whose priority
+		// changed must have had (or now have) a priority of at least
+		// ``min_priority``. Pieces that weren't in the piece list before are
+		// expected to be in m_added.
+		void rebucket(int min_priority);
+
+		// the ways a change in availability of many pieces at once can be
+		// applied to the piece list
+		enum class bulk_update : std::uint8_t
+		{
+			// move the affected pieces one at a time, with add() and update()
+			per_piece,
+			// rebucket() the part of the piece list that's affected
+			rebucket,
+			// mark the piece list as dirty, to be rebuilt by update_pieces()
+			rebuild
+		};
+
+		// estimates the cost of moving the pieces in ``bitmask`` one at a time,
+		// when their peer counts change by ``delta``. ``min_priority`` is set
+		// to the lowest priority affected by the change. Returns false if the
+		// change would break up a seed
+		bool move_cost(typed_bitfield<piece_index_t> const& bitmask
+			, int delta, std::int64_t& cost, int& min_priority);
+
+		// picks the cheapest way to apply a change with the specified cost of
+		// moving pieces one at a time, affecting priorities ``min_priority``
+		// and up
+		bulk_update pick_bulk_update(std::int64_t cost, int min_priority) const;
+
 		prio_index_t priority_begin(int prio) const;
 		prio_index_t priority_end(int prio) const;
 
@@ -896,6 +936,26 @@ namespace libtorrent::aux {
 		// if this is set to true, it means update_pieces()
 		// has to be called before accessing m_pieces.
 		mutable bool m_dirty = false;
+
+		// when set, bulk changes to piece availability are applied to
+		// m_pieces with rebucket() rather than setting m_dirty
+		bool m_incremental = false;
+
+		// pieces that were added to the piece list by a bulk availability
+		// change, to be inserted by rebucket()
+		std::vector<piece_index_t> m_added;
+
+		struct rebucket_entry
+		{
+			piece_index_t piece;
+			int priority;
+			// true if the piece moved to a different priority bucket
+			bool moved;
+		};
+
+		// scratch space for rebucket()
+		std::vector<rebucket_entry> m_rebucket;
+		std::vector<int> m_bucket_pos;
 	public:
 
 		enum { max_pieces = (std::numeric_limits<int>::max)() - 1 };
@@ -26,6 +26,7 @@ see LICENSE file.
 #include "libtorrent/performance_counters.hpp" // for counters
 #include "libtorrent/aux_/allocating_handler.hpp"
 #include "libtorrent/aux_/time.hpp"
+#include "libtorrent/aux_/timer_wheel.hpp"
 #include "libtorrent/aux_/torrent_list.hpp"
 #include "libtorrent/session_params.hpp" // for disk_io_constructor_type
 
@@ -594,6 +595,9 @@ namespace aux {
 			std::tuple<std::shared_ptr<torrent>, info_hash_t, bool>
 			add_torrent_impl(add_torrent_params const& p, error_code& ec) = delete;
 			void async_add_torrent(add_torrent_params* params);
+			void async_add_torrents(std::vector<add_torrent_params>&& params);
+			void add_torrents_batch(std::shared_ptr<std::vector<add_torrent_params>> params
+				, std::size_t start);
 
 			void remove_torrent(torrent_handle const& h, remove_flags_t options) override;
 			void remove_torrent_impl(std::shared_ptr<torrent> tptr, remove_flags_t options) override;
@@ -604,6 +608,7 @@ namespace aux {
 			void refresh_torrent_status(std::vector<torrent_status>* ret
 				, status_flags_t flags) const;
 			void post_torrent_updates(status_flags_t flags);
+			void post_status_deltas();
 			void post_session_stats();
 			void post_dht_stats();
 
@@ -652,6 +657,11 @@ namespace aux {
 			// ``num_peers_half_open`` instead.
 			int num_connections() const override { return int(m_connections.size()); }
 
+			void schedule_timeout(std::shared_ptr<peer_connection> const& p
+				, time_point at) override;
+			void schedule_housekeeping(std::shared_ptr<torrent> const& t
+				, time_point at) override;
+
 			void trigger_unchoke() noexcept override
 			{
 				TORRENT_ASSERT(is_single_thread());
@@ -753,6 +763,8 @@ namespace aux {
 			void announce(sha1_hash const& ih, address const& addr, int port) override;
 			void outgoing_get_peers(sha1_hash const& target
 				, sha1_hash const& sent_target, udp::endpoint const& ep) override;
+			void indexer_results(std::vector<sha1_hash> const& info_hashes
+				, std::vector<std::pair<sha1_hash, tcp::endpoint>> const& peers) override;
 
 #ifndef TORRENT_DISABLE_LOGGING
 			bool should_log(module_t m) const override;
@@ -980,6 +992,18 @@ namespace aux {
 			// peers.
 			connection_map m_connections;
 
+			// connections, scheduled (in seconds of clock_type) for when their
+			// next timeout or keep-alive is due. The time_point is the one the
+			// connection asked for, to tell stale entries apart from the current
+			// one. This saves checking every connection every second
+			aux::timer_wheel<std::pair<std::weak_ptr<peer_connection>, time_point>> m_peer_timeouts{
+				total_seconds(clock_type::now().time_since_epoch())};
+
+			// torrents scheduled for housekeeping (such as leaving upload mode),
+			// the same way as m_peer_timeouts
+			aux::timer_wheel<std::pair<std::weak_ptr<torrent>, time_point>> m_torrent_housekeeping{
+				total_seconds(clock_type::now().time_since_epoch())};
+
 #ifdef TORRENT_SSL_PEERS
 			// this list holds incoming connections while they
 			// are performing SSL handshake. When we shut down
@@ -1223,6 +1247,11 @@ namespace aux {
 
 			void on_udp_writeable(std::weak_ptr<session_udp_socket> s, error_code const& ec);
 
+			// send the packets queued on the UDP socket. If the socket is
+			// blocked, wait for it to become writeable again
+			void flush_udp_batch(std::shared_ptr<session_udp_socket> const& s);
+			void on_udp_flush(std::weak_ptr<session_udp_socket> s);
+
 			void on_udp_packet(std::weak_ptr<session_udp_socket> s
 				, std::weak_ptr<listen_socket_t> ls
 				, transport ssl, error_code const& ec);
@@ -165,6 +165,13 @@ namespace libtorrent::aux {
 		virtual void close_connection(peer_connection* p) noexcept = 0;
 		virtual int num_connections() const = 0;
 
+		// have peer_connection::on_timeout() or torrent::on_housekeeping()
+		// called once ``at`` has passed (with one second granularity)
+		virtual void schedule_timeout(std::shared_ptr<peer_connection> const& p
+			, time_point at) = 0;
+		virtual void schedule_housekeeping(std::shared_ptr<torrent> const& t
+			, time_point at) = 0;
+
 		virtual void deferred_submit_jobs() = 0;
 
 		virtual std::uint16_t listen_port() const = 0;
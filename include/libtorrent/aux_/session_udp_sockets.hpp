@@ -48,6 +48,10 @@ namespace aux {
 		// writeable again. Once it is, we'll set it to false and notify the utp
 		// socket manager
 		bool write_blocked = false;
+
+		// this is true when packets have been queued on the socket (with the
+		// udp_socket::batch flag), and a handler to send them has been posted
+		bool flush_pending = false;
 	};
 
 } }
@@ -0,0 +1,171 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#ifndef TORRENT_SLAB_ALLOCATOR_HPP_INCLUDED
+#define TORRENT_SLAB_ALLOCATOR_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace libtorrent::aux {
+
+	// allocates fixed size blocks (disk buffers) out of large slabs of
+	// memory, mapped directly from the operating system. Freed blocks are
+	// kept in small caches, each shared by a subset of the threads, and
+	// returned to their slab in batches. This keeps the slab lock off the
+	// common path and lets the network thread and the disk threads allocate
+	// and free blocks without contending on a single lock.
+	//
+	// Optionally, slabs are backed by huge pages and there is one arena of
+	// slabs per NUMA node, where threads allocate from the arena local to the
+	// node they run on. Slabs that become entirely free are unmapped.
+	struct TORRENT_EXTRA_EXPORT slab_allocator
+	{
+		// the size of each slab, in bytes. This is the size of a huge page
+		// on x86
+		static constexpr int slab_size = 2 * 1024 * 1024;
+
+		// the number of free blocks each cache may hold, and the number of
+		// caches in each arena. Threads are assigned a cache round-robin
+		static constexpr int cache_size = 32;
+		static constexpr int num_caches = 16;
+
+		explicit slab_allocator(int block_size);
+		~slab_allocator();
+		slab_allocator(slab_allocator const&) = delete;
+		slab_allocator& operator=(slab_allocator const&) = delete;
+
+		// returns nullptr if we're out of memory
+		char* allocate();
+		void free(char* block);
+
+		// when enabled, new slabs are allocated with huge pages. If there are
+		// no huge pages reserved, transparent huge pages are requested
+		// instead. Existing slabs are not affected
+		void set_huge_pages(bool enable);
+
+		// when enabled, blocks are allocated from the slabs of the NUMA node
+		// the calling thread is running on
+		void set_numa(bool enable);
+
+		// the observer is called with the address and size of every slab that's
+		// mapped (``added`` = true) and of every slab that's about to be
+		// unmapped (``added`` = false). When set, it's immediately called for
+		// all current slabs. This is used by disk I/O backends that register
+		// their buffers with the kernel. It's called with the allocator's
+		// internal lock held, so it must not call back into the allocator
+		using slab_observer = std::function<void(char* base, int size, bool added)>;
+		void set_slab_observer(slab_observer o);
+
+		int block_size() const { return m_block_size; }
+		int blocks_per_slab() const { return m_blocks_per_slab; }
+
+		struct stats_t
+		{
+			// the number of slabs currently allocated
+			int slabs = 0;
+
+			// the number of slabs backed by huge pages
+			int huge_page_slabs = 0;
+
+			// free blocks held in caches
+			int cached_blocks = 0;
+
+			// free blocks in slabs that also have blocks in use (or cached).
+			// This is memory held by the allocator that can't be returned to
+			// the operating system, i.e. fragmentation
+			int free_slab_blocks = 0;
+		};
+		stats_t stats() const;
+
+	private:
+
+		struct slab
+		{
+			char* base;
+
+			// singly linked list of blocks that have been freed back into this
+			// slab. The link is stored in the first bytes of each block
+			char* free_list = nullptr;
+
+			// blocks from this index and up have never been handed out, and
+			// their pages may not even have been touched yet
+			int next_untouched = 0;
+
+			// the number of free blocks, in free_list and past next_untouched
+			int num_free;
+
+			// the arena (NUMA node) this slab belongs to
+			int arena;
+
+			bool huge_pages;
+		};
+
+		// a stack of free blocks, shared by the threads that map to it
+		struct alignas(64) cache
+		{
+			std::mutex mutex;
+			int size = 0;
+			std::array<char*, cache_size> blocks;
+		};
+
+		struct arena
+		{
+			// the NUMA node this arena allocates from
+			int index = 0;
+
+			// the slabs in this arena that have free blocks
+			std::vector<slab*> partial;
+			std::array<cache, num_caches> caches;
+		};
+
+		arena& current_arena();
+
+		// moves up to half a cache worth of free blocks from the arena's
+		// slabs into the cache. Returns false if we're out of memory
+		bool refill(arena& a, cache& c);
+
+		// returns the ``count`` blocks at the bottom of the cache, i.e. the
+		// ones that were freed the longest time ago, to their slabs
+		void flush(cache& c, int count);
+
+		slab* new_slab(int arena_idx);
+		void release_slab(slab* s);
+		slab* find_slab(char const* block) const;
+
+		int const m_block_size;
+		int const m_blocks_per_slab;
+
+		std::atomic<bool> m_huge_pages{false};
+		std::atomic<bool> m_numa{false};
+
+		// one per NUMA node
+		std::vector<std::unique_ptr<arena>> m_arenas;
+
+		// protects all slabs and the arenas' partial lists. The caches have
+		// their own mutexes, which are always locked before this one
+		mutable std::mutex m_mutex;
+
+		// all slabs, sorted by base address
+		std::vector<std::unique_ptr<slab>> m_slabs;
+
+		int m_free_slab_blocks = 0;
+		int m_huge_page_slabs = 0;
+
+		slab_observer m_observer;
+	};
+}
+
+#endif
@@ -0,0 +1,130 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#ifndef TORRENT_TIMER_WHEEL_HPP_INCLUDED
+#define TORRENT_TIMER_WHEEL_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/assert.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace libtorrent::aux {
+
+	// a hierarchical timer wheel. Items are scheduled to fire at an absolute
+	// tick (the unit is up to the caller, typically seconds) and are handed
+	// back by advance() once that tick is reached. Scheduling and firing are
+	// O(1) amortized, regardless of the number of items in the wheel. Items
+	// can't be cancelled, the callback is expected to re-validate an item when
+	// it fires (and possibly schedule it again).
+	// the wheel has 4 levels of 64 slots each. Level 0 holds items that are due
+	// within the next 64 ticks, level 1 within 64 * 64 ticks and so on. Items
+	// further out than that are kept in the last slot of the top level and
+	// are re-inserted when it's cascaded.
+	template <typename T>
+	struct timer_wheel
+	{
+		explicit timer_wheel(std::int64_t const now = 0) : m_now(now) {}
+
+		// schedule ``item`` to fire at ``tick``. If ``tick`` is in the past, the
+		// item fires on the next call to advance()
+		void schedule(T item, std::int64_t const tick)
+		{
+			std::int64_t const t = std::max(tick, m_now);
+			std::int64_t const delta = t - m_now;
+			int level = 0;
+			while (level < num_levels - 1 && delta >= (std::int64_t(1) << (slot_bits * (level + 1))))
+				++level;
+
+			// items beyond the range of the top level are parked in the slot
+			// that's cascaded last
+			std::int64_t const top = std::int64_t(1) << (slot_bits * num_levels);
+			std::int64_t const slot_tick = delta >= top
+				? m_now + top - 1 : t;
+			auto& slot = m_levels[std::size_t(level)][slot_index(slot_tick, level)];
+			slot.emplace_back(tick, std::move(item));
+			++m_size;
+		}
+
+		// advance the wheel up to (and including) tick ``now``, calling ``f``
+		// for every item whose tick has been reached. ``f`` may schedule new
+		// items.
+		template <typename Fun>
+		void advance(std::int64_t const now, Fun&& f)
+		{
+			std::vector<std::pair<std::int64_t, T>> fired;
+			while (m_now <= now)
+			{
+				// there's nothing to cascade or fire, skip ahead
+				if (m_size == 0)
+				{
+					m_now = now + 1;
+					break;
+				}
+
+				// when the lower levels wrap around, move the items in the
+				// corresponding slots of the upper levels down
+				for (int level = num_levels - 1; level > 0; --level)
+				{
+					if ((m_now & ((std::int64_t(1) << (slot_bits * level)) - 1)) != 0)
+						continue;
+					cascade(level);
+				}
+
+				fired.clear();
+				fired.swap(m_levels[0][slot_index(m_now, 0)]);
+				m_size -= int(fired.size());
+				TORRENT_ASSERT(m_size >= 0);
+				++m_now;
+				for (auto& i : fired) f(std::move(i.second));
+			}
+		}
+
+		// the number of items currently scheduled
+		int size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+
+		// the next tick advance() will process
+		std::int64_t now() const { return m_now; }
+
+	private:
+
+		static constexpr int slot_bits = 6;
+		static constexpr int num_slots = 1 << slot_bits;
+		static constexpr int num_levels = 4;
+
+		static std::size_t slot_index(std::int64_t const tick, int const level)
+		{
+			return std::size_t((tick >> (slot_bits * level)) & (num_slots - 1));
+		}
+
+		void cascade(int const level)
+		{
+			std::vector<std::pair<std::int64_t, T>> items;
+			items.swap(m_levels[std::size_t(level)][slot_index(m_now, level)]);
+			m_size -= int(items.size());
+			for (auto& i : items)
+				schedule(std::move(i.second), i.first);
+		}
+
+		std::array<std::array<std::vector<std::pair<std::int64_t, T>>, num_slots>
+			, num_levels> m_levels;
+
+		// the next tick to be processed
+		std::int64_t m_now;
+
+		int m_size = 0;
+	};
+}
+
+#endif
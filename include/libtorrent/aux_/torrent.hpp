@@ -44,6 +44,7 @@ see LICENSE file.
 #include "libtorrent/socket.hpp"
 #include "libtorrent/address.hpp"
 #include "libtorrent/aux_/peer_list.hpp"
+#include "libtorrent/aux_/torrent_peer_allocator.hpp"
 #include "libtorrent/aux_/tracker_manager.hpp"
 #include "libtorrent/aux_/stat.hpp"
 #include "libtorrent/alert.hpp"
@@ -329,6 +330,11 @@ namespace libtorrent::aux {
 		// the state of this torrent (queued, checking, downloading, etc.)
 		std::uint32_t m_state:3;
 
+		// when compact_peer_storage is enabled, the peer list allocates its
+		// peers from here rather than from the session. This must be
+		// destructed after the peer list
+		std::unique_ptr<aux::torrent_peer_slab_allocator> m_peer_storage;
+
 		std::unique_ptr<aux::peer_list> m_peer_list;
 	};
 
@@ -505,6 +511,10 @@ namespace libtorrent::aux {
 
 		void second_tick(int tick_interval_ms);
 
+		// is called by the session once the time passed to
+		// session_interface::schedule_housekeeping() has passed
+		void on_housekeeping(time_point at);
+
 		// see if we need to connect to web seeds, and if so,
 		// connect to them
 		void maybe_connect_web_seeds();
@@ -515,7 +525,19 @@ namespace libtorrent::aux {
 		stat statistics() const { return m_stat; }
 		std::optional<std::int64_t> bytes_left() const;
 
-		void bytes_done(torrent_status& st, status_flags_t) const;
+		// the total size of the torrent, and of the parts we want, and how
+		// much of those we have. These are computed from the piece counts
+		// the piece picker keeps, which is cheap, and only count whole
+		// pieces. With query_accurate_download_counters, the blocks we have
+		// of partial pieces are added too, by walking the download queue
+		struct byte_counts
+		{
+			std::int64_t total_done = 0;
+			std::int64_t total_wanted_done = 0;
+			std::int64_t total_wanted = 0;
+			std::int64_t total = 0;
+		};
+		byte_counts bytes_done(status_flags_t) const;
 
 		void sent_bytes(int bytes_payload, int bytes_protocol);
 		void received_bytes(int bytes_payload, int bytes_protocol);
@@ -627,6 +649,10 @@ namespace libtorrent::aux {
 		void post_status(status_flags_t flags);
 		void status(torrent_status* st, status_flags_t flags);
 
+		// appends this torrent to ``d`` if any of the fields reported in
+		// state_delta_alert changed since the last call
+		void status_delta(torrent_status_deltas& d);
+
 		// this torrent changed state, if the user is subscribing to
 		// it, add it to the m_state_updates list in session_impl
 		void state_updated();
@@ -714,6 +740,11 @@ namespace libtorrent::aux {
 
 		bool want_tick() const;
 		void update_want_tick();
+
+		// make sure the session calls on_housekeeping() when the next
+		// housekeeping task is due. Must be called when the state changes in
+		// a way that may make it earlier
+		void schedule_housekeeping();
 		void update_state_list();
 
 		bool want_peers() const;
@@ -731,7 +762,7 @@ namespace libtorrent::aux {
 		void update_peer_port(int port, torrent_peer* p, peer_source_flags_t src);
 		void set_seed(torrent_peer* p, bool s);
 		void clear_failcount(torrent_peer* p);
-		std::pair<aux::peer_list::iterator, aux::peer_list::iterator> find_peers(address const& a);
+		std::vector<aux::torrent_peer*> find_peers(address const& a);
 
 		// the number of peers that belong to this torrent
 		int num_peers() const { return int(m_connections.size() - m_peers_to_disconnect.size()); }
@@ -1279,6 +1310,9 @@ namespace libtorrent::aux {
 		void construct_storage();
 		void update_list(torrent_list_index_t list, bool in);
 
+		// the progress_ppm field of torrent_status
+		int progress_ppm(byte_counts const& bytes) const;
+
 		void on_files_deleted(storage_error const& error);
 		void on_torrent_paused();
 		void on_storage_moved(status_t status, std::string const& path
@@ -1457,9 +1491,9 @@ namespace libtorrent::aux {
 		// this was the last time _we_ saw a seed in this swarm
 		std::time_t m_last_seen_complete = 0;
 
-		// this is the time last any of our peers saw a seed
-		// in this swarm
-		std::time_t m_swarm_last_seen_complete = 0;
+		// the time we've asked the session to call on_housekeeping() at, or
+		// max() if we haven't. Calls for any other time are stale and ignored
+		time_point m_housekeeping_at = time_point::max();
 
 		// keep a copy of the info-hash here, so it can be accessed from multiple
 		// threads, and be cheap to access from the client
@@ -1540,6 +1574,28 @@ namespace libtorrent::aux {
 		// it's a connection to ourself, and we should reject it.
 		std::set<peer_id> m_outgoing_pids;
 
+		// the fields reported by status_delta()
+		struct status_snapshot
+		{
+			torrent_status::state_t state;
+			torrent_flags_t flags;
+			error_code errc;
+			int progress_ppm;
+			std::int64_t total_done;
+			std::int64_t total_wanted_done;
+			std::int64_t total_wanted;
+			std::int64_t all_time_upload;
+			std::int64_t all_time_download;
+			int download_payload_rate;
+			int upload_payload_rate;
+			int num_peers;
+			int num_seeds;
+		};
+
+		// the fields as of the last call to status_delta(). This is allocated
+		// the first time it's called, most torrents never need it
+		std::unique_ptr<status_snapshot> m_last_delta;
+
 		// for torrents who have a bandwidth limit, this is != 0
 		// and refers to a peer_class in the session.
 		peer_class_t m_peer_class{0};
@@ -45,6 +45,9 @@ namespace libtorrent::aux {
 		std::int64_t total_download() const;
 		std::int64_t total_upload() const;
 
+		// the priority of connecting to this peer, given our external
+		// address. This is not cached here, to keep torrent_peer objects
+		// small. The peer_list and peer_connection keep the ranks they use
 		std::uint32_t rank(aux::external_ip const& external, int external_port) const;
 
 		libtorrent::address address() const;
@@ -78,11 +81,6 @@ namespace libtorrent::aux {
 		// will refer to a valid peer_connection
 		peer_connection_interface* connection;
 
-		// as computed by hashing our IP with the remote
-		// IP of this peer
-		// calculated lazily
-		mutable std::uint32_t peer_rank = 0;
-
 		// the time when this torrent_peer was optimistically unchoked
 		// the last time. in seconds since session was created
 		// 16 bits is enough to last for 18.2 hours
@@ -16,6 +16,11 @@ see LICENSE file.
 #include "libtorrent/aux_/torrent_peer.hpp"
 #include "libtorrent/aux_/pool.hpp"
 
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
 namespace libtorrent::aux {
 
 	struct TORRENT_EXTRA_EXPORT torrent_peer_allocator_interface
@@ -30,6 +35,10 @@ namespace libtorrent::aux {
 
 		virtual torrent_peer* allocate_peer_entry(int type) = 0;
 		virtual void free_peer_entry(torrent_peer* p) = 0;
+
+		// returns true if every entry is preceded by a slot holding its
+		// cached rank. See torrent_peer_allocator::rank_slot()
+		virtual bool has_rank_slots() const { return false; }
 	protected:
 		~torrent_peer_allocator_interface() {}
 	};
@@ -45,6 +54,16 @@ namespace libtorrent::aux {
 
 		torrent_peer* allocate_peer_entry(int type) override;
 		void free_peer_entry(torrent_peer* p) override;
+		bool has_rank_slots() const override { return true; }
+
+		// the rank of p, cached by the peer_list. torrent_peer doesn't have
+		// room for it, so the pools keep it in front of each entry. 0 means
+		// it hasn't been computed yet
+		static std::uint32_t& rank_slot(torrent_peer const* p)
+		{
+			return *reinterpret_cast<std::uint32_t*>(
+				const_cast<char*>(reinterpret_cast<char const*>(p)) - rank_slot_size);
+		}
 
 		std::uint64_t total_bytes() const { return m_total_bytes; }
 		std::uint64_t total_allocations() const { return m_total_allocations; }
@@ -53,18 +72,25 @@ namespace libtorrent::aux {
 
 	private:
 
+		// the size of the rank slot, keeping the entries aligned
+		static constexpr int rank_slot_size = alignof(torrent_peer);
+		static_assert(rank_slot_size >= int(sizeof(std::uint32_t)));
+
+		torrent_peer* allocate(aux::pool& pool, int size);
+		void free(aux::pool& pool, torrent_peer* p, int size);
+
 		// this is a shared pool where torrent_peer objects
 		// are allocated. It's a pool since we're likely
 		// to have tens of thousands of peers, and a pool
 		// saves significant overhead
 
-		aux::pool m_ipv4_peer_pool{sizeof(ipv4_peer), 500};
-		aux::pool m_ipv6_peer_pool{sizeof(ipv6_peer), 500};
+		aux::pool m_ipv4_peer_pool{rank_slot_size + sizeof(ipv4_peer), 500};
+		aux::pool m_ipv6_peer_pool{rank_slot_size + sizeof(ipv6_peer), 500};
 #if TORRENT_USE_I2P
-		aux::pool m_i2p_peer_pool{sizeof(i2p_peer), 500};
+		aux::pool m_i2p_peer_pool{rank_slot_size + sizeof(i2p_peer), 500};
 #endif
 #if TORRENT_USE_RTC
-		aux::pool m_rtc_peer_pool{sizeof(rtc_peer), 500};
+		aux::pool m_rtc_peer_pool{rank_slot_size + sizeof(rtc_peer), 500};
 #endif
 		// the total number of bytes allocated (cumulative)
 		std::uint64_t m_total_bytes = 0;
@@ -78,6 +104,88 @@ namespace libtorrent::aux {
 		bool m_in_use = true;
 #endif
 	};
+
+	// allocates the torrent_peer objects of a single torrent, packed back to
+	// back in arrays (slabs) of entries of the same type. Slabs are aligned
+	// to cache lines, so each 32 byte ipv4_peer is contained in one half of
+	// a cache line. Free entries are linked by their 32-bit index into the
+	// slab, stored in the entry itself. New slabs are twice the size of the
+	// previous one, up to max_slab_entries, and slabs that become entirely
+	// free are released, except the last one with free entries.
+	struct TORRENT_EXTRA_EXPORT torrent_peer_slab_allocator final
+		: torrent_peer_allocator_interface
+	{
+		static constexpr int min_slab_entries = 32;
+		static constexpr int max_slab_entries = 1024;
+
+		torrent_peer_slab_allocator();
+		~torrent_peer_slab_allocator();
+		torrent_peer_slab_allocator(torrent_peer_slab_allocator const&) = delete;
+		torrent_peer_slab_allocator& operator=(torrent_peer_slab_allocator const&) = delete;
+
+		torrent_peer* allocate_peer_entry(int type) override;
+		void free_peer_entry(torrent_peer* p) override;
+
+		std::uint64_t total_bytes() const { return m_total_bytes; }
+		std::uint64_t total_allocations() const { return m_total_allocations; }
+		int live_bytes() const { return m_live_bytes; }
+		int live_allocations() const { return m_live_allocations; }
+
+		// the number of bytes of all slabs currently allocated, including
+		// free entries
+		int reserved_bytes() const { return m_reserved_bytes; }
+
+	private:
+
+		struct slab
+		{
+			char* base;
+			int num_entries;
+
+			// the index of the first entry that has been freed back into
+			// this slab, or -1. Each free entry holds the index of the next
+			std::uint32_t free_list = 0xffffffff;
+
+			// entries from this index and up have never been handed out
+			int next_untouched = 0;
+
+			// the number of free entries, in free_list and past
+			// next_untouched
+			int num_free;
+		};
+
+		struct peer_pool
+		{
+			int entry_size = 0;
+
+			// the number of entries of the next slab to allocate
+			int next_slab_entries = min_slab_entries;
+
+			// all slabs, sorted by base address
+			std::vector<std::unique_ptr<slab>> slabs;
+
+			// the slabs that have free entries
+			std::vector<slab*> partial;
+		};
+
+		void* allocate(peer_pool& pool);
+		void free(peer_pool& pool, void* entry);
+		slab* new_slab(peer_pool& pool);
+		void release_slab(peer_pool& pool, slab* s);
+
+		std::array<peer_pool, 4> m_pools;
+
+		// the total number of bytes allocated (cumulative)
+		std::uint64_t m_total_bytes = 0;
+		// the total number of allocations (cumulative)
+		std::uint64_t m_total_allocations = 0;
+		// the number of currently live bytes
+		int m_live_bytes = 0;
+		// the number of currently live allocations
+		int m_live_allocations = 0;
+		// the number of bytes held in slabs
+		int m_reserved_bytes = 0;
+	};
 }
 
 #endif
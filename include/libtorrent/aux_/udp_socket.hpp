@@ -24,6 +24,7 @@ see LICENSE file.
 
 #include <array>
 #include <memory>
+#include <vector>
 
 namespace libtorrent::aux {
 
@@ -46,6 +47,12 @@ namespace libtorrent::aux {
 		static inline constexpr udp_send_flags_t dont_queue = 2_bit;
 		static inline constexpr udp_send_flags_t dont_fragment = 3_bit;
 
+		// the packet may be held back in a queue and sent together with
+		// other queued packets by the next call to flush_batch(). Packets sent
+		// through a proxy or with the dont_fragment flag are always sent
+		// immediately.
+		static inline constexpr udp_send_flags_t batch = 4_bit;
+
 		bool is_open() const { return m_abort == false; }
 		udp::socket::executor_type get_executor() { return m_socket.get_executor(); }
 
@@ -69,6 +76,13 @@ namespace libtorrent::aux {
 			error_code error;
 		};
 
+		// the max number of packets returned by a single call to read()
+		static constexpr int max_read_packets = 32;
+
+		// receive as many packets as are available on the socket (but no more
+		// than max_read_packets or the size of ``pkts``). The packet buffers
+		// are valid until the next call to read(). On linux, this uses
+		// recvmmsg() to receive the whole batch in a single system call.
 		int read(span<packet> pkts, error_code& ec);
 
 		// this is only valid when using a socks5 proxy
@@ -77,6 +91,24 @@ namespace libtorrent::aux {
 
 		void send(udp::endpoint const& ep, span<char const> p
 			, error_code& ec, udp_send_flags_t flags = {});
+
+		// the max number of packets held in the send queue, and the max
+		// size of a packet for it to be queued
+		static constexpr int max_batch_packets = 64;
+		static constexpr int max_batch_packet_size = 1500;
+
+		// send all packets queued by send() with the batch flag. On linux,
+		// this is done with sendmmsg(), and runs of packets of the same size
+		// to the same endpoint are sent as a single UDP GSO (generic
+		// segmentation offload) message, where supported. If the socket's send
+		// buffer fills up, ec is set to would_block and the remaining packets
+		// are kept in the queue. Until they have been sent, send() with the
+		// batch flag fails with would_block. Other errors are treated as if
+		// the packets had been lost.
+		void flush_batch(error_code& ec);
+
+		// returns true if there are packets in the send queue
+		bool has_batch() const { return m_send_queue_head < int(m_send_queue.size()); }
 		void open(udp const& protocol, error_code& ec);
 		void bind(udp::endpoint const& ep, error_code& ec);
 		void close();
@@ -130,12 +162,28 @@ namespace libtorrent::aux {
 		void wrap(char const* hostname, int port, span<char const> p, error_code& ec, udp_send_flags_t flags);
 		bool unwrap(udp_socket::packet& pack);
 
+		bool use_proxy(udp_send_flags_t flags) const;
+
+		void queue_packet(udp::endpoint const& ep, span<char const> p, error_code& ec);
+
+		// send as many of the queued packets as possible, starting at
+		// m_send_queue_head. Returns the number of packets that were sent or
+		// dropped because of an error. ec is only set if the send buffer is
+		// full
+		int send_queued(error_code& ec);
+
+		// receive up to ``pkts.size()`` packets into the receive buffers,
+		// starting at buffer ``first_buf``. Returns the number of packets
+		// received. Only the data and from fields of the packets are set.
+		int receive(span<packet> pkts, int first_buf, error_code& ec);
+
 		udp::socket m_socket;
 
 		io_context& m_ioc;
 
 		using receive_buffer = std::array<char, 1500>;
-		std::unique_ptr<receive_buffer> m_buf;
+		// max_read_packets buffers
+		std::unique_ptr<receive_buffer[]> m_buf;
 		aux::listen_socket_handle m_listen_socket;
 
 		std::uint16_t m_bind_port;
@@ -144,7 +192,33 @@ namespace libtorrent::aux {
 
 		std::shared_ptr<socks5> m_socks5_connection;
 
+		struct queued_packet
+		{
+			udp::endpoint ep;
+			// offset and size of the packet in m_send_buf
+			int offset;
+			int size;
+		};
+
+		// packets sent with the batch flag, waiting for flush_batch(). The
+		// packets before m_send_queue_head have already been sent
+		std::vector<queued_packet> m_send_queue;
+		int m_send_queue_head = 0;
+
+		// the payloads of the packets in m_send_queue, back to back. This
+		// is allocated on first use, and can hold max_batch_packets packets
+		// of max_batch_packet_size bytes
+		std::unique_ptr<char[]> m_send_buf;
+
 		bool m_abort:1;
+
+		// set when flush_batch() failed to send all packets because the
+		// socket's send buffer is full
+		bool m_batch_blocked:1;
+
+		// cleared if sending a UDP GSO message fails, in which case we fall
+		// back to sending one message per packet
+		bool m_use_gso:1;
 	};
 }
 
@@ -13,7 +13,6 @@ see LICENSE file.
 #ifndef TORRENT_UTP_SOCKET_MANAGER_HPP_INCLUDED
 #define TORRENT_UTP_SOCKET_MANAGER_HPP_INCLUDED
 
-#include <map>
 #include <functional>
 
 #include "libtorrent/aux_/socket_type.hpp"
@@ -22,6 +21,7 @@ see LICENSE file.
 #include "libtorrent/aux_/session_settings.hpp"
 #include "libtorrent/span.hpp"
 #include "libtorrent/aux_/packet_pool.hpp"
+#include "libtorrent/aux_/utp_socket_map.hpp"
 
 namespace libtorrent {
 
@@ -78,8 +78,10 @@ namespace aux {
 
 		void remove_udp_socket(std::weak_ptr<utp_socket_interface> sock);
 
-		// internal, used by utp_stream
-		void remove_socket(std::uint16_t id);
+		// internal, used by utp_stream when the remote endpoint of a socket
+		// changes
+		void rekey_socket(utp_socket_impl* s, udp::endpoint const& old_ep
+			, udp::endpoint const& new_ep);
 
 		utp_socket_impl* new_utp_socket(utp_stream* str);
 		int gain_factor() const { return m_sett.get_int(settings_pack::utp_gain_factor); }
@@ -93,7 +95,7 @@ namespace aux {
 		int cwnd_reduce_timer() const { return m_sett.get_int(settings_pack::utp_cwnd_reduce_timer); }
 
 		int mtu_for_dest(address const& addr) const;
-		int num_sockets() const { return int(m_utp_sockets.size()); }
+		int num_sockets() const { return m_utp_sockets.size(); }
 
 		void defer_ack(utp_socket_impl* s);
 		void cancel_deferred_ack(utp_socket_impl* s);
@@ -126,9 +128,9 @@ namespace aux {
 		send_fun_t m_send_fun;
 		incoming_utp_callback_t m_cb;
 
-		// replace with a hash-map
-		using socket_map_t = std::multimap<std::uint16_t, std::unique_ptr<utp_socket_impl>>;
-		socket_map_t m_utp_sockets;
+		// all uTP sockets, keyed on their receive connection ID and remote
+		// endpoint
+		utp_socket_map<utp_socket_impl> m_utp_sockets;
 
 		using socket_vector_t = std::vector<utp_socket_impl*>;
 
@@ -148,6 +150,10 @@ namespace aux {
 		// sent or received.
 		socket_vector_t m_drained_event;
 
+		// the sockets to tick. The table may not be modified while iterating
+		// over it, and ticking a socket may cause new ones to be created
+		socket_vector_t m_tick_sockets;
+
 		// list of sockets that received EWOULDBLOCK from the
 		// underlying socket. They are notified when the socket
 		// becomes writable again
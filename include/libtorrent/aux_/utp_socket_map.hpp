@@ -0,0 +1,181 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#ifndef TORRENT_UTP_SOCKET_MAP_HPP_INCLUDED
+#define TORRENT_UTP_SOCKET_MAP_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/socket.hpp"
+#include "libtorrent/address.hpp"
+#include "libtorrent/assert.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace libtorrent::aux {
+
+	// an open-addressing hash table of uTP sockets, keyed on the connection
+	// ID and the remote endpoint. It owns the sockets. Each slot holds the
+	// socket pointer and the hash of its key, so probing only touches the
+	// socket object itself for the final match() on a hash hit. Keys are not
+	// unique, there may be more than one socket with the same key (e.g. ones
+	// that haven't been connected yet). find() returns any one of them.
+	//
+	// Since the key of a socket is not stored in the table, the caller must
+	// pass in the key the socket was inserted with, when removing or
+	// re-keying it. ``Socket`` must have a member function
+	// ``bool match(udp::endpoint const& ep, std::uint16_t id) const``.
+	template <typename Socket>
+	struct utp_socket_map
+	{
+		// the seed is mixed into the hash, to make it harder for an attacker
+		// to cause collisions
+		explicit utp_socket_map(std::uint32_t const seed = 0) : m_seed(seed) {}
+
+		utp_socket_map(utp_socket_map const&) = delete;
+		utp_socket_map& operator=(utp_socket_map const&) = delete;
+
+		Socket* insert(std::uint16_t const id, udp::endpoint const& ep
+			, std::unique_ptr<Socket> s)
+		{
+			TORRENT_ASSERT(s);
+			if ((m_size + 1) * 2 > int(m_slots.size()))
+				grow();
+			auto* const ret = s.get();
+			insert_slot(slot{std::move(s), hash(id, ep)});
+			++m_size;
+			return ret;
+		}
+
+		Socket* find(std::uint16_t const id, udp::endpoint const& ep) const
+		{
+			if (m_size == 0) return nullptr;
+			std::uint32_t const h = hash(id, ep);
+			std::size_t const mask = m_slots.size() - 1;
+			for (std::size_t i = h & mask;; i = (i + 1) & mask)
+			{
+				slot const& sl = m_slots[i];
+				if (!sl.sock) return nullptr;
+				if (sl.hash == h && sl.sock->match(ep, id)) return sl.sock.get();
+			}
+		}
+
+		// removes the socket ``s``, which was inserted (or last re-keyed) with
+		// the specified key, and returns it. Returns nullptr if it's not in
+		// the table.
+		std::unique_ptr<Socket> remove(std::uint16_t const id
+			, udp::endpoint const& ep, Socket const* s)
+		{
+			if (m_size == 0) return {};
+			std::size_t const mask = m_slots.size() - 1;
+			std::size_t i = hash(id, ep) & mask;
+			for (;; i = (i + 1) & mask)
+			{
+				if (!m_slots[i].sock) return {};
+				if (m_slots[i].sock.get() == s) break;
+			}
+
+			std::unique_ptr<Socket> ret = std::move(m_slots[i].sock);
+			--m_size;
+
+			// backward-shift deletion. Move entries following the hole back
+			// if their home slot is at or before the hole, so there are no
+			// gaps in any probe sequence
+			std::size_t hole = i;
+			for (std::size_t j = (i + 1) & mask; m_slots[j].sock; j = (j + 1) & mask)
+			{
+				std::size_t const home = m_slots[j].hash & mask;
+				// the distance from the home slot to j, and to the hole
+				if (((j - home) & mask) < ((j - hole) & mask)) continue;
+				m_slots[hole] = std::move(m_slots[j]);
+				hole = j;
+			}
+			return ret;
+		}
+
+		// call this when the key of a socket changes, e.g. when its remote
+		// endpoint is set
+		void rekey(std::uint16_t const id, udp::endpoint const& old_ep
+			, udp::endpoint const& new_ep, Socket const* s)
+		{
+			std::unique_ptr<Socket> sock = remove(id, old_ep, s);
+			TORRENT_ASSERT(sock);
+			if (!sock) return;
+			insert(id, new_ep, std::move(sock));
+		}
+
+		// calls ``f`` with a pointer to each socket. ``f`` must not modify
+		// the table
+		template <typename Fun>
+		void for_each(Fun f) const
+		{
+			for (auto const& sl : m_slots)
+				if (sl.sock) f(sl.sock.get());
+		}
+
+		int size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+
+	private:
+
+		struct slot
+		{
+			std::unique_ptr<Socket> sock;
+			std::uint32_t hash = 0;
+		};
+
+		std::uint32_t hash(std::uint16_t const id, udp::endpoint const& ep) const
+		{
+			std::uint64_t h = (std::uint64_t(ep.port()) << 16) | id;
+			h ^= m_seed;
+			address const& a = ep.address();
+			if (a.is_v4())
+			{
+				h ^= std::uint64_t(a.to_v4().to_uint()) << 32;
+			}
+			else
+			{
+				auto const b = a.to_v6().to_bytes();
+				std::uint64_t w[2];
+				std::memcpy(w, b.data(), sizeof(w));
+				h ^= w[0] ^ (w[1] * 0xff51afd7ed558ccdULL);
+			}
+			// fibonacci hashing, the high bits are the well mixed ones
+			h *= 0x9e3779b97f4a7c15ULL;
+			return std::uint32_t(h >> 32);
+		}
+
+		void insert_slot(slot s)
+		{
+			std::size_t const mask = m_slots.size() - 1;
+			std::size_t i = s.hash & mask;
+			while (m_slots[i].sock) i = (i + 1) & mask;
+			m_slots[i] = std::move(s);
+		}
+
+		void grow()
+		{
+			std::vector<slot> old(std::max(std::size_t(16), m_slots.size() * 2));
+			old.swap(m_slots);
+			for (auto& sl : old)
+				if (sl.sock) insert_slot(std::move(sl));
+		}
+
+		// the number of slots is always a power of two, and at most half of
+		// them are occupied
+		std::vector<slot> m_slots;
+		int m_size = 0;
+		std::uint32_t m_seed;
+	};
+}
+
+#endif
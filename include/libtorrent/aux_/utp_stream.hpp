@@ -649,6 +649,10 @@ struct utp_socket_impl
 	void update_mtu_limits();
 	void experienced_loss(std::uint32_t seq_nr, time_point now);
 
+	// the remote endpoint is part of the key in the socket manager's socket
+	// table, it must only be changed through this function
+	void set_remote_endpoint(udp::endpoint const& ep);
+
 	void send_deferred_ack();
 	void socket_drained();
 
@@ -172,6 +172,8 @@ see LICENSE file.
 #define TORRENT_USE_IFCONF 1
 #define TORRENT_HAS_SALEN 0
 #define TORRENT_USE_FDATASYNC 1
+#define TORRENT_HAS_RECVMMSG 1
+#define TORRENT_HAS_SENDMMSG 1
 
 #if defined __GLIBC__ && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ > 24))
 #define TORRENT_USE_GETRANDOM 1
@@ -219,6 +221,13 @@ see LICENSE file.
 
 #define TORRENT_USE_SYNC_FILE_RANGE 1
 
+// io_uring_disk_io only needs the kernel headers, not liburing
+#if !defined TORRENT_HAVE_IO_URING && defined __has_include
+#if __has_include(<linux/io_uring.h>)
+#define TORRENT_HAVE_IO_URING 1
+#endif
+#endif
+
 #endif // ANDROID
 
 #if defined __GLIBC__ && ( defined __x86_64__ || defined __i386 \
@@ -426,6 +435,14 @@ see LICENSE file.
 #define TORRENT_HAS_FALLOCATE 1
 #endif
 
+#ifndef TORRENT_HAS_RECVMMSG
+#define TORRENT_HAS_RECVMMSG 0
+#endif
+
+#ifndef TORRENT_HAS_SENDMMSG
+#define TORRENT_HAS_SENDMMSG 0
+#endif
+
 #ifndef TORRENT_HAS_FADVISE
 #define TORRENT_HAS_FADVISE 1
 #endif
@@ -482,6 +499,10 @@ see LICENSE file.
 #define TORRENT_USE_SYNC_FILE_RANGE 0
 #endif
 
+#ifndef TORRENT_HAVE_IO_URING
+#define TORRENT_HAVE_IO_URING 0
+#endif
+
 #ifndef TORRENT_USE_FDATASYNC
 #define TORRENT_USE_FDATASYNC 0
 #endif
@@ -127,7 +127,7 @@ namespace file_open_mode {
 		time_point last_use;
 	};
 
-	using disk_job_flags_t = flags::bitfield_flag<std::uint8_t, struct disk_job_flags_tag>;
+	using disk_job_flags_t = flags::bitfield_flag<std::uint16_t, struct disk_job_flags_tag>;
 
 	// The disk_interface is the customization point for disk I/O in libtorrent.
 	// implement this interface and provide a factory function to the session constructor
@@ -167,6 +167,14 @@ namespace file_open_mode {
 		// it should be flushed to disk
 		static constexpr disk_job_flags_t flush_piece = 7_bit;
 
+		// the caller of async_read() only needs read-only access to the block,
+		// and only passes it to the kernel (e.g. send() on a TCP socket). This
+		// allows back-ends that map files into memory to hand out a reference
+		// to the mapping itself, instead of a copy in a disk buffer. Such a
+		// buffer may not be modified, and accessing it may fault if the file is
+		// truncated while it's held.
+		static constexpr disk_job_flags_t zero_copy = 8_bit;
+
 		// this is called when a new torrent is added. The shared_ptr can be
 		// used to hold the internal torrent object alive as long as there are
 		// outstanding disk operations on the storage.
@@ -127,6 +127,8 @@ struct file_progress_alert;
 struct piece_info_alert;
 struct piece_availability_alert;
 struct tracker_list_alert;
+struct state_delta_alert;
+struct dht_indexer_alert;
 
 // include/libtorrent/announce_entry.hpp
 TORRENT_VERSION_NAMESPACE_2
@@ -271,6 +273,7 @@ TORRENT_VERSION_NAMESPACE_4_END
 TORRENT_VERSION_NAMESPACE_4
 struct torrent_status;
 TORRENT_VERSION_NAMESPACE_4_END
+struct torrent_status_deltas;
 
 // include/libtorrent/web_seed_entry.hpp
 struct web_seed_entry;
@@ -0,0 +1,40 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#ifndef TORRENT_IO_URING_DISK_IO_HPP
+#define TORRENT_IO_URING_DISK_IO_HPP
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/disk_interface.hpp"
+#include "libtorrent/io_context.hpp"
+
+namespace libtorrent {
+
+#if TORRENT_HAVE_IO_URING
+
+	struct counters;
+	struct settings_interface;
+
+	// constructs a disk I/O back-end using the Linux io_uring interface.
+	// Reads, writes and fsyncs are submitted to the kernel in batches, and
+	// complete directly on the network thread, without any disk threads. Jobs
+	// on whole files, like moving, deleting or checking them, may block, and
+	// run on a small pool of threads instead. The disk buffers are registered
+	// with the kernel as fixed buffers, when supported. It uses the same
+	// storage (and part file) as the pread back-end. If io_uring is not
+	// available at run time (for instance if it's disabled by the kernel or a
+	// seccomp policy), this falls back to pread_disk_io.
+	TORRENT_EXPORT std::unique_ptr<disk_interface> io_uring_disk_io_constructor(
+		io_context& ios, settings_interface const&, counters& cnt);
+
+#endif // TORRENT_HAVE_IO_URING
+
+}
+
+#endif // TORRENT_IO_URING_DISK_IO_HPP
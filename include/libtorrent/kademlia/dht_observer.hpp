@@ -12,8 +12,13 @@ see LICENSE file.
 #ifndef DHT_OBSERVER_HPP
 #define DHT_OBSERVER_HPP
 
+#include <utility>
+#include <vector>
+
 #include "libtorrent/config.hpp"
 #include "libtorrent/address.hpp"
+#include "libtorrent/socket.hpp"
+#include "libtorrent/sha1_hash.hpp"
 #include "libtorrent/string_view.hpp"
 #include "libtorrent/kademlia/msg.hpp"
 #include "libtorrent/aux_/session_udp_sockets.hpp" // for transport
@@ -68,6 +73,11 @@ namespace dht {
 		virtual bool on_dht_request(string_view query
 			, dht::msg const& request, entry& response) = 0;
 
+		// called with a batch of info-hashes (and their peers) discovered by
+		// the DHT indexer
+		virtual void indexer_results(std::vector<sha1_hash> const& info_hashes
+			, std::vector<std::pair<sha1_hash, tcp::endpoint>> const& peers) = 0;
+
 	protected:
 		~dht_observer() = default;
 	};
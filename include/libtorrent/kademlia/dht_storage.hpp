@@ -50,10 +50,11 @@ namespace dht {
 	// the peers, mutable and immutable items and it's designed to
 	// provide a fast and fully compliant behavior of the BEPs.
 	//
-	// libtorrent comes with one built-in storage implementation:
-	// ``dht_default_storage`` (private non-accessible class). Its
-	// constructor function is called dht_default_storage_constructor().
-	// You should know that if this storage becomes full of DHT items,
+	// libtorrent comes with two built-in storage implementations:
+	// ``dht_default_storage`` and ``dht_sharded_storage`` (private
+	// non-accessible classes). Their constructor functions are called
+	// dht_default_storage_constructor() and dht_sharded_storage_constructor().
+	// You should know that if the storage becomes full of DHT items,
 	// the current implementation could degrade in performance.
 	struct TORRENT_EXPORT dht_storage_interface
 	{
@@ -216,6 +217,16 @@ namespace dht {
 	TORRENT_EXPORT std::unique_ptr<dht_storage_interface> dht_default_storage_constructor(
 		settings_interface const& settings);
 
+	// constructor for a DHT storage meant for nodes receiving a large number
+	// of announces (like bootstrap nodes). Torrents are kept in flat hash
+	// tables, split into shards, and peers in compact arrays. Rather than
+	// looking at every peer on every tick(), peers are expired in batches by
+	// when they announced. This means a peer may be kept up to 5 minutes past
+	// its expiry. Use it by setting session_params::dht_storage_constructor
+	// or by calling session_handle::set_dht_storage().
+	TORRENT_EXPORT std::unique_ptr<dht_storage_interface> dht_sharded_storage_constructor(
+		settings_interface const& settings);
+
 } // namespace dht
 } // namespace libtorrent
 
@@ -15,6 +15,8 @@ see LICENSE file.
 #define TORRENT_DHT_TRACKER
 
 #include <functional>
+#include <memory>
+#include <vector>
 
 #include <libtorrent/kademlia/node.hpp>
 #include <libtorrent/kademlia/dos_blocker.hpp>
@@ -27,6 +29,12 @@ see LICENSE file.
 #include <libtorrent/io_context.hpp>
 #include <libtorrent/aux_/udp_socket.hpp>
 #include <libtorrent/entry.hpp>
+#include <libtorrent/bdecode.hpp>
+#include <libtorrent/time.hpp>
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <boost/asio/thread_pool.hpp>
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
 
 namespace libtorrent {
 
@@ -166,6 +174,31 @@ namespace libtorrent::dht {
 		void update_storage_node_ids();
 		node* get_node(node_id const& id, string_view family_name);
 
+		// a mutable put handed off to a DHT worker thread to have its
+		// signature verified, as part of a batch. The message refers to the
+		// copy of the packet in buffer
+		struct pending_put
+		{
+			std::vector<char> buffer;
+			bdecode_node message;
+			aux::listen_socket_handle socket;
+			udp::endpoint ep;
+			time_point queued;
+
+			// the time it took to verify the batch this put was part of
+			std::int64_t verify_time = 0;
+			bool valid_signature = false;
+		};
+		using put_batch = std::vector<std::unique_ptr<pending_put>>;
+
+		// if m_msg is a mutable put worth verifying on a worker thread,
+		// queues it and returns true. The nodes are passed the message
+		// once it has been verified, in on_puts_verified()
+		bool verify_put_async(aux::listen_socket_handle const& s
+			, udp::endpoint const& ep, span<char const> buf);
+		void flush_put_queue();
+		void on_puts_verified(put_batch batch);
+
 		// implements socket_manager
 		bool has_quota() override;
 		bool send_packet(aux::listen_socket_handle const& s, entry& e, udp::endpoint const& addr) override;
@@ -199,6 +232,19 @@ namespace libtorrent::dht {
 		time_point m_last_tick;
 
 		io_context& m_ioc;
+
+		// the puts waiting to be handed to m_verify_pool as a batch
+		put_batch m_put_queue;
+
+		// the number of mutable puts queued or handed off to m_verify_pool,
+		// that haven't been passed on to the nodes yet
+		int m_puts_in_flight = 0;
+
+		// the threads verifying the signatures of incoming mutable puts,
+		// if dht_worker_threads is non-zero. This is the last member, so
+		// the threads are joined before the rest of the tracker is torn
+		// down
+		std::unique_ptr<boost::asio::thread_pool> m_verify_pool;
 	};
 } // namespace libtorrent::dht
 
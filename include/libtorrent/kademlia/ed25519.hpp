@@ -17,6 +17,7 @@ see LICENSE file.
 
 #include <array>
 #include <tuple>
+#include <vector>
 
 namespace libtorrent {
 namespace dht {
@@ -44,10 +45,29 @@ namespace dht {
 	TORRENT_EXPORT signature ed25519_sign(span<char const> msg
 		, public_key const& pk, secret_key const& sk);
 
-	// Verifies the signature on the given message using ``pk``
+	// Verifies the signature on the given message using ``pk``. This uses the
+	// cofactored verification equation, so a signature whose R or ``pk``
+	// has an additional component of small order is accepted. Those are
+	// never produced by an honest signer, but DHT nodes using cofactorless
+	// verification reject them.
 	TORRENT_EXPORT bool ed25519_verify(signature const& sig
 		, span<char const> msg, public_key const& pk);
 
+	// Verifies a number of signatures at once. Element ``i`` of the returned
+	// vector is true if ``sigs[i]`` is a valid signature of ``msgs[i]`` using
+	// ``pks[i]``. All three spans must have the same size.
+	//
+	// The signatures are checked in batches, with a single multi-scalar
+	// multiplication each, which is about twice as fast as calling
+	// ed25519_verify() on each of them. If a batch fails, it is split in
+	// smaller batches, to tell which signatures are invalid. So this is
+	// only faster when most signatures are valid.
+	//
+	// The result for each signature is the same as ed25519_verify() would
+	// give.
+	TORRENT_EXPORT std::vector<bool> ed25519_verify_batch(span<signature const> sigs
+		, span<span<char const> const> msgs, span<public_key const> pks);
+
 	// Adds a scalar to the given key pair where scalar is a 32 byte buffer
 	// (possibly generated with `ed25519_create_seed`), generating a new key pair.
 	//
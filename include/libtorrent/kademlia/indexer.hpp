@@ -0,0 +1,147 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#ifndef TORRENT_DHT_INDEXER_HPP
+#define TORRENT_DHT_INDEXER_HPP
+
+#include <array>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include "libtorrent/kademlia/traversal_algorithm.hpp"
+#include "libtorrent/kademlia/observer.hpp"
+#include "libtorrent/aux_/bloom_filter.hpp"
+
+namespace libtorrent::dht {
+
+// remembers which keys have been seen recently. It's made up of a few bloom
+// filters, the oldest of which is cleared and reused once the newest one is
+// full. This keeps the false positive rate bounded, at the cost of forgetting
+// the oldest keys. The keys are expected to be uniformly distributed (like
+// info-hashes and SHA-1 digests).
+struct TORRENT_EXTRA_EXPORT recently_seen
+{
+	// returns true if k has been seen recently. Otherwise k is recorded and
+	// false is returned
+	bool insert(sha1_hash const& k);
+
+	void clear();
+
+private:
+
+	// bloom_filter uses 16 bits of the key to index into the filter, it
+	// can't make use of more than 8 kiB
+	static constexpr int filter_size = 8192;
+
+	// the number of keys added to a filter before moving on to the next one.
+	// With the two bits bloom_filter sets per key, this is a false positive
+	// rate of about 1.3% per filter
+	static constexpr int filter_capacity = 4000;
+
+	std::array<aux::bloom_filter<filter_size>, 4> m_filters;
+
+	// the filter new keys are added to
+	int m_current = 0;
+
+	// the number of keys added to m_filters[m_current]
+	int m_size = 0;
+};
+
+// crawls the DHT with sample_infohashes requests, asking the nodes for the
+// peers of the info-hashes they return. All requests share this object, which
+// keeps the frontier of nodes to query, so there's no per-request
+// traversal state. It's not part of the node's list of running requests, and
+// never has any results of its own (m_results is empty), so the
+// traversal_algorithm bookkeeping is bypassed. The number of requests in
+// flight is limited by settings_pack::dht_indexer_requests, and requests are
+// only sent while the DHT has upload quota (dht_upload_rate_limit).
+class TORRENT_EXTRA_EXPORT indexer final : public traversal_algorithm
+{
+public:
+
+	explicit indexer(node& dht_node);
+
+	char const* name() const override;
+
+	// sends as many requests as the limits allow and passes on the results
+	// gathered since the last call to the dht_observer
+	void tick();
+
+	// stop sending requests. Responses to outstanding requests are ignored
+	void stop();
+
+	void got_samples(node_id const& id, udp::endpoint const& ep
+		, std::vector<sha1_hash> const& samples
+		, std::vector<std::pair<node_id, udp::endpoint>> const& nodes);
+	void got_peers(sha1_hash const& info_hash, std::vector<tcp::endpoint> const& peers
+		, std::vector<std::pair<node_id, udp::endpoint>> const& nodes);
+
+	// called when a request completes, successfully or not
+	void request_done();
+
+	int num_in_flight() const { return m_in_flight; }
+	int frontier_size() const { return int(m_frontier.size()); }
+
+private:
+
+	void add_node(node_id const& id, udp::endpoint const& ep);
+	void send_requests();
+	bool send_request(udp::endpoint const& ep, node_id const& id
+		, sha1_hash const& info_hash, entry& e);
+	void flush_results();
+
+	std::shared_ptr<indexer> self()
+	{ return std::static_pointer_cast<indexer>(shared_from_this()); }
+
+	struct get_peers_request
+	{
+		sha1_hash info_hash;
+		node_id id;
+		udp::endpoint ep;
+	};
+
+	// nodes we have heard about but not yet sent a sample_infohashes request
+	std::deque<std::pair<node_id, udp::endpoint>> m_frontier;
+
+	// info-hashes to ask the node that sampled them for peers. These take
+	// priority over sampling more nodes
+	std::deque<get_peers_request> m_get_peers;
+
+	// the endpoints of the nodes added to m_frontier (by their SHA-1)
+	recently_seen m_seen_nodes;
+	recently_seen m_seen_info_hashes;
+
+	// the results not yet handed to the dht_observer
+	std::vector<sha1_hash> m_info_hashes;
+	std::vector<std::pair<sha1_hash, tcp::endpoint>> m_peers;
+
+	int m_in_flight = 0;
+	bool m_stopped = false;
+};
+
+// the observer for both the sample_infohashes and get_peers requests sent by
+// the indexer
+class indexer_observer final : public observer
+{
+public:
+	indexer_observer(std::shared_ptr<traversal_algorithm> algorithm
+		, udp::endpoint const& ep, node_id const& id, sha1_hash const& info_hash);
+
+	void reply(msg const&) override;
+	void timeout() override;
+
+private:
+	// the info-hash of a get_peers request. All zeros for sample_infohashes
+	sha1_hash const m_info_hash;
+};
+
+} // namespace libtorrent::dht
+
+#endif // TORRENT_DHT_INDEXER_HPP
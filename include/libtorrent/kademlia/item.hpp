@@ -18,6 +18,8 @@ see LICENSE file.
 #include <libtorrent/span.hpp>
 #include <libtorrent/kademlia/types.hpp>
 
+#include <vector>
+
 namespace libtorrent {
 namespace dht {
 
@@ -35,6 +37,23 @@ TORRENT_EXTRA_EXPORT bool verify_mutable_item(
 	, public_key const& pk
 	, signature const& sig);
 
+// the arguments to verify_mutable_item(), for one of the items passed to
+// verify_mutable_items()
+struct mutable_item_signature
+{
+	span<char const> v;
+	span<char const> salt;
+	sequence_number seq;
+	public_key pk;
+	signature sig;
+};
+
+// verifies the signatures of a number of mutable items at once, with
+// ed25519_verify_batch(). Element ``i`` of the returned vector is what
+// verify_mutable_item() would return for ``items[i]``
+TORRENT_EXTRA_EXPORT std::vector<bool> verify_mutable_items(
+	span<mutable_item_signature const> items);
+
 // TODO: since this is a public function, it should probably be moved
 // out of this header and into one with other public functions.
 
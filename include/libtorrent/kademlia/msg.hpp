@@ -15,6 +15,8 @@ see LICENSE file.
 #include "libtorrent/socket.hpp"
 #include "libtorrent/span.hpp"
 
+#include <optional>
+
 namespace libtorrent {
 
 struct bdecode_node;
@@ -34,6 +36,10 @@ struct msg
 	// the address of the process sending or receiving
 	// the message.
 	udp::endpoint addr;
+
+	// for incoming mutable puts whose signature has already been verified
+	// by a DHT worker thread, this is the result of that verification
+	std::optional<bool> valid_signature;
 };
 
 struct key_desc_t
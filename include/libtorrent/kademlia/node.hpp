@@ -44,6 +44,7 @@ namespace libtorrent {
 namespace dht {
 
 struct traversal_algorithm;
+class indexer;
 struct dht_observer;
 struct msg;
 struct settings;
@@ -158,7 +159,8 @@ public:
 	std::string generate_token(udp::endpoint const& addr, sha1_hash const& info_hash);
 
 	// the returned time is the delay until connection_timeout()
-	// should be called again the next time
+	// should be called again the next time. This also starts, stops and
+	// ticks the indexer, according to settings_pack::dht_indexer_requests
 	time_duration connection_timeout();
 
 	// generates a new secret number used to generate write tokens
@@ -198,6 +200,12 @@ public:
 
 	dht_observer* observer() const { return m_observer; }
 
+	// returns false if the DHT has used up its upload quota
+	// (dht_upload_rate_limit) for now
+	bool has_quota() { return m_sock_man->has_quota(); }
+
+	indexer const* get_indexer() const { return m_indexer.get(); }
+
 	udp protocol() const { return m_protocol.protocol; }
 	char const* protocol_family_name() const { return m_protocol.family_name; }
 	char const* protocol_nodes_key() const { return m_protocol.nodes_key; }
@@ -271,6 +279,10 @@ private:
 
 	dht_storage_interface& m_storage;
 
+	// crawls the DHT, when enabled. Outstanding requests keep it alive until
+	// they complete
+	std::shared_ptr<indexer> m_indexer;
+
 #ifndef TORRENT_DISABLE_LOGGING
 	std::uint32_t m_search_id = 0;
 #endif
@@ -40,6 +40,7 @@
 #include "libtorrent/index_range.hpp"
 #include "libtorrent/info_hash.hpp"
 #include "libtorrent/io_context.hpp"
+#include "libtorrent/io_uring_disk_io.hpp"
 #include "libtorrent/ip_filter.hpp"
 #include "libtorrent/kademlia/announce_flags.hpp"
 #include "libtorrent/kademlia/dht_observer.hpp"
@@ -84,6 +85,7 @@
 #include "libtorrent/piece_block.hpp"
 #include "libtorrent/portmap.hpp"
 #include "libtorrent/posix_disk_io.hpp"
+#include "libtorrent/pread_disk_io.hpp"
 #include "libtorrent/random.hpp"
 #include "libtorrent/read_resume_data.hpp"
 #include "libtorrent/session.hpp"
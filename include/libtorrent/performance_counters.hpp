@@ -179,6 +179,7 @@ namespace libtorrent {
 			num_write_ops,
 			num_read_ops,
 			num_read_back,
+			num_zero_copy_reads,
 
 			file_pool_hits,
 			file_pool_misses,
@@ -238,6 +239,13 @@ namespace libtorrent {
 			dht_invalid_get,
 			dht_invalid_sample_infohashes,
 
+			// cumulative time (in microseconds) spent in the stages of
+			// handling incoming DHT messages
+			dht_decode_time,
+			dht_incoming_time,
+			dht_verify_time,
+			dht_verify_wait_time,
+
 			// uTP counters.
 			utp_packet_loss,
 			utp_timeout,
@@ -252,6 +260,12 @@ namespace libtorrent {
 			utp_invalid_pkts_in,
 			utp_redundant_pkts_in,
 
+			// the number of batches of UDP packets received
+			// from UDP sockets, and the total number of
+			// packets in those batches
+			udp_read_batches,
+			udp_packets_in,
+
 			// the buffer sizes accepted by
 			// socket send calls. The larger
 			// the more efficient. The size is
@@ -306,6 +320,26 @@ namespace libtorrent {
 			socket_recv_size19,
 			socket_recv_size20,
 
+			// the time it took to run the once-per-second
+			// session tick (ticking torrents and peers). The
+			// bucket a tick is counted in is the smallest
+			// 1 << n microseconds it took less than, where
+			// n is the number at the end of the counter name
+			second_tick_time7,
+			second_tick_time8,
+			second_tick_time9,
+			second_tick_time10,
+			second_tick_time11,
+			second_tick_time12,
+			second_tick_time13,
+			second_tick_time14,
+			second_tick_time15,
+			second_tick_time16,
+			second_tick_time17,
+			second_tick_time18,
+			second_tick_time19,
+			second_tick_time20,
+
 			num_stats_counters
 		};
 
@@ -383,6 +417,10 @@ namespace libtorrent {
 			request_latency,
 
 			disk_blocks_in_use,
+			disk_buffer_slabs,
+			disk_buffer_huge_page_slabs,
+			disk_buffer_cached_blocks,
+			disk_buffer_free_slab_blocks,
 			queued_disk_jobs,
 			num_running_disk_jobs,
 			num_read_jobs,
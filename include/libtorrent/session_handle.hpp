@@ -200,6 +200,18 @@ namespace aux { struct torrent; }
 		// see status_flags_t in torrent_handle.
 		void post_torrent_updates(status_flags_t flags = status_flags_t::all());
 
+		// This is a cheaper alternative to post_torrent_updates(). It posts a
+		// state_delta_alert with only the frequently changing status fields,
+		// and only of the torrents where any of those fields changed since the
+		// last state_delta_alert. It considers the same torrents as
+		// post_torrent_updates(), and both functions reset which torrents
+		// have changed. The fields are laid out as one array per field (see
+		// torrent_status_deltas). Pieces, trackers, names and paths are not
+		// included. Use torrent_handle::status() for those. The download
+		// counters only include whole pieces, as if
+		// torrent_handle::query_accurate_download_counters wasn't set.
+		void post_status_deltas();
+
 		// This function will post a session_stats_alert object, containing a
 		// snapshot of the performance counters from the internals of libtorrent.
 		// To interpret these counters, query the session via
@@ -279,6 +291,19 @@ namespace aux { struct torrent; }
 		void async_add_torrent(add_torrent_params&& params);
 		void async_add_torrent(add_torrent_params const& params);
 
+		// adds all torrents in ``params`` to the session, like calling
+		// async_add_torrent() for each of them. The network thread adds them in
+		// batches, letting other work (like socket I/O and timers) run in
+		// between, so the session stays responsive while a large number of
+		// torrents are added, typically at startup. An add_torrent_alert is
+		// posted for each torrent.
+		//
+		// Loading the .torrent files and resume data (with load_torrent_file()
+		// and read_resume_data()) doesn't involve the session and may be done
+		// on any number of threads concurrently. Each thread may call
+		// async_add_torrents() with the torrents it has loaded.
+		void async_add_torrents(std::vector<add_torrent_params> params);
+
 #ifndef BOOST_NO_EXCEPTIONS
 #if TORRENT_ABI_VERSION == 1
 		// deprecated in 0.14
@@ -1013,6 +1013,60 @@ namespace aux {
 			// fragmentation on filesystems like btrfs.
 			disk_disable_copy_on_write,
 
+			// When set, the slabs disk buffers are allocated from are backed
+			// by huge pages. If no huge pages have been reserved by the
+			// system, transparent huge pages are requested instead. This
+			// reduces TLB pressure when hashing and copying disk buffers.
+			// Only supported on Linux.
+			disk_buffer_huge_pages,
+
+			// When set, disk buffers are allocated from slabs local to the
+			// NUMA node the allocating thread is running on. This only makes
+			// a difference on systems with more than one NUMA node. Only
+			// supported on Linux.
+			disk_buffer_numa_arenas,
+
+			// When set, blocks uploaded to peers are sent straight out of the
+			// memory mapped files, rather than being copied into disk buffers
+			// first. This only applies to the mmap disk I/O back-end, and to
+			// peers over plain TCP (not SSL, uTP or encrypted). The pages are
+			// faulted in by the disk thread before the block is handed to the
+			// peer.
+			zero_copy_send,
+
+			// When set, peers joining and leaving the swarm (bitfields and
+			// have-all messages) update the piece picker's availability
+			// buckets incrementally, instead of invalidating them. Without
+			// this, the list of pieces sorted by rarity is rebuilt from scratch
+			// the next time pieces are picked, which is expensive for torrents
+			// with many pieces and many peers coming and going. Changes that
+			// affect most pieces still fall back to a rebuild, when that's
+			// cheaper. This only affects piece pickers created after the
+			// setting is changed.
+			incremental_piece_availability,
+
+			// When set, torrents index their peer lists by a hash of the
+			// peers' IP addresses, and keep their connect candidates sorted
+			// by preference, rather than keeping the peer list sorted by
+			// address and scanning it for candidates. This keeps adding,
+			// removing and connecting to peers cheap for torrents with tens of
+			// thousands of peers. It also means every connect candidate is
+			// considered when picking peers to connect to, not only a window
+			// of the list. This only affects peer lists created after the
+			// setting is changed.
+			hashed_peer_list,
+
+			// When set, each torrent allocates its peer entries out of its own
+			// arrays of densely packed, cache line aligned entries, rather
+			// than out of the pools shared by all torrents. This uses less
+			// memory per known peer in swarms with many peers, and returns
+			// the memory when a torrent's peer list shrinks or the torrent is
+			// removed. The entries have no room for caching the peers' ranks,
+			// which makes picking peers to connect to a bit slower, unless
+			// hashed_peer_list is also set. This only affects peer lists
+			// created after the setting is changed.
+			compact_peer_storage,
+
 			max_bool_setting_internal
 		};
 
@@ -2098,6 +2152,24 @@ namespace aux {
 			// the WebRTC connection timeout used by WebTorrent (in seconds)
 			webtorrent_connection_timeout,
 
+			// the number of threads the DHT uses to verify the signatures of
+			// incoming mutable puts (ed25519). When set to 0 (the default),
+			// signatures are verified on the network thread, as part of
+			// handling the message. This setting takes effect the next time
+			// the DHT is started. It has no effect in simulator builds.
+			dht_worker_threads,
+
+			// the number of requests the DHT indexer keeps in flight, per DHT
+			// node. When set to 0 (the default), the indexer is disabled. When
+			// enabled, each DHT node crawls the network with
+			// ``sample_infohashes`` requests, and asks the nodes that return
+			// info-hashes it hasn't seen recently for the peers of those
+			// info-hashes (with ``get_peers``). The results are posted in
+			// batches, as dht_indexer_alert. The indexer's requests count
+			// towards dht_upload_rate_limit, which needs to be raised for the
+			// indexer to crawl at a meaningful rate.
+			dht_indexer_requests,
+
 			max_int_setting_internal
 		};
 
@@ -97,6 +97,16 @@ namespace aux {
 		// counter. This operation is not cheap and a malicious torrent may pose
 		// a DoS attack, stalling torrent parsing.
 		int max_duplicate_filenames = 500;
+
+		// when loading a v2 torrent, the piece layers are normally validated
+		// against the merkle root of each file. When set to false, they are
+		// only checked for having the correct size, and are validated once the
+		// torrent is added to a session instead (where they are validated
+		// regardless). If they turn out to be invalid at that point, they are
+		// discarded and the hashes are requested from peers. This makes loading
+		// a large number of (large) v2 torrents at startup cheaper, since each
+		// piece layer is only hashed once.
+		bool validate_piece_layers = true;
 	};
 
 	using torrent_info_flags_t = flags::bitfield_flag<std::uint8_t, struct torrent_info_flags_tag>;
@@ -21,10 +21,12 @@ see LICENSE file.
 #include "libtorrent/storage_defs.hpp" // for storage_mode_t
 #include "libtorrent/error_code.hpp"
 #include "libtorrent/aux_/noexcept_movable.hpp"
+#include "libtorrent/flags.hpp"
 
 #include <cstdint>
 #include <string>
 #include <ctime>
+#include <vector>
 
 namespace libtorrent {
 
@@ -258,7 +260,8 @@ TORRENT_VERSION_NAMESPACE_4
 		std::time_t completed_time = 0;
 
 		// the time when we, or one of our peers, last saw a complete copy of
-		// this torrent.
+		// this torrent. What our peers have seen is only included when
+		// querying with torrent_handle::query_last_seen_complete.
 		std::time_t last_seen_complete = 0;
 
 		// The allocation mode for the torrent. See storage_mode_t for the
@@ -573,6 +576,62 @@ TORRENT_VERSION_NAMESPACE_4
 	};
 
 TORRENT_VERSION_NAMESPACE_4_END
+
+	// a bitmask of the fields in torrent_status_deltas
+	using status_fields_t = flags::bitfield_flag<std::uint32_t, struct status_fields_tag>;
+
+namespace status_field {
+
+	// each of these flags corresponds to the torrent_status field, and the
+	// torrent_status_deltas array, of the same name
+	inline constexpr status_fields_t state = 0_bit;
+	inline constexpr status_fields_t flags = 1_bit;
+	inline constexpr status_fields_t errc = 2_bit;
+	inline constexpr status_fields_t progress_ppm = 3_bit;
+	inline constexpr status_fields_t total_done = 4_bit;
+	inline constexpr status_fields_t total_wanted_done = 5_bit;
+	inline constexpr status_fields_t total_wanted = 6_bit;
+	inline constexpr status_fields_t all_time_upload = 7_bit;
+	inline constexpr status_fields_t all_time_download = 8_bit;
+	inline constexpr status_fields_t download_payload_rate = 9_bit;
+	inline constexpr status_fields_t upload_payload_rate = 10_bit;
+	inline constexpr status_fields_t num_peers = 11_bit;
+	inline constexpr status_fields_t num_seeds = 12_bit;
+
+} // namespace status_field
+
+	// the fields of torrent_status that change frequently, for a number of
+	// torrents. This is laid out with one array per field, where element
+	// ``i`` of every array belongs to the torrent ``handles[i]``. For each
+	// torrent, ``changed[i]`` has the status_field flags set for the fields
+	// that changed since the previous delta for that torrent. The other
+	// fields hold their (unchanged) current values. The fields have the same
+	// meaning as in torrent_status, queried without
+	// torrent_handle::query_accurate_download_counters. i.e. ``total_done``
+	// and ``total_wanted_done`` only count pieces that have passed the hash
+	// check.
+	struct TORRENT_EXPORT torrent_status_deltas
+	{
+		int size() const { return int(handles.size()); }
+
+		std::vector<torrent_handle> handles;
+		std::vector<status_fields_t> changed;
+
+		std::vector<torrent_status::state_t> state;
+		std::vector<torrent_flags_t> flags;
+		std::vector<error_code> errc;
+		std::vector<int> progress_ppm;
+		std::vector<std::int64_t> total_done;
+		std::vector<std::int64_t> total_wanted_done;
+		std::vector<std::int64_t> total_wanted;
+		std::vector<std::int64_t> all_time_upload;
+		std::vector<std::int64_t> all_time_download;
+		std::vector<int> download_payload_rate;
+		std::vector<int> upload_payload_rate;
+		std::vector<int> num_peers;
+		std::vector<int> num_seeds;
+	};
+
 } // namespace libtorrent
 
 namespace std {
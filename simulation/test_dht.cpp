@@ -179,6 +179,68 @@ TORRENT_TEST(dht_dual_stack_get_peers)
 #endif // TORRENT_DISABLE_DHT
 }
 
+TORRENT_TEST(dht_indexer)
+{
+#ifndef TORRENT_DISABLE_DHT
+	sim::default_config cfg;
+	sim::simulation sim{ cfg };
+
+	dht_network dht(sim, 100);
+
+	lt::sha1_hash const test_ih("01234567890123456789");
+	bool got_info_hash = false;
+	bool got_peer = false;
+
+	setup_swarm(1, swarm_test::download, sim
+		// add session
+		, [](lt::settings_pack&) {
+		}
+		// add torrent
+		, [](lt::add_torrent_params&) {}
+		// on alert
+		, [&](lt::alert const* a, lt::session&)
+		{
+			if (auto const* p = lt::alert_cast<lt::dht_indexer_alert>(a))
+			{
+				for (auto const& ih : p->info_hashes())
+					got_info_hash |= ih == test_ih;
+				for (auto const& peer : p->peers())
+					got_peer |= peer.first == test_ih && peer.second.port() == 6881;
+			}
+		}
+		// terminate?
+		, [&](int ticks, lt::session& ses) -> bool
+		{
+			if (ticks == 0)
+			{
+				bootstrap_session({&dht}, ses);
+			}
+			if (ticks == 2)
+			{
+				ses.dht_announce(test_ih, 6881);
+			}
+			if (ticks == 4)
+			{
+				// crawl the network for the info-hash we just announced
+				settings_pack pack;
+				pack.set_int(settings_pack::dht_indexer_requests, 8);
+				pack.set_int(settings_pack::dht_upload_rate_limit, 100000);
+				ses.apply_settings(pack);
+			}
+			if (ticks == 30)
+			{
+				TEST_CHECK(got_info_hash);
+				TEST_CHECK(got_peer);
+				return true;
+			}
+			return false;
+		});
+
+	sim.run();
+
+#endif // TORRENT_DISABLE_DHT
+}
+
 TORRENT_TEST(dht_dual_stack_immutable_item)
 {
 #ifndef TORRENT_DISABLE_DHT
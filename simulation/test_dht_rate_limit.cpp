@@ -48,6 +48,8 @@ struct obs : dht::dht_observer
 	bool on_dht_request(string_view /* query */
 		, dht::msg const& /* request */, entry& /* response */) override
 	{ return false; }
+	void indexer_results(std::vector<sha1_hash> const& /* info_hashes */
+		, std::vector<std::pair<sha1_hash, tcp::endpoint>> const& /* peers */) override {}
 
 #ifndef TORRENT_DISABLE_LOGGING
 	bool should_log(module_t) const override { return true; }
@@ -50,10 +50,10 @@ namespace
 		return sett;
 	}
 
-	std::unique_ptr<dht_storage_interface> create_default_dht_storage(
-		settings_interface const& sett)
+	std::unique_ptr<dht_storage_interface> create_dht_storage(
+		settings_interface const& sett, dht_storage_constructor_type const& sc)
 	{
-		std::unique_ptr<dht_storage_interface> s(dht_default_storage_constructor(sett));
+		std::unique_ptr<dht_storage_interface> s(sc(sett));
 		TEST_CHECK(s.get() != nullptr);
 
 		s->update_node_ids({to_hash("0000000000000000000000000000000000000200")});
@@ -88,10 +88,10 @@ void test_expiration(simulation& sim
 	sim.run();
 }
 
-TORRENT_TEST(dht_storage_counters)
+void test_storage_counters(dht_storage_constructor_type const& sc)
 {
 	auto sett = test_settings();
-	std::unique_ptr<dht_storage_interface> s(create_default_dht_storage(sett));
+	std::unique_ptr<dht_storage_interface> s(create_dht_storage(sett, sc));
 
 	TEST_CHECK(s.get() != nullptr);
 
@@ -145,7 +145,17 @@ TORRENT_TEST(dht_storage_counters)
 	test_expiration(sim, hours(1), s, c); // test expiration of everything after 3 hours
 }
 
-TORRENT_TEST(dht_storage_infohashes_sample)
+TORRENT_TEST(dht_storage_counters)
+{
+	test_storage_counters(dht_default_storage_constructor);
+}
+
+TORRENT_TEST(dht_sharded_storage_counters)
+{
+	test_storage_counters(dht_sharded_storage_constructor);
+}
+
+void test_infohashes_sample(dht_storage_constructor_type const& sc)
 {
 	default_config cfg;
 	simulation sim(cfg);
@@ -155,7 +165,7 @@ TORRENT_TEST(dht_storage_infohashes_sample)
 	sett.set_int(settings_pack::dht_max_torrents, 5);
 	sett.set_int(settings_pack::dht_sample_infohashes_interval, 30);
 	sett.set_int(settings_pack::dht_max_infohashes_sample_count, 2);
-	std::unique_ptr<dht_storage_interface> s(create_default_dht_storage(sett));
+	std::unique_ptr<dht_storage_interface> s(create_dht_storage(sett, sc));
 
 	TEST_CHECK(s.get() != nullptr);
 
@@ -192,6 +202,16 @@ TORRENT_TEST(dht_storage_infohashes_sample)
 
 	sim.run();
 }
+
+TORRENT_TEST(dht_storage_infohashes_sample)
+{
+	test_infohashes_sample(dht_default_storage_constructor);
+}
+
+TORRENT_TEST(dht_sharded_storage_infohashes_sample)
+{
+	test_infohashes_sample(dht_sharded_storage_constructor);
+}
 #else
 TORRENT_TEST(disabled) {}
 #endif // TORRENT_DISABLE_DHT
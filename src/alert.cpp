@@ -3118,7 +3118,8 @@ namespace {
 		"block_uploaded", "alerts_dropped", "socks5",
 		"file_prio", "oversized_file", "torrent_conflict",
 		"peer_info", "file_progress", "piece_info",
-		"piece_availability", "tracker_list"
+		"piece_availability", "tracker_list", "state_delta",
+		"dht_indexer"
 		}};
 
 		TORRENT_ASSERT(alert_type >= 0);
@@ -3282,4 +3283,96 @@ namespace {
 #endif
 	}
 
+	state_delta_alert::state_delta_alert(aux::stack_allocator&
+		, torrent_status_deltas d)
+		: deltas(std::move(d))
+	{}
+
+	std::string state_delta_alert::message() const
+	{
+#ifdef TORRENT_DISABLE_ALERT_MSG
+		return {};
+#else
+		char msg[100];
+		std::snprintf(msg, sizeof(msg), "state deltas for %d torrents", deltas.size());
+		return msg;
+#endif
+	}
+
+	dht_indexer_alert::dht_indexer_alert(aux::stack_allocator& alloc
+		, std::vector<sha1_hash> const& info_hashes
+		, std::vector<std::pair<sha1_hash, tcp::endpoint>> const& peers)
+		: m_alloc(alloc)
+		, m_num_info_hashes(aux::numeric_cast<int>(info_hashes.size()))
+	{
+		m_info_hashes_idx = alloc.allocate(m_num_info_hashes * 20);
+
+		// a batch may have peers but no new info-hashes, that's not a
+		// failure to allocate
+		if (m_info_hashes_idx.is_valid())
+		{
+			char* ptr = alloc.ptr(m_info_hashes_idx);
+			std::memcpy(ptr, info_hashes.data(), info_hashes.size() * 20);
+		}
+		else
+		{
+			m_num_info_hashes = 0;
+		}
+
+		// the peers are stored the same way as DHT nodes are
+		std::vector<std::pair<sha1_hash, udp::endpoint>> p;
+		p.reserve(peers.size());
+		for (auto const& e : peers)
+			p.emplace_back(e.first, udp::endpoint(e.second.address(), e.second.port()));
+
+		std::tie(m_v4_num_peers, m_v4_peers_idx, m_v6_num_peers, m_v6_peers_idx)
+			= write_nodes(alloc, p);
+	}
+
+	std::string dht_indexer_alert::message() const
+	{
+#ifdef TORRENT_DISABLE_ALERT_MSG
+		return {};
+#else
+		char msg[200];
+		std::snprintf(msg, sizeof(msg), "DHT indexer: %d info-hashes, %d peers"
+			, m_num_info_hashes, num_peers());
+		return msg;
+#endif
+	}
+
+	int dht_indexer_alert::num_info_hashes() const
+	{
+		return m_num_info_hashes;
+	}
+
+	std::vector<sha1_hash> dht_indexer_alert::info_hashes() const
+	{
+		aux::vector<sha1_hash> info_hashes;
+		info_hashes.resize(m_num_info_hashes);
+
+		char const* ptr = m_alloc.get().ptr(m_info_hashes_idx);
+		std::memcpy(info_hashes.data(), ptr, info_hashes.size() * 20);
+
+		return TORRENT_RVO(info_hashes);
+	}
+
+	int dht_indexer_alert::num_peers() const
+	{
+		return m_v4_num_peers + m_v6_num_peers;
+	}
+
+	std::vector<std::pair<sha1_hash, tcp::endpoint>> dht_indexer_alert::peers() const
+	{
+		std::vector<std::pair<sha1_hash, udp::endpoint>> const p = read_nodes(m_alloc.get()
+			, m_v4_num_peers, m_v4_peers_idx
+			, m_v6_num_peers, m_v6_peers_idx);
+
+		std::vector<std::pair<sha1_hash, tcp::endpoint>> ret;
+		ret.reserve(p.size());
+		for (auto const& e : p)
+			ret.emplace_back(e.first, tcp::endpoint(e.second.address(), e.second.port()));
+		return ret;
+	}
+
 } // namespace libtorrent
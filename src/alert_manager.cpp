@@ -14,6 +14,8 @@ see LICENSE file.
 #include "libtorrent/aux_/alert_manager.hpp"
 #include "libtorrent/alert_types.hpp"
 
+#include <algorithm> // for inplace_merge
+
 #ifndef TORRENT_DISABLE_EXTENSIONS
 #include "libtorrent/extensions.hpp"
 #include <memory> // for shared_ptr
@@ -21,36 +23,76 @@ see LICENSE file.
 
 namespace libtorrent::aux {
 
+namespace {
+
+	int thread_shard_index()
+	{
+		static std::atomic<int> next_index{0};
+		thread_local int const idx = next_index++ % alert_manager::num_shards;
+		return idx;
+	}
+}
+
 	alert_manager::alert_manager(int const queue_limit, alert_category_t const alert_mask)
 		: m_alert_mask(alert_mask)
 		, m_queue_size_limit(queue_limit)
-	{}
+	{
+		for (auto& s : m_shards)
+			for (auto& a : s.allocations)
+				a.reset(++m_generation);
+	}
 
 	alert_manager::~alert_manager() = default;
 
+	alert_manager::shard& alert_manager::current_shard()
+	{
+		return m_shards[thread_shard_index()];
+	}
+
 	alert* alert_manager::wait_for_alert(time_duration max_wait)
 	{
 		std::unique_lock<std::recursive_mutex> lock(m_mutex);
 
-		if (!m_alerts[m_generation & 1].empty())
-			return m_alerts[m_generation & 1].front();
+		// returns the oldest alert in the queue, or nullptr if it's empty
+		auto front = [this]
+		{
+			alert* ret = nullptr;
+			std::uint64_t ret_seq = 0;
+			for (auto& s : m_shards)
+			{
+				std::lock_guard<std::mutex> l(s.mutex);
+				int const idx = s.generation & 1;
+				if (s.alerts[idx].empty()) continue;
+				std::uint64_t const seq = s.sequence[idx].front();
+				if (ret != nullptr && seq > ret_seq) continue;
+				ret = s.alerts[idx].front();
+				ret_seq = seq;
+			}
+			return ret;
+		};
+
+		if (alert* a = front()) return a;
 
 		// this call can be interrupted prematurely by other signals
 		m_condition.wait_for(lock, max_wait);
-		if (!m_alerts[m_generation & 1].empty())
-			return m_alerts[m_generation & 1].front();
+		return front();
+	}
 
-		return nullptr;
+	void alert_manager::mark_dropped(int const type)
+	{
+		std::lock_guard<std::recursive_mutex> lock(m_mutex);
+		m_dropped.set(std::size_t(type));
 	}
 
-	void alert_manager::maybe_notify(alert* a)
+	void alert_manager::maybe_notify(alert* a, bool const first)
 	{
-		if (m_alerts[m_generation & 1].size() == 1)
+		if (first)
 		{
 			// we just posted to an empty queue. If anyone is waiting for
 			// alerts, we need to notify them. Also (potentially) call the
 			// user supplied m_notify callback to let the client wake up its
 			// message loop to poll for alerts.
+			std::lock_guard<std::recursive_mutex> lock(m_mutex);
 			if (m_notify) m_notify();
 
 			// TODO: 2 keep a count of the number of threads waiting. Only if it's
@@ -70,7 +112,7 @@ namespace libtorrent::aux {
 	{
 		std::unique_lock<std::recursive_mutex> lock(m_mutex);
 		m_notify = fun;
-		if (!m_alerts[m_generation & 1].empty())
+		if (m_num_queued.load(std::memory_order_relaxed) > 0)
 		{
 			if (m_notify) m_notify();
 		}
@@ -87,37 +129,89 @@ namespace libtorrent::aux {
 	{
 		std::lock_guard<std::recursive_mutex> lock(m_mutex);
 
-		if (m_alerts[m_generation & 1].empty())
-		{
-			alerts.clear();
-			return;
-		}
+		alerts.clear();
+		if (m_num_queued.load(std::memory_order_relaxed) == 0) return;
 
 		if (m_dropped.any()) {
 			emplace_alert<alerts_dropped_alert>(m_dropped);
 			m_dropped.reset();
 		}
 
-		m_alerts[m_generation & 1].get_pointers(alerts);
+		// collect the alerts from every shard, and swap its buffers. Each shard
+		// is in posting order already, so they just need to be merged
+		m_merge.clear();
+		std::vector<std::size_t> runs;
+		std::vector<alert*> pointers;
+		for (auto& s : m_shards)
+		{
+			std::lock_guard<std::mutex> l(s.mutex);
+			int const idx = s.generation & 1;
+			if (s.alerts[idx].empty()) continue;
+
+			s.alerts[idx].get_pointers(pointers);
+			auto const& seq = s.sequence[idx];
+			TORRENT_ASSERT(seq.size() == pointers.size());
+			for (std::size_t i = 0; i < pointers.size(); ++i)
+				m_merge.emplace_back(seq[i], pointers[i]);
+			runs.push_back(m_merge.size());
+
+			// swap buffers
+			s.generation += 1;
+			int const next = s.generation & 1;
+			// clear the one we will start writing to now
+			s.alerts[next].clear();
+			s.sequence[next].clear();
+			s.allocations[next].reset(++m_generation);
+			m_num_queued.fetch_sub(int(pointers.size()), std::memory_order_relaxed);
+		}
+
+		// merge the runs pairwise, until there's only one left
+		auto by_seq = [](std::pair<std::uint64_t, alert*> const& lhs
+			, std::pair<std::uint64_t, alert*> const& rhs)
+		{ return lhs.first < rhs.first; };
+		while (runs.size() > 1)
+		{
+			std::vector<std::size_t> merged;
+			std::size_t begin = 0;
+			for (std::size_t i = 0; i < runs.size(); i += 2)
+			{
+				if (i + 1 < runs.size())
+				{
+					std::inplace_merge(m_merge.begin() + std::ptrdiff_t(begin)
+						, m_merge.begin() + std::ptrdiff_t(runs[i])
+						, m_merge.begin() + std::ptrdiff_t(runs[i + 1]), by_seq);
+					begin = runs[i + 1];
+				}
+				else
+				{
+					begin = runs[i];
+				}
+				merged.push_back(begin);
+			}
+			runs.swap(merged);
+		}
+
+		alerts.reserve(m_merge.size());
+		for (auto const& e : m_merge) alerts.push_back(e.second);
 
-		// swap buffers
-		m_generation += 1;
-		// clear the one we will start writing to now
-		m_alerts[m_generation & 1].clear();
-		m_allocations[m_generation & 1].reset(m_generation);
+		// a producer may have counted its alert before we drained its shard
+		// (seeing a non-empty queue, so not notifying) but queued it after.
+		// Those alerts are still counted here, and nobody has been notified
+		// about them yet
+		if (m_num_queued.load(std::memory_order_relaxed) > 0)
+		{
+			if (m_notify) m_notify();
+			m_condition.notify_all();
+		}
 	}
 
 	bool alert_manager::pending() const
 	{
-		std::lock_guard<std::recursive_mutex> lock(m_mutex);
-		return !m_alerts[m_generation & 1].empty();
+		return m_num_queued.load(std::memory_order_relaxed) > 0;
 	}
 
 	int alert_manager::set_alert_queue_size_limit(int queue_size_limit_)
 	{
-		std::lock_guard<std::recursive_mutex> lock(m_mutex);
-
-		std::swap(m_queue_size_limit, queue_size_limit_);
-		return queue_size_limit_;
+		return m_queue_size_limit.exchange(queue_size_limit_);
 	}
 }
@@ -123,13 +123,18 @@ namespace libtorrent::aux {
 		std::int64_t dt_milliseconds = total_milliseconds(dt);
 		if (dt_milliseconds > 3000) dt_milliseconds = 3000;
 
-		// for each bandwidth channel, call update_quota(dt)
-
-		std::vector<bandwidth_channel*> channels;
-
-		std::vector<bw_request> queue;
-
-		for (auto i = m_queue.begin(); i != m_queue.end();)
+		// requests that are satisfied (or whose peer is disconnecting) are
+		// moved to this list and the remaining ones are compacted towards the
+		// front of m_queue, preserving their order. Erasing them one at a
+		// time would make this quadratic in the number of queued requests.
+		// The vectors are members to reuse their memory across ticks
+		std::vector<bw_request> done;
+		done.swap(m_done);
+		TORRENT_ASSERT(done.empty());
+		m_channels.clear();
+
+		auto out = m_queue.begin();
+		for (auto i = m_queue.begin(); i != m_queue.end(); ++i)
 		{
 			if (i->peer->is_disconnecting())
 			{
@@ -144,8 +149,7 @@ namespace libtorrent::aux {
 				}
 
 				i->assigned = 0;
-				queue.push_back(std::move(*i));
-				i = m_queue.erase(i);
+				done.push_back(std::move(*i));
 				continue;
 			}
 			for (int j = 0; j < bw_request::max_bandwidth_channels && i->channel[j]; ++j)
@@ -153,26 +157,31 @@ namespace libtorrent::aux {
 				bandwidth_channel* bwc = i->channel[j];
 				bwc->tmp = 0;
 			}
-			++i;
+			if (out != i) *out = std::move(*i);
+			++out;
 		}
+		m_queue.erase(out, m_queue.end());
 
+		// for each bandwidth channel, sum up the priorities of the requests
+		// waiting for it, and call update_quota(dt)
 		for (auto const& r : m_queue)
 		{
 			for (int j = 0; j < bw_request::max_bandwidth_channels && r.channel[j]; ++j)
 			{
 				bandwidth_channel* bwc = r.channel[j];
-				if (bwc->tmp == 0) channels.push_back(bwc);
+				if (bwc->tmp == 0) m_channels.push_back(bwc);
 				TORRENT_ASSERT(INT_MAX - bwc->tmp > r.priority);
 				bwc->tmp += r.priority;
 			}
 		}
 
-		for (auto const& ch : channels)
+		for (auto const& ch : m_channels)
 		{
 			ch->update_quota(int(dt_milliseconds));
 		}
 
-		for (auto i = m_queue.begin(); i != m_queue.end();)
+		out = m_queue.begin();
+		for (auto i = m_queue.begin(); i != m_queue.end(); ++i)
 		{
 			int a = i->assign_bandwidth();
 			if (i->assigned == i->request_size
@@ -180,21 +189,25 @@ namespace libtorrent::aux {
 			{
 				a += i->request_size - i->assigned;
 				TORRENT_ASSERT(i->assigned <= i->request_size);
-				queue.push_back(std::move(*i));
-				i = m_queue.erase(i);
+				done.push_back(std::move(*i));
 			}
 			else
 			{
-				++i;
+				if (out != i) *out = std::move(*i);
+				++out;
 			}
 			m_queued_bytes -= a;
 		}
+		m_queue.erase(out, m_queue.end());
 
-		while (!queue.empty())
+		// the peers may request more bandwidth from within the callback,
+		// which adds them back to m_queue
+		while (!done.empty())
 		{
-			bw_request& bwr = queue.back();
+			bw_request& bwr = done.back();
 			bwr.peer->assign_bandwidth(m_channel, bwr.assigned);
-			queue.pop_back();
+			done.pop_back();
 		}
+		m_done.swap(done);
 	}
 }
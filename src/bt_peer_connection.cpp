@@ -519,6 +519,15 @@ namespace {
 		return !m_sent_handshake || m_state < state_t::read_packet_size;
 	}
 
+	bool bt_peer_connection::supports_zero_copy_send() const
+	{
+#if !defined TORRENT_DISABLE_ENCRYPTION
+		// encrypted blocks are copied before being encrypted in place
+		if (m_encrypted && !m_enc_handler.is_send_plaintext()) return false;
+#endif
+		return peer_connection::supports_zero_copy_send();
+	}
+
 #if !defined TORRENT_DISABLE_ENCRYPTION
 
 	void bt_peer_connection::write_pe1_2_dhkey()
@@ -78,6 +78,57 @@ namespace {
 		std::memset(&info[0], 0, sizeof(std::uint32_t) * 4);
 #endif
 	}
+
+	// like cpuid(), but for leaves that take a sub-leaf in ECX. Returns
+	// zeroes if the leaf is not supported
+	void cpuid_count(std::uint32_t* info, int type, int sub) noexcept
+	{
+#if defined _MSC_VER
+		std::uint32_t max_leaf[4] = {0};
+		__cpuid(reinterpret_cast<int*>(max_leaf), 0);
+		if (max_leaf[0] < std::uint32_t(type))
+		{
+			info[0] = info[1] = info[2] = info[3] = 0;
+			return;
+		}
+		__cpuidex(reinterpret_cast<int*>(info), type, sub);
+#elif defined __GNUC__
+		if (__get_cpuid_max(0, nullptr) < std::uint32_t(type))
+		{
+			info[0] = info[1] = info[2] = info[3] = 0;
+			return;
+		}
+		__cpuid_count(std::uint32_t(type), std::uint32_t(sub), info[0], info[1], info[2], info[3]);
+#else
+		TORRENT_UNUSED(type);
+		TORRENT_UNUSED(sub);
+		std::memset(&info[0], 0, sizeof(std::uint32_t) * 4);
+#endif
+	}
+
+	// returns true if the operating system saves the AVX (YMM) registers on
+	// context switches
+	bool os_supports_avx() noexcept
+	{
+		std::uint32_t cpui[4] = {0};
+		cpuid(cpui, 1);
+		// OSXSAVE and AVX
+		if ((cpui[2] & (1 << 27)) == 0 || (cpui[2] & (1 << 28)) == 0)
+			return false;
+#if defined _MSC_VER
+		std::uint64_t const xcr0 = _xgetbv(0);
+#elif defined __GNUC__
+		std::uint32_t eax = 0;
+		std::uint32_t edx = 0;
+		// xgetbv, spelled out for old assemblers
+		__asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c"(0));
+		std::uint64_t const xcr0 = (std::uint64_t(edx) << 32) | eax;
+#else
+		std::uint64_t const xcr0 = 0;
+#endif
+		// XMM and YMM state
+		return (xcr0 & 6) == 6;
+	}
 #endif
 
 	bool supports_sse42() noexcept
@@ -102,6 +153,33 @@ namespace {
 #endif
 	}
 
+	bool supports_avx2() noexcept
+	{
+#if TORRENT_HAS_SSE
+		if (!os_supports_avx()) return false;
+		std::uint32_t cpui[4] = {0};
+		cpuid_count(cpui, 7, 0);
+		return (cpui[1] & (1 << 5)) != 0;
+#else
+		return false;
+#endif
+	}
+
+	bool supports_sha_ni() noexcept
+	{
+#if TORRENT_HAS_SSE
+		// the SHA extensions are used together with SSSE3 and SSE4.1
+		std::uint32_t cpui[4] = {0};
+		cpuid(cpui, 1);
+		if ((cpui[2] & (1 << 9)) == 0 || (cpui[2] & (1 << 19)) == 0)
+			return false;
+		cpuid_count(cpui, 7, 0);
+		return (cpui[1] & (1 << 29)) != 0;
+#else
+		return false;
+#endif
+	}
+
 	bool supports_arm_neon() noexcept
 	{
 #if TORRENT_HAS_ARM_NEON && TORRENT_HAS_AUXV
@@ -144,6 +222,8 @@ namespace {
 
 	bool const sse42_support = supports_sse42();
 	bool const mmx_support = supports_mmx();
+	bool const avx2_support = supports_avx2();
+	bool const sha_ni_support = supports_sha_ni();
 	bool const arm_neon_support = supports_arm_neon();
 	bool const arm_crc32c_support = supports_arm_crc32c();
 } }
@@ -16,6 +16,7 @@ see LICENSE file.
 #include "libtorrent/io_context.hpp"
 #include "libtorrent/disk_observer.hpp"
 #include "libtorrent/disk_interface.hpp" // for default_block_size
+#include "libtorrent/performance_counters.hpp"
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 
@@ -51,7 +52,8 @@ namespace {
 } // anonymous namespace
 
 	disk_buffer_pool::disk_buffer_pool(io_context& ios)
-		: m_in_use(0)
+		: m_allocator(default_block_size)
+		, m_in_use(0)
 		, m_max_use(64)
 		, m_low_watermark(std::max(m_max_use - 32, 0))
 		, m_exceeded_max_size(false)
@@ -70,11 +72,12 @@ namespace {
 	// and if we're in fact below the low watermark. If so, we need to
 	// post the notification messages to the peers that are waiting for
 	// more buffers to received data into
-	void disk_buffer_pool::check_buffer_level(std::unique_lock<std::mutex>& l)
+	void disk_buffer_pool::check_buffer_level()
 	{
-		TORRENT_ASSERT(l.owns_lock());
 		if (!m_exceeded_max_size || m_in_use > m_low_watermark) return;
 
+		std::unique_lock<std::mutex> l(m_pool_mutex);
+		if (!m_exceeded_max_size) return;
 		m_exceeded_max_size = false;
 
 		std::vector<std::weak_ptr<disk_observer>> cbs;
@@ -85,8 +88,7 @@ namespace {
 
 	char* disk_buffer_pool::allocate_buffer(char const* category)
 	{
-		std::unique_lock<std::mutex> l(m_pool_mutex);
-		return allocate_buffer_impl(l, category);
+		return allocate_buffer_impl(category);
 	}
 
 	// we allow allocating more blocks even after we exceed the max size,
@@ -99,26 +101,29 @@ namespace {
 	char* disk_buffer_pool::allocate_buffer(bool& exceeded
 		, std::shared_ptr<disk_observer> o, char const* category)
 	{
-		std::unique_lock<std::mutex> l(m_pool_mutex);
-		char* ret = allocate_buffer_impl(l, category);
+		char* ret = allocate_buffer_impl(category);
 		if (m_exceeded_max_size)
 		{
-			exceeded = true;
-			if (o) m_observers.push_back(std::move(o));
+			// check again under the lock, in case the level just dropped
+			// below the low watermark and the observers were called. We must
+			// not add an observer to a list that won't be called again
+			std::unique_lock<std::mutex> l(m_pool_mutex);
+			if (m_exceeded_max_size)
+			{
+				exceeded = true;
+				if (o) m_observers.push_back(std::move(o));
+			}
 		}
 		return ret;
 	}
 
-	char* disk_buffer_pool::allocate_buffer_impl(std::unique_lock<std::mutex>& l
-		, char const* category)
+	char* disk_buffer_pool::allocate_buffer_impl(char const* category)
 	{
 		TORRENT_ASSERT(m_settings_set);
 		TORRENT_ASSERT(m_magic == 0x1337);
-		TORRENT_ASSERT(l.owns_lock());
-		TORRENT_UNUSED(l);
 		TORRENT_UNUSED(category);
 
-		char* ret = static_cast<char*>(std::malloc(default_block_size));
+		char* ret = m_allocator.allocate();
 
 		if (ret == nullptr)
 		{
@@ -126,25 +131,27 @@ namespace {
 			return nullptr;
 		}
 
-		++m_in_use;
+		int const in_use = ++m_in_use;
 
 #if TORRENT_DEBUG_BUFFER_POOL
 		try
 		{
+			std::unique_lock<std::mutex> l(m_pool_mutex);
 			auto const [it, added] = m_buffers_in_use.insert({ret, category});
 			TORRENT_UNUSED(it);
 			TORRENT_ASSERT(added);
+			m_histogram[category] += 1;
+			maybe_log();
 		}
 		catch (...)
 		{
-			free_buffer_impl(ret, l);
+			free_buffer_impl(ret);
 			return nullptr;
 		}
-		m_histogram[category] += 1;
-		maybe_log();
 #endif
 
-		if (m_in_use >= m_low_watermark + (m_max_use - m_low_watermark)
+		int const low_watermark = m_low_watermark;
+		if (in_use >= low_watermark + (m_max_use - low_watermark)
 			/ 2 && !m_exceeded_max_size)
 		{
 			m_exceeded_max_size = true;
@@ -158,22 +165,20 @@ namespace {
 		// sort the pointers in order to maximize cache hits
 		std::sort(bufvec.begin(), bufvec.end());
 
-		std::unique_lock<std::mutex> l(m_pool_mutex);
 		for (char* buf : bufvec)
 		{
 			remove_buffer_in_use(buf);
-			free_buffer_impl(buf, l);
+			free_buffer_impl(buf);
 		}
 
-		check_buffer_level(l);
+		check_buffer_level();
 	}
 
 	void disk_buffer_pool::free_buffer(char* buf)
 	{
-		std::unique_lock<std::mutex> l(m_pool_mutex);
 		remove_buffer_in_use(buf);
-		free_buffer_impl(buf, l);
-		check_buffer_level(l);
+		free_buffer_impl(buf);
+		check_buffer_level();
 	}
 
 	void disk_buffer_pool::set_settings(settings_interface const& sett)
@@ -182,12 +187,15 @@ namespace {
 
 		int const pool_size = std::max(1, sett.get_int(settings_pack::max_queued_disk_bytes) / default_block_size);
 		m_max_use = pool_size;
-		m_low_watermark = m_max_use / 2;
-		if (m_in_use >= m_max_use && !m_exceeded_max_size)
+		m_low_watermark = pool_size / 2;
+		if (m_in_use >= pool_size && !m_exceeded_max_size)
 		{
 			m_exceeded_max_size = true;
 		}
 
+		m_allocator.set_huge_pages(sett.get_bool(settings_pack::disk_buffer_huge_pages));
+		m_allocator.set_numa(sett.get_bool(settings_pack::disk_buffer_numa_arenas));
+
 #if TORRENT_USE_ASSERTS
 		m_settings_set = true;
 #endif
@@ -197,6 +205,7 @@ namespace {
 	{
 		TORRENT_UNUSED(buf);
 #if TORRENT_DEBUG_BUFFER_POOL
+		std::unique_lock<std::mutex> l(m_pool_mutex);
 		auto i = m_buffers_in_use.find(buf);
 		TORRENT_ASSERT(i != m_buffers_in_use.end());
 		TORRENT_ASSERT(m_histogram[i->second] > 0);
@@ -237,18 +246,26 @@ namespace {
 	}
 #endif
 
-	void disk_buffer_pool::free_buffer_impl(char* buf, std::unique_lock<std::mutex>& l)
+	void disk_buffer_pool::free_buffer_impl(char* buf)
 	{
 		TORRENT_ASSERT(buf);
 		TORRENT_ASSERT(m_magic == 0x1337);
 		TORRENT_ASSERT(m_settings_set);
-		TORRENT_ASSERT(l.owns_lock());
-		TORRENT_UNUSED(l);
 
-		std::free(buf);
+		m_allocator.free(buf);
 
 		--m_in_use;
 	}
 
+	void disk_buffer_pool::update_stats_counters(counters& c) const
+	{
+		auto const st = m_allocator.stats();
+		c.set_value(counters::disk_blocks_in_use, m_in_use);
+		c.set_value(counters::disk_buffer_slabs, st.slabs);
+		c.set_value(counters::disk_buffer_huge_page_slabs, st.huge_page_slabs);
+		c.set_value(counters::disk_buffer_cached_blocks, st.cached_blocks);
+		c.set_value(counters::disk_buffer_free_slab_blocks, st.free_slab_blocks);
+	}
+
 }
 }
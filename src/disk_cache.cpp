@@ -0,0 +1,299 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "libtorrent/aux_/disk_cache.hpp"
+#include "libtorrent/aux_/pread_disk_job.hpp"
+#include "libtorrent/aux_/alloca.hpp"
+#include "libtorrent/assert.hpp"
+
+#include <vector>
+#include <algorithm>
+
+namespace libtorrent::aux {
+
+	span<char const> cached_block_entry::buf() const
+	{
+		if (write_job == nullptr) return {};
+		auto const& w = std::get<job::write>(write_job->action);
+		return {w.buf.data(), w.buffer_size};
+	}
+
+	cached_piece_entry::cached_piece_entry(piece_location const& loc, int const num)
+		: piece(loc)
+		, blocks_in_piece(num)
+		, blocks(new cached_block_entry[std::size_t(num)])
+	{}
+
+	int disk_cache::insert(piece_location const loc, int const block_idx
+		, int const blocks_in_piece, pread_disk_job* j)
+	{
+		TORRENT_ASSERT(block_idx >= 0);
+		TORRENT_ASSERT(block_idx < blocks_in_piece);
+		std::unique_lock<std::mutex> l(m_mutex);
+
+		auto it = m_pieces.find(loc);
+		if (it == m_pieces.end())
+			it = m_pieces.emplace(loc, cached_piece_entry(loc, blocks_in_piece)).first;
+
+		cached_piece_entry& pe = it->second;
+		TORRENT_ASSERT(pe.blocks_in_piece == blocks_in_piece);
+		cached_block_entry& blk = pe.blocks[block_idx];
+
+		// the peer_connection never issues two writes for the same block until
+		// the first one has completed. The first one completes when it's
+		// flushed, but it may still linger in the cache if the piece is pinned
+		// by a hash job. In that case the caller has to write this block
+		// directly instead
+		if (blk.write_job != nullptr)
+		{
+			TORRENT_ASSERT(blk.flushed);
+			TORRENT_ASSERT(!blk.flushing);
+			return -1;
+		}
+
+		blk.write_job = j;
+		blk.flushed = false;
+		blk.flushing = false;
+		pe.last_write = clock_type::now();
+		++pe.num_blocks;
+		return ++m_blocks;
+	}
+
+	char const* disk_cache::block_buffer(piece_location const loc, int const block_idx) const
+	{
+		auto const it = m_pieces.find(loc);
+		if (it == m_pieces.end()) return nullptr;
+		cached_piece_entry const& pe = it->second;
+		if (block_idx < 0 || block_idx >= pe.blocks_in_piece) return nullptr;
+		return pe.blocks[block_idx].buf().data();
+	}
+
+	bool disk_cache::pin(piece_location const loc, int const first_block
+		, span<span<char const>> bufs)
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		auto const it = m_pieces.find(loc);
+		if (it == m_pieces.end()) return false;
+
+		cached_piece_entry& pe = it->second;
+		++pe.readers;
+
+		int const end = std::min(pe.blocks_in_piece, first_block + int(bufs.size()));
+		for (int i = first_block; i < end; ++i)
+			bufs[i - first_block] = pe.blocks[i].buf();
+		return true;
+	}
+
+	void disk_cache::unpin(piece_location const loc, jobqueue_t& completed)
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		auto const it = m_pieces.find(loc);
+		TORRENT_ASSERT(it != m_pieces.end());
+		if (it == m_pieces.end()) return;
+
+		cached_piece_entry& pe = it->second;
+		TORRENT_ASSERT(pe.readers > 0);
+		--pe.readers;
+		if (release_flushed(pe, completed))
+			m_pieces.erase(it);
+	}
+
+	bool disk_cache::release_flushed(cached_piece_entry& pe, jobqueue_t& completed)
+	{
+		if (pe.readers > 0) return false;
+
+		for (int i = 0; i < pe.blocks_in_piece; ++i)
+		{
+			cached_block_entry& blk = pe.blocks[i];
+			if (blk.write_job == nullptr || !blk.flushed) continue;
+			TORRENT_ASSERT(!blk.flushing);
+			completed.push_back(blk.write_job);
+			blk.write_job = nullptr;
+			blk.flushed = false;
+			--pe.num_blocks;
+			--m_blocks;
+		}
+		return pe.num_blocks == 0;
+	}
+
+	void disk_cache::flush_piece_impl(std::unique_lock<std::mutex>& l
+		, cached_piece_entry& pe, write_fun const& f, jobqueue_t& completed)
+	{
+		TORRENT_ASSERT(l.owns_lock());
+
+		// claim all blocks that need flushing. While they're marked as
+		// flushing, nobody else will touch them, and the piece entry won't be
+		// removed (since num_blocks > 0)
+		int const num = pe.blocks_in_piece;
+		TORRENT_ALLOCA(bufs, span<char const>, num);
+		TORRENT_ALLOCA(claimed, bool, num);
+		int num_claimed = 0;
+		for (int i = 0; i < num; ++i)
+		{
+			cached_block_entry& blk = pe.blocks[i];
+			claimed[i] = blk.write_job != nullptr && !blk.flushing && !blk.flushed;
+			if (!claimed[i]) continue;
+			blk.flushing = true;
+			bufs[i] = blk.buf();
+			++num_claimed;
+		}
+		if (num_claimed == 0) return;
+		m_flushing_blocks += num_claimed;
+
+		// the readers count keeps the piece entry alive, even if other threads
+		// release all blocks while we're not holding the mutex
+		++pe.readers;
+		l.unlock();
+
+		// now, write runs of adjacent blocks
+		TORRENT_ALLOCA(errors, storage_error, num);
+		int i = 0;
+		while (i < num)
+		{
+			if (!claimed[i]) { ++i; continue; }
+			int const start = i;
+			while (i < num && claimed[i]) ++i;
+			storage_error err;
+			f(pe.blocks[start].write_job, start * default_block_size
+				, bufs.subspan(start, i - start), err);
+			for (int k = start; k < i; ++k) errors[k] = err;
+		}
+
+		l.lock();
+		for (int k = 0; k < num; ++k)
+		{
+			if (!claimed[k]) continue;
+			cached_block_entry& blk = pe.blocks[k];
+			blk.flushing = false;
+			blk.flushed = true;
+			if (errors[k]) blk.write_job->error = errors[k];
+		}
+		m_flushing_blocks -= num_claimed;
+		--pe.readers;
+
+		if (release_flushed(pe, completed))
+			m_pieces.erase(pe.piece);
+	}
+
+	void disk_cache::flush_piece(piece_location const loc, write_fun const& f
+		, jobqueue_t& completed)
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		auto const it = m_pieces.find(loc);
+		if (it == m_pieces.end()) return;
+		flush_piece_impl(l, it->second, f, completed);
+	}
+
+	void disk_cache::flush_storage(storage_index_t const st, write_fun const& f
+		, jobqueue_t& completed)
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		std::vector<piece_location> pieces;
+		for (auto const& p : m_pieces)
+			if (p.first.torrent == st) pieces.push_back(p.first);
+
+		for (auto const& loc : pieces)
+		{
+			auto const it = m_pieces.find(loc);
+			if (it == m_pieces.end()) continue;
+			flush_piece_impl(l, it->second, f, completed);
+		}
+	}
+
+	void disk_cache::flush_to_limit(int const target, write_fun const& f
+		, jobqueue_t& completed)
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		if (m_blocks - m_flushing_blocks <= target) return;
+
+		// flush the pieces with the most blocks first, since they result in
+		// the largest (and fewest) write calls
+		std::vector<std::pair<int, piece_location>> pieces;
+		pieces.reserve(m_pieces.size());
+		for (auto const& p : m_pieces)
+			pieces.emplace_back(p.second.num_blocks, p.first);
+		std::sort(pieces.begin(), pieces.end()
+			, [](auto const& lhs, auto const& rhs) { return lhs.first > rhs.first; });
+
+		for (auto const& p : pieces)
+		{
+			if (m_blocks - m_flushing_blocks <= target) break;
+			auto const it = m_pieces.find(p.second);
+			if (it == m_pieces.end()) continue;
+			flush_piece_impl(l, it->second, f, completed);
+		}
+	}
+
+	void disk_cache::flush_stale(time_point const cutoff, write_fun const& f
+		, jobqueue_t& completed)
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		std::vector<piece_location> pieces;
+		for (auto const& p : m_pieces)
+			if (p.second.last_write < cutoff) pieces.push_back(p.first);
+
+		for (auto const& loc : pieces)
+		{
+			auto const it = m_pieces.find(loc);
+			if (it == m_pieces.end()) continue;
+			flush_piece_impl(l, it->second, f, completed);
+		}
+	}
+
+	void disk_cache::flush_all(write_fun const& f, jobqueue_t& completed)
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		std::vector<piece_location> pieces;
+		pieces.reserve(m_pieces.size());
+		for (auto const& p : m_pieces) pieces.push_back(p.first);
+
+		for (auto const& loc : pieces)
+		{
+			auto const it = m_pieces.find(loc);
+			if (it == m_pieces.end()) continue;
+			flush_piece_impl(l, it->second, f, completed);
+		}
+	}
+
+	void disk_cache::clear_piece(piece_location const loc, jobqueue_t& completed)
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		auto const it = m_pieces.find(loc);
+		if (it == m_pieces.end()) return;
+
+		cached_piece_entry& pe = it->second;
+		for (int i = 0; i < pe.blocks_in_piece; ++i)
+		{
+			cached_block_entry& blk = pe.blocks[i];
+			// blocks that are being flushed right now will be released by the
+			// thread flushing them
+			if (blk.write_job == nullptr || blk.flushing) continue;
+			// unflushed blocks are marked as flushed without writing them.
+			// They are released below (if there are no readers) or when the
+			// last reader unpins the piece
+			blk.flushed = true;
+		}
+
+		if (release_flushed(pe, completed))
+			m_pieces.erase(it);
+	}
+
+	int disk_cache::size() const
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		return m_blocks;
+	}
+
+	bool disk_cache::has_storage(storage_index_t const st) const
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		return std::any_of(m_pieces.begin(), m_pieces.end()
+			, [st](auto const& p) { return p.first.torrent == st; });
+	}
+}
@@ -133,6 +133,92 @@ void ge_double_scalarmult_vartime(ge_p2 *r, const unsigned char *a, const ge_p3
 }
 
 
+/*
+Ai = A,3A,5A,7A,9A,11A,13A,15A
+*/
+
+static void ge_odd_multiples(ge_cached *Ai, const ge_p3 *A) {
+    ge_p1p1 t;
+    ge_p3 u;
+    ge_p3 A2;
+    int i;
+    ge_p3_to_cached(&Ai[0], A);
+    ge_p3_dbl(&t, A);
+    ge_p1p1_to_p3(&A2, &t);
+
+    for (i = 1; i < 8; ++i) {
+        ge_add(&t, &A2, &Ai[i - 1]);
+        ge_p1p1_to_p3(&u, &t);
+        ge_p3_to_cached(&Ai[i], &u);
+    }
+}
+
+/*
+r = a[0] * A[0] + ... + a[n-1] * A[n-1] + b * B
+where a[i] is the 32 byte scalar starting at a + 32 * i.
+B is the Ed25519 base point (x,4/5) with x positive.
+Ai must have room for 8 * n elements and aslide for 256 * n. All points
+share the same doublings, which makes this a lot cheaper than n separate
+scalar multiplications.
+*/
+
+void ge_multi_scalarmult_vartime(ge_p2 *r, int n, const unsigned char *a, const ge_p3 *A, const unsigned char *b, ge_cached *Ai, signed char *aslide) {
+    signed char bslide[256];
+    ge_p1p1 t;
+    ge_p3 u;
+    int i;
+    int j;
+    int top = -1;
+
+    slide(bslide, b);
+    for (i = 255; i >= 0; --i) {
+        if (bslide[i]) {
+            top = i;
+            break;
+        }
+    }
+
+    for (j = 0; j < n; ++j) {
+        slide(aslide + 256 * j, a + 32 * j);
+        ge_odd_multiples(Ai + 8 * j, &A[j]);
+
+        for (i = 255; i > top; --i) {
+            if (aslide[256 * j + i]) {
+                top = i;
+                break;
+            }
+        }
+    }
+
+    ge_p2_0(r);
+
+    for (i = top; i >= 0; --i) {
+        ge_p2_dbl(&t, r);
+
+        for (j = 0; j < n; ++j) {
+            const signed char s = aslide[256 * j + i];
+
+            if (s > 0) {
+                ge_p1p1_to_p3(&u, &t);
+                ge_add(&t, &u, &Ai[8 * j + s / 2]);
+            } else if (s < 0) {
+                ge_p1p1_to_p3(&u, &t);
+                ge_sub(&t, &u, &Ai[8 * j + (-s) / 2]);
+            }
+        }
+
+        if (bslide[i] > 0) {
+            ge_p1p1_to_p3(&u, &t);
+            ge_madd(&t, &u, &Bi[bslide[i] / 2]);
+        } else if (bslide[i] < 0) {
+            ge_p1p1_to_p3(&u, &t);
+            ge_msub(&t, &u, &Bi[(-bslide[i]) / 2]);
+        }
+
+        ge_p1p1_to_p2(r, &t);
+    }
+}
+
 static const fe d = {
     -10913610, 13857413, -15372611, 6949391, 114729, -8787816, -6275908, -3247719, -18696448, -12055116
 };
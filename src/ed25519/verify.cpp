@@ -6,6 +6,9 @@
 #include "ge.h"
 #include "sc.h"
 
+#include <cstring>
+#include <vector>
+
 namespace libtorrent {
 namespace aux {
 
@@ -50,16 +53,69 @@ static int consttime_equal(const unsigned char *x, const unsigned char *y) {
     return !r;
 }
 
-int ed25519_verify(const unsigned char *signature, const unsigned char *message, std::ptrdiff_t message_len, const unsigned char *public_key) {
+/*
+A non-canonical encoding of R (y >= p, or x = 0 with the sign bit set)
+decodes to a valid point, but a signature using one is rejected, as it would
+be by comparing the encoding of [S]B - [h]A with R. Only R is checked; A is
+covered by h, which is computed over its encoding.
+*/
+static int is_canonical_point(const unsigned char *s) {
+    int i;
+    int all_ff = 1;
+    int y_is_one = s[0] == 1;
+
+    for (i = 1; i < 31; ++i) {
+        all_ff &= s[i] == 0xff;
+        y_is_one &= s[i] == 0;
+    }
+    all_ff &= (s[31] & 0x7f) == 0x7f;
+    y_is_one &= (s[31] & 0x7f) == 0;
+
+    /* y >= p = 2^255 - 19 */
+    if (all_ff && s[0] >= 0xed) {
+        return 0;
+    }
+
+    /* x = 0 (y = 1 or y = p - 1) with the sign bit set */
+    if ((s[31] & 0x80) && (y_is_one || (all_ff && s[0] == 0xec))) {
+        return 0;
+    }
+
+    return 1;
+}
+
+/* returns 1 if [8]P is the identity, i.e. P only has a component of small
+order (if any) */
+static int is_small_order(const ge_p2 *p) {
+    static const unsigned char identity[32] = {1};
     unsigned char checker[32];
-    ge_p3 A;
-    ge_p2 R;
+    ge_p1p1 t;
+    ge_p2 r = *p;
+    int i;
+
+    for (i = 0; i < 3; ++i) {
+        ge_p2_dbl(&t, &r);
+        ge_p1p1_to_p2(&r, &t);
+    }
+    ge_tobytes(checker, &r);
 
+    return consttime_equal(checker, identity);
+}
+
+/*
+Checks the encodings of R and S, decodes -A and computes h = H(R || A || M).
+Returns 0 if the signature is malformed.
+*/
+static int prepare_signature(ge_p3 *neg_a, unsigned char *h, const unsigned char *signature, const unsigned char *message, std::ptrdiff_t message_len, const unsigned char *public_key) {
     if (signature[63] & 224) {
         return 0;
     }
 
-    if (ge_frombytes_negate_vartime(&A, public_key) != 0) {
+    if (!is_canonical_point(signature)) {
+        return 0;
+    }
+
+    if (ge_frombytes_negate_vartime(neg_a, public_key) != 0) {
         return 0;
     }
 
@@ -67,18 +123,114 @@ int ed25519_verify(const unsigned char *signature, const unsigned char *message,
     hash.update({reinterpret_cast<char const*>(signature), 32});
     hash.update({reinterpret_cast<char const*>(public_key), 32});
     hash.update({reinterpret_cast<char const*>(message), message_len});
-    sha512_hash h = hash.final();
-    
-    sc_reduce(reinterpret_cast<unsigned char*>(h.data()));
-    ge_double_scalarmult_vartime(&R, reinterpret_cast<unsigned char*>(h.data())
-        , &A, signature + 32);
-    ge_tobytes(checker, &R);
-
-    if (!consttime_equal(checker, signature)) {
+    sha512_hash const digest = hash.final();
+    std::memcpy(h, digest.data(), 64);
+    sc_reduce(h);
+
+    return 1;
+}
+
+/*
+Both ed25519_verify() and ed25519_verify_batch() check the cofactored
+verification equation (RFC 8032, section 5.1.7)
+
+    [8] ([S]B - [h]A - R) = 0
+
+rather than [S]B - [h]A - R = 0. The two only differ for signatures where
+A or R has a component of small order, which an honest signer never
+produces. The batch verification can't tell whether those are valid under
+the cofactorless equation, since the random scalars it multiplies each
+signature by may or may not cancel out the small order component. Using
+the cofactored equation in both makes them agree on every signature.
+
+ed25519_verify() first compares [S]B - [h]A with R, which is enough for
+every signature where the cofactorless equation holds. Only if it doesn't,
+R is decoded and subtracted, and the difference multiplied by 8.
+*/
+int ed25519_verify(const unsigned char *signature, const unsigned char *message, std::ptrdiff_t message_len, const unsigned char *public_key) {
+    unsigned char h[64];
+    unsigned char checker[32];
+    ge_p3 A;
+    ge_p3 R;
+    ge_p3 p;
+    ge_cached c;
+    ge_p1p1 t;
+    ge_p2 r;
+
+    if (!prepare_signature(&A, h, signature, message, message_len, public_key)) {
         return 0;
     }
 
-    return 1;
+    /* [S]B + [h](-A) */
+    ge_double_scalarmult_vartime(&r, h, &A, signature + 32);
+    ge_tobytes(checker, &r);
+
+    if (consttime_equal(checker, signature)) {
+        return 1;
+    }
+
+    if (ge_frombytes_negate_vartime(&R, signature) != 0) {
+        return 0;
+    }
+
+    /* r + (-R). ge_add() takes r in extended coordinates, (XZ:YZ:Z^2:XY) */
+    fe_mul(p.X, r.X, r.Z);
+    fe_mul(p.Y, r.Y, r.Z);
+    fe_sq(p.Z, r.Z);
+    fe_mul(p.T, r.X, r.Y);
+    ge_p3_to_cached(&c, &R);
+    ge_add(&t, &p, &c);
+    ge_p1p1_to_p2(&r, &t);
+
+    return is_small_order(&r);
+}
+
+/*
+Verifies all the signatures at once, by checking that
+
+    [8] ((sum z_i S_i) B - sum (z_i h_i) A_i - sum z_i R_i) = 0
+
+where z_i are the random 128 bit scalars in random (16 bytes each). Every
+term is zero if all signatures are valid. If one isn't, the random z_i make
+it very unlikely that the terms cancel out. Returns 1 if all signatures are
+valid, 0 otherwise. It doesn't say which signature is invalid.
+*/
+int ed25519_verify_batch(const unsigned char *const *signatures, const unsigned char *const *messages, const std::ptrdiff_t *message_lens, const unsigned char *const *public_keys, const unsigned char *random, int num) {
+    static const unsigned char zero[32] = {0};
+    std::vector<ge_p3> points(std::size_t(num) * 2);
+    std::vector<unsigned char> scalars(std::size_t(num) * 64);
+    std::vector<ge_cached> multiples(std::size_t(num) * 16);
+    std::vector<signed char> slides(std::size_t(num) * 512);
+    unsigned char b[32] = {0};
+    ge_p2 r;
+    int i;
+
+    for (i = 0; i < num; ++i) {
+        const unsigned char *signature = signatures[i];
+        unsigned char *scalar = &scalars[std::size_t(i) * 64];
+        unsigned char h[64];
+        unsigned char z[32] = {0};
+
+        /* -A_i and -R_i */
+        if (!prepare_signature(&points[std::size_t(i) * 2], h, signature
+            , messages[i], message_lens[i], public_keys[i])) {
+            return 0;
+        }
+
+        if (ge_frombytes_negate_vartime(&points[std::size_t(i) * 2 + 1], signature) != 0) {
+            return 0;
+        }
+
+        std::memcpy(z, random + 16 * i, 16);
+        sc_muladd(scalar, z, h, zero);
+        std::memcpy(scalar + 32, z, 32);
+        sc_muladd(b, z, signature + 32, b);
+    }
+
+    ge_multi_scalarmult_vartime(&r, num * 2, scalars.data(), points.data(), b
+        , multiples.data(), slides.data());
+
+    return is_small_order(&r);
 }
 
 } }
@@ -46,7 +46,9 @@ see LICENSE file.
 #include "libtorrent/aux_/file.hpp"
 #include "libtorrent/aux_/path.hpp" // for convert_to_native_path_string
 #include "libtorrent/aux_/string_util.hpp"
+#include "libtorrent/aux_/alloca.hpp"
 #include <cstring>
+#include <algorithm> // for min
 
 #include "libtorrent/assert.hpp"
 #include "libtorrent/aux_/throw.hpp"
@@ -132,6 +134,22 @@ namespace libtorrent::aux {
 
 		return int(bytes_written);
 	}
+
+	int pwritev_all(handle_type const fd
+		, span<span<char const> const> bufs
+		, std::int64_t file_offset
+		, error_code& ec)
+	{
+		int ret = 0;
+		for (auto const b : bufs)
+		{
+			int const r = pwrite_all(fd, b, file_offset, ec);
+			if (ec) return -1;
+			ret += r;
+			file_offset += r;
+		}
+		return ret;
+	}
 #else
 
 	int pread_all(handle_type const handle
@@ -183,6 +201,71 @@ namespace libtorrent::aux {
 		} while (buf.size() > 0);
 		return ret;
 	}
+
+	int pwritev_all(handle_type const handle
+		, span<span<char const> const> bufs
+		, std::int64_t file_offset
+		, error_code& ec)
+	{
+#ifdef TORRENT_LINUX
+		int ret = 0;
+		while (!bufs.empty())
+		{
+			// limit the number of iovecs passed in a single call. IOV_MAX is at
+			// least 1024 on linux, a full 16 MiB piece
+			std::ptrdiff_t const num_bufs = std::min(bufs.size(), std::ptrdiff_t(1024));
+			TORRENT_ALLOCA(vec, ::iovec, num_bufs);
+			for (std::ptrdiff_t i = 0; i < num_bufs; ++i)
+			{
+				vec[i].iov_base = const_cast<char*>(bufs[i].data());
+				vec[i].iov_len = std::size_t(bufs[i].size());
+			}
+
+			auto r = ::pwritev(handle, vec.data(), int(num_bufs), file_offset);
+			if (r == 0)
+			{
+				ec = boost::asio::error::eof;
+				return ret;
+			}
+			if (r < 0)
+			{
+				ec = error_code(errno, system_category());
+				return -1;
+			}
+			ret += int(r);
+			file_offset += r;
+
+			// skip the buffers that were written in full
+			while (!bufs.empty() && r >= bufs.front().size())
+			{
+				r -= bufs.front().size();
+				bufs = bufs.subspan(1);
+			}
+
+			// a short write in the middle of a buffer. Complete that buffer
+			// before moving on to the next vectored write
+			if (r > 0)
+			{
+				int const w = pwrite_all(handle, bufs.front().subspan(r), file_offset, ec);
+				if (ec) return -1;
+				ret += w;
+				file_offset += w;
+				bufs = bufs.subspan(1);
+			}
+		}
+		return ret;
+#else
+		int ret = 0;
+		for (auto const b : bufs)
+		{
+			int const r = pwrite_all(handle, b, file_offset, ec);
+			if (ec) return -1;
+			ret += r;
+			file_offset += r;
+		}
+		return ret;
+#endif
+	}
 #endif
 
 namespace {
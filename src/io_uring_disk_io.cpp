@@ -0,0 +1,1558 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/io_uring_disk_io.hpp"
+
+#if TORRENT_HAVE_IO_URING
+
+#include "libtorrent/pread_disk_io.hpp"
+#include "libtorrent/disk_buffer_holder.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/error.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/performance_counters.hpp"
+#include "libtorrent/settings_pack.hpp"
+#include "libtorrent/add_torrent_params.hpp"
+#include "libtorrent/aux_/disk_buffer_pool.hpp"
+#include "libtorrent/aux_/disk_io_thread_pool.hpp"
+#include "libtorrent/aux_/disk_job.hpp"
+#include "libtorrent/aux_/file_pool.hpp"
+#include "libtorrent/aux_/file.hpp" // for file_handle
+#include "libtorrent/aux_/pread_storage.hpp"
+#include "libtorrent/aux_/storage_array.hpp"
+#include "libtorrent/aux_/storage_utils.hpp" // for contains_resume_data
+#include "libtorrent/aux_/store_buffer.hpp"
+#include "libtorrent/aux_/multi_hasher.hpp"
+#include "libtorrent/aux_/platform_util.hpp" // for set_thread_name
+#include "libtorrent/aux_/throw.hpp"
+#include "libtorrent/aux_/time.hpp"
+
+#include <array>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+
+#include <boost/asio/posix/stream_descriptor.hpp>
+
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+
+namespace libtorrent {
+
+namespace {
+
+	// the number of submission queue entries. The completion queue is twice
+	// as large
+	constexpr unsigned ring_size = 256;
+
+	// the number of blocks read at a time when hashing a piece
+	constexpr int hash_batch_size = 8;
+
+	// the max number of threads running file jobs (see file_job)
+	constexpr int num_file_threads = 2;
+
+#ifdef IORING_RSRC_REGISTER_SPARSE
+	// the number of slabs of disk buffers that can be registered as fixed
+	// buffers. Buffers in slabs beyond this are used as normal buffers
+	constexpr int max_fixed_buffers = 256;
+#endif
+
+	aux::open_mode_t file_mode(disk_job_flags_t const flags)
+	{
+		aux::open_mode_t ret = aux::open_mode::read_only;
+		if (flags & disk_interface::sequential_access) ret |= aux::open_mode::sequential_access;
+		return ret;
+	}
+
+	int sys_io_uring_setup(unsigned const entries, io_uring_params* p)
+	{
+		return int(::syscall(__NR_io_uring_setup, entries, p));
+	}
+
+	int sys_io_uring_enter(int const fd, unsigned const to_submit
+		, unsigned const min_complete, unsigned const flags)
+	{
+		return int(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete
+			, flags, nullptr, 0));
+	}
+
+	int sys_io_uring_register(int const fd, unsigned const opcode
+		, void const* arg, unsigned const nr_args)
+	{
+		return int(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+	}
+
+	// a minimal wrapper around an io_uring instance, i.e. the submission and
+	// completion rings shared with the kernel. We don't depend on liburing
+	struct uring
+	{
+		explicit uring(unsigned const entries)
+		{
+			io_uring_params p{};
+			m_fd = sys_io_uring_setup(entries, &p);
+			if (m_fd < 0) aux::throw_ex<system_error>(error_code(errno, system_category()));
+
+			std::size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+			std::size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+			bool const single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+			if (single_mmap) sq_size = cq_size = std::max(sq_size, cq_size);
+
+			m_sq_ring = map(sq_size, IORING_OFF_SQ_RING);
+			m_sq_ring_size = sq_size;
+			if (single_mmap)
+			{
+				m_cq_ring = m_sq_ring;
+			}
+			else
+			{
+				m_cq_ring = map(cq_size, IORING_OFF_CQ_RING);
+				m_cq_ring_size = cq_size;
+			}
+			m_sqes = static_cast<io_uring_sqe*>(map(p.sq_entries * sizeof(io_uring_sqe)
+				, IORING_OFF_SQES));
+			m_sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+
+			char* const sq = static_cast<char*>(m_sq_ring);
+			m_sq_head = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+			m_sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+			m_sq_mask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+			m_sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+			m_sq_entries = p.sq_entries;
+			m_sqe_tail = *m_sq_tail;
+
+			char* const cq = static_cast<char*>(m_cq_ring);
+			m_cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+			m_cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+			m_cq_mask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+			m_cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+			m_cq_entries = p.cq_entries;
+		}
+
+		~uring() { close(); }
+		uring(uring const&) = delete;
+		uring& operator=(uring const&) = delete;
+
+		// returns nullptr if the submission queue is full
+		io_uring_sqe* get_sqe()
+		{
+			unsigned const head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+			if (m_sqe_tail - head >= m_sq_entries) return nullptr;
+			unsigned const idx = m_sqe_tail & m_sq_mask;
+			m_sq_array[idx] = idx;
+			++m_sqe_tail;
+			io_uring_sqe* ret = &m_sqes[idx];
+			std::memset(ret, 0, sizeof(*ret));
+			return ret;
+		}
+
+		// the number of entries queued up, but not yet submitted
+		unsigned pending() const
+		{
+			return m_sqe_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+		}
+
+		// submits all queued entries to the kernel, and optionally waits for
+		// ``wait_for`` completions. Returns a negative errno on failure
+		int submit(unsigned const wait_for = 0)
+		{
+			__atomic_store_n(m_sq_tail, m_sqe_tail, __ATOMIC_RELEASE);
+			unsigned const to_submit = pending();
+			if (to_submit == 0 && wait_for == 0) return 0;
+			for (;;)
+			{
+				int const ret = sys_io_uring_enter(m_fd, to_submit, wait_for
+					, wait_for > 0 ? IORING_ENTER_GETEVENTS : 0u);
+				if (ret < 0 && errno == EINTR) continue;
+				return ret < 0 ? -errno : ret;
+			}
+		}
+
+		// appends all available completions to ``out``, and frees up their
+		// slots in the completion queue
+		void reap(std::vector<io_uring_cqe>& out)
+		{
+			unsigned head = *m_cq_head;
+			unsigned const tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+			for (; head != tail; ++head)
+				out.push_back(m_cqes[head & m_cq_mask]);
+			__atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+		}
+
+		int register_eventfd(int const efd)
+		{
+			return sys_io_uring_register(m_fd, IORING_REGISTER_EVENTFD, &efd, 1);
+		}
+
+#ifdef IORING_RSRC_REGISTER_SPARSE
+		// allocates a table of ``num`` empty fixed buffer slots
+		int register_sparse_buffers(unsigned const num)
+		{
+			io_uring_rsrc_register r{};
+			r.nr = num;
+			r.flags = IORING_RSRC_REGISTER_SPARSE;
+			return sys_io_uring_register(m_fd, IORING_REGISTER_BUFFERS2, &r, sizeof(r));
+		}
+
+		// an iovec with a null base clears the slot
+		int update_buffer(unsigned const slot, iovec const& iov)
+		{
+			io_uring_rsrc_update2 u{};
+			u.offset = slot;
+			u.data = reinterpret_cast<std::uintptr_t>(&iov);
+			u.nr = 1;
+			return sys_io_uring_register(m_fd, IORING_REGISTER_BUFFERS_UPDATE, &u, sizeof(u));
+		}
+#endif
+
+		unsigned cq_entries() const { return m_cq_entries; }
+
+	private:
+
+		void* map(std::size_t const size, std::uint64_t const offset)
+		{
+			void* ret = ::mmap(nullptr, size, PROT_READ | PROT_WRITE
+				, MAP_SHARED | MAP_POPULATE, m_fd, off_t(offset));
+			if (ret == MAP_FAILED)
+			{
+				error_code const ec(errno, system_category());
+				close();
+				aux::throw_ex<system_error>(ec);
+			}
+			return ret;
+		}
+
+		void close()
+		{
+			if (m_sqes) ::munmap(m_sqes, m_sqes_size);
+			if (m_cq_ring && m_cq_ring != m_sq_ring) ::munmap(m_cq_ring, m_cq_ring_size);
+			if (m_sq_ring) ::munmap(m_sq_ring, m_sq_ring_size);
+			if (m_fd >= 0) ::close(m_fd);
+			m_sqes = nullptr;
+			m_cq_ring = nullptr;
+			m_sq_ring = nullptr;
+			m_fd = -1;
+		}
+
+		int m_fd = -1;
+
+		void* m_sq_ring = nullptr;
+		std::size_t m_sq_ring_size = 0;
+		void* m_cq_ring = nullptr;
+		std::size_t m_cq_ring_size = 0;
+		io_uring_sqe* m_sqes = nullptr;
+		std::size_t m_sqes_size = 0;
+
+		unsigned* m_sq_head;
+		unsigned* m_sq_tail;
+		unsigned* m_sq_array;
+		unsigned m_sq_mask;
+		unsigned m_sq_entries;
+
+		// the tail of the submission queue, including the entries we have
+		// filled in but not published to the kernel yet
+		unsigned m_sqe_tail;
+
+		unsigned* m_cq_head;
+		unsigned* m_cq_tail;
+		io_uring_cqe* m_cqes;
+		unsigned m_cq_mask;
+		unsigned m_cq_entries;
+	};
+
+	struct uring_job;
+
+	// a read, write or fsync of a contiguous range of one file. A job
+	// touching several files, or several blocks, has one of these per range
+	struct uring_op
+	{
+		uring_job* job;
+		std::shared_ptr<aux::file_handle> file;
+		file_index_t file_index;
+		std::int64_t file_offset;
+		char* buf;
+		int length;
+
+		// the number of bytes transferred so far. Short reads and writes are
+		// resubmitted for the remainder
+		int transferred;
+
+		// identifies the block (of a hash job) this op reads into
+		int tag;
+	};
+
+	enum class job_type : std::uint8_t { read, write, hash, fsync };
+
+	struct uring_job
+	{
+		uring_job(job_type const t, storage_index_t const idx
+			, std::shared_ptr<aux::pread_storage> s)
+			: type(t), storage(idx), st(std::move(s)), start_time(clock_type::now())
+		{}
+
+		job_type type;
+		storage_index_t storage;
+		std::shared_ptr<aux::pread_storage> st;
+
+		// the ops are filled in before the job is submitted, and not touched
+		// while it's in flight (they're referenced by the kernel's
+		// completions)
+		std::vector<uring_op> ops;
+
+		// the number of ops not completed yet
+		int outstanding = 0;
+
+		storage_error error;
+		time_point start_time;
+
+		// called on the network thread once all ops have completed. Returns
+		// true if the job is done. A job may also submit more ops and return
+		// false (this is how hash jobs read one batch of blocks at a time)
+		std::function<bool(uring_job&)> on_complete;
+	};
+
+	// a job operating on whole files of a storage, like moving, deleting or
+	// checking them. These may block for a long time, so they run on the file
+	// threads. Only the queue links of disk_job are used
+	struct file_job : aux::disk_job
+	{
+		explicit file_job(std::function<void()> f) : fun(std::move(f)) {}
+		std::function<void()> fun;
+	};
+
+	// appends the slices prepared by the storage as ops on the job. ``buf`` is
+	// the buffer passed to prepare_read() or prepare_write()
+	void add_ops(uring_job& j, std::vector<aux::pread_storage::file_slice>& slices
+		, char* buf, int const tag = 0)
+	{
+		for (auto& s : slices)
+		{
+			j.ops.push_back({&j, std::move(s.file), s.file_index, s.file_offset
+				, buf + s.buffer_offset, s.length, 0, tag});
+		}
+		slices.clear();
+	}
+
+} // anonymous namespace
+
+	struct TORRENT_EXTRA_EXPORT io_uring_disk_io final
+		: disk_interface
+	{
+		io_uring_disk_io(io_context& ios, settings_interface const& sett, counters& cnt);
+		~io_uring_disk_io() override;
+
+		void settings_updated() override;
+		storage_holder new_torrent(storage_params const& params
+			, std::shared_ptr<void> const& owner) override;
+		void remove_torrent(storage_index_t) override;
+
+		void abort(bool wait) override;
+
+		void async_read(storage_index_t storage, peer_request const& r
+			, std::function<void(disk_buffer_holder, storage_error const&)> handler
+			, disk_job_flags_t flags = {}) override;
+		bool async_write(storage_index_t storage, peer_request const& r
+			, char const* buf, std::shared_ptr<disk_observer> o
+			, std::function<void(storage_error const&)> handler
+			, disk_job_flags_t flags = {}) override;
+		void async_hash(storage_index_t storage, piece_index_t piece, span<sha256_hash> v2
+			, disk_job_flags_t flags
+			, std::function<void(piece_index_t, sha1_hash const&, storage_error const&)> handler) override;
+		void async_hash2(storage_index_t storage, piece_index_t piece, int offset, disk_job_flags_t flags
+			, std::function<void(piece_index_t, sha256_hash const&, storage_error const&)> handler) override;
+		void async_move_storage(storage_index_t storage, std::string p, move_flags_t flags
+			, std::function<void(status_t, std::string const&, storage_error const&)> handler) override;
+		void async_release_files(storage_index_t storage
+			, std::function<void()> handler = std::function<void()>()) override;
+		void async_delete_files(storage_index_t storage, remove_flags_t options
+			, std::function<void(storage_error const&)> handler) override;
+		void async_check_files(storage_index_t storage
+			, add_torrent_params const* resume_data
+			, aux::vector<std::string, file_index_t> links
+			, std::function<void(status_t, storage_error const&)> handler) override;
+		void async_rename_file(storage_index_t storage, file_index_t index, std::string name
+			, std::function<void(std::string const&, file_index_t, storage_error const&)> handler) override;
+		void async_stop_torrent(storage_index_t storage
+			, std::function<void()> handler) override;
+		void async_set_file_priority(storage_index_t storage
+			, aux::vector<download_priority_t, file_index_t> prio
+			, std::function<void(storage_error const&
+				, aux::vector<download_priority_t, file_index_t>)> handler) override;
+		void async_clear_piece(storage_index_t storage, piece_index_t index
+			, std::function<void(piece_index_t)> handler) override;
+
+		void update_stats_counters(counters& c) const override;
+
+		std::vector<open_file_state> get_status(storage_index_t) const override;
+
+		// submits all queued operations to the kernel, in a single system call
+		void submit_jobs() override;
+
+	private:
+
+		struct storage_state
+		{
+			// the number of jobs that have been issued, but not completed
+			int outstanding = 0;
+
+			// jobs waiting to be issued. Fence jobs (the first member is true)
+			// need exclusive access to the storage, and are run once all
+			// outstanding jobs have completed. Other jobs are only queued up
+			// here if there's a fence ahead of them, or a file job is running
+			std::deque<std::pair<bool, std::function<void()>>> deferred;
+
+			// the files that have been written to since they were last synced
+			std::map<file_index_t, std::weak_ptr<aux::file_handle>> dirty_files;
+
+			// set while a file job of this storage is running on a file thread
+			bool file_job = false;
+
+			// set by remove_torrent(). The storage index is released once
+			// there are no jobs left
+			bool removed = false;
+		};
+
+		// runs ``f`` once all jobs ahead of it (and, if ``fence`` is set, all
+		// outstanding I/O) on this storage have completed
+		void add_job(storage_index_t storage, bool fence, std::function<void()> f);
+		void run_deferred(storage_index_t storage);
+
+		// runs ``f`` on a file thread, as a fence. Other jobs on the storage
+		// are held back until it returns. ``f`` posts its own handler
+		void add_file_job(storage_index_t storage
+			, std::function<void(aux::pread_storage&)> f);
+		void start_file_job(storage_index_t storage
+			, std::function<void(aux::pread_storage&)> f);
+		void file_job_done(storage_index_t storage);
+		void thread_fun(aux::disk_io_thread_pool& pool
+			, executor_work_guard<io_context::executor_type> work);
+
+		// removes the storage once remove_torrent() has been called and it
+		// has no more jobs
+		void release_storage(storage_index_t storage);
+
+		// queues up the job's ops to be submitted to the kernel. If the job
+		// has no ops, it's completed asynchronously
+		void submit(uring_job* j);
+		void queue_op(uring_op& op);
+		bool fits_in_queue(uring_job const& j) const;
+
+		// called once all ops of a job have completed
+		void complete_job(uring_job* j);
+
+		// reaps and handles completions, and re-arms the wait on the eventfd
+		void on_event(error_code const& ec);
+		void arm_event();
+		void reap();
+		void handle_completion(io_uring_cqe const& cqe);
+
+		// reads the next batch of blocks of a hash job, and hashes them once
+		// they've been read
+		struct hash_state;
+		void read_hash_batch(uring_job& j, hash_state& hs);
+		bool hash_batch_done(uring_job& j, hash_state& hs);
+
+		status_t check_fastresume(aux::pread_storage& st
+			, add_torrent_params const* rd
+			, aux::vector<std::string, file_index_t> const& links
+			, storage_error& error);
+
+		// fsyncs all files written to since the last sync, then calls ``f``
+		void sync_files(storage_index_t storage, std::function<void()> f);
+
+		// tracks which slabs of disk buffers are registered as fixed buffers
+		void on_slab(char* base, int size, bool added);
+		int fixed_buffer_index(char const* buf) const;
+
+		settings_interface const& m_settings;
+
+		// LRU cache of open files
+		aux::file_pool m_file_pool;
+
+		aux::disk_buffer_pool m_buffer_pool;
+
+		counters& m_stats_counters;
+
+		// completions are handled on this io_context
+		io_context& m_ios;
+
+		uring m_ring;
+
+		// the kernel signals this eventfd when it posts completions
+		boost::asio::posix::stream_descriptor m_event;
+		bool m_event_armed = false;
+
+		aux::storage_array<aux::pread_storage> m_torrents;
+		aux::vector<storage_state, storage_index_t> m_storage_state;
+
+		// blocks that are being written. Reads and hashes of these blocks are
+		// served from here, since the write may not have hit the file yet
+		aux::store_buffer m_store_buffer;
+
+		// the number of ops submitted to the kernel that haven't completed
+		// yet. This is capped at the size of the completion queue
+		int m_inflight = 0;
+
+		// jobs waiting for room in the completion queue
+		std::deque<uring_job*> m_backlog;
+
+		// the number of jobs (of each kind) currently being executed
+		int m_num_jobs = 0;
+		int m_num_read_jobs = 0;
+		int m_num_write_jobs = 0;
+
+		// scratch space for reaping completions
+		std::vector<io_uring_cqe> m_completions;
+
+		// maps the base address of each registered slab to its fixed buffer
+		// slot and size. The slab observer is called from whichever thread
+		// allocates or frees disk buffers
+		mutable std::mutex m_fixed_mutex;
+		std::map<char const*, std::pair<int, int>> m_fixed_buffers;
+		std::vector<int> m_free_fixed_slots;
+
+		// protects the job queue of m_file_threads
+		mutable std::mutex m_job_mutex;
+
+		// runs file jobs. This is last, so the threads are stopped before
+		// anything they use is destructed
+		aux::disk_io_thread_pool m_file_threads;
+	};
+
+	struct io_uring_disk_io::hash_state
+	{
+		piece_index_t piece;
+		disk_job_flags_t flags;
+		bool v1;
+		int piece_size;
+		int piece_size2;
+		int blocks_in_piece2;
+		int blocks_to_read;
+		span<sha256_hash> block_hashes;
+		hasher ph;
+
+		// the first block of the batch being read
+		int batch_start = 0;
+		int batch_size = 0;
+
+		std::vector<disk_buffer_holder> buffers;
+
+		// the number of bytes read into each buffer
+		std::array<int, hash_batch_size> filled{};
+
+		std::function<void(piece_index_t, sha1_hash const&, storage_error const&)> handler;
+	};
+
+	TORRENT_EXPORT std::unique_ptr<disk_interface> io_uring_disk_io_constructor(
+		io_context& ios, settings_interface const& sett, counters& cnt)
+	{
+		try
+		{
+			return std::make_unique<io_uring_disk_io>(ios, sett, cnt);
+		}
+		catch (system_error const&)
+		{
+			// io_uring may be disabled, or not supported by this kernel
+			return pread_disk_io_constructor(ios, sett, cnt);
+		}
+	}
+
+	io_uring_disk_io::io_uring_disk_io(io_context& ios, settings_interface const& sett
+		, counters& cnt)
+		: m_settings(sett)
+		, m_file_pool(sett.get_int(settings_pack::file_pool_size))
+		, m_buffer_pool(ios)
+		, m_stats_counters(cnt)
+		, m_ios(ios)
+		, m_ring(ring_size)
+		, m_event(ios)
+		, m_file_threads([this](aux::disk_io_thread_pool& pool
+			, executor_work_guard<io_context::executor_type> work)
+			{ thread_fun(pool, std::move(work)); }, ios)
+	{
+		int const efd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (efd < 0) aux::throw_ex<system_error>(error_code(errno, system_category()));
+		m_event.assign(efd);
+		if (m_ring.register_eventfd(efd) < 0)
+			aux::throw_ex<system_error>(error_code(errno, system_category()));
+
+#ifdef IORING_RSRC_REGISTER_SPARSE
+		// registering the disk buffers saves the kernel from mapping and
+		// pinning their pages for every operation. This is best-effort, older
+		// kernels don't support updating registered buffers
+		if (m_ring.register_sparse_buffers(max_fixed_buffers) >= 0)
+		{
+			for (int i = max_fixed_buffers - 1; i >= 0; --i)
+				m_free_fixed_slots.push_back(i);
+			m_buffer_pool.set_slab_observer([this](char* base, int size, bool added)
+				{ on_slab(base, size, added); });
+		}
+#endif
+
+		m_file_threads.set_max_threads(num_file_threads);
+		settings_updated();
+	}
+
+	io_uring_disk_io::~io_uring_disk_io()
+	{
+		m_file_threads.abort(true);
+		m_buffer_pool.set_slab_observer({});
+
+		// the kernel may still be writing into our buffers. Wait for all
+		// operations to complete, but don't call any handlers
+		for (uring_job* j : m_backlog)
+		{
+			m_inflight += int(j->ops.size());
+			for (auto& op : j->ops) queue_op(op);
+		}
+		m_backlog.clear();
+		while (m_inflight > 0)
+		{
+			if (m_ring.submit(1) < 0) break;
+			m_completions.clear();
+			m_ring.reap(m_completions);
+			for (auto const& cqe : m_completions)
+			{
+				auto* op = reinterpret_cast<uring_op*>(std::uintptr_t(cqe.user_data));
+				--m_inflight;
+				if (--op->job->outstanding == 0) delete op->job;
+			}
+		}
+	}
+
+	void io_uring_disk_io::settings_updated()
+	{
+		m_buffer_pool.set_settings(m_settings);
+		m_file_pool.resize(m_settings.get_int(settings_pack::file_pool_size));
+	}
+
+	storage_holder io_uring_disk_io::new_torrent(storage_params const& params
+		, std::shared_ptr<void> const& owner)
+	{
+		TORRENT_ASSERT(params.files.is_valid());
+
+		auto storage = std::make_shared<aux::pread_storage>(params, m_file_pool);
+		storage->set_owner(owner);
+		storage_index_t const idx = m_torrents.add(std::move(storage));
+		if (idx >= m_storage_state.end_index())
+			m_storage_state.resize(static_cast<std::uint32_t>(idx) + 1);
+		return {idx, *this};
+	}
+
+	void io_uring_disk_io::remove_torrent(storage_index_t const idx)
+	{
+		// once removed, the storage index may be reused by another torrent.
+		// The jobs still in flight refer to its state, so the index is only
+		// released once they have completed
+		m_storage_state[idx].removed = true;
+		release_storage(idx);
+	}
+
+	void io_uring_disk_io::release_storage(storage_index_t const idx)
+	{
+		auto& s = m_storage_state[idx];
+		if (!s.removed || s.outstanding > 0 || s.file_job || !s.deferred.empty())
+			return;
+		s = storage_state{};
+		m_torrents.remove(idx);
+	}
+
+	void io_uring_disk_io::abort(bool const wait)
+	{
+		// jobs in flight keep completing as long as the io_context is running.
+		// Any remaining ones are waited for in the destructor
+		submit_jobs();
+		m_file_threads.abort(wait);
+	}
+
+	void io_uring_disk_io::submit_jobs()
+	{
+		if (m_ring.pending() == 0) return;
+		int const ret = m_ring.submit();
+		TORRENT_ASSERT(ret >= 0);
+		TORRENT_UNUSED(ret);
+		arm_event();
+	}
+
+	void io_uring_disk_io::add_job(storage_index_t const storage, bool const fence
+		, std::function<void()> f)
+	{
+		auto& s = m_storage_state[storage];
+		if (s.deferred.empty() && !s.file_job && (!fence || s.outstanding == 0))
+		{
+			f();
+			return;
+		}
+		s.deferred.emplace_back(fence, std::move(f));
+	}
+
+	void io_uring_disk_io::run_deferred(storage_index_t const storage)
+	{
+		// the job may add more deferred jobs, don't hold on to a reference
+		// across calls
+		while (!m_storage_state[storage].deferred.empty())
+		{
+			auto& s = m_storage_state[storage];
+			if (s.file_job) return;
+			if (s.deferred.front().first && s.outstanding > 0) return;
+			auto f = std::move(s.deferred.front().second);
+			s.deferred.pop_front();
+			f();
+		}
+	}
+
+	void io_uring_disk_io::add_file_job(storage_index_t const storage
+		, std::function<void(aux::pread_storage&)> f)
+	{
+		add_job(storage, true, [this, storage, f = std::move(f)]() mutable
+		{
+			start_file_job(storage, std::move(f));
+		});
+	}
+
+	void io_uring_disk_io::start_file_job(storage_index_t const storage
+		, std::function<void(aux::pread_storage&)> f)
+	{
+		auto& s = m_storage_state[storage];
+		TORRENT_ASSERT(!s.file_job);
+		TORRENT_ASSERT(s.outstanding == 0);
+		s.file_job = true;
+		++m_num_jobs;
+
+		// the handler ``f`` posts is queued ahead of file_job_done(), so it's
+		// called before any job held back by this one
+		auto* j = new file_job([this, storage, st = m_torrents[storage], f = std::move(f)]
+		{
+			f(*st);
+			post(m_ios, [this, storage] { file_job_done(storage); });
+		});
+
+		std::lock_guard<std::mutex> l(m_job_mutex);
+		m_file_threads.push_back(j);
+		m_file_threads.submit_jobs();
+	}
+
+	void io_uring_disk_io::file_job_done(storage_index_t const storage)
+	{
+		TORRENT_ASSERT(m_storage_state[storage].file_job);
+		m_storage_state[storage].file_job = false;
+		--m_num_jobs;
+		run_deferred(storage);
+		release_storage(storage);
+
+		// the jobs that were held back may have issued new ops
+		submit_jobs();
+	}
+
+	void io_uring_disk_io::thread_fun(aux::disk_io_thread_pool& pool
+		, executor_work_guard<io_context::executor_type> work)
+	{
+		// work is used to keep the io_context alive until the handlers of our
+		// jobs have been posted
+		TORRENT_UNUSED(work);
+
+		aux::set_thread_name("libtorrent-disk-file-thread");
+
+		std::unique_lock<std::mutex> l(m_job_mutex);
+		for (;;)
+		{
+			auto const result = pool.wait_for_job(l);
+			if (result == aux::wait_result::exit_thread) break;
+			if (result == aux::wait_result::interrupt) continue;
+
+			auto* j = static_cast<file_job*>(pool.pop_front());
+			l.unlock();
+			j->fun();
+			delete j;
+			l.lock();
+		}
+	}
+
+	void io_uring_disk_io::submit(uring_job* j)
+	{
+		++m_storage_state[j->storage].outstanding;
+		j->outstanding = int(j->ops.size());
+
+		if (j->ops.empty())
+		{
+			// everything was read from the store buffer or the part file, or
+			// there was an error. Complete the job without calling the
+			// handler from within the async_* call
+			post(m_ios, [this, j] { complete_job(j); });
+			return;
+		}
+
+		if (!m_backlog.empty() || !fits_in_queue(*j))
+		{
+			m_backlog.push_back(j);
+			return;
+		}
+
+		m_inflight += int(j->ops.size());
+		for (auto& op : j->ops) queue_op(op);
+
+		// don't let the submission queue fill up while waiting for
+		// submit_jobs()
+		if (m_ring.pending() >= ring_size / 2) submit_jobs();
+	}
+
+	bool io_uring_disk_io::fits_in_queue(uring_job const& j) const
+	{
+		// a job with more ops than fit in the completion queue (e.g. a block
+		// spanning many small files) is issued on its own. The kernel holds on
+		// to completions that don't fit
+		return m_inflight == 0
+			|| m_inflight + int(j.ops.size()) <= int(m_ring.cq_entries());
+	}
+
+	void io_uring_disk_io::queue_op(uring_op& op)
+	{
+		io_uring_sqe* sqe = m_ring.get_sqe();
+		if (sqe == nullptr)
+		{
+			// the submission queue is full, flush it to the kernel
+			m_ring.submit();
+			sqe = m_ring.get_sqe();
+		}
+		TORRENT_ASSERT(sqe != nullptr);
+
+		sqe->fd = op.file->fd();
+		sqe->user_data = reinterpret_cast<std::uintptr_t>(&op);
+
+		if (op.job->type == job_type::fsync)
+		{
+			sqe->opcode = IORING_OP_FSYNC;
+			sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+			return;
+		}
+
+		bool const write = op.job->type == job_type::write;
+		sqe->addr = reinterpret_cast<std::uintptr_t>(op.buf + op.transferred);
+		sqe->len = unsigned(op.length - op.transferred);
+		sqe->off = std::uint64_t(op.file_offset + op.transferred);
+
+		int const fixed = fixed_buffer_index(op.buf);
+		if (fixed >= 0)
+		{
+			sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+			sqe->buf_index = std::uint16_t(fixed);
+		}
+		else
+		{
+			sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+		}
+	}
+
+	void io_uring_disk_io::complete_job(uring_job* j)
+	{
+		storage_index_t const storage = j->storage;
+		--m_storage_state[storage].outstanding;
+		if (j->on_complete(*j)) delete j;
+		run_deferred(storage);
+		release_storage(storage);
+	}
+
+	void io_uring_disk_io::arm_event()
+	{
+		if (m_event_armed) return;
+		m_event_armed = true;
+		m_event.async_wait(boost::asio::posix::stream_descriptor::wait_read
+			, [this](error_code const& ec) { on_event(ec); });
+	}
+
+	void io_uring_disk_io::on_event(error_code const& ec)
+	{
+		// when we're destructed, the wait is cancelled
+		if (ec == boost::asio::error::operation_aborted) return;
+		m_event_armed = false;
+
+		std::uint64_t count;
+		while (::read(m_event.native_handle(), &count, sizeof(count)) > 0);
+
+		reap();
+
+		// handlers may have issued new jobs
+		submit_jobs();
+		if (m_inflight > 0) arm_event();
+	}
+
+	void io_uring_disk_io::reap()
+	{
+		// handling a completion may submit more ops, and even reap. Swap out
+		// the scratch buffer first
+		std::vector<io_uring_cqe> completions;
+		completions.swap(m_completions);
+		completions.clear();
+		m_ring.reap(completions);
+		for (auto const& cqe : completions) handle_completion(cqe);
+
+		// there may be room for jobs waiting for the completion queue now
+		while (!m_backlog.empty())
+		{
+			uring_job* j = m_backlog.front();
+			if (!fits_in_queue(*j)) break;
+			m_backlog.pop_front();
+			m_inflight += int(j->ops.size());
+			for (auto& op : j->ops) queue_op(op);
+		}
+
+		if (m_completions.empty()) m_completions.swap(completions);
+	}
+
+	void io_uring_disk_io::handle_completion(io_uring_cqe const& cqe)
+	{
+		auto* op = reinterpret_cast<uring_op*>(std::uintptr_t(cqe.user_data));
+		uring_job* j = op->job;
+		--m_inflight;
+
+		if (cqe.res < 0)
+		{
+			if (!j->error)
+			{
+				j->error.ec.assign(-cqe.res, system_category());
+				j->error.operation = j->type == job_type::write
+					|| j->type == job_type::fsync
+					? operation_t::file_write
+					: operation_t::file_read;
+				j->error.file(op->file_index);
+			}
+		}
+		else if (cqe.res > 0 && j->type != job_type::fsync)
+		{
+			op->transferred += cqe.res;
+			if (op->transferred < op->length)
+			{
+				// a short read or write. Issue another one for the remainder
+				++m_inflight;
+				queue_op(*op);
+				return;
+			}
+		}
+		else if (j->type != job_type::fsync && op->transferred < op->length)
+		{
+			// we hit the end of the file. Like pread_all() and pwrite_all(),
+			// this is an error, otherwise the rest of the buffer would be
+			// passed on as if it had been read
+			if (!j->error)
+			{
+				j->error.ec = boost::asio::error::eof;
+				j->error.operation = j->type == job_type::write
+					? operation_t::file_write
+					: operation_t::file_read;
+				j->error.file(op->file_index);
+			}
+		}
+
+		if (--j->outstanding > 0) return;
+		complete_job(j);
+	}
+
+	void io_uring_disk_io::async_read(storage_index_t const storage, peer_request const& r
+		, std::function<void(disk_buffer_holder, storage_error const&)> handler
+		, disk_job_flags_t const flags)
+	{
+		TORRENT_ASSERT(r.length <= default_block_size);
+		TORRENT_ASSERT(r.length > 0);
+		TORRENT_ASSERT(r.start >= 0);
+		TORRENT_ASSERT(r.start + r.length <= m_torrents[storage]->files().piece_size(r.piece));
+
+		storage_error ec;
+		if (r.length <= 0 || r.start < 0)
+		{
+			// this is an invalid read request.
+			ec.ec = errors::invalid_request;
+			ec.operation = operation_t::file_read;
+			handler(disk_buffer_holder{}, ec);
+			return;
+		}
+
+		disk_buffer_holder buffer(m_buffer_pool
+			, m_buffer_pool.allocate_buffer("send buffer"), r.length);
+		if (!buffer)
+		{
+			ec.ec = error::no_memory;
+			ec.operation = operation_t::alloc_cache_piece;
+			post(m_ios, [ec, h = std::move(handler)] { h(disk_buffer_holder{}, ec); });
+			return;
+		}
+
+		char* const buf = buffer.data();
+		auto* j = new uring_job(job_type::read, storage, m_torrents[storage]);
+		++m_num_jobs;
+		++m_num_read_jobs;
+		j->on_complete = [this, h = std::move(handler)
+			, b = std::make_shared<disk_buffer_holder>(std::move(buffer))](uring_job& job)
+		{
+			if (!job.error.ec)
+			{
+				std::int64_t const read_time = total_microseconds(clock_type::now() - job.start_time);
+				m_stats_counters.inc_stats_counter(counters::num_blocks_read);
+				m_stats_counters.inc_stats_counter(counters::num_read_ops);
+				m_stats_counters.inc_stats_counter(counters::disk_read_time, read_time);
+				m_stats_counters.inc_stats_counter(counters::disk_job_time, read_time);
+			}
+			--m_num_jobs;
+			--m_num_read_jobs;
+			h(std::move(*b), job.error);
+			return true;
+		};
+
+		add_job(storage, false, [this, j, r, flags, buf]
+		{
+			// the request may not be aligned to blocks, in which case it spans
+			// two. Either of them may still be in the store buffer
+			int const first_block = r.start / default_block_size;
+			std::vector<aux::pread_storage::file_slice> slices;
+			int pos = 0;
+			for (int block = first_block; pos < r.length; ++block)
+			{
+				int const block_offset = block * default_block_size;
+				int const start = std::max(r.start - block_offset, 0);
+				int const len = std::min(default_block_size - start, r.length - pos);
+
+				if (!m_store_buffer.get({j->storage, r.piece, block_offset}
+					, [&](char const* b) { std::memcpy(buf + pos, b + start, std::size_t(len)); }))
+				{
+					j->st->prepare_read(m_settings, {buf + pos, len}, r.piece
+						, block_offset + start, file_mode(flags), slices, j->error);
+					if (j->error)
+					{
+						j->ops.clear();
+						break;
+					}
+					add_ops(*j, slices, buf + pos);
+				}
+				pos += len;
+			}
+			submit(j);
+		});
+	}
+
+	bool io_uring_disk_io::async_write(storage_index_t const storage, peer_request const& r
+		, char const* buf, std::shared_ptr<disk_observer> o
+		, std::function<void(storage_error const&)> handler
+		, disk_job_flags_t const flags)
+	{
+		bool exceeded = false;
+		disk_buffer_holder buffer(m_buffer_pool, m_buffer_pool.allocate_buffer(
+			exceeded, o, "write cache"), default_block_size);
+		if (!buffer) aux::throw_ex<std::bad_alloc>();
+		std::memcpy(buffer.data(), buf, aux::numeric_cast<std::size_t>(r.length));
+
+		TORRENT_ASSERT(r.start % default_block_size == 0);
+		TORRENT_ASSERT(r.length <= default_block_size);
+		TORRENT_ASSERT(r.start + r.length <= m_torrents[storage]->files().piece_size(r.piece));
+
+		// reads of this block are served from the store buffer until the write
+		// completes. If an earlier write of the same block is still in flight,
+		// this one is issued as a fence, once that one has completed
+		aux::torrent_location const loc{storage, r.piece, r.start};
+		bool const overwrite = m_store_buffer.get(loc, [](char const*) {});
+		char* const write_buf = buffer.data();
+		if (!overwrite) m_store_buffer.insert(loc, write_buf);
+
+		auto* j = new uring_job(job_type::write, storage, m_torrents[storage]);
+		++m_num_jobs;
+		++m_num_write_jobs;
+		j->on_complete = [this, loc, h = std::move(handler)
+			, b = std::make_shared<disk_buffer_holder>(std::move(buffer))](uring_job& job)
+		{
+			m_store_buffer.erase(loc);
+			b->reset();
+			if (!job.error.ec)
+			{
+				auto& dirty = m_storage_state[job.storage].dirty_files;
+				for (auto const& op : job.ops)
+					dirty[op.file_index] = op.file;
+
+				std::int64_t const write_time = total_microseconds(clock_type::now() - job.start_time);
+				m_stats_counters.inc_stats_counter(counters::num_blocks_written);
+				m_stats_counters.inc_stats_counter(counters::num_write_ops);
+				m_stats_counters.inc_stats_counter(counters::disk_write_time, write_time);
+				m_stats_counters.inc_stats_counter(counters::disk_job_time, write_time);
+			}
+			--m_num_jobs;
+			--m_num_write_jobs;
+			h(job.error);
+			return true;
+		};
+
+		add_job(storage, overwrite, [this, j, r, flags, loc, overwrite, write_buf]
+		{
+			if (overwrite) m_store_buffer.insert(loc, write_buf);
+			std::vector<aux::pread_storage::file_slice> slices;
+			j->st->prepare_write(m_settings, {write_buf, r.length}, r.piece, r.start
+				, file_mode(flags), slices, j->error);
+			if (!j->error) add_ops(*j, slices, write_buf);
+			submit(j);
+		});
+		return exceeded;
+	}
+
+	void io_uring_disk_io::async_hash(storage_index_t const storage
+		, piece_index_t const piece, span<sha256_hash> const v2, disk_job_flags_t const flags
+		, std::function<void(piece_index_t, sha1_hash const&, storage_error const&)> handler)
+	{
+		auto& st = m_torrents[storage];
+		auto hs = std::make_shared<hash_state>();
+		hs->piece = piece;
+		hs->flags = flags;
+		hs->v1 = bool(flags & disk_interface::v1_hash);
+		hs->piece_size = hs->v1 ? st->files().piece_size(piece) : 0;
+		hs->piece_size2 = v2.empty() ? 0 : st->files().piece_size2(piece);
+		hs->blocks_in_piece2 = v2.empty() ? 0 : st->files().blocks_in_piece2(piece);
+		int const blocks_in_piece = (hs->piece_size + default_block_size - 1) / default_block_size;
+		hs->blocks_to_read = std::max(blocks_in_piece, hs->blocks_in_piece2);
+		hs->block_hashes = v2;
+		hs->handler = std::move(handler);
+
+		TORRENT_ASSERT(v2.empty() || int(v2.size()) >= hs->blocks_in_piece2);
+		TORRENT_ASSERT(hs->v1 || !v2.empty());
+
+		auto* j = new uring_job(job_type::hash, storage, st);
+		++m_num_jobs;
+		++m_num_read_jobs;
+		j->on_complete = [this, hs](uring_job& job) { return hash_batch_done(job, *hs); };
+		add_job(storage, false, [this, j, hs] { read_hash_batch(*j, *hs); });
+	}
+
+	void io_uring_disk_io::read_hash_batch(uring_job& j, hash_state& hs)
+	{
+		hs.batch_size = std::min(hash_batch_size, hs.blocks_to_read - hs.batch_start);
+		std::vector<aux::pread_storage::file_slice> slices;
+		for (int i = 0; i < hs.batch_size; ++i)
+		{
+			if (int(hs.buffers.size()) <= i)
+			{
+				disk_buffer_holder buf(m_buffer_pool
+					, m_buffer_pool.allocate_buffer("hash buffer"), default_block_size);
+				if (!buf)
+				{
+					// hash fewer blocks at a time, unless we can't even
+					// allocate one
+					if (i > 0)
+					{
+						hs.batch_size = i;
+						break;
+					}
+					j.error.ec = error::no_memory;
+					j.error.operation = operation_t::alloc_cache_piece;
+					break;
+				}
+				hs.buffers.push_back(std::move(buf));
+			}
+
+			int const block = hs.batch_start + i;
+			int const offset = block * default_block_size;
+			int const len = hs.v1 ? std::min(default_block_size, hs.piece_size - offset) : 0;
+			int const len2 = block < hs.blocks_in_piece2
+				? std::min(default_block_size, hs.piece_size2 - offset) : 0;
+			int const size = std::max(len, len2);
+			char* const buf = hs.buffers[std::size_t(i)].data();
+
+			if (m_store_buffer.get({j.storage, hs.piece, offset}
+				, [&](char const* b) { std::memcpy(buf, b, std::size_t(size)); }))
+			{
+				hs.filled[std::size_t(i)] = size;
+				continue;
+			}
+
+			int const ret = j.st->prepare_read(m_settings, {buf, size}, hs.piece, offset
+				, file_mode(hs.flags), slices, j.error);
+			if (j.error) break;
+
+			// the part of the block that was read synchronously (from pad files
+			// or the part file). The rest is added as the ops complete
+			int pending = 0;
+			for (auto const& s : slices) pending += s.length;
+			hs.filled[std::size_t(i)] = ret - pending;
+			add_ops(j, slices, buf, i);
+		}
+		if (j.error) j.ops.clear();
+		submit(&j);
+	}
+
+	bool io_uring_disk_io::hash_batch_done(uring_job& j, hash_state& hs)
+	{
+		bool done = bool(j.error);
+		if (!done)
+		{
+			for (auto const& op : j.ops)
+			{
+				hs.filled[std::size_t(op.tag)] += op.transferred;
+				m_stats_counters.inc_stats_counter(counters::num_read_back);
+				m_stats_counters.inc_stats_counter(counters::num_read_ops);
+			}
+
+			// the v2 block hashes of the batch are computed in parallel
+			std::array<span<char const>, hash_batch_size> v2_blocks;
+			int num_v2 = 0;
+			for (int i = 0; i < hs.batch_size; ++i)
+			{
+				int const block = hs.batch_start + i;
+				int const offset = block * default_block_size;
+				int const len = hs.v1 ? std::min(default_block_size, hs.piece_size - offset) : 0;
+				char const* buf = hs.buffers[std::size_t(i)].data();
+
+				if (hs.v1) hs.ph.update({buf, len});
+				if (block < hs.blocks_in_piece2)
+				{
+					int const len2 = std::min(default_block_size, hs.piece_size2 - offset);
+					v2_blocks[std::size_t(num_v2++)] = {buf, len2};
+				}
+
+				// like the other back-ends, stop at the end of the file
+				if (hs.filled[std::size_t(i)] <= 0)
+				{
+					done = true;
+					break;
+				}
+			}
+			if (num_v2 > 0)
+			{
+				aux::multi_sha256(span<span<char const> const>(v2_blocks).first(num_v2)
+					, hs.block_hashes.subspan(hs.batch_start, num_v2));
+			}
+
+			hs.batch_start += hs.batch_size;
+			if (hs.batch_start >= hs.blocks_to_read) done = true;
+		}
+
+		if (!done)
+		{
+			j.ops.clear();
+			hs.filled.fill(0);
+			read_hash_batch(j, hs);
+			return false;
+		}
+
+		if (!j.error.ec)
+		{
+			std::int64_t const hash_time = total_microseconds(clock_type::now() - j.start_time);
+			m_stats_counters.inc_stats_counter(counters::disk_hash_time, hash_time);
+			m_stats_counters.inc_stats_counter(counters::disk_job_time, hash_time);
+		}
+		hs.buffers.clear();
+		--m_num_jobs;
+		--m_num_read_jobs;
+		hs.handler(hs.piece, hs.v1 ? hs.ph.final() : sha1_hash{}, j.error);
+		return true;
+	}
+
+	void io_uring_disk_io::async_hash2(storage_index_t const storage
+		, piece_index_t const piece, int const offset, disk_job_flags_t const flags
+		, std::function<void(piece_index_t, sha256_hash const&, storage_error const&)> handler)
+	{
+		auto& st = m_torrents[storage];
+		int const piece_size = st->files().piece_size2(piece);
+		TORRENT_ASSERT(piece_size > offset);
+		int const len = std::min(default_block_size, piece_size - offset);
+
+		disk_buffer_holder buffer(m_buffer_pool
+			, m_buffer_pool.allocate_buffer("hash buffer"), default_block_size);
+		if (!buffer)
+		{
+			storage_error ec;
+			ec.ec = error::no_memory;
+			ec.operation = operation_t::alloc_cache_piece;
+			post(m_ios, [=, h = std::move(handler)] { h(piece, sha256_hash{}, ec); });
+			return;
+		}
+
+		char* const buf = buffer.data();
+		auto* j = new uring_job(job_type::hash, storage, st);
+		++m_num_jobs;
+		++m_num_read_jobs;
+		j->on_complete = [this, piece, len, h = std::move(handler)
+			, b = std::make_shared<disk_buffer_holder>(std::move(buffer))](uring_job& job)
+		{
+			sha256_hash hash;
+			if (!job.error.ec)
+			{
+				hash = hasher256(span<char const>(b->data(), len)).final();
+				std::int64_t const hash_time = total_microseconds(clock_type::now() - job.start_time);
+				m_stats_counters.inc_stats_counter(counters::disk_hash_time, hash_time);
+				m_stats_counters.inc_stats_counter(counters::disk_job_time, hash_time);
+			}
+			b->reset();
+			--m_num_jobs;
+			--m_num_read_jobs;
+			h(piece, hash, job.error);
+			return true;
+		};
+
+		add_job(storage, false, [this, j, piece, offset, len, flags, buf]
+		{
+			if (!m_store_buffer.get({j->storage, piece, offset}
+				, [&](char const* b) { std::memcpy(buf, b, std::size_t(len)); }))
+			{
+				std::vector<aux::pread_storage::file_slice> slices;
+				j->st->prepare_read(m_settings, {buf, len}, piece, offset
+					, file_mode(flags), slices, j->error);
+				if (!j->error) add_ops(*j, slices, buf);
+			}
+			submit(j);
+		});
+	}
+
+	void io_uring_disk_io::async_move_storage(storage_index_t const storage
+		, std::string p, move_flags_t const flags
+		, std::function<void(status_t, std::string const&, storage_error const&)> handler)
+	{
+		add_file_job(storage, [this, p, flags, h = std::move(handler)](aux::pread_storage& st)
+		{
+			// if files have to be closed, that's the storage's responsibility
+			storage_error error;
+			auto ret = st.move_storage(p, flags, error);
+			post(m_ios, [=] { h(ret.first, ret.second, error); });
+		});
+	}
+
+	void io_uring_disk_io::async_release_files(storage_index_t const storage
+		, std::function<void()> handler)
+	{
+		add_file_job(storage, [this, h = std::move(handler)](aux::pread_storage& st)
+		{
+			storage_error ignore;
+			st.release_files(ignore);
+			if (h) post(m_ios, h);
+		});
+	}
+
+	void io_uring_disk_io::async_delete_files(storage_index_t const storage
+		, remove_flags_t const options
+		, std::function<void(storage_error const&)> handler)
+	{
+		add_job(storage, true, [this, storage, options, h = std::move(handler)]
+		{
+			m_storage_state[storage].dirty_files.clear();
+			start_file_job(storage, [this, options, h](aux::pread_storage& st)
+			{
+				storage_error error;
+				st.delete_files(options, error);
+				post(m_ios, [=] { h(error); });
+			});
+		});
+	}
+
+	void io_uring_disk_io::async_check_files(storage_index_t const storage
+		, add_torrent_params const* resume_data
+		, aux::vector<std::string, file_index_t> links
+		, std::function<void(status_t, storage_error const&)> handler)
+	{
+		add_file_job(storage, [this, resume_data, links, h = std::move(handler)](aux::pread_storage& st)
+		{
+			storage_error error;
+			status_t const ret = check_fastresume(st, resume_data, links, error);
+			post(m_ios, [=] { h(ret, error); });
+		});
+	}
+
+	status_t io_uring_disk_io::check_fastresume(aux::pread_storage& st
+		, add_torrent_params const* rd
+		, aux::vector<std::string, file_index_t> const& links
+		, storage_error& error)
+	{
+		add_torrent_params tmp;
+		if (rd == nullptr) rd = &tmp;
+
+		TORRENT_ASSERT(st.files().piece_length() > 0);
+
+		// always initialize the storage
+		auto const ret_flag = st.initialize(m_settings, error);
+		if (error) return disk_status::fatal_disk_error | ret_flag;
+
+		// we must call verify_resume() unconditionally of the setting below, in
+		// order to set up the links (if present)
+		bool const verify_success = st.verify_resume_data(*rd, links, error);
+
+		if (m_settings.get_bool(settings_pack::no_recheck_incomplete_resume))
+			return ret_flag;
+
+		if (!aux::contains_resume_data(*rd))
+		{
+			// if we don't have any resume data, we still may need to trigger a
+			// full re-check, if there are *any* files.
+			storage_error ignore;
+			return st.has_any_file(ignore)
+				? disk_status::need_full_check | ret_flag
+				: ret_flag;
+		}
+
+		return verify_success ? ret_flag : disk_status::need_full_check | ret_flag;
+	}
+
+	void io_uring_disk_io::async_rename_file(storage_index_t const storage
+		, file_index_t const index, std::string name
+		, std::function<void(std::string const&, file_index_t, storage_error const&)> handler)
+	{
+		add_file_job(storage, [this, index, name, h = std::move(handler)](aux::pread_storage& st)
+		{
+			// if files need to be closed, that's the storage's responsibility
+			storage_error error;
+			st.rename_file(index, name, error);
+			post(m_ios, [=] { h(name, index, error); });
+		});
+	}
+
+	void io_uring_disk_io::async_stop_torrent(storage_index_t const storage
+		, std::function<void()> handler)
+	{
+		add_job(storage, true, [this, storage, h = std::move(handler)]
+		{
+			// make sure everything we've written has hit the disk before the
+			// files are closed
+			sync_files(storage, [this, storage, h]
+			{
+				start_file_job(storage, [this, h](aux::pread_storage& st)
+				{
+					storage_error ignore;
+					st.release_files(ignore);
+					if (h) post(m_ios, h);
+				});
+			});
+		});
+	}
+
+	void io_uring_disk_io::sync_files(storage_index_t const storage
+		, std::function<void()> f)
+	{
+		auto* j = new uring_job(job_type::fsync, storage, m_torrents[storage]);
+		auto& dirty = m_storage_state[storage].dirty_files;
+		for (auto const& d : dirty)
+		{
+			auto file = d.second.lock();
+			if (!file) continue;
+			j->ops.push_back({j, std::move(file), d.first, 0, nullptr, 0, 0, 0});
+		}
+		dirty.clear();
+
+		++m_num_jobs;
+		j->on_complete = [this, f = std::move(f)](uring_job&)
+		{
+			--m_num_jobs;
+			f();
+			return true;
+		};
+		submit(j);
+	}
+
+	void io_uring_disk_io::async_set_file_priority(storage_index_t const storage
+		, aux::vector<download_priority_t, file_index_t> prios
+		, std::function<void(storage_error const&
+			, aux::vector<download_priority_t, file_index_t>)> handler)
+	{
+		add_file_job(storage, [this, prios, h = std::move(handler)](aux::pread_storage& st) mutable
+		{
+			storage_error error;
+			st.set_file_priority(m_settings, prios, error);
+			post(m_ios, [=] { h(error, prios); });
+		});
+	}
+
+	void io_uring_disk_io::async_clear_piece(storage_index_t const storage
+		, piece_index_t const index, std::function<void(piece_index_t)> handler)
+	{
+		// all writes issued before this must complete before the handler is
+		// called, this is why it's a fence
+		add_job(storage, true, [this, index, h = std::move(handler)]
+		{
+			post(m_ios, [=] { h(index); });
+		});
+	}
+
+	void io_uring_disk_io::update_stats_counters(counters& c) const
+	{
+		int queued = int(m_backlog.size());
+		for (auto const& s : m_storage_state)
+			queued += int(s.deferred.size());
+		{
+			std::lock_guard<std::mutex> l(m_job_mutex);
+			queued += m_file_threads.queue_size();
+		}
+
+		c.set_value(counters::num_read_jobs, m_num_read_jobs);
+		c.set_value(counters::num_write_jobs, m_num_write_jobs);
+		c.set_value(counters::num_jobs, m_num_jobs);
+		c.set_value(counters::queued_disk_jobs, queued);
+
+		// gauges
+		m_buffer_pool.update_stats_counters(c);
+
+		std::int64_t hits;
+		std::int64_t misses;
+		std::int64_t stalls;
+		std::int64_t races;
+		std::int64_t num_files;
+		std::tie(hits, misses, stalls, races, num_files) = m_file_pool.stats_counters();
+		c.set_value(counters::file_pool_hits, hits);
+		c.set_value(counters::file_pool_misses, misses);
+		c.set_value(counters::file_pool_thread_stall, stalls);
+		c.set_value(counters::file_pool_race, races);
+		c.set_value(counters::file_pool_size, num_files);
+	}
+
+	std::vector<open_file_state> io_uring_disk_io::get_status(storage_index_t const st) const
+	{
+		return m_file_pool.get_status(st);
+	}
+
+	void io_uring_disk_io::on_slab(char* const base, int const size, bool const added)
+	{
+#ifdef IORING_RSRC_REGISTER_SPARSE
+		std::lock_guard<std::mutex> l(m_fixed_mutex);
+		if (added)
+		{
+			// if we run out of slots, or exceed RLIMIT_MEMLOCK, the slab is
+			// just not registered
+			if (m_free_fixed_slots.empty()) return;
+			int const slot = m_free_fixed_slots.back();
+			iovec const iov{base, std::size_t(size)};
+			if (m_ring.update_buffer(unsigned(slot), iov) < 0) return;
+			m_free_fixed_slots.pop_back();
+			m_fixed_buffers[base] = {slot, size};
+		}
+		else
+		{
+			auto const it = m_fixed_buffers.find(base);
+			if (it == m_fixed_buffers.end()) return;
+			iovec const iov{nullptr, 0};
+			m_ring.update_buffer(unsigned(it->second.first), iov);
+			m_free_fixed_slots.push_back(it->second.first);
+			m_fixed_buffers.erase(it);
+		}
+#else
+		TORRENT_UNUSED(base);
+		TORRENT_UNUSED(size);
+		TORRENT_UNUSED(added);
+#endif
+	}
+
+	int io_uring_disk_io::fixed_buffer_index(char const* const buf) const
+	{
+		std::lock_guard<std::mutex> l(m_fixed_mutex);
+		auto it = m_fixed_buffers.upper_bound(buf);
+		if (it == m_fixed_buffers.begin()) return -1;
+		--it;
+		if (buf >= it->first + it->second.second) return -1;
+		return it->second.first;
+	}
+}
+
+#endif // TORRENT_HAVE_IO_URING
@@ -18,6 +18,10 @@ see LICENSE file.
 
 #include <tuple>
 #include <algorithm>
+#include <array>
+#include <cstring>
+#include <functional>
+#include <limits>
 #include <utility>
 #include <map>
 #include <set>
@@ -32,6 +36,7 @@ see LICENSE file.
 #include <libtorrent/aux_/numeric_cast.hpp>
 #include <libtorrent/aux_/ip_helpers.hpp> // for is_v4
 #include <libtorrent/bdecode.hpp>
+#include <libtorrent/hasher.hpp>
 
 namespace libtorrent::dht {
 namespace {
@@ -168,171 +173,31 @@ namespace {
 		int count() const { return int(samples.size()); }
 	};
 
-	class dht_default_storage final : public dht_storage_interface
+	// the parts the storage implementations have in common. Immutable and
+	// mutable items, and the sample of info-hashes, are kept the same way by
+	// all of them. They differ in how torrents and peers are stored
+	class dht_storage_base : public dht_storage_interface
 	{
 	public:
 
-		explicit dht_default_storage(settings_interface const& settings)
+		explicit dht_storage_base(settings_interface const& settings)
 			: m_settings(settings)
 		{
 			m_counters.reset();
 		}
 
-		~dht_default_storage() override = default;
-
-		dht_default_storage(dht_default_storage const&) = delete;
-		dht_default_storage& operator=(dht_default_storage const&) = delete;
+		dht_storage_base(dht_storage_base const&) = delete;
+		dht_storage_base& operator=(dht_storage_base const&) = delete;
 
 #if TORRENT_ABI_VERSION == 1
-		size_t num_torrents() const override { return m_map.size(); }
-		size_t num_peers() const override
-		{
-			size_t ret = 0;
-			for (auto const& t : m_map)
-				ret += t.second.peers4.size() + t.second.peers6.size();
-			return ret;
-		}
+		size_t num_torrents() const override { return std::size_t(m_counters.torrents); }
+		size_t num_peers() const override { return std::size_t(m_counters.peers); }
 #endif
 		void update_node_ids(std::vector<node_id> const& ids) override
 		{
 			m_node_ids = ids;
 		}
 
-		bool get_peers(sha1_hash const& info_hash
-			, bool const noseed, bool const scrape, address const& requester
-			, entry& peers) const override
-		{
-			auto const i = m_map.find(info_hash);
-			if (i == m_map.end()) return int(m_map.size()) >= m_settings.get_int(settings_pack::dht_max_torrents);
-
-			torrent_entry const& v = i->second;
-			auto const& peersv = requester.is_v4() ? v.peers4 : v.peers6;
-
-			if (!v.name.empty()) peers["n"] = v.name;
-
-			if (scrape)
-			{
-				aux::bloom_filter<256> downloaders;
-				aux::bloom_filter<256> seeds;
-
-				for (auto const& p : peersv)
-				{
-					sha1_hash const iphash = aux::hash_address(p.addr.address());
-					if (p.seed) seeds.set(iphash);
-					else downloaders.set(iphash);
-				}
-
-				peers["BFpe"] = downloaders.to_string();
-				peers["BFsd"] = seeds.to_string();
-			}
-			else
-			{
-				tcp const protocol = requester.is_v4() ? tcp::v4() : tcp::v6();
-				int to_pick = m_settings.get_int(settings_pack::dht_max_peers_reply);
-				TORRENT_ASSERT(to_pick >= 0);
-				// if these are IPv6 peers their addresses are 4x the size of IPv4
-				// so reduce the max peers 4 fold to compensate
-				// max_peers_reply should probably be specified in bytes
-				if (!peersv.empty() && protocol == tcp::v6())
-					to_pick /= 4;
-				entry::list_type& pe = peers["values"].list();
-
-				int candidates = int(std::count_if(peersv.begin(), peersv.end()
-					, [=](peer_entry const& e) { return !(noseed && e.seed); }));
-
-				to_pick = std::min(to_pick, candidates);
-
-				for (auto iter = peersv.begin(); to_pick > 0; ++iter)
-				{
-					// if the node asking for peers is a seed, skip seeds from the
-					// peer list
-					if (noseed && iter->seed) continue;
-
-					TORRENT_ASSERT(candidates >= to_pick);
-
-					// pick this peer with probability
-					// <peers left to pick> / <peers left in the set>
-					if (aux::random(std::uint32_t(candidates--)) > std::uint32_t(to_pick))
-						continue;
-
-					pe.emplace_back();
-					std::string& str = pe.back().string();
-
-					str.resize(18);
-					std::string::iterator out = str.begin();
-					aux::write_endpoint(iter->addr, out);
-					str.resize(std::size_t(out - str.begin()));
-
-					--to_pick;
-				}
-			}
-
-			if (int(peersv.size()) < m_settings.get_int(settings_pack::dht_max_peers))
-				return false;
-
-			// we're at the max peers stored for this torrent
-			// only send a write token if the requester is already in the set
-			// only check for a match on IP because the peer may be announcing
-			// a different port than the one it is using to send DHT messages
-			peer_entry requester_entry;
-			requester_entry.addr.address(requester);
-			auto requester_iter = std::lower_bound(peersv.begin(), peersv.end(), requester_entry);
-			return requester_iter == peersv.end()
-				|| requester_iter->addr.address() != requester;
-		}
-
-		void announce_peer(sha1_hash const& info_hash
-			, tcp::endpoint const& endp
-			, string_view name, bool const seed) override
-		{
-			auto const ti = m_map.find(info_hash);
-			torrent_entry* v;
-			if (ti == m_map.end())
-			{
-				if (int(m_map.size()) >= m_settings.get_int(settings_pack::dht_max_torrents))
-				{
-					// we're at capacity, drop the announce
-					return;
-				}
-
-				m_counters.torrents += 1;
-				v = &m_map[info_hash];
-			}
-			else
-			{
-				v = &ti->second;
-			}
-
-			// the peer announces a torrent name, and we don't have a name
-			// for this torrent. Store it.
-			if (!name.empty() && v->name.empty())
-			{
-				v->name = name.substr(0, 100);
-			}
-
-			auto& peersv = aux::is_v4(endp) ? v->peers4 : v->peers6;
-
-			peer_entry peer;
-			peer.addr = endp;
-			peer.added = aux::time_now();
-			peer.seed = seed;
-			auto i = std::lower_bound(peersv.begin(), peersv.end(), peer);
-			if (i != peersv.end() && i->addr == endp)
-			{
-				*i = peer;
-			}
-			else if (int(peersv.size()) >= m_settings.get_int(settings_pack::dht_max_peers))
-			{
-				// we're at capacity, drop the announce
-				return;
-			}
-			else
-			{
-				peersv.insert(i, peer);
-				m_counters.peers += 1;
-			}
-		}
-
 		bool get_immutable_item(sha1_hash const& target
 			, entry& item) const override
 		{
@@ -458,7 +323,7 @@ namespace {
 		{
 			item["interval"] = std::clamp(m_settings.get_int(settings_pack::dht_sample_infohashes_interval)
 				, 0, sample_infohashes_interval_max);
-			item["num"] = int(m_map.size());
+			item["num"] = m_counters.torrents;
 
 			refresh_infohashes_sample();
 
@@ -469,26 +334,21 @@ namespace {
 			return m_infohashes_sample.count();
 		}
 
-		void tick() override
+		dht_storage_counters counters() const override
 		{
-			// look through all peers and see if any have timed out
-			for (auto i = m_map.begin(), end(m_map.end()); i != end;)
-			{
-				torrent_entry& t = i->second;
-				purge_peers(t.peers4);
-				purge_peers(t.peers6);
+			return m_counters;
+		}
 
-				if (!t.peers4.empty() || !t.peers6.empty())
-				{
-					++i;
-					continue;
-				}
+	protected:
 
-				// if there are no more peers, remove the entry altogether
-				i = m_map.erase(i);
-				m_counters.torrents -= 1;// peers is decreased by purge_peers
-			}
+		// calls f with the info-hash of every torrent stored, until it returns
+		// false
+		virtual void for_each_info_hash(std::function<bool(sha1_hash const&)> f) const = 0;
 
+		// removes the immutable and mutable items that haven't been put in
+		// dht_item_lifetime seconds
+		void expire_items()
+		{
 			if (0 == m_settings.get_int(settings_pack::dht_item_lifetime)) return;
 
 			time_point const now = aux::time_now();
@@ -519,38 +379,18 @@ namespace {
 			}
 		}
 
-		dht_storage_counters counters() const override
-		{
-			return m_counters;
-		}
-
-	private:
 		settings_interface const& m_settings;
 		dht_storage_counters m_counters;
 
 		std::vector<node_id> m_node_ids;
-		std::map<node_id, torrent_entry> m_map;
+
+	private:
+
 		std::map<node_id, dht_immutable_item> m_immutable_table;
 		std::map<node_id, dht_mutable_item> m_mutable_table;
 
 		infohashes_sample m_infohashes_sample;
 
-		void purge_peers(std::vector<peer_entry>& peers)
-		{
-			auto now = aux::time_now();
-			auto new_end = std::remove_if(peers.begin(), peers.end()
-				, [=](peer_entry const& e)
-			{
-				return e.added + announce_interval * 3 / 2 < now;
-			});
-
-			m_counters.peers -= std::int32_t(std::distance(new_end, peers.end()));
-			peers.erase(new_end, peers.end());
-			// if we're using less than 1/4 of the capacity free up the excess
-			if (!peers.empty() && peers.capacity() / peers.size() >= 4U)
-				peers.shrink_to_fit();
-		}
-
 		void refresh_infohashes_sample()
 		{
 			time_point const now = aux::time_now();
@@ -559,7 +399,7 @@ namespace {
 
 			int const max_count = std::clamp(m_settings.get_int(settings_pack::dht_max_infohashes_sample_count)
 				, 0, infohashes_sample_count_max);
-			int const count = std::min(max_count, int(m_map.size()));
+			int const count = std::min(max_count, int(m_counters.torrents));
 
 			if (interval > 0
 				&& m_infohashes_sample.created + seconds(interval) > now
@@ -571,42 +411,698 @@ namespace {
 			samples.reserve(count);
 
 			int to_pick = count;
-			int candidates = int(m_map.size());
+			int candidates = int(m_counters.torrents);
 
-			for (auto const& t : m_map)
+			for_each_info_hash([&](sha1_hash const& ih)
 			{
 				if (to_pick == 0)
-					break;
+					return false;
 
 				TORRENT_ASSERT(candidates >= to_pick);
 
 				// pick this key with probability
 				// <keys left to pick> / <keys left in the set>
 				if (aux::random(std::uint32_t(candidates--)) > std::uint32_t(to_pick))
-					continue;
+					return true;
 
-				samples.push_back(t.first);
+				samples.push_back(ih);
 				--to_pick;
-			}
+				return true;
+			});
 
 			TORRENT_ASSERT(int(samples.size()) == count);
 			m_infohashes_sample.created = now;
 		}
 	};
-}
 
-void dht_storage_counters::reset()
-{
-	torrents = 0;
-	peers = 0;
-	immutable_data = 0;
-	mutable_data = 0;
-}
+	class dht_default_storage final : public dht_storage_base
+	{
+	public:
 
-std::unique_ptr<dht_storage_interface> dht_default_storage_constructor(
-	settings_interface const& settings)
-{
-	return std::make_unique<dht_default_storage>(settings);
+		explicit dht_default_storage(settings_interface const& settings)
+			: dht_storage_base(settings)
+		{}
+
+		~dht_default_storage() override = default;
+
+		bool get_peers(sha1_hash const& info_hash
+			, bool const noseed, bool const scrape, address const& requester
+			, entry& peers) const override
+		{
+			auto const i = m_map.find(info_hash);
+			if (i == m_map.end()) return int(m_map.size()) >= m_settings.get_int(settings_pack::dht_max_torrents);
+
+			torrent_entry const& v = i->second;
+			auto const& peersv = requester.is_v4() ? v.peers4 : v.peers6;
+
+			if (!v.name.empty()) peers["n"] = v.name;
+
+			if (scrape)
+			{
+				aux::bloom_filter<256> downloaders;
+				aux::bloom_filter<256> seeds;
+
+				for (auto const& p : peersv)
+				{
+					sha1_hash const iphash = aux::hash_address(p.addr.address());
+					if (p.seed) seeds.set(iphash);
+					else downloaders.set(iphash);
+				}
+
+				peers["BFpe"] = downloaders.to_string();
+				peers["BFsd"] = seeds.to_string();
+			}
+			else
+			{
+				tcp const protocol = requester.is_v4() ? tcp::v4() : tcp::v6();
+				int to_pick = m_settings.get_int(settings_pack::dht_max_peers_reply);
+				TORRENT_ASSERT(to_pick >= 0);
+				// if these are IPv6 peers their addresses are 4x the size of IPv4
+				// so reduce the max peers 4 fold to compensate
+				// max_peers_reply should probably be specified in bytes
+				if (!peersv.empty() && protocol == tcp::v6())
+					to_pick /= 4;
+				entry::list_type& pe = peers["values"].list();
+
+				int candidates = int(std::count_if(peersv.begin(), peersv.end()
+					, [=](peer_entry const& e) { return !(noseed && e.seed); }));
+
+				to_pick = std::min(to_pick, candidates);
+
+				for (auto iter = peersv.begin(); to_pick > 0; ++iter)
+				{
+					// if the node asking for peers is a seed, skip seeds from the
+					// peer list
+					if (noseed && iter->seed) continue;
+
+					TORRENT_ASSERT(candidates >= to_pick);
+
+					// pick this peer with probability
+					// <peers left to pick> / <peers left in the set>
+					if (aux::random(std::uint32_t(candidates--)) > std::uint32_t(to_pick))
+						continue;
+
+					pe.emplace_back();
+					std::string& str = pe.back().string();
+
+					str.resize(18);
+					std::string::iterator out = str.begin();
+					aux::write_endpoint(iter->addr, out);
+					str.resize(std::size_t(out - str.begin()));
+
+					--to_pick;
+				}
+			}
+
+			if (int(peersv.size()) < m_settings.get_int(settings_pack::dht_max_peers))
+				return false;
+
+			// we're at the max peers stored for this torrent
+			// only send a write token if the requester is already in the set
+			// only check for a match on IP because the peer may be announcing
+			// a different port than the one it is using to send DHT messages
+			peer_entry requester_entry;
+			requester_entry.addr.address(requester);
+			auto requester_iter = std::lower_bound(peersv.begin(), peersv.end(), requester_entry);
+			return requester_iter == peersv.end()
+				|| requester_iter->addr.address() != requester;
+		}
+
+		void announce_peer(sha1_hash const& info_hash
+			, tcp::endpoint const& endp
+			, string_view name, bool const seed) override
+		{
+			auto const ti = m_map.find(info_hash);
+			torrent_entry* v;
+			if (ti == m_map.end())
+			{
+				if (int(m_map.size()) >= m_settings.get_int(settings_pack::dht_max_torrents))
+				{
+					// we're at capacity, drop the announce
+					return;
+				}
+
+				m_counters.torrents += 1;
+				v = &m_map[info_hash];
+			}
+			else
+			{
+				v = &ti->second;
+			}
+
+			// the peer announces a torrent name, and we don't have a name
+			// for this torrent. Store it.
+			if (!name.empty() && v->name.empty())
+			{
+				v->name = name.substr(0, 100);
+			}
+
+			auto& peersv = aux::is_v4(endp) ? v->peers4 : v->peers6;
+
+			peer_entry peer;
+			peer.addr = endp;
+			peer.added = aux::time_now();
+			peer.seed = seed;
+			auto i = std::lower_bound(peersv.begin(), peersv.end(), peer);
+			if (i != peersv.end() && i->addr == endp)
+			{
+				*i = peer;
+			}
+			else if (int(peersv.size()) >= m_settings.get_int(settings_pack::dht_max_peers))
+			{
+				// we're at capacity, drop the announce
+				return;
+			}
+			else
+			{
+				peersv.insert(i, peer);
+				m_counters.peers += 1;
+			}
+		}
+
+		void tick() override
+		{
+			// look through all peers and see if any have timed out
+			for (auto i = m_map.begin(), end(m_map.end()); i != end;)
+			{
+				torrent_entry& t = i->second;
+				purge_peers(t.peers4);
+				purge_peers(t.peers6);
+
+				if (!t.peers4.empty() || !t.peers6.empty())
+				{
+					++i;
+					continue;
+				}
+
+				// if there are no more peers, remove the entry altogether
+				i = m_map.erase(i);
+				m_counters.torrents -= 1;// peers is decreased by purge_peers
+			}
+
+			expire_items();
+		}
+
+	private:
+
+		std::map<node_id, torrent_entry> m_map;
+
+		void for_each_info_hash(std::function<bool(sha1_hash const&)> f) const override
+		{
+			for (auto const& t : m_map)
+			{
+				if (!f(t.first)) break;
+			}
+		}
+
+		void purge_peers(std::vector<peer_entry>& peers)
+		{
+			auto now = aux::time_now();
+			auto new_end = std::remove_if(peers.begin(), peers.end()
+				, [=](peer_entry const& e)
+			{
+				return e.added + announce_interval * 3 / 2 < now;
+			});
+
+			m_counters.peers -= std::int32_t(std::distance(new_end, peers.end()));
+			peers.erase(new_end, peers.end());
+			// if we're using less than 1/4 of the capacity free up the excess
+			if (!peers.empty() && peers.capacity() / peers.size() >= 4U)
+				peers.shrink_to_fit();
+		}
+	};
+
+	// the peers stored by dht_sharded_storage. The address is in network byte
+	// order and the time of the (last) announce is in seconds, relative to when
+	// the storage was created. This is 12 bytes for an IPv4 peer, compared to
+	// 40 or more for peer_entry
+	template <typename Bytes>
+	struct compact_peer
+	{
+		Bytes addr;
+		std::uint16_t port;
+		bool seed;
+		std::uint32_t added;
+	};
+
+	template <typename Bytes>
+	bool operator<(compact_peer<Bytes> const& lhs, compact_peer<Bytes> const& rhs)
+	{
+		return std::tie(lhs.addr, lhs.port) < std::tie(rhs.addr, rhs.port);
+	}
+
+	using compact_peer4 = compact_peer<address_v4::bytes_type>;
+	using compact_peer6 = compact_peer<address_v6::bytes_type>;
+
+	struct compact_torrent_entry
+	{
+		std::string name;
+		std::vector<compact_peer4> peers4;
+		std::vector<compact_peer6> peers6;
+		// the most recent expiry bucket this torrent was added to
+		std::uint32_t expiry_bucket = std::numeric_limits<std::uint32_t>::max();
+	};
+
+	// the finalizer of splitmix64
+	std::uint64_t mix(std::uint64_t h)
+	{
+		h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+		return h ^ (h >> 31);
+	}
+
+	// info-hashes are picked by whoever announces them, so they are hashed with
+	// a random seed, to make it hard to come up with info-hashes that collide
+	std::uint64_t hash_info_hash(sha1_hash const& ih, std::uint64_t const seed)
+	{
+		std::uint64_t w[3] = {};
+		std::memcpy(w, ih.data(), std::size_t(ih.size()));
+		return mix(mix(mix(w[0] ^ seed) ^ w[1]) ^ w[2]);
+	}
+
+	// an open addressing hash table of torrents, keyed by info-hash, with
+	// linear probing. Every slot has a control byte, kept in a separate array,
+	// holding 7 bits of the hash of its key (with the high bit set), or 0 if
+	// the slot is empty. Probing only touches the slots whose bits match.
+	class torrent_table
+	{
+	public:
+
+		explicit torrent_table(std::uint64_t const seed) : m_seed(seed) {}
+
+		int size() const { return m_size; }
+
+		compact_torrent_entry* find(sha1_hash const& ih, std::uint64_t const hash)
+		{
+			std::size_t const i = find_slot(ih, hash);
+			return i == npos ? nullptr : &m_slots[i].torrent;
+		}
+
+		compact_torrent_entry const* find(sha1_hash const& ih, std::uint64_t const hash) const
+		{
+			std::size_t const i = find_slot(ih, hash);
+			return i == npos ? nullptr : &m_slots[i].torrent;
+		}
+
+		// the info-hash must not already be in the table
+		compact_torrent_entry& insert(sha1_hash const& ih, std::uint64_t const hash)
+		{
+			TORRENT_ASSERT(find_slot(ih, hash) == npos);
+			if ((std::size_t(m_size) + 1) * 4 > m_ctrl.size() * 3)
+				rehash(std::max(min_capacity, m_ctrl.size() * 2));
+
+			std::size_t const mask = m_ctrl.size() - 1;
+			std::size_t i = home_slot(hash, mask);
+			while (m_ctrl[i] != 0) i = (i + 1) & mask;
+			m_ctrl[i] = tag(hash);
+			m_slots[i].info_hash = ih;
+			++m_size;
+			return m_slots[i].torrent;
+		}
+
+		void erase(sha1_hash const& ih, std::uint64_t const hash)
+		{
+			std::size_t i = find_slot(ih, hash);
+			TORRENT_ASSERT(i != npos);
+			if (i == npos) return;
+
+			// move the following entries back into the hole, so that every entry
+			// can still be reached by probing from its home slot without passing
+			// an empty one
+			std::size_t const mask = m_ctrl.size() - 1;
+			for (std::size_t j = (i + 1) & mask; m_ctrl[j] != 0; j = (j + 1) & mask)
+			{
+				std::size_t const home = home_slot(hash_info_hash(m_slots[j].info_hash, m_seed), mask);
+				// the entry has to stay if its home slot is between the hole
+				// and the slot it's in
+				if (((j - home) & mask) < ((j - i) & mask)) continue;
+				m_ctrl[i] = m_ctrl[j];
+				m_slots[i] = std::move(m_slots[j]);
+				i = j;
+			}
+			m_ctrl[i] = 0;
+			m_slots[i] = torrent_slot();
+			--m_size;
+
+			if (m_ctrl.size() > min_capacity && std::size_t(m_size) * 8 < m_ctrl.size())
+				rehash(m_ctrl.size() / 2);
+		}
+
+		// calls f with every info-hash in the table, until it returns false.
+		// Returns false if f did
+		template <typename Fun>
+		bool for_each(Fun const& f) const
+		{
+			for (std::size_t i = 0; i < m_ctrl.size(); ++i)
+			{
+				if (m_ctrl[i] != 0 && !f(m_slots[i].info_hash)) return false;
+			}
+			return true;
+		}
+
+	private:
+
+		struct torrent_slot
+		{
+			sha1_hash info_hash;
+			compact_torrent_entry torrent;
+		};
+
+		static constexpr std::size_t min_capacity = 16;
+		static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+		// the lowest 7 bits of the hash are the tag, the bits above them pick
+		// the home slot. (The highest bits pick the shard)
+		static std::uint8_t tag(std::uint64_t const hash)
+		{ return std::uint8_t(0x80 | (hash & 0x7f)); }
+
+		static std::size_t home_slot(std::uint64_t const hash, std::size_t const mask)
+		{ return std::size_t(hash >> 7) & mask; }
+
+		std::size_t find_slot(sha1_hash const& ih, std::uint64_t const hash) const
+		{
+			if (m_size == 0) return npos;
+			std::size_t const mask = m_ctrl.size() - 1;
+			std::uint8_t const t = tag(hash);
+			for (std::size_t i = home_slot(hash, mask); m_ctrl[i] != 0; i = (i + 1) & mask)
+			{
+				if (m_ctrl[i] == t && m_slots[i].info_hash == ih) return i;
+			}
+			return npos;
+		}
+
+		void rehash(std::size_t const capacity)
+		{
+			TORRENT_ASSERT((capacity & (capacity - 1)) == 0);
+			TORRENT_ASSERT(capacity > std::size_t(m_size));
+			std::vector<std::uint8_t> ctrl(capacity, 0);
+			std::vector<torrent_slot> slots(capacity);
+			std::size_t const mask = capacity - 1;
+			for (std::size_t j = 0; j < m_ctrl.size(); ++j)
+			{
+				if (m_ctrl[j] == 0) continue;
+				std::size_t i = home_slot(hash_info_hash(m_slots[j].info_hash, m_seed), mask);
+				while (ctrl[i] != 0) i = (i + 1) & mask;
+				ctrl[i] = m_ctrl[j];
+				slots[i] = std::move(m_slots[j]);
+			}
+			m_ctrl = std::move(ctrl);
+			m_slots = std::move(slots);
+		}
+
+		std::uint64_t m_seed;
+		std::vector<std::uint8_t> m_ctrl;
+		std::vector<torrent_slot> m_slots;
+		int m_size = 0;
+	};
+
+	// peers are expired in batches, by when they announced. Every bucket lists
+	// the torrents that had a peer announce during a 5 minute window
+	constexpr std::uint32_t expiry_bucket_seconds = 5 * 60;
+	constexpr std::uint32_t peer_lifetime_seconds = std::uint32_t(
+		std::chrono::duration_cast<seconds>(announce_interval * 3 / 2).count());
+	// once this many buckets have started after the one a peer announced in,
+	// the peer has expired
+	constexpr std::uint32_t peer_lifetime_buckets = peer_lifetime_seconds / expiry_bucket_seconds + 1;
+	constexpr std::uint32_t num_expiry_buckets = 16;
+	static_assert(peer_lifetime_buckets < num_expiry_buckets, "too few expiry buckets");
+
+	constexpr int num_shard_bits = 5;
+
+	class dht_sharded_storage final : public dht_storage_base
+	{
+	public:
+
+		explicit dht_sharded_storage(settings_interface const& settings)
+			: dht_storage_base(settings)
+			, m_created(aux::time_now())
+		{
+			aux::random_bytes({reinterpret_cast<char*>(&m_seed), sizeof(m_seed)});
+			m_shards.reserve(1 << num_shard_bits);
+			for (int i = 0; i < 1 << num_shard_bits; ++i)
+				m_shards.emplace_back(m_seed);
+		}
+
+		~dht_sharded_storage() override = default;
+
+		bool get_peers(sha1_hash const& info_hash
+			, bool const noseed, bool const scrape, address const& requester
+			, entry& peers) const override
+		{
+			std::uint64_t const hash = hash_info_hash(info_hash, m_seed);
+			compact_torrent_entry const* v = shard(hash).find(info_hash, hash);
+			if (v == nullptr) return m_counters.torrents >= m_settings.get_int(settings_pack::dht_max_torrents);
+
+			if (!v->name.empty()) peers["n"] = v->name;
+
+			if (requester.is_v4())
+				return get_peers_impl(v->peers4, noseed, scrape, requester.to_v4().to_bytes(), peers);
+			else
+				return get_peers_impl(v->peers6, noseed, scrape, requester.to_v6().to_bytes(), peers);
+		}
+
+		void announce_peer(sha1_hash const& info_hash
+			, tcp::endpoint const& endp
+			, string_view name, bool const seed) override
+		{
+			std::uint32_t const now = now_seconds();
+			std::uint32_t const bucket = now / expiry_bucket_seconds;
+
+			// if tick() hasn't been called in a long time, the bucket this
+			// torrent is added to may still list torrents from the last time
+			// around
+			if (bucket >= m_next_expiry + num_expiry_buckets) expire_peers(now);
+
+			std::uint64_t const hash = hash_info_hash(info_hash, m_seed);
+			torrent_table& table = shard(hash);
+			compact_torrent_entry* v = table.find(info_hash, hash);
+			if (v == nullptr)
+			{
+				if (m_counters.torrents >= m_settings.get_int(settings_pack::dht_max_torrents))
+				{
+					// we're at capacity, drop the announce
+					return;
+				}
+
+				m_counters.torrents += 1;
+				v = &table.insert(info_hash, hash);
+			}
+
+			if (v->expiry_bucket != bucket)
+			{
+				v->expiry_bucket = bucket;
+				m_expiry[bucket % num_expiry_buckets].push_back(info_hash);
+			}
+
+			// the peer announces a torrent name, and we don't have a name
+			// for this torrent. Store it.
+			if (!name.empty() && v->name.empty())
+			{
+				v->name = name.substr(0, 100);
+			}
+
+			if (aux::is_v4(endp))
+				add_peer(v->peers4, endp.address().to_v4().to_bytes(), endp.port(), seed, now);
+			else
+				add_peer(v->peers6, endp.address().to_v6().to_bytes(), endp.port(), seed, now);
+		}
+
+		void tick() override
+		{
+			expire_peers(now_seconds());
+			expire_items();
+		}
+
+	private:
+
+		time_point const m_created;
+		std::uint64_t m_seed = 0;
+
+		// the torrents, split by the highest bits of the hash of their
+		// info-hash. Every shard grows (and rehashes) by itself, which bounds
+		// the time it takes to add a torrent
+		std::vector<torrent_table> m_shards;
+
+		// the info-hashes of the torrents that had peers announce in the
+		// bucket, indexed by the bucket number modulo num_expiry_buckets
+		std::array<std::vector<sha1_hash>, num_expiry_buckets> m_expiry;
+
+		// the oldest bucket that hasn't been expired yet
+		std::uint32_t m_next_expiry = 0;
+
+		std::uint32_t now_seconds() const
+		{
+			return std::uint32_t(total_seconds(aux::time_now() - m_created));
+		}
+
+		torrent_table& shard(std::uint64_t const hash)
+		{ return m_shards[std::size_t(hash >> (64 - num_shard_bits))]; }
+
+		torrent_table const& shard(std::uint64_t const hash) const
+		{ return m_shards[std::size_t(hash >> (64 - num_shard_bits))]; }
+
+		void for_each_info_hash(std::function<bool(sha1_hash const&)> f) const override
+		{
+			for (auto const& s : m_shards)
+			{
+				if (!s.for_each(f)) break;
+			}
+		}
+
+		template <typename Bytes>
+		bool get_peers_impl(std::vector<compact_peer<Bytes>> const& peersv
+			, bool const noseed, bool const scrape, Bytes const& requester
+			, entry& peers) const
+		{
+			if (scrape)
+			{
+				aux::bloom_filter<256> downloaders;
+				aux::bloom_filter<256> seeds;
+
+				for (auto const& p : peersv)
+				{
+					// the same as aux::hash_address()
+					sha1_hash const iphash = hasher(reinterpret_cast<char const*>(p.addr.data())
+						, int(p.addr.size())).final();
+					if (p.seed) seeds.set(iphash);
+					else downloaders.set(iphash);
+				}
+
+				peers["BFpe"] = downloaders.to_string();
+				peers["BFsd"] = seeds.to_string();
+			}
+			else
+			{
+				int to_pick = m_settings.get_int(settings_pack::dht_max_peers_reply);
+				TORRENT_ASSERT(to_pick >= 0);
+				// IPv6 addresses are 4x the size of IPv4 ones, reduce the max
+				// peers to compensate, like dht_default_storage does
+				if (!peersv.empty() && std::tuple_size<Bytes>::value == 16)
+					to_pick /= 4;
+				entry::list_type& pe = peers["values"].list();
+
+				int candidates = int(std::count_if(peersv.begin(), peersv.end()
+					, [=](compact_peer<Bytes> const& e) { return !(noseed && e.seed); }));
+
+				to_pick = std::min(to_pick, candidates);
+
+				for (auto iter = peersv.begin(); to_pick > 0; ++iter)
+				{
+					if (noseed && iter->seed) continue;
+
+					TORRENT_ASSERT(candidates >= to_pick);
+
+					// pick this peer with probability
+					// <peers left to pick> / <peers left in the set>
+					if (aux::random(std::uint32_t(candidates--)) > std::uint32_t(to_pick))
+						continue;
+
+					pe.emplace_back();
+					std::string& str = pe.back().string();
+					str.assign(iter->addr.begin(), iter->addr.end());
+					str.push_back(char(iter->port >> 8));
+					str.push_back(char(iter->port & 0xff));
+
+					--to_pick;
+				}
+			}
+
+			if (int(peersv.size()) < m_settings.get_int(settings_pack::dht_max_peers))
+				return false;
+
+			// we're at the max peers stored for this torrent
+			// only send a write token if the requester is already in the set
+			// (matching on IP only)
+			compact_peer<Bytes> const requester_entry{requester, 0, false, 0};
+			auto const i = std::lower_bound(peersv.begin(), peersv.end(), requester_entry);
+			return i == peersv.end() || i->addr != requester;
+		}
+
+		template <typename Bytes>
+		void add_peer(std::vector<compact_peer<Bytes>>& peersv, Bytes const& addr
+			, std::uint16_t const port, bool const seed, std::uint32_t const now)
+		{
+			compact_peer<Bytes> const peer{addr, port, seed, now};
+			auto const i = std::lower_bound(peersv.begin(), peersv.end(), peer);
+			if (i != peersv.end() && i->addr == addr && i->port == port)
+			{
+				*i = peer;
+			}
+			else if (int(peersv.size()) >= m_settings.get_int(settings_pack::dht_max_peers))
+			{
+				// we're at capacity, drop the announce
+				return;
+			}
+			else
+			{
+				peersv.insert(i, peer);
+				m_counters.peers += 1;
+			}
+		}
+
+		// purges the expired peers of the torrents listed in the buckets whose
+		// peers have all expired, and removes the torrents left without peers.
+		// Torrents not listed in those buckets don't have any expired peers
+		void expire_peers(std::uint32_t const now)
+		{
+			std::uint32_t const bucket = now / expiry_bucket_seconds;
+			while (m_next_expiry + peer_lifetime_buckets <= bucket)
+			{
+				auto& torrents = m_expiry[m_next_expiry % num_expiry_buckets];
+				for (auto const& ih : torrents)
+				{
+					std::uint64_t const hash = hash_info_hash(ih, m_seed);
+					torrent_table& table = shard(hash);
+					compact_torrent_entry* t = table.find(ih, hash);
+					// the torrent may already have been removed
+					if (t == nullptr) continue;
+
+					purge_peers(t->peers4, now);
+					purge_peers(t->peers6, now);
+					if (!t->peers4.empty() || !t->peers6.empty()) continue;
+
+					// if there are no more peers, remove the entry altogether
+					table.erase(ih, hash);
+					m_counters.torrents -= 1; // peers is decreased by purge_peers
+				}
+				torrents.clear();
+				++m_next_expiry;
+			}
+		}
+
+		template <typename Peer>
+		void purge_peers(std::vector<Peer>& peers, std::uint32_t const now)
+		{
+			auto const new_end = std::remove_if(peers.begin(), peers.end()
+				, [=](Peer const& p) { return p.added + peer_lifetime_seconds < now; });
+
+			m_counters.peers -= std::int32_t(std::distance(new_end, peers.end()));
+			peers.erase(new_end, peers.end());
+			// if we're using less than 1/4 of the capacity free up the excess
+			if (!peers.empty() && peers.capacity() / peers.size() >= 4U)
+				peers.shrink_to_fit();
+		}
+	};
+}
+
+void dht_storage_counters::reset()
+{
+	torrents = 0;
+	peers = 0;
+	immutable_data = 0;
+	mutable_data = 0;
+}
+
+std::unique_ptr<dht_storage_interface> dht_default_storage_constructor(
+	settings_interface const& settings)
+{
+	return std::make_unique<dht_default_storage>(settings);
+}
+
+std::unique_ptr<dht_storage_interface> dht_sharded_storage_constructor(
+	settings_interface const& settings)
+{
+	return std::make_unique<dht_sharded_storage>(settings);
 }
 
 } // namespace libtorrent::dht
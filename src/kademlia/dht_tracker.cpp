@@ -20,6 +20,7 @@ see LICENSE file.
 #include <libtorrent/kademlia/msg.hpp>
 #include <libtorrent/kademlia/dht_observer.hpp>
 #include <libtorrent/kademlia/dht_settings.hpp>
+#include <libtorrent/kademlia/item.hpp>
 
 #include <libtorrent/bencode.hpp>
 #include <libtorrent/version.hpp>
@@ -52,6 +53,35 @@ namespace libtorrent::dht {
 		c.inc_stats_counter(counters::dht_allocated_observers, allocated_observers);
 	}
 
+	// the max number of mutable puts waiting for, or being verified by, a
+	// DHT worker thread. Puts arriving when this many are in flight are
+	// dropped, rather than queuing up unbounded work and latency
+	constexpr int max_puts_in_flight = 1000;
+
+	// the max number of puts handed to a worker thread at a time, to have
+	// their signatures verified as a batch
+	constexpr std::size_t max_put_batch = 64;
+
+	// the salt of a put message. The salt size has already been checked
+	span<char const> put_salt(bdecode_node const& args)
+	{
+		bdecode_node const salt = args.dict_find_string("salt");
+		if (!salt) return {};
+		return {salt.string_ptr(), salt.string_length()};
+	}
+
+	// the signed fields of a mutable put that has been checked to have all
+	// the required fields, by verify_put_async()
+	mutable_item_signature put_signature(bdecode_node const& message)
+	{
+		bdecode_node const args = message.dict_find_dict("a");
+		return {args.dict_find("v").data_section()
+			, put_salt(args)
+			, sequence_number(args.dict_find_int_value("seq"))
+			, public_key(args.dict_find_string("k").string_ptr())
+			, signature(args.dict_find_string("sig").string_ptr())};
+	}
+
 	std::vector<udp::endpoint> concat(std::vector<udp::endpoint> const& v1
 		, std::vector<udp::endpoint> const& v2)
 	{
@@ -151,6 +181,12 @@ namespace libtorrent::dht {
 	{
 		m_running = true;
 
+#ifndef TORRENT_BUILD_SIMULATOR
+		int const worker_threads = m_settings.get_int(settings_pack::dht_worker_threads);
+		if (worker_threads > 0 && !m_verify_pool)
+			m_verify_pool = std::make_unique<boost::asio::thread_pool>(std::size_t(worker_threads));
+#endif
+
 		ADD_OUTSTANDING_ASYNC("dht_tracker::refresh_key");
 		refresh_key({});
 
@@ -181,6 +217,17 @@ namespace libtorrent::dht {
 			n.second.connection_timer.cancel();
 		m_refresh_timer.cancel();
 		m_host_resolver.cancel();
+
+		if (m_verify_pool)
+		{
+			m_puts_in_flight -= int(m_put_queue.size());
+			m_put_queue.clear();
+
+			// let the workers finish the puts they have been handed. They
+			// are dropped in on_puts_verified(), since we're not running
+			m_verify_pool->join();
+			m_verify_pool.reset();
+		}
 	}
 
 #if TORRENT_ABI_VERSION == 1
@@ -519,7 +566,10 @@ namespace libtorrent::dht {
 
 		int pos;
 		error_code err;
+		time_point const decode_start = clock_type::now();
 		int const ret = bdecode(buf.data(), buf.data() + buf_size, m_msg, err, &pos, 10, 500);
+		m_counters.inc_stats_counter(counters::dht_decode_time
+			, total_microseconds(clock_type::now() - decode_start));
 		if (ret != 0)
 		{
 			m_counters.inc_stats_counter(counters::dht_messages_in_dropped);
@@ -543,12 +593,133 @@ namespace libtorrent::dht {
 		m_log->log_packet(dht_logger::incoming_message, buf, ep);
 #endif
 
+		if (m_verify_pool && verify_put_async(s, ep, buf)) return true;
+
 		libtorrent::dht::msg const m(m_msg, ep);
+		time_point const start = clock_type::now();
 		for (auto& n : m_nodes)
 			n.second.dht.incoming(s, m);
+		m_counters.inc_stats_counter(counters::dht_incoming_time
+			, total_microseconds(clock_type::now() - start));
 		return true;
 	}
 
+	bool dht_tracker::verify_put_async(aux::listen_socket_handle const& s
+		, udp::endpoint const& ep, span<char const> const buf)
+	{
+		if (m_msg.dict_find_string_value("y") != "q"
+			|| m_msg.dict_find_string_value("q") != "put")
+			return false;
+
+		bdecode_node const args = m_msg.dict_find_dict("a");
+		if (!args) return false;
+
+		// anything the node would reject before verifying the signature is
+		// handled right away, on this thread. This includes the write token,
+		// so that a flood of puts with invalid tokens can't tie up the
+		// workers and crowd out legitimate puts
+		bdecode_node const token = args.dict_find_string("token");
+		bdecode_node const v = args.dict_find("v");
+		bdecode_node const seq = args.dict_find_int("seq");
+		bdecode_node const k = args.dict_find_string("k");
+		bdecode_node const sig = args.dict_find_string("sig");
+		if (!token || !v || !seq || !k || !sig
+			|| k.string_length() != public_key::len
+			|| sig.string_length() != signature::len
+			|| seq.int_value() < 0
+			|| v.data_section().size() > 1000
+			|| v.data_section().empty())
+			return false;
+
+		span<char const> const salt = put_salt(args);
+		if (salt.size() > 64) return false;
+
+		if (m_settings.get_bool(settings_pack::dht_read_only)) return false;
+
+		auto const n = m_nodes.find(s);
+		if (n == m_nodes.end()) return false;
+		if (!n->second.dht.verify_token(token.string_value()
+			, item_target_id(salt, public_key(k.string_ptr())), ep))
+			return false;
+
+		if (m_puts_in_flight >= max_puts_in_flight)
+		{
+			m_counters.inc_stats_counter(counters::dht_messages_in_dropped);
+			return true;
+		}
+
+		auto p = std::make_unique<pending_put>();
+		p->buffer.assign(buf.begin(), buf.end());
+		p->message = m_msg;
+		p->message.switch_underlying_buffer(p->buffer.data());
+		p->socket = s;
+		p->ep = ep;
+		p->queued = clock_type::now();
+		++m_puts_in_flight;
+
+		// puts are verified in batches. The queue is flushed once the
+		// current batch of packets has been handled (or when it's full), so
+		// all puts received in one batch are verified together
+		m_put_queue.push_back(std::move(p));
+		if (m_put_queue.size() >= max_put_batch)
+			flush_put_queue();
+		else if (m_put_queue.size() == 1)
+			post(m_ioc, [self = self()] { self->flush_put_queue(); });
+		return true;
+	}
+
+	void dht_tracker::flush_put_queue()
+	{
+		if (m_put_queue.empty() || !m_verify_pool) return;
+
+		post(*m_verify_pool, [batch = std::move(m_put_queue), &cnt = m_counters
+			, &ioc = m_ioc, weak_self = std::weak_ptr<dht_tracker>(self())]() mutable
+		{
+			time_point const start = clock_type::now();
+			std::vector<mutable_item_signature> items;
+			items.reserve(batch.size());
+			for (auto const& p : batch)
+				items.push_back(put_signature(p->message));
+			std::vector<bool> const valid = verify_mutable_items(items);
+			std::int64_t const verify_time = total_microseconds(clock_type::now() - start);
+			cnt.inc_stats_counter(counters::dht_verify_time, verify_time);
+
+			for (std::size_t i = 0; i < batch.size(); ++i)
+			{
+				batch[i]->valid_signature = valid[i];
+				batch[i]->verify_time = verify_time;
+			}
+
+			post(ioc, [batch = std::move(batch), weak_self = std::move(weak_self)]() mutable
+			{
+				if (auto t = weak_self.lock()) t->on_puts_verified(std::move(batch));
+			});
+		});
+		m_put_queue.clear();
+	}
+
+	void dht_tracker::on_puts_verified(put_batch batch)
+	{
+		TORRENT_ASSERT(m_puts_in_flight >= int(batch.size()));
+		m_puts_in_flight -= int(batch.size());
+
+		for (auto const& p : batch)
+		{
+			m_counters.inc_stats_counter(counters::dht_verify_wait_time
+				, total_microseconds(clock_type::now() - p->queued) - p->verify_time);
+
+			if (!m_running) continue;
+
+			libtorrent::dht::msg m(p->message, p->ep);
+			m.valid_signature = p->valid_signature;
+			time_point const start = clock_type::now();
+			for (auto& n : m_nodes)
+				n.second.dht.incoming(p->socket, m);
+			m_counters.inc_stats_counter(counters::dht_incoming_time
+				, total_microseconds(clock_type::now() - start));
+		}
+	}
+
 	dht_tracker::tracker_node::tracker_node(io_context& ios
 		, aux::listen_socket_handle const& s, socket_manager* sock
 		, aux::session_settings const& settings
@@ -11,6 +11,9 @@ see LICENSE file.
 #include <libtorrent/kademlia/ed25519.hpp>
 #include <libtorrent/aux_/random.hpp>
 #include <libtorrent/aux_/ed25519.hpp>
+#include <libtorrent/assert.hpp>
+
+#include <algorithm>
 
 namespace libtorrent { namespace dht {
 
@@ -61,6 +64,74 @@ namespace libtorrent { namespace dht {
 		return lt::aux::ed25519_verify(sig_ptr, msg_ptr, msg.size(), pk_ptr) == 1;
 	}
 
+	namespace {
+
+	// the largest number of signatures verified as one batch
+	constexpr int max_batch_size = 64;
+
+	// below this, verifying the signatures one at a time is faster
+	constexpr int min_batch_size = 4;
+
+	// verifies the signatures in [begin, end) as one batch. If any of them is
+	// invalid, the two halves are verified separately, until the batches are
+	// too small to be worth it and the signatures are verified one at a time.
+	// This way a single invalid signature doesn't cost much more than
+	// verifying the signatures in its batch one at a time
+	void verify_range(span<signature const> sigs
+		, span<span<char const> const> msgs, span<public_key const> pks
+		, int const begin, int const end, std::vector<bool>& ret)
+	{
+		int const n = end - begin;
+		TORRENT_ASSERT(n <= max_batch_size);
+		if (n < min_batch_size)
+		{
+			for (int i = begin; i < end; ++i)
+				ret[std::size_t(i)] = ed25519_verify(sigs[i], msgs[i], pks[i]);
+			return;
+		}
+
+		std::array<unsigned char const*, max_batch_size> sig_ptrs;
+		std::array<unsigned char const*, max_batch_size> msg_ptrs;
+		std::array<std::ptrdiff_t, max_batch_size> msg_lens;
+		std::array<unsigned char const*, max_batch_size> pk_ptrs;
+		std::array<char, max_batch_size * 16> random;
+		for (int i = 0; i < n; ++i)
+		{
+			sig_ptrs[std::size_t(i)] = reinterpret_cast<unsigned char const*>(sigs[begin + i].bytes.data());
+			msg_ptrs[std::size_t(i)] = reinterpret_cast<unsigned char const*>(msgs[begin + i].data());
+			msg_lens[std::size_t(i)] = msgs[begin + i].size();
+			pk_ptrs[std::size_t(i)] = reinterpret_cast<unsigned char const*>(pks[begin + i].bytes.data());
+		}
+		aux::crypto_random_bytes(span<char>(random).first(n * 16));
+
+		if (lt::aux::ed25519_verify_batch(sig_ptrs.data(), msg_ptrs.data()
+			, msg_lens.data(), pk_ptrs.data()
+			, reinterpret_cast<unsigned char const*>(random.data()), n) == 1)
+		{
+			std::fill(ret.begin() + begin, ret.begin() + end, true);
+			return;
+		}
+
+		int const mid = begin + n / 2;
+		verify_range(sigs, msgs, pks, begin, mid, ret);
+		verify_range(sigs, msgs, pks, mid, end, ret);
+	}
+
+	} // anonymous namespace
+
+	std::vector<bool> ed25519_verify_batch(span<signature const> sigs
+		, span<span<char const> const> msgs, span<public_key const> pks)
+	{
+		TORRENT_ASSERT(sigs.size() == msgs.size());
+		TORRENT_ASSERT(sigs.size() == pks.size());
+
+		int const num = int(sigs.size());
+		std::vector<bool> ret(std::size_t(num), false);
+		for (int begin = 0; begin < num; begin += max_batch_size)
+			verify_range(sigs, msgs, pks, begin, std::min(num, begin + max_batch_size), ret);
+		return ret;
+	}
+
 	public_key ed25519_add_scalar(public_key const& pk
 		, std::array<char, 32> const& scalar)
 	{
@@ -0,0 +1,295 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "libtorrent/kademlia/indexer.hpp"
+#include "libtorrent/kademlia/node.hpp"
+#include "libtorrent/kademlia/dht_observer.hpp"
+#include "libtorrent/kademlia/io.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/performance_counters.hpp"
+#include "libtorrent/aux_/numeric_cast.hpp"
+#include "libtorrent/aux_/socket_io.hpp"
+#include "libtorrent/aux_/ip_helpers.hpp" // for is_v4
+
+#include <cstring> // for memcpy
+
+namespace libtorrent::dht {
+
+namespace {
+
+	// the most nodes we keep around to query. Nodes we hear about once the
+	// frontier is full are dropped (and not recorded as seen)
+	constexpr std::size_t max_frontier = 100000;
+
+	// the most info-hashes waiting to be looked up with get_peers
+	constexpr std::size_t max_get_peers = 10000;
+
+	// the results are handed to the dht_observer once this many info-hashes
+	// or peers have been collected, or on the next tick()
+	constexpr std::size_t max_batch = 1000;
+
+	sha1_hash hash_endpoint(udp::endpoint const& ep)
+	{
+		std::array<char, 18> buf;
+		char* ptr = buf.data();
+		aux::write_endpoint(ep, ptr);
+		return hasher(buf.data(), int(ptr - buf.data())).final();
+	}
+}
+
+bool recently_seen::insert(sha1_hash const& k)
+{
+	for (auto const& f : m_filters)
+		if (f.find(k)) return true;
+
+	if (m_size == filter_capacity)
+	{
+		m_current = (m_current + 1) % int(m_filters.size());
+		m_filters[std::size_t(m_current)].clear();
+		m_size = 0;
+	}
+	m_filters[std::size_t(m_current)].set(k);
+	++m_size;
+	return false;
+}
+
+void recently_seen::clear()
+{
+	for (auto& f : m_filters) f.clear();
+	m_current = 0;
+	m_size = 0;
+}
+
+indexer::indexer(node& dht_node)
+	: traversal_algorithm(dht_node, generate_random_id())
+{}
+
+char const* indexer::name() const { return "indexer"; }
+
+void indexer::tick()
+{
+	flush_results();
+	send_requests();
+}
+
+void indexer::stop()
+{
+	flush_results();
+	m_stopped = true;
+	m_frontier.clear();
+	m_get_peers.clear();
+}
+
+void indexer::got_samples(node_id const& id, udp::endpoint const& ep
+	, std::vector<sha1_hash> const& samples
+	, std::vector<std::pair<node_id, udp::endpoint>> const& nodes)
+{
+	if (m_stopped) return;
+
+	for (auto const& n : nodes) add_node(n.first, n.second);
+
+	for (auto const& ih : samples)
+	{
+		if (m_seen_info_hashes.insert(ih)) continue;
+		m_info_hashes.push_back(ih);
+
+		// the node that sampled the info-hash is the one storing its peers
+		if (m_get_peers.size() < max_get_peers)
+			m_get_peers.push_back({ih, id, ep});
+	}
+
+	if (m_info_hashes.size() >= max_batch) flush_results();
+}
+
+void indexer::got_peers(sha1_hash const& info_hash, std::vector<tcp::endpoint> const& peers
+	, std::vector<std::pair<node_id, udp::endpoint>> const& nodes)
+{
+	if (m_stopped) return;
+
+	for (auto const& n : nodes) add_node(n.first, n.second);
+	for (auto const& p : peers) m_peers.emplace_back(info_hash, p);
+
+	if (m_peers.size() >= max_batch) flush_results();
+}
+
+void indexer::request_done()
+{
+	TORRENT_ASSERT(m_in_flight > 0);
+	--m_in_flight;
+	send_requests();
+}
+
+void indexer::add_node(node_id const& id, udp::endpoint const& ep)
+{
+	if (m_frontier.size() >= max_frontier) return;
+	if (!m_node.native_address(ep) || ep.port() == 0) return;
+	if (m_seen_nodes.insert(hash_endpoint(ep))) return;
+	m_frontier.emplace_back(id, ep);
+}
+
+void indexer::send_requests()
+{
+	int const limit = m_node.settings().get_int(settings_pack::dht_indexer_requests);
+	bool seeded = false;
+
+	while (!m_stopped && m_in_flight < limit && m_node.has_quota())
+	{
+		if (!m_get_peers.empty())
+		{
+			get_peers_request const r = m_get_peers.front();
+			m_get_peers.pop_front();
+
+			entry e;
+			e["q"] = "get_peers";
+			e["a"]["info_hash"] = r.info_hash.to_string();
+			if (!send_request(r.ep, r.id, r.info_hash, e)) break;
+			m_node.stats_counters().inc_stats_counter(counters::dht_get_peers_out);
+			continue;
+		}
+
+		if (m_frontier.empty())
+		{
+			// wait for the outstanding requests to return more nodes
+			if (m_in_flight > 0) break;
+
+			// only try this once per call, in case no request can be sent
+			if (seeded) break;
+			seeded = true;
+
+			// we have run out of nodes to query. Start over with the nodes in
+			// our routing table (including the replacements). If we have
+			// already queried all of them, this crawl is complete and we start a
+			// new one
+			auto const seed = [this] {
+				auto const add = [this](node_entry const& ne) { add_node(ne.id, ne.ep()); };
+				m_node.m_table.for_each_node(add, add);
+			};
+			seed();
+			if (m_frontier.empty())
+			{
+				m_seen_nodes.clear();
+				seed();
+			}
+			if (m_frontier.empty()) break;
+		}
+
+		auto const n = m_frontier.front();
+		m_frontier.pop_front();
+
+		entry e;
+		e["q"] = "sample_infohashes";
+		// a random target makes the node return a different set of nodes each
+		// time, spreading the crawl across the whole ID space
+		e["a"]["target"] = generate_random_id().to_string();
+		if (!send_request(n.second, n.first, sha1_hash(), e)) break;
+		m_node.stats_counters().inc_stats_counter(counters::dht_sample_infohashes_out);
+	}
+}
+
+bool indexer::send_request(udp::endpoint const& ep, node_id const& id
+	, sha1_hash const& info_hash, entry& e)
+{
+	auto o = m_node.m_rpc.allocate_observer<indexer_observer>(self(), ep, id, info_hash);
+	if (!o) return false;
+#if TORRENT_USE_ASSERTS
+	o->m_in_constructor = false;
+#endif
+	o->flags |= observer::flag_queried;
+	// if the packet can't be sent, just move on to the next request
+	if (m_node.m_rpc.invoke(e, ep, o)) ++m_in_flight;
+	return true;
+}
+
+void indexer::flush_results()
+{
+	if (m_info_hashes.empty() && m_peers.empty()) return;
+
+	dht_observer* obs = m_node.observer();
+	if (obs != nullptr) obs->indexer_results(m_info_hashes, m_peers);
+	m_info_hashes.clear();
+	m_peers.clear();
+}
+
+indexer_observer::indexer_observer(std::shared_ptr<traversal_algorithm> algorithm
+	, udp::endpoint const& ep, node_id const& id, sha1_hash const& info_hash)
+	: observer(std::move(algorithm), ep, id)
+	, m_info_hash(info_hash)
+{}
+
+void indexer_observer::reply(msg const& m)
+{
+	bdecode_node const r = m.message.dict_find_dict("r");
+	if (!r)
+	{
+		timeout();
+		return;
+	}
+
+	auto* ix = static_cast<indexer*>(algorithm());
+
+	std::vector<std::pair<node_id, udp::endpoint>> nodes;
+	udp const protocol = ix->get_node().protocol();
+	int const protocol_size = int(aux::address_size(protocol));
+	bdecode_node const n = r.dict_find_string(ix->get_node().protocol_nodes_key());
+	if (n)
+	{
+		char const* ptr = n.string_ptr();
+		char const* end = ptr + n.string_length();
+
+		while (end - ptr >= 20 + protocol_size + 2)
+		{
+			node_endpoint nep = read_node_endpoint(protocol, ptr);
+			nodes.emplace_back(nep.id, nep.ep);
+		}
+	}
+
+	if (m_info_hash.is_all_zeros())
+	{
+		std::vector<sha1_hash> samples;
+		bdecode_node const s = r.dict_find_string("samples");
+		if (s && s.string_length() % 20 == 0)
+		{
+			samples.resize(aux::numeric_cast<std::size_t>(s.string_length() / 20));
+			std::memcpy(samples.data(), s.string_ptr(), samples.size() * 20);
+		}
+		ix->got_samples(id(), target_ep(), samples, nodes);
+	}
+	else
+	{
+		std::vector<tcp::endpoint> peers;
+		bdecode_node const v = r.dict_find_list("values");
+		if (v && v.list_size() == 1 && v.list_at(0).type() == bdecode_node::string_t
+			&& aux::is_v4(m.addr))
+		{
+			// assume it's mainline format
+			char const* ptr = v.list_at(0).string_ptr();
+			char const* end = ptr + v.list_at(0).string_length();
+			while (end - ptr >= 6)
+				peers.push_back(aux::read_v4_endpoint<tcp::endpoint>(ptr));
+		}
+		else if (v)
+		{
+			peers = aux::read_endpoint_list<tcp::endpoint>(v);
+		}
+		ix->got_peers(m_info_hash, peers, nodes);
+	}
+
+	flags |= flag_done;
+	ix->request_done();
+}
+
+void indexer_observer::timeout()
+{
+	if (flags & flag_done) return;
+	// sets flag_done and tells the routing table about the failure
+	observer::timeout();
+	static_cast<indexer*>(algorithm())->request_done();
+}
+
+} // namespace libtorrent::dht
@@ -86,6 +86,27 @@ bool verify_mutable_item(
 	return ed25519_verify(sig, {str, len}, pk);
 }
 
+std::vector<bool> verify_mutable_items(span<mutable_item_signature const> items)
+{
+	std::size_t const num = std::size_t(items.size());
+	std::vector<char> str(num * 1200);
+	std::vector<span<char const>> msgs;
+	std::vector<signature> sigs;
+	std::vector<public_key> pks;
+	msgs.reserve(num);
+	sigs.reserve(num);
+	pks.reserve(num);
+	for (std::size_t i = 0; i < num; ++i)
+	{
+		auto const& item = items[std::ptrdiff_t(i)];
+		span<char> const buf(str.data() + i * 1200, 1200);
+		msgs.emplace_back(buf.first(canonical_string(item.v, item.seq, item.salt, buf)));
+		sigs.push_back(item.sig);
+		pks.push_back(item.pk);
+	}
+	return ed25519_verify_batch(sigs, msgs, pks);
+}
+
 // given the bencoded buffer ``v``, the salt (which is optional and may have
 // a length of zero to be omitted), sequence number ``seq``, public key (32
 // bytes ed25519 key) ``pk`` and a secret/private key ``sk`` (64 bytes ed25519
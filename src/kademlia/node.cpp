@@ -50,6 +50,7 @@ see LICENSE file.
 #include "libtorrent/kademlia/msg.hpp"
 #include <libtorrent/kademlia/put_data.hpp>
 #include <libtorrent/kademlia/sample_infohashes.hpp>
+#include <libtorrent/kademlia/indexer.hpp>
 
 using namespace std::placeholders;
 
@@ -696,6 +697,19 @@ void node::send_single_refresh(udp::endpoint const& ep, int const bucket
 time_duration node::connection_timeout()
 {
 	time_duration d = m_rpc.tick();
+
+	int const indexer_requests = m_settings.get_int(settings_pack::dht_indexer_requests);
+	if (indexer_requests > 0 && !m_indexer)
+	{
+		m_indexer = std::make_shared<indexer>(*this);
+	}
+	else if (indexer_requests <= 0 && m_indexer)
+	{
+		m_indexer->stop();
+		m_indexer.reset();
+	}
+	if (m_indexer) m_indexer->tick();
+
 	time_point now(aux::time_now());
 	if (now - minutes(2) < m_last_tracker_tick) return d;
 	m_last_tracker_tick = now;
@@ -1041,8 +1055,21 @@ void node::incoming_request(msg const& m, entry& e)
 				return;
 			}
 
-			// msg_keys[4] is the signature, msg_keys[3] is the public key
-			if (!verify_mutable_item(buf, salt, seq, pk, sig))
+			// msg_keys[4] is the signature, msg_keys[3] is the public key.
+			// If a DHT worker thread has already verified it, use its result
+			bool valid_signature;
+			if (m.valid_signature)
+			{
+				valid_signature = *m.valid_signature;
+			}
+			else
+			{
+				time_point const start = clock_type::now();
+				valid_signature = verify_mutable_item(buf, salt, seq, pk, sig);
+				m_counters.inc_stats_counter(counters::dht_verify_time
+					, total_microseconds(clock_type::now() - start));
+			}
+			if (!valid_signature)
 			{
 				m_counters.inc_stats_counter(counters::dht_invalid_put);
 				incoming_error(e, "invalid signature", 206);
@@ -21,6 +21,8 @@ see LICENSE file.
 #include <cstdio> // for snprintf
 #include <cinttypes> // for PRId64 et.al.
 #include <cstdint>
+#include <cstring> // for memcpy
+#include <array>
 
 #include "libtorrent/config.hpp"
 
@@ -36,6 +38,7 @@ see LICENSE file.
 #include "libtorrent/aux_/invariant_check.hpp"
 #include "libtorrent/address.hpp"
 #include "libtorrent/aux_/array.hpp"
+#include "libtorrent/aux_/byteswap.hpp"
 
 using namespace std::placeholders;
 
@@ -1065,6 +1068,83 @@ bool routing_table::node_seen(node_id const& id, udp::endpoint const& ep, int co
 	return verify_node_address(m_settings, id, ep.address()) && add_node(node_entry(id, ep, rtt, true));
 }
 
+namespace {
+
+	// the XOR distance between a node ID and the target of a lookup, packed
+	// into integers that compare in the same order as the 160 bit big-endian
+	// distance does. Sorting these is a lot cheaper than comparing node IDs
+	// with compare_ref(), which XORs both IDs with the target and compares
+	// them byte by byte every time
+	struct distance_key
+	{
+		std::uint64_t hi;
+		std::uint64_t mid;
+		std::uint32_t lo;
+
+		// the index of the node in the bucket
+		int idx;
+
+		bool operator<(distance_key const& rhs) const
+		{
+			if (hi != rhs.hi) return hi < rhs.hi;
+			if (mid != rhs.mid) return mid < rhs.mid;
+			return lo < rhs.lo;
+		}
+	};
+
+	using id_words = std::array<std::uint32_t, node_id::size() / 4>;
+
+	id_words load_id(node_id const& id)
+	{
+		id_words ret;
+		std::memcpy(ret.data(), id.data(), std::size_t(node_id::size()));
+		return ret;
+	}
+
+	distance_key make_distance_key(id_words const& target, node_id const& id
+		, int const idx)
+	{
+		id_words const w = load_id(id);
+		id_words d;
+		for (std::size_t k = 0; k < d.size(); ++k)
+			d[k] = aux::network_to_host(std::uint32_t(w[k] ^ target[k]));
+		return distance_key{std::uint64_t(d[0]) << 32 | d[1]
+			, std::uint64_t(d[2]) << 32 | d[3], d[4], idx};
+	}
+
+	// appends the nodes in b (optionally only the confirmed ones) to l, but
+	// no more than "count" in total. If the bucket has more nodes than there
+	// is room for, the ones closest to the target are picked. Only the nodes
+	// that are returned are copied. Returns true once l is full
+	bool copy_closest(bucket_t const& b, id_words const& target
+		, find_nodes_flags_t const options, int const count
+		, std::vector<distance_key>& keys, std::vector<node_entry>& l)
+	{
+		bool const all = bool(options & routing_table::include_failed);
+		auto const eligible = [all](node_entry const& ne) { return all || ne.confirmed(); };
+
+		int const room = count - int(l.size());
+		if (int(std::count_if(b.begin(), b.end(), eligible)) <= room)
+		{
+			std::copy_if(b.begin(), b.end(), std::back_inserter(l), eligible);
+			return int(l.size()) == count;
+		}
+
+		keys.clear();
+		for (int k = 0; k < b.end_index(); ++k)
+		{
+			if (!eligible(b[k])) continue;
+			keys.push_back(make_distance_key(target, b[k].id, k));
+		}
+
+		// get the nodes closest to the target
+		std::nth_element(keys.begin(), keys.begin() + room, keys.end());
+		for (int k = 0; k < room; ++k)
+			l.push_back(b[keys[std::size_t(k)].idx]);
+		return true;
+	}
+}
+
 // fills the vector with the k nodes from our buckets that
 // are nearest to the given id.
 std::vector<node_entry> routing_table::find_node(node_id const& target
@@ -1074,81 +1154,29 @@ std::vector<node_entry> routing_table::find_node(node_id const& target
 	if (count == 0) count = m_bucket_size;
 
 	auto const i = find_bucket(target);
-	int const bucket_index = int(std::distance(m_buckets.begin(), i));
-	int const bucket_size_limit = bucket_limit(bucket_index);
 
-	l.reserve(aux::numeric_cast<std::size_t>(bucket_size_limit));
+	l.reserve(aux::numeric_cast<std::size_t>(count));
 
-	table_t::iterator j = i;
+	id_words const target_words = load_id(target);
+	std::vector<distance_key> keys;
 
-	int unsorted_start_idx = 0;
-	for (; j != m_buckets.end() && int(l.size()) < count; ++j)
+	table_t::iterator j = i;
+	for (; j != m_buckets.end(); ++j)
 	{
-		bucket_t const& b = j->live_nodes;
-		if (options & include_failed)
-		{
-			std::copy(b.begin(), b.end(), std::back_inserter(l));
-		}
-		else
-		{
-			std::remove_copy_if(b.begin(), b.end(), std::back_inserter(l)
-				, [](node_entry const& ne) { return !ne.confirmed(); });
-		}
-
-		if (int(l.size()) == count) return l;
-
-		if (int(l.size()) > count)
-		{
-			// get the k nodes closest to the target
-			std::nth_element(l.begin() + unsorted_start_idx, l.begin() + count, l.end()
-				, [&target](node_entry const& lhs, node_entry const& rhs)
-				{ return compare_ref(lhs.id, rhs.id, target); });
-
-			l.resize(aux::numeric_cast<std::size_t>(count));
+		if (copy_closest(j->live_nodes, target_words, options, count, keys, l))
 			return l;
-		}
-		unsorted_start_idx = int(l.size());
 	}
 
 	// if we still don't have enough nodes, copy nodes
 	// further away from us
 
-	if (i == m_buckets.begin())
-		return l;
-
 	j = i;
-
-	unsorted_start_idx = int(l.size());
-	do
+	while (j != m_buckets.begin())
 	{
 		--j;
-		bucket_t const& b = j->live_nodes;
-
-		if (options & include_failed)
-		{
-			std::copy(b.begin(), b.end(), std::back_inserter(l));
-		}
-		else
-		{
-			std::remove_copy_if(b.begin(), b.end(), std::back_inserter(l)
-				, [](node_entry const& ne) { return !ne.confirmed(); });
-		}
-
-		if (int(l.size()) == count) return l;
-
-		if (int(l.size()) > count)
-		{
-			// get the k nodes closest to the target
-			std::nth_element(l.begin() + unsorted_start_idx, l.begin() + count, l.end()
-				, [&target](node_entry const& lhs, node_entry const& rhs)
-				{ return compare_ref(lhs.id, rhs.id, target); });
-
-			l.resize(aux::numeric_cast<std::size_t>(count));
+		if (copy_closest(j->live_nodes, target_words, options, count, keys, l))
 			return l;
-		}
-		unsorted_start_idx = int(l.size());
 	}
-	while (j != m_buckets.begin() && int(l.size()) < count);
 
 	TORRENT_ASSERT(int(l.size()) <= count);
 	return l;
@@ -26,6 +26,7 @@ see LICENSE file.
 #include <libtorrent/kademlia/direct_request.hpp>
 #include <libtorrent/kademlia/get_item.hpp>
 #include <libtorrent/kademlia/sample_infohashes.hpp>
+#include <libtorrent/kademlia/indexer.hpp>
 #include <libtorrent/aux_/session_settings.hpp>
 
 #include <libtorrent/aux_/socket_io.hpp> // for print_endpoint
@@ -124,6 +125,7 @@ namespace {
 	, sizeof(get_peers_observer)
 	, sizeof(obfuscated_get_peers_observer)
 	, sizeof(sample_infohashes_observer)
+	, sizeof(indexer_observer)
 	, sizeof(null_observer)
 	, sizeof(traversal_observer)});
 }
@@ -331,7 +331,14 @@ void traversal_algorithm::failed(observer_ptr o, traversal_flags_t const flags)
 	if (!(o->flags & observer::flag_no_id))
 		m_node.m_table.node_failed(o->id(), o->target_ep());
 
-	if (m_results.empty()) return;
+	if (m_results.empty())
+	{
+		// there's no traversal state to update (e.g. the indexer), but make
+		// sure the rpc_manager doesn't short-timeout this observer again on
+		// every tick, failing the node each time
+		if (flags & short_timeout) o->flags |= observer::flag_short_timeout;
+		return;
+	}
 
 	bool decrement_branch_factor = false;
 
@@ -19,6 +19,12 @@ see LICENSE file.
 #include "libtorrent/magnet_uri.hpp"
 #include "libtorrent/aux_/string_util.hpp" // for is_i2p_url, ltrim, ensure_trailing_slash
 #include "libtorrent/aux_/resolve_duplicate_filenames.hpp"
+#include "libtorrent/aux_/mmap.hpp"
+
+#include "try_signal.hpp"
+
+#include <system_error>
+#include <cstring> // for memcpy
 
 namespace libtorrent {
 
@@ -74,7 +80,8 @@ namespace {
 		}
 	}
 
-	void parse_piece_layers(bdecode_node const& e, file_storage const& fs, error_code& ec, add_torrent_params& out)
+	void parse_piece_layers(bdecode_node const& e, file_storage const& fs
+		, bool const validate, error_code& ec, add_torrent_params& out)
 	{
 		std::map<sha256_hash, string_view> piece_layers;
 
@@ -125,6 +132,27 @@ namespace {
 				return;
 			}
 
+			if (!validate)
+			{
+				// leave it to the torrent to validate the piece layer against
+				// the root, when it loads the merkle tree. Just lay out the
+				// hashes the same way build_sparse_vector() would
+				int const num_blocks = fs.file_num_blocks(file);
+				int const first_piece = merkle_first_leaf(merkle_num_leafs(num_pieces));
+				bitfield mask(merkle_num_nodes(merkle_num_leafs(num_blocks)));
+				for (int p = first_piece; p < first_piece + num_pieces; ++p)
+					mask.set_bit(p);
+				auto& tree = out.merkle_trees[file];
+				tree.resize(std::size_t(num_pieces));
+				for (int p = 0; p < num_pieces; ++p)
+					tree[std::size_t(p)].assign(piece_layer.data() + p * sha256_hash::size());
+				out.merkle_tree_mask[file] = std::move(mask);
+				out.verified_leaf_hashes[file] = bitfield(num_blocks, fs.blocks_per_piece() == 1);
+
+				all_file_roots.erase(file_index);
+				continue;
+			}
+
 			aux::merkle_tree tree(fs.file_num_blocks(file), fs.blocks_per_piece(), fs.root_ptr(file));
 			if (!tree.load_piece_layer(piece_layer))
 			{
@@ -179,7 +207,7 @@ namespace aux
 			bdecode_node const& e = torrent_file.dict_find_dict("piece layers");
 			if (e)
 			{
-				parse_piece_layers(e, ti->layout(), ec, out);
+				parse_piece_layers(e, ti->layout(), cfg.validate_piece_layers, ec, out);
 				if (ec) return{};
 			}
 		}
@@ -339,6 +367,63 @@ namespace aux
 	add_torrent_params load_torrent_file(std::string const& filename
 		, error_code& ec, load_torrent_limits const& cfg)
 	{
+#if TORRENT_HAVE_MMAP || TORRENT_HAVE_MAP_VIEW_OF_FILE
+		// large .torrent files (typically v2 torrents with large piece layers)
+		// are copied out of a read-only mapping of the file, rather than read
+		// in chunks
+		file_status st;
+		stat_file(filename, &st, ec);
+		if (!ec && std::int64_t(st.file_size) >= aux::mapped_file_cutoff)
+		{
+			if (std::int64_t(st.file_size) > cfg.max_buffer_size)
+			{
+				ec = errors::metadata_too_large;
+				return {};
+			}
+			std::vector<char> buf;
+			try
+			{
+				aux::file_mapping m(aux::file_handle(filename, 0, aux::open_mode::read_only)
+					, aux::open_mode::read_only, std::int64_t(st.file_size)
+#if TORRENT_HAVE_MAP_VIEW_OF_FILE
+					, std::make_shared<std::mutex>()
+#endif
+					);
+				if (m.has_memory_map())
+				{
+					// if the file is truncated while we're copying it, reading
+					// past its new end raises SIGBUS (or an in-page error on
+					// windows). try_signal() unwinds with longjmp, so nothing
+					// but the copy may run under it
+					auto const range = m.range();
+					buf.resize(std::size_t(range.size()));
+					sig::try_signal([&]{
+						std::memcpy(buf.data(), range.data(), buf.size());
+						});
+				}
+			}
+			catch (storage_error const& err)
+			{
+				ec = err.ec;
+				return {};
+			}
+			catch (std::system_error const&)
+			{
+				// the mapping failed, or the file changed while we copied it.
+				// Read it instead
+				buf.clear();
+			}
+
+			if (!buf.empty())
+			{
+				add_torrent_params ret = load_torrent_buffer(buf, ec, cfg);
+				if (ec) return {};
+				return ret;
+			}
+		}
+		ec.clear();
+#endif
+
 		std::vector<char> buf;
 		load_file(filename, buf, ec, cfg.max_buffer_size);
 		if (ec) return {};
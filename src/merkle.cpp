@@ -11,6 +11,7 @@ see LICENSE file.
 
 #include "libtorrent/aux_/merkle.hpp"
 #include "libtorrent/aux_/vector.hpp"
+#include "libtorrent/aux_/multi_hasher.hpp"
 #include "libtorrent/bitfield.hpp"
 
 namespace libtorrent {
@@ -112,15 +113,10 @@ namespace libtorrent {
 		int level_size = num_leafs;
 		while (level_size > 1)
 		{
-			int parent = merkle_get_parent(level_start);
-			for (int i = level_start; i < level_start + level_size; i += 2, ++parent)
-			{
-				hasher256 h;
-				h.update(tree[i]);
-				h.update(tree[i + 1]);
-				tree[parent] = h.final();
-			}
-			level_start = merkle_get_parent(level_start);
+			int const parent = merkle_get_parent(level_start);
+			aux::multi_sha256_pairs(tree.subspan(level_start, level_size)
+				, tree.subspan(parent, level_size / 2));
+			level_start = parent;
 			level_size /= 2;
 		}
 		TORRENT_ASSERT(level_size == 1);
@@ -144,16 +140,25 @@ namespace libtorrent {
 			level_start = merkle_get_parent(level_start);
 			level_size /= 2;
 
-			for (int i = level_start; i < level_start + level_size; ++i)
+			// hash the runs of nodes whose children are both known, in batches
+			int const level_end = level_start + level_size;
+			for (int i = level_start; i < level_end;)
 			{
-				int const child = merkle_get_first_child(i);
-				bool const zeros_left = tree[child].is_all_zeros();
-				bool const zeros_right = tree[child + 1].is_all_zeros();
-				if (zeros_left || zeros_right) continue;
-				hasher256 h;
-				h.update(tree[child]);
-				h.update(tree[child + 1]);
-				tree[i] = h.final();
+				auto const known = [&tree](int const n)
+				{
+					int const child = merkle_get_first_child(n);
+					return !tree[child].is_all_zeros() && !tree[child + 1].is_all_zeros();
+				};
+				if (!known(i))
+				{
+					++i;
+					continue;
+				}
+				int const run_start = i;
+				while (i < level_end && known(i)) ++i;
+				aux::multi_sha256_pairs(
+					tree.subspan(merkle_get_first_child(run_start), (i - run_start) * 2)
+					, tree.subspan(run_start, i - run_start));
 			}
 		}
 		TORRENT_ASSERT(level_size == 1);
@@ -226,14 +231,10 @@ namespace libtorrent {
 
 		while (num_leafs > 1)
 		{
-			int i = 0;
-			for (; i < int(leaves.size()) / 2; ++i)
-			{
-				scratch_space[std::size_t(i)] = hasher256()
-					.update(leaves[i * 2])
-					.update(leaves[i * 2 + 1])
-					.final();
-			}
+			// when leaves points into scratch_space, this computes the next
+			// layer in place
+			int i = int(leaves.size()) / 2;
+			aux::multi_sha256_pairs(leaves.first(i * 2), scratch_space);
 			if (leaves.size() & 1)
 			{
 				// if we have an odd number of leaves, compute the boundary hash
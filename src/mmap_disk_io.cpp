@@ -27,6 +27,7 @@ see LICENSE file.
 #include "libtorrent/aux_/debug.hpp"
 #include "libtorrent/units.hpp"
 #include "libtorrent/hasher.hpp"
+#include "libtorrent/aux_/multi_hasher.hpp"
 #include "libtorrent/aux_/platform_util.hpp" // for set_thread_name
 #include "libtorrent/aux_/disk_job_pool.hpp"
 #include "libtorrent/aux_/disk_io_thread_pool.hpp"
@@ -58,6 +59,27 @@ see LICENSE file.
 namespace libtorrent {
 namespace {
 
+	// the number of v2 blocks hashed at a time, by multi_sha256()
+	constexpr int hash_batch_size = 8;
+
+#if TORRENT_HAVE_MMAP
+	// the "allocator" of a buffer handed out by a zero-copy read. It keeps the
+	// file mapping alive for as long as the buffer refers to it, and deletes
+	// itself when the buffer is freed
+	struct mapped_view final : buffer_allocator_interface
+	{
+		explicit mapped_view(std::shared_ptr<aux::file_mapping> m)
+			: mapping(std::move(m)) {}
+
+		void free_disk_buffer(char*) override { delete this; }
+#if TORRENT_DEBUG_BUFFER_POOL
+		void rename_buffer(char*, char const*) override {}
+#endif
+
+		std::shared_ptr<aux::file_mapping> mapping;
+	};
+#endif
+
 	aux::open_mode_t file_mode_for_job(aux::mmap_disk_job* j)
 	{
 		aux::open_mode_t ret = aux::open_mode::read_only;
@@ -72,7 +94,8 @@ namespace {
 				| disk_interface::sequential_access
 				| disk_interface::volatile_read
 				| disk_interface::v1_hash
-				| disk_interface::flush_piece))
+				| disk_interface::flush_piece
+				| disk_interface::zero_copy))
 			== disk_job_flags_t{};
 	}
 #endif
@@ -436,6 +459,34 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 
 	status_t mmap_disk_io::do_job(aux::job::read& a, aux::mmap_disk_job* j)
 	{
+#if TORRENT_HAVE_MMAP
+		// volatile reads drop the pages from the page cache once they've been
+		// read, which doesn't work if they're sent straight out of the mapping
+		if ((j->flags & disk_interface::zero_copy)
+			&& !(j->flags & disk_interface::volatile_read))
+		{
+			time_point const start_time = clock_type::now();
+			span<char const> view;
+			auto mapping = j->storage->read_view(m_settings, a.piece, a.offset
+				, a.buffer_size, file_mode_for_job(j), view, j->error);
+			if (j->error) return disk_status::fatal_disk_error;
+			if (mapping)
+			{
+				// disk_buffer_holder never lets the buffer be modified, it's
+				// only ever passed to send()
+				a.buf = disk_buffer_holder(*new mapped_view(std::move(mapping))
+					, const_cast<char*>(view.data()), int(view.size()));
+
+				std::int64_t const read_time = total_microseconds(clock_type::now() - start_time);
+				m_stats_counters.inc_stats_counter(counters::num_blocks_read);
+				m_stats_counters.inc_stats_counter(counters::num_zero_copy_reads);
+				m_stats_counters.inc_stats_counter(counters::disk_read_time, read_time);
+				m_stats_counters.inc_stats_counter(counters::disk_job_time, read_time);
+				return {};
+			}
+		}
+#endif
+
 		a.buf = disk_buffer_holder(m_buffer_pool, m_buffer_pool.allocate_buffer("send buffer (cache miss)"), default_block_size);
 		if (!a.buf)
 		{
@@ -873,49 +924,91 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 		int offset = 0;
 		int const blocks_to_read = std::max(blocks_in_piece, blocks_in_piece2);
 		time_point const start_time = clock_type::now();
-		for (int i = 0; i < blocks_to_read; ++i)
-		{
-			bool const v2_block = i < blocks_in_piece2;
 
-			DLOG("do_hash: reading (piece: %d block: %d)\n", int(a.piece), i);
+		// the v2 blocks are read into a scratch buffer, a batch at a time, and
+		// hashed in parallel by multi_sha256(). The v1 hash of hybrid torrents
+		// is computed from the same buffer, so the blocks are only read once.
+		int const batch_size = std::min(blocks_in_piece2, hash_batch_size);
+		std::vector<char> scratch(std::size_t(batch_size) * default_block_size);
+		aux::array<span<char const>, hash_batch_size> batch;
 
-			std::ptrdiff_t const len = v1 ? std::min(default_block_size, piece_size - offset) : 0;
-			std::ptrdiff_t const len2 = v2_block ? std::min(default_block_size, piece_size2 - offset) : 0;
+		int i = 0;
+		bool done = false;
+		while (!done && i < blocks_in_piece2)
+		{
+			int const first_block = i;
+			int num = 0;
+			for (; num < batch_size && i < blocks_in_piece2; ++num, ++i)
+			{
+				offset = i * default_block_size;
+				std::ptrdiff_t const len = v1 ? std::min(default_block_size, piece_size - offset) : 0;
+				std::ptrdiff_t const len2 = std::min(default_block_size, piece_size2 - offset);
+				std::ptrdiff_t const read_len = std::max(len, len2);
+				char* const buf = scratch.data() + num * default_block_size;
 
-			hasher256 h2;
+				DLOG("do_hash: reading (piece: %d block: %d)\n", int(a.piece), i);
 
-			if (!m_store_buffer.get({ j->storage->storage_index(), a.piece, offset }
-				, [&](char const* buf)
-				{
-					if (v1)
-					{
-						h.update({ buf, len });
-						ret = int(len);
-					}
-					if (v2_block)
+				if (!m_store_buffer.get({ j->storage->storage_index(), a.piece, offset }
+					, [&](char const* sb)
 					{
-						h2.update({ buf, len2 });
-						ret = int(len2);
-					}
-				}))
-			{
-				if (v1)
+						std::memcpy(buf, sb, std::size_t(read_len));
+						ret = int(read_len);
+					}))
 				{
-					// if we will call hash2() in a bit, don't trigger a flush
-					// just yet, let hash2() do it
-					auto const flags = v2_block ? (j->flags & ~disk_interface::flush_piece) : j->flags;
 					j->error.ec.clear();
-					ret = j->storage->hash(m_settings, h, len, a.piece, offset
-						, file_mode, flags, j->error);
+					ret = j->storage->read(m_settings, {buf, read_len}, a.piece, offset
+						, file_mode, j->flags, j->error);
 					if (ret < 0) break;
+
+					if (!j->error.ec)
+					{
+						m_stats_counters.inc_stats_counter(counters::num_read_back);
+						m_stats_counters.inc_stats_counter(counters::num_blocks_read);
+						m_stats_counters.inc_stats_counter(counters::num_read_ops);
+					}
 				}
-				if (v2_block)
+
+				std::ptrdiff_t const v1_len = std::min(len, std::ptrdiff_t(ret));
+				if (v1_len > 0) h.update({ buf, v1_len });
+				batch[num] = { buf, std::min(len2, std::ptrdiff_t(ret)) };
+
+				if (ret <= 0)
 				{
-					j->error.ec.clear();
-					ret = j->storage->hash2(m_settings, h2, len2, a.piece, offset
-						, file_mode, j->flags, j->error);
-					if (ret < 0) break;
+					done = true;
+					++num;
+					++i;
+					break;
 				}
+			}
+
+			if (ret < 0) break;
+
+			aux::multi_sha256(span<span<char const> const>(batch).first(num)
+				, a.block_hashes.subspan(first_block, num));
+		}
+
+		// v1 blocks past the end of the v2 piece (i.e. pad files at the end
+		// of a hybrid torrent's piece), or all blocks of a v1-only torrent,
+		// are hashed straight from the file
+		for (; v1 && !done && ret >= 0 && i < blocks_to_read; ++i)
+		{
+			offset = i * default_block_size;
+
+			DLOG("do_hash: reading (piece: %d block: %d)\n", int(a.piece), i);
+
+			std::ptrdiff_t const len = std::min(default_block_size, piece_size - offset);
+
+			if (!m_store_buffer.get({ j->storage->storage_index(), a.piece, offset }
+				, [&](char const* buf)
+				{
+					h.update({ buf, len });
+					ret = int(len);
+				}))
+			{
+				j->error.ec.clear();
+				ret = j->storage->hash(m_settings, h, len, a.piece, offset
+					, file_mode, j->flags, j->error);
+				if (ret < 0) break;
 
 				if (!j->error.ec)
 				{
@@ -925,12 +1018,7 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 				}
 			}
 
-			if (v2_block)
-				a.block_hashes[i] = h2.final();
-
 			if (ret <= 0) break;
-
-			offset += default_block_size;
 		}
 
 		if (!j->error.ec)
@@ -1105,7 +1193,7 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 		jl.unlock();
 
 		// gauges
-		c.set_value(counters::disk_blocks_in_use, m_buffer_pool.in_use());
+		m_buffer_pool.update_stats_counters(c);
 
 		std::int64_t hits;
 		std::int64_t misses;
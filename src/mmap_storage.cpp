@@ -639,6 +639,54 @@ error_code translate_error(std::error_code const& err, bool const write)
 		});
 	}
 
+	std::shared_ptr<aux::file_mapping> mmap_storage::read_view(
+		settings_interface const& sett
+		, piece_index_t const piece, int const offset, int const length
+		, aux::open_mode_t const mode
+		, span<char const>& view
+		, storage_error& error)
+	{
+		auto const slices = files().map_block(piece, offset, length);
+		if (slices.size() != 1) return {};
+		file_index_t const file_index = slices.front().file_index;
+		std::int64_t const file_offset = slices.front().offset;
+
+		if (files().pad_file_at(file_index)) return {};
+		if (file_index < m_file_priority.end_index()
+			&& m_file_priority[file_index] == dont_download
+			&& use_partfile(file_index))
+			return {};
+
+		auto handle = open_file(sett, file_index, mode, error);
+		if (error) return {};
+		if (!handle->has_memory_map()) return {};
+
+		span<byte const> const file_range = handle->range();
+		if (file_range.size() < file_offset + length) return {};
+		view = file_range.subspan(static_cast<std::ptrdiff_t>(file_offset), length);
+
+		try
+		{
+			// touch every page, to take the page faults here rather than on
+			// the network thread, when the view is sent
+			sig::try_signal([&]{
+				char sum = 0;
+				for (std::ptrdiff_t i = 0; i < view.size(); i += 4096)
+					sum ^= static_cast<char const volatile*>(view.data())[i];
+				sum ^= static_cast<char const volatile*>(view.data())[view.size() - 1];
+				TORRENT_UNUSED(sum);
+			});
+		}
+		catch (std::system_error const& err)
+		{
+			error.ec = translate_error(err.code(), false);
+			error.operation = operation_t::file_read;
+			error.file(file_index);
+			return {};
+		}
+		return handle;
+	}
+
 	int mmap_storage::write(settings_interface const& sett
 		, span<char const> buffer
 		, piece_index_t const piece, int const offset
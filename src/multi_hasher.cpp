@@ -0,0 +1,835 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "libtorrent/aux_/multi_hasher.hpp"
+#include "libtorrent/aux_/cpuid.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/assert.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+// the SIMD kernels are built with the target attribute on GCC and clang, so
+// they don't require the whole library to be built for a newer CPU. They are
+// only called if cpuid reports support for the instructions
+#if TORRENT_HAS_SSE
+#define TORRENT_HAS_SIMD_HASH 1
+#include <immintrin.h>
+#if defined __GNUC__
+#define TORRENT_TARGET(x) __attribute__((target(x)))
+#else
+#define TORRENT_TARGET(x)
+#endif
+#else
+#define TORRENT_HAS_SIMD_HASH 0
+#endif
+
+namespace libtorrent::aux {
+
+namespace {
+
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunknown-warning-option"
+#pragma clang diagnostic ignored "-Wunsafe-buffer-usage"
+#endif
+
+	template <typename Hasher, typename Hash>
+	void hash_generic(span<span<char const> const> bufs, span<Hash> out)
+	{
+		for (std::ptrdiff_t i = 0; i < bufs.size(); ++i)
+		{
+			Hasher h;
+			if (!bufs[i].empty()) h.update(bufs[i]);
+			out[i] = h.final();
+		}
+	}
+
+#if TORRENT_HAS_SIMD_HASH
+	std::uint32_t const sha1_iv[5] = {
+		0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+
+	std::uint32_t const sha256_iv[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a
+		, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+	alignas(16) std::uint32_t const sha256_k[64] = {
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5
+		, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174
+		, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da
+		, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967
+		, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85
+		, 0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070
+		, 0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3
+		, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+	// builds the final, padded, block(s) of the message ``buf`` in ``out``.
+	// These are the trailing bytes that don't make up a full block, the 0x80
+	// terminator and the message length in bits. Returns the number of blocks
+	// (1 or 2)
+	int pad_message(span<char const> const buf, char (&out)[128])
+	{
+		std::ptrdiff_t const full = buf.size() & ~std::ptrdiff_t(63);
+		std::size_t const rest = std::size_t(buf.size() - full);
+		if (rest > 0) std::memcpy(out, buf.data() + full, rest);
+		out[rest] = char(0x80);
+		int const blocks = rest + 9 > 64 ? 2 : 1;
+		std::size_t const len_pos = std::size_t(blocks * 64 - 8);
+		std::memset(out + rest + 1, 0, len_pos - rest - 1);
+		std::uint64_t const bits = std::uint64_t(buf.size()) * 8;
+		for (std::size_t i = 0; i < 8; ++i)
+			out[len_pos + i] = char(bits >> (56 - i * 8));
+		return blocks;
+	}
+
+	template <typename Hash, std::size_t N>
+	Hash make_digest(std::uint32_t const (&state)[N])
+	{
+		static_assert(Hash::size() == N * 4, "digest size mismatch");
+		Hash ret;
+		char* d = ret.data();
+		for (std::size_t i = 0; i < N; ++i)
+		{
+			d[i * 4] = char(state[i] >> 24);
+			d[i * 4 + 1] = char(state[i] >> 16);
+			d[i * 4 + 2] = char(state[i] >> 8);
+			d[i * 4 + 3] = char(state[i]);
+		}
+		return ret;
+	}
+
+	// drives a kernel that hashes ``Lanes`` messages in parallel.
+	// ``compress(state, data, blocks)`` hashes ``blocks`` 64 byte blocks of
+	// each of the messages, ``state`` and ``data`` are arrays of ``Lanes``
+	// pointers. Messages of different lengths are hashed in passes of as
+	// many blocks as the shortest remaining message. Lanes without any data
+	// left hash a copy of another lane's data, into a scratch state.
+	template <int Lanes, typename Hash, std::size_t N, typename Compress>
+	void hash_parallel(span<span<char const> const> bufs, span<Hash> out
+		, std::uint32_t const (&iv)[N], Compress compress)
+	{
+		for (std::ptrdiff_t first = 0; first < bufs.size(); first += Lanes)
+		{
+			int const num = int(std::min(std::ptrdiff_t(Lanes), bufs.size() - first));
+
+			std::uint32_t state[Lanes][N];
+			std::uint32_t scratch[N];
+			std::ptrdiff_t blocks[Lanes] = {};
+			char const* ptr[Lanes] = {};
+			for (int l = 0; l < Lanes; ++l)
+				std::copy(std::begin(iv), std::end(iv), state[l]);
+			for (int l = 0; l < num; ++l)
+			{
+				blocks[l] = bufs[first + l].size() / 64;
+				ptr[l] = bufs[first + l].data();
+			}
+
+			std::uint32_t* st[Lanes];
+			char const* p[Lanes];
+			for (;;)
+			{
+				std::ptrdiff_t n = std::numeric_limits<std::ptrdiff_t>::max();
+				char const* filler = nullptr;
+				for (int l = 0; l < Lanes; ++l)
+				{
+					if (blocks[l] == 0) continue;
+					n = std::min(n, blocks[l]);
+					filler = ptr[l];
+				}
+				if (filler == nullptr) break;
+
+				for (int l = 0; l < Lanes; ++l)
+				{
+					if (blocks[l] == 0)
+					{
+						st[l] = scratch;
+						p[l] = filler;
+						continue;
+					}
+					st[l] = state[l];
+					p[l] = ptr[l];
+				}
+				compress(st, p, n);
+				for (int l = 0; l < Lanes; ++l)
+				{
+					if (blocks[l] == 0) continue;
+					blocks[l] -= n;
+					ptr[l] += n * 64;
+				}
+			}
+
+			char tail[Lanes][128];
+			int tail_blocks[Lanes] = {};
+			for (int l = 0; l < num; ++l)
+				tail_blocks[l] = pad_message(bufs[first + l], tail[l]);
+
+			for (int b = 0; b < 2; ++b)
+			{
+				bool any = false;
+				for (int l = 0; l < Lanes; ++l)
+				{
+					if (tail_blocks[l] > b)
+					{
+						st[l] = state[l];
+						p[l] = tail[l] + b * 64;
+						any = true;
+						continue;
+					}
+					st[l] = scratch;
+					p[l] = tail[0];
+				}
+				if (!any) break;
+				compress(st, p, 1);
+			}
+
+			for (int l = 0; l < num; ++l)
+				out[first + l] = make_digest<Hash>(state[l]);
+		}
+	}
+
+	// ==== SHA-NI ====
+
+	// each group is 4 rounds. The message schedule is computed 3 groups
+	// ahead, in the 4 registers in ``msg``
+	template <int G>
+	TORRENT_TARGET("sha,sse4.1")
+	inline void sha1_ni_group(__m128i& abcd, __m128i& e0, __m128i& e1
+		, __m128i (&msg)[4], char const* data)
+	{
+		if constexpr (G < 4)
+		{
+			__m128i const mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+			msg[G] = _mm_shuffle_epi8(_mm_loadu_si128(
+				reinterpret_cast<__m128i const*>(data + G * 16)), mask);
+		}
+
+		if constexpr (G == 0)
+		{
+			e0 = _mm_add_epi32(e0, msg[0]);
+			e1 = abcd;
+			abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+		}
+		else if constexpr (G % 2 == 1)
+		{
+			e1 = _mm_sha1nexte_epu32(e1, msg[G % 4]);
+			e0 = abcd;
+			abcd = _mm_sha1rnds4_epu32(abcd, e1, G / 5);
+		}
+		else
+		{
+			e0 = _mm_sha1nexte_epu32(e0, msg[G % 4]);
+			e1 = abcd;
+			abcd = _mm_sha1rnds4_epu32(abcd, e0, G / 5);
+		}
+
+		if constexpr (G >= 3 && G <= 18)
+			msg[(G + 1) % 4] = _mm_sha1msg2_epu32(msg[(G + 1) % 4], msg[G % 4]);
+		if constexpr (G >= 1 && G <= 16)
+			msg[(G + 3) % 4] = _mm_sha1msg1_epu32(msg[(G + 3) % 4], msg[G % 4]);
+		if constexpr (G >= 2 && G <= 17)
+			msg[(G + 2) % 4] = _mm_xor_si128(msg[(G + 2) % 4], msg[G % 4]);
+	}
+
+	template <int... G>
+	TORRENT_TARGET("sha,sse4.1")
+	inline void sha1_ni_block(std::integer_sequence<int, G...>
+		, __m128i (&abcd)[2], __m128i (&e0)[2], char const* data0, char const* data1)
+	{
+		__m128i const abcd_save[2] = {abcd[0], abcd[1]};
+		__m128i const e0_save[2] = {e0[0], e0[1]};
+		__m128i e1[2];
+		__m128i msg0[4];
+		__m128i msg1[4];
+		((sha1_ni_group<G>(abcd[0], e0[0], e1[0], msg0, data0)
+			, sha1_ni_group<G>(abcd[1], e0[1], e1[1], msg1, data1)), ...);
+		for (int l = 0; l < 2; ++l)
+		{
+			e0[l] = _mm_sha1nexte_epu32(e0[l], e0_save[l]);
+			abcd[l] = _mm_add_epi32(abcd[l], abcd_save[l]);
+		}
+	}
+
+	// hashes two messages at a time. A single message is bound by the
+	// latency of the SHA instructions, interleaving two independent ones
+	// makes better use of the execution units
+	TORRENT_TARGET("sha,sse4.1")
+	void sha1_ni_x2(std::uint32_t* const* state, char const* const* data
+		, std::ptrdiff_t const blocks)
+	{
+		__m128i abcd[2];
+		__m128i e0[2];
+		for (int l = 0; l < 2; ++l)
+		{
+			abcd[l] = _mm_shuffle_epi32(_mm_loadu_si128(
+				reinterpret_cast<__m128i const*>(state[l])), 0x1b);
+			e0[l] = _mm_set_epi32(int(state[l][4]), 0, 0, 0);
+		}
+
+		for (std::ptrdiff_t b = 0; b < blocks; ++b)
+		{
+			sha1_ni_block(std::make_integer_sequence<int, 20>{}
+				, abcd, e0, data[0] + b * 64, data[1] + b * 64);
+		}
+
+		for (int l = 0; l < 2; ++l)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(state[l]), _mm_shuffle_epi32(abcd[l], 0x1b));
+			state[l][4] = std::uint32_t(_mm_extract_epi32(e0[l], 3));
+		}
+	}
+
+	template <int G>
+	TORRENT_TARGET("sha,sse4.1")
+	inline void sha256_ni_group(__m128i& state0, __m128i& state1
+		, __m128i (&msg)[4], char const* data)
+	{
+		if constexpr (G < 4)
+		{
+			__m128i const mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+			msg[G] = _mm_shuffle_epi8(_mm_loadu_si128(
+				reinterpret_cast<__m128i const*>(data + G * 16)), mask);
+		}
+
+		__m128i m = _mm_add_epi32(msg[G % 4], _mm_load_si128(
+			reinterpret_cast<__m128i const*>(&sha256_k[G * 4])));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+		if constexpr (G >= 3 && G <= 14)
+		{
+			__m128i const tmp = _mm_alignr_epi8(msg[G % 4], msg[(G + 3) % 4], 4);
+			msg[(G + 1) % 4] = _mm_sha256msg2_epu32(
+				_mm_add_epi32(msg[(G + 1) % 4], tmp), msg[G % 4]);
+		}
+		m = _mm_shuffle_epi32(m, 0x0e);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, m);
+		if constexpr (G >= 1 && G <= 12)
+			msg[(G + 3) % 4] = _mm_sha256msg1_epu32(msg[(G + 3) % 4], msg[G % 4]);
+	}
+
+	template <int... G>
+	TORRENT_TARGET("sha,sse4.1")
+	inline void sha256_ni_block(std::integer_sequence<int, G...>
+		, __m128i (&state0)[2], __m128i (&state1)[2], char const* data0, char const* data1)
+	{
+		__m128i const abef_save[2] = {state0[0], state0[1]};
+		__m128i const cdgh_save[2] = {state1[0], state1[1]};
+		__m128i msg0[4];
+		__m128i msg1[4];
+		((sha256_ni_group<G>(state0[0], state1[0], msg0, data0)
+			, sha256_ni_group<G>(state0[1], state1[1], msg1, data1)), ...);
+		for (int l = 0; l < 2; ++l)
+		{
+			state0[l] = _mm_add_epi32(state0[l], abef_save[l]);
+			state1[l] = _mm_add_epi32(state1[l], cdgh_save[l]);
+		}
+	}
+
+	// see sha1_ni_x2()
+	TORRENT_TARGET("sha,sse4.1")
+	void sha256_ni_x2(std::uint32_t* const* state, char const* const* data
+		, std::ptrdiff_t const blocks)
+	{
+		// the SHA-NI instructions keep the state as ABEF and CDGH
+		__m128i state0[2];
+		__m128i state1[2];
+		for (int l = 0; l < 2; ++l)
+		{
+			__m128i const tmp = _mm_shuffle_epi32(_mm_loadu_si128(
+				reinterpret_cast<__m128i const*>(state[l])), 0xb1);
+			state1[l] = _mm_shuffle_epi32(_mm_loadu_si128(
+				reinterpret_cast<__m128i const*>(state[l] + 4)), 0x1b);
+			state0[l] = _mm_alignr_epi8(tmp, state1[l], 8);
+			state1[l] = _mm_blend_epi16(state1[l], tmp, 0xf0);
+		}
+
+		for (std::ptrdiff_t b = 0; b < blocks; ++b)
+		{
+			sha256_ni_block(std::make_integer_sequence<int, 16>{}
+				, state0, state1, data[0] + b * 64, data[1] + b * 64);
+		}
+
+		for (int l = 0; l < 2; ++l)
+		{
+			__m128i const tmp = _mm_shuffle_epi32(state0[l], 0x1b);
+			__m128i const cdgh = _mm_shuffle_epi32(state1[l], 0xb1);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(state[l])
+				, _mm_blend_epi16(tmp, cdgh, 0xf0));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(state[l] + 4)
+				, _mm_alignr_epi8(cdgh, tmp, 8));
+		}
+	}
+
+	// ==== AVX2, 8 lanes ====
+
+	template <int N>
+	TORRENT_TARGET("avx2")
+	inline __m256i rotl(__m256i const x)
+	{ return _mm256_or_si256(_mm256_slli_epi32(x, N), _mm256_srli_epi32(x, 32 - N)); }
+
+	template <int N>
+	TORRENT_TARGET("avx2")
+	inline __m256i rotr(__m256i const x)
+	{ return _mm256_or_si256(_mm256_srli_epi32(x, N), _mm256_slli_epi32(x, 32 - N)); }
+
+	TORRENT_TARGET("avx2")
+	inline __m256i add(__m256i const a, __m256i const b)
+	{ return _mm256_add_epi32(a, b); }
+
+	// loads 8 big-endian 32 bit words from each of the 8 lanes and transposes
+	// them, so that w[i] holds word i of every lane
+	TORRENT_TARGET("avx2")
+	inline void load_transposed(__m256i* w, char const* const* data, int const offset)
+	{
+		__m256i const bswap = _mm256_set_epi8(
+			12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3
+			, 12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+		__m256i v[8];
+		for (int l = 0; l < 8; ++l)
+		{
+			v[l] = _mm256_shuffle_epi8(_mm256_loadu_si256(
+				reinterpret_cast<__m256i const*>(data[l] + offset)), bswap);
+		}
+
+		__m256i const t0 = _mm256_unpacklo_epi32(v[0], v[1]);
+		__m256i const t1 = _mm256_unpackhi_epi32(v[0], v[1]);
+		__m256i const t2 = _mm256_unpacklo_epi32(v[2], v[3]);
+		__m256i const t3 = _mm256_unpackhi_epi32(v[2], v[3]);
+		__m256i const t4 = _mm256_unpacklo_epi32(v[4], v[5]);
+		__m256i const t5 = _mm256_unpackhi_epi32(v[4], v[5]);
+		__m256i const t6 = _mm256_unpacklo_epi32(v[6], v[7]);
+		__m256i const t7 = _mm256_unpackhi_epi32(v[6], v[7]);
+
+		__m256i const u0 = _mm256_unpacklo_epi64(t0, t2);
+		__m256i const u1 = _mm256_unpackhi_epi64(t0, t2);
+		__m256i const u2 = _mm256_unpacklo_epi64(t1, t3);
+		__m256i const u3 = _mm256_unpackhi_epi64(t1, t3);
+		__m256i const u4 = _mm256_unpacklo_epi64(t4, t6);
+		__m256i const u5 = _mm256_unpackhi_epi64(t4, t6);
+		__m256i const u6 = _mm256_unpacklo_epi64(t5, t7);
+		__m256i const u7 = _mm256_unpackhi_epi64(t5, t7);
+
+		w[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+		w[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+		w[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+		w[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+		w[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+		w[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+		w[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+		w[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+	}
+
+	// load (and store) word ``i`` of the state of each lane into (from) a
+	// register
+	template <std::size_t N>
+	TORRENT_TARGET("avx2")
+	inline void load_state(__m256i (&s)[N], std::uint32_t* const* state)
+	{
+		for (std::size_t i = 0; i < N; ++i)
+		{
+			s[i] = _mm256_set_epi32(int(state[7][i]), int(state[6][i])
+				, int(state[5][i]), int(state[4][i]), int(state[3][i])
+				, int(state[2][i]), int(state[1][i]), int(state[0][i]));
+		}
+	}
+
+	template <std::size_t N>
+	TORRENT_TARGET("avx2")
+	inline void store_state(__m256i const (&s)[N], std::uint32_t* const* state)
+	{
+		for (std::size_t i = 0; i < N; ++i)
+		{
+			alignas(32) std::uint32_t lanes[8];
+			_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), s[i]);
+			for (std::size_t l = 0; l < 8; ++l) state[l][i] = lanes[l];
+		}
+	}
+
+	TORRENT_TARGET("avx2")
+	void sha1_avx2(std::uint32_t* const* state, char const* const* data
+		, std::ptrdiff_t const blocks)
+	{
+		__m256i s[5];
+		load_state(s, state);
+
+		for (std::ptrdiff_t b = 0; b < blocks; ++b)
+		{
+			int const offset = int(b * 64);
+			__m256i w[16];
+			load_transposed(w, data, offset);
+			load_transposed(w + 8, data, offset + 32);
+
+			__m256i a = s[0];
+			__m256i bb = s[1];
+			__m256i c = s[2];
+			__m256i d = s[3];
+			__m256i e = s[4];
+
+			for (int t = 0; t < 80; ++t)
+			{
+				if (t >= 16)
+				{
+					w[t & 15] = rotl<1>(_mm256_xor_si256(
+						_mm256_xor_si256(w[(t - 3) & 15], w[(t - 8) & 15])
+						, _mm256_xor_si256(w[(t - 14) & 15], w[t & 15])));
+				}
+
+				__m256i f;
+				std::uint32_t k;
+				if (t < 20)
+				{
+					// d ^ (b & (c ^ d))
+					f = _mm256_xor_si256(d, _mm256_and_si256(bb, _mm256_xor_si256(c, d)));
+					k = 0x5a827999;
+				}
+				else if (t < 40)
+				{
+					f = _mm256_xor_si256(_mm256_xor_si256(bb, c), d);
+					k = 0x6ed9eba1;
+				}
+				else if (t < 60)
+				{
+					// (b & c) | (d & (b | c))
+					f = _mm256_or_si256(_mm256_and_si256(bb, c)
+						, _mm256_and_si256(d, _mm256_or_si256(bb, c)));
+					k = 0x8f1bbcdc;
+				}
+				else
+				{
+					f = _mm256_xor_si256(_mm256_xor_si256(bb, c), d);
+					k = 0xca62c1d6;
+				}
+
+				__m256i const tmp = add(add(rotl<5>(a), f)
+					, add(add(e, _mm256_set1_epi32(int(k))), w[t & 15]));
+				e = d;
+				d = c;
+				c = rotl<30>(bb);
+				bb = a;
+				a = tmp;
+			}
+
+			s[0] = add(s[0], a);
+			s[1] = add(s[1], bb);
+			s[2] = add(s[2], c);
+			s[3] = add(s[3], d);
+			s[4] = add(s[4], e);
+		}
+
+		store_state(s, state);
+	}
+
+	// one round of SHA-256. ``wk`` is the message word plus the round
+	// constant
+	TORRENT_TARGET("avx2")
+	inline void sha256_avx2_round(__m256i (&v)[8], __m256i const wk)
+	{
+		__m256i const& a = v[0];
+		__m256i const& e = v[4];
+		__m256i const S1 = _mm256_xor_si256(_mm256_xor_si256(
+			rotr<6>(e), rotr<11>(e)), rotr<25>(e));
+		// g ^ (e & (f ^ g))
+		__m256i const ch = _mm256_xor_si256(v[6]
+			, _mm256_and_si256(e, _mm256_xor_si256(v[5], v[6])));
+		__m256i const t1 = add(add(v[7], S1), add(ch, wk));
+		__m256i const S0 = _mm256_xor_si256(_mm256_xor_si256(
+			rotr<2>(a), rotr<13>(a)), rotr<22>(a));
+		// (a & b) | (c & (a | b))
+		__m256i const maj = _mm256_or_si256(_mm256_and_si256(a, v[1])
+			, _mm256_and_si256(v[2], _mm256_or_si256(a, v[1])));
+		__m256i const t2 = add(S0, maj);
+
+		v[7] = v[6];
+		v[6] = v[5];
+		v[5] = v[4];
+		v[4] = add(v[3], t1);
+		v[3] = v[2];
+		v[2] = v[1];
+		v[1] = v[0];
+		v[0] = add(t1, t2);
+	}
+
+	// compresses one block, whose first 16 message words are in ``w``, into
+	// ``s``
+	TORRENT_TARGET("avx2")
+	inline void sha256_avx2_block(__m256i (&s)[8], __m256i (&w)[16])
+	{
+		__m256i v[8];
+		std::copy(std::begin(s), std::end(s), v);
+
+		for (int t = 0; t < 64; ++t)
+		{
+			if (t >= 16)
+			{
+				__m256i const w15 = w[(t - 15) & 15];
+				__m256i const w2 = w[(t - 2) & 15];
+				__m256i const s0 = _mm256_xor_si256(_mm256_xor_si256(
+					rotr<7>(w15), rotr<18>(w15)), _mm256_srli_epi32(w15, 3));
+				__m256i const s1 = _mm256_xor_si256(_mm256_xor_si256(
+					rotr<17>(w2), rotr<19>(w2)), _mm256_srli_epi32(w2, 10));
+				w[t & 15] = add(add(w[t & 15], s0), add(w[(t - 7) & 15], s1));
+			}
+			sha256_avx2_round(v, add(w[t & 15], _mm256_set1_epi32(int(sha256_k[t]))));
+		}
+
+		for (int i = 0; i < 8; ++i) s[i] = add(s[i], v[i]);
+	}
+
+	TORRENT_TARGET("avx2")
+	void sha256_avx2(std::uint32_t* const* state, char const* const* data
+		, std::ptrdiff_t const blocks)
+	{
+		__m256i s[8];
+		load_state(s, state);
+
+		for (std::ptrdiff_t b = 0; b < blocks; ++b)
+		{
+			int const offset = int(b * 64);
+			__m256i w[16];
+			load_transposed(w, data, offset);
+			load_transposed(w + 8, data, offset + 32);
+			sha256_avx2_block(s, w);
+		}
+
+		store_state(s, state);
+	}
+
+	// the padding block of a 64 byte message is the same for all messages,
+	// and so is its message schedule. This is W[t] + K[t] for that block
+	struct pad_schedule
+	{
+		pad_schedule()
+		{
+			std::uint32_t w[64] = {};
+			w[0] = 0x80000000;
+			w[15] = 64 * 8;
+			auto rotr32 = [](std::uint32_t const x, int const n)
+			{ return (x >> n) | (x << (32 - n)); };
+			for (int t = 16; t < 64; ++t)
+			{
+				std::uint32_t const s0 = rotr32(w[t - 15], 7) ^ rotr32(w[t - 15], 18) ^ (w[t - 15] >> 3);
+				std::uint32_t const s1 = rotr32(w[t - 2], 17) ^ rotr32(w[t - 2], 19) ^ (w[t - 2] >> 10);
+				w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+			}
+			for (int t = 0; t < 64; ++t) wk[t] = w[t] + sha256_k[t];
+		}
+		std::uint32_t wk[64];
+	};
+
+	pad_schedule const& pad_64()
+	{
+		static pad_schedule const ret;
+		return ret;
+	}
+
+	// hashes the 8 sibling pairs starting at ``children``, into ``parents``
+	TORRENT_TARGET("avx2")
+	void sha256_pairs_avx2(sha256_hash const* children, sha256_hash* parents
+		, std::ptrdiff_t const num)
+	{
+		std::uint32_t const* wk = pad_64().wk;
+		for (std::ptrdiff_t i = 0; i + 8 <= num; i += 8)
+		{
+			char const* data[8];
+			for (int l = 0; l < 8; ++l) data[l] = children[(i + l) * 2].data();
+
+			__m256i s[8];
+			for (int k = 0; k < 8; ++k) s[k] = _mm256_set1_epi32(int(sha256_iv[k]));
+
+			__m256i w[16];
+			load_transposed(w, data, 0);
+			load_transposed(w + 8, data, 32);
+			sha256_avx2_block(s, w);
+
+			__m256i v[8];
+			std::copy(std::begin(s), std::end(s), v);
+			for (int t = 0; t < 64; ++t)
+				sha256_avx2_round(v, _mm256_set1_epi32(int(wk[t])));
+			for (int k = 0; k < 8; ++k) s[k] = add(s[k], v[k]);
+
+			std::uint32_t state[8][8];
+			std::uint32_t* st[8];
+			for (int l = 0; l < 8; ++l) st[l] = state[l];
+			store_state(s, st);
+			for (int l = 0; l < 8; ++l)
+				parents[i + l] = make_digest<sha256_hash>(state[l]);
+		}
+	}
+
+	alignas(16) char const pad_block_64[64] = {
+		char(0x80), 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+		, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+		, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+		, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0 };
+
+	void sha256_pairs_ni(sha256_hash const* children, sha256_hash* parents
+		, std::ptrdiff_t const num)
+	{
+		char const* const pad[2] = {pad_block_64, pad_block_64};
+		for (std::ptrdiff_t i = 0; i < num; i += 2)
+		{
+			bool const odd = i + 1 == num;
+			std::uint32_t state[2][8];
+			std::copy(std::begin(sha256_iv), std::end(sha256_iv), state[0]);
+			std::copy(std::begin(sha256_iv), std::end(sha256_iv), state[1]);
+			std::uint32_t* st[2] = {state[0], state[1]};
+			char const* data[2] = {children[i * 2].data()
+				, children[(odd ? i : i + 1) * 2].data()};
+			sha256_ni_x2(st, data, 1);
+			sha256_ni_x2(st, pad, 1);
+			parents[i] = make_digest<sha256_hash>(state[0]);
+			if (!odd) parents[i + 1] = make_digest<sha256_hash>(state[1]);
+		}
+	}
+#endif // TORRENT_HAS_SIMD_HASH
+
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+
+	void sha256_pairs_generic(sha256_hash const* children, sha256_hash* parents
+		, std::ptrdiff_t const num)
+	{
+		for (std::ptrdiff_t i = 0; i < num; ++i)
+		{
+			parents[i] = hasher256(children[i * 2])
+				.update(children[i * 2 + 1]).final();
+		}
+	}
+
+	hash_kernel best_kernel(std::ptrdiff_t const num_bufs)
+	{
+		if (hash_kernel_supported(hash_kernel::sha_ni)) return hash_kernel::sha_ni;
+		// with only a few buffers, most of the AVX2 lanes would be wasted
+		if (num_bufs >= 4 && hash_kernel_supported(hash_kernel::avx2))
+			return hash_kernel::avx2;
+		return hash_kernel::generic;
+	}
+} // anonymous namespace
+
+	int hash_lanes()
+	{
+		if (hash_kernel_supported(hash_kernel::sha_ni)) return 2;
+		if (hash_kernel_supported(hash_kernel::avx2)) return 8;
+		return 1;
+	}
+
+	bool hash_kernel_supported(hash_kernel const k)
+	{
+		switch (k)
+		{
+			case hash_kernel::generic: return true;
+#if TORRENT_HAS_SIMD_HASH
+			case hash_kernel::sha_ni: return sha_ni_support;
+			case hash_kernel::avx2: return avx2_support;
+#else
+			case hash_kernel::sha_ni:
+			case hash_kernel::avx2:
+				return false;
+#endif
+		}
+		return false;
+	}
+
+	void multi_sha1(span<span<char const> const> bufs, span<sha1_hash> out)
+	{
+		multi_sha1(bufs, out, best_kernel(bufs.size()));
+	}
+
+	void multi_sha256(span<span<char const> const> bufs, span<sha256_hash> out)
+	{
+		multi_sha256(bufs, out, best_kernel(bufs.size()));
+	}
+
+	void multi_sha1(span<span<char const> const> bufs, span<sha1_hash> out
+		, hash_kernel const k)
+	{
+		TORRENT_ASSERT(out.size() >= bufs.size());
+		TORRENT_ASSERT(hash_kernel_supported(k));
+		switch (k)
+		{
+#if TORRENT_HAS_SIMD_HASH
+			case hash_kernel::sha_ni:
+				hash_parallel<2>(bufs, out, sha1_iv, &sha1_ni_x2);
+				return;
+			case hash_kernel::avx2:
+				hash_parallel<8>(bufs, out, sha1_iv, &sha1_avx2);
+				return;
+#else
+			case hash_kernel::sha_ni:
+			case hash_kernel::avx2:
+#endif
+			case hash_kernel::generic:
+				hash_generic<hasher>(bufs, out);
+				return;
+		}
+	}
+
+	void multi_sha256(span<span<char const> const> bufs, span<sha256_hash> out
+		, hash_kernel const k)
+	{
+		TORRENT_ASSERT(out.size() >= bufs.size());
+		TORRENT_ASSERT(hash_kernel_supported(k));
+		switch (k)
+		{
+#if TORRENT_HAS_SIMD_HASH
+			case hash_kernel::sha_ni:
+				hash_parallel<2>(bufs, out, sha256_iv, &sha256_ni_x2);
+				return;
+			case hash_kernel::avx2:
+				hash_parallel<8>(bufs, out, sha256_iv, &sha256_avx2);
+				return;
+#else
+			case hash_kernel::sha_ni:
+			case hash_kernel::avx2:
+#endif
+			case hash_kernel::generic:
+				hash_generic<hasher256>(bufs, out);
+				return;
+		}
+	}
+
+	void multi_sha256_pairs(span<sha256_hash const> children, span<sha256_hash> parents)
+	{
+		multi_sha256_pairs(children, parents, best_kernel(children.size() / 2));
+	}
+
+	void multi_sha256_pairs(span<sha256_hash const> children, span<sha256_hash> parents
+		, hash_kernel const k)
+	{
+		static_assert(sizeof(sha256_hash) == 32, "sibling pairs must be contiguous");
+		TORRENT_ASSERT((children.size() & 1) == 0);
+		TORRENT_ASSERT(parents.size() >= children.size() / 2);
+		TORRENT_ASSERT(hash_kernel_supported(k));
+
+		std::ptrdiff_t const num = children.size() / 2;
+		switch (k)
+		{
+#if TORRENT_HAS_SIMD_HASH
+			case hash_kernel::sha_ni:
+				sha256_pairs_ni(children.data(), parents.data(), num);
+				return;
+			case hash_kernel::avx2:
+			{
+				std::ptrdiff_t const full = num & ~std::ptrdiff_t(7);
+				sha256_pairs_avx2(children.data(), parents.data(), full);
+				sha256_pairs_generic(children.data() + full * 2, parents.data() + full
+					, num - full);
+				return;
+			}
+#else
+			case hash_kernel::sha_ni:
+			case hash_kernel::avx2:
+#endif
+			case hash_kernel::generic:
+				sha256_pairs_generic(children.data(), parents.data(), num);
+				return;
+		}
+	}
+}
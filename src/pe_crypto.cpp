@@ -58,9 +58,6 @@ namespace libtorrent::aux {
 		return ret;
 	}
 
-	void rc4_init(const unsigned char* in, std::size_t len, rc4 *state);
-	std::size_t rc4_encrypt(unsigned char *out, std::size_t outlen, rc4 *state);
-
 	// Set the prime P and the generator, generate local public key
 	dh_key_exchange::dh_key_exchange()
 	{
@@ -326,65 +323,68 @@ namespace libtorrent::aux {
 // this library is public domain and has been specially
 // tailored for libtorrent by Arvid Norberg
 
-void rc4_init(const unsigned char* in, std::size_t len, rc4 *state)
+void rc4_init(unsigned char const* in, std::size_t len, rc4* state)
 {
-	std::size_t const key_size = sizeof(state->buf);
-	aux::array<std::uint8_t, key_size> key;
-	std::uint8_t tmp, *s;
-	int keylen, x, y, j;
-
 	TORRENT_ASSERT(state != nullptr);
-	TORRENT_ASSERT(len <= key_size);
-	if (len > key_size) len = key_size;
+	TORRENT_ASSERT(len > 0);
+	TORRENT_ASSERT(len <= state->buf.size());
+	if (len > state->buf.size()) len = state->buf.size();
 
-	state->x = 0;
-	while (len--) {
-		state->buf[state->x++] = *in++;
-	}
-
-	/* extract the key */
-	s = state->buf.data();
-	std::memcpy(key.data(), s, key_size);
-	keylen = state->x;
+	std::uint32_t* const s = state->buf.data();
+	for (std::uint32_t x = 0; x < 256; ++x)
+		s[x] = x;
 
 	/* make RC4 perm and shuffle */
-	for (x = 0; x < int(key_size); ++x) {
-		s[x] = x & 0xff;
-	}
-
-	for (j = x = y = 0; x < int(key_size); x++) {
-		y = (y + state->buf[x] + key[j++]) & 255;
-		if (j == keylen) {
-			j = 0;
-		}
-		tmp = s[x]; s[x] = s[y]; s[y] = tmp;
+	std::uint32_t y = 0;
+	std::size_t j = 0;
+	for (std::uint32_t x = 0; x < 256; ++x)
+	{
+		y = (y + s[x] + in[j]) & 0xff;
+		if (++j == len) j = 0;
+		std::swap(s[x], s[y]);
 	}
 	state->x = 0;
 	state->y = 0;
 }
 
-std::size_t rc4_encrypt(unsigned char *out, std::size_t outlen, rc4 *state)
+std::size_t rc4_encrypt(unsigned char* out, std::size_t const outlen, rc4* state)
 {
-	std::uint8_t x, y, *s, tmp;
-	std::size_t n;
-
-	TORRENT_ASSERT(out != nullptr);
+	TORRENT_ASSERT(out != nullptr || outlen == 0);
 	TORRENT_ASSERT(state != nullptr);
 
-	n = outlen;
-	x = state->x & 0xff;
-	y = state->y & 0xff;
-	s = state->buf.data();
-	while (outlen--) {
-		x = (x + 1) & 255;
-		y = (y + s[x]) & 255;
-		tmp = s[x]; s[x] = s[y]; s[y] = tmp;
-		tmp = (s[x] + s[y]) & 255;
-		*out++ ^= s[tmp];
+	// every byte of keystream depends on the permutation left by the
+	// previous one, so there's no way to generate it in parallel. What we
+	// can do is to keep the indices and the permutation in 32 bit words and
+	// unroll the loop, producing 4 bytes per iteration
+	std::uint32_t x = std::uint32_t(state->x) & 0xff;
+	std::uint32_t y = std::uint32_t(state->y) & 0xff;
+	std::uint32_t* const s = state->buf.data();
+
+	auto const next = [&]
+	{
+		x = (x + 1) & 0xff;
+		std::uint32_t const sx = s[x];
+		y = (y + sx) & 0xff;
+		std::uint32_t const sy = s[y];
+		s[x] = sy;
+		s[y] = sx;
+		return static_cast<unsigned char>(s[(sx + sy) & 0xff]);
+	};
+
+	std::size_t n = outlen;
+	for (; n >= 4; n -= 4, out += 4)
+	{
+		out[0] ^= next();
+		out[1] ^= next();
+		out[2] ^= next();
+		out[3] ^= next();
 	}
-	state->x = x;
-	state->y = y;
-	return n;
+	for (; n > 0; --n, ++out)
+		*out ^= next();
+
+	state->x = int(x);
+	state->y = int(y);
+	return outlen;
 }
 
 } // namespace libtorrent::aux
@@ -327,6 +327,7 @@ namespace {
 #endif
 
 		m_ses.set_peer_classes(this, m_remote.address(), socket_type_idx(m_socket));
+		schedule_timeout();
 
 #ifndef TORRENT_DISABLE_LOGGING
 		if (should_log(peer_log_alert::info))
@@ -1369,6 +1370,7 @@ namespace {
 		// of the torrent and peer_connection::disconnect() will fail if it
 		// think it is
 		m_torrent = t;
+		schedule_timeout();
 
 		if (t && t->alerts().should_post<peer_connect_alert>())
 		{
@@ -1446,8 +1448,10 @@ namespace {
 	std::uint32_t peer_connection::peer_rank() const
 	{
 		TORRENT_ASSERT(is_single_thread());
-		return m_peer_info == nullptr ? 0
-			: m_peer_info->rank(m_ses.external_address(), m_ses.listen_port());
+		if (m_peer_info == nullptr) return 0;
+		if (m_peer_rank == 0)
+			m_peer_rank = m_peer_info->rank(m_ses.external_address(), m_ses.listen_port());
+		return m_peer_rank;
 	}
 
 	// message handlers
@@ -1791,6 +1795,7 @@ namespace {
 			m_peer_interested = true;
 		}
 		if (is_disconnecting()) return;
+		schedule_timeout();
 
 		// if the peer is ready to download stuff, it must have metadata
 		m_has_metadata = true;
@@ -2928,8 +2933,12 @@ namespace {
 			// we completed an incoming block, and there are still outstanding
 			// requests. The next block we expect to receive now has another
 			// timeout period until we time out. So, reset the timer.
+			// request_timeout() may have become shorter with this sample
 			if (!m_download_queue.empty())
+			{
 				m_requested.set(m_connect, now);
+				schedule_timeout();
+			}
 
 			if (request_a_block(*t, *this))
 				m_counters.inc_stats_counter(counters::incoming_redundant_piece_picks);
@@ -3007,8 +3016,12 @@ namespace {
 		// we completed an incoming block, and there are still outstanding
 		// requests. The next block we expect to receive now has another
 		// timeout period until we time out. So, reset the timer.
+		// request_timeout() may have become shorter with this sample
 		if (!m_download_queue.empty())
+		{
 			m_requested.set(m_connect, now);
+			schedule_timeout();
+		}
 
 		bool const was_finished = picker.is_piece_finished(p.piece);
 		// did we request this block from any other peers?
@@ -3872,6 +3885,7 @@ namespace {
 		if (!ignore_unchoke_slots())
 			m_counters.inc_stats_counter(counters::num_peers_up_unchoked);
 		m_choked = false;
+		schedule_timeout();
 
 		m_uploaded_at_last_unchoke = m_statistics.total_payload_upload();
 
@@ -4170,6 +4184,7 @@ namespace {
 			// previously did not have a request. That's when we start the
 			// request timeout.
 			m_requested.set(m_connect, aux::time_now());
+			schedule_timeout();
 		}
 	}
 
@@ -4577,6 +4592,31 @@ namespace {
 		return std::max(2, ret);
 	}
 
+	int peer_connection::connect_timeout() const
+	{
+		int ret = m_settings.get_int(settings_pack::peer_connect_timeout);
+		if (m_peer_info) ret += 3 * m_peer_info->failcount;
+
+		// SSL and i2p handshakes are slow
+		if (is_ssl(m_socket))
+			ret += 10;
+
+#if TORRENT_USE_I2P
+		if (is_i2p(m_socket))
+			ret += 20;
+#endif
+		return ret;
+	}
+
+	int peer_connection::handshake_timeout() const
+	{
+		int ret = m_settings.get_int(settings_pack::handshake_timeout);
+#if TORRENT_USE_I2P
+		ret *= is_i2p(m_socket) ? 4 : 1;
+#endif
+		return ret;
+	}
+
 	void peer_connection::get_peer_info(peer_info& p) const
 	{
 		TORRENT_ASSERT(is_single_thread());
@@ -4921,25 +4961,99 @@ namespace {
 		if (is_disconnecting()) return;
 #endif
 
+		// if our download rate isn't increasing significantly anymore, end slow
+		// start. The 10kB is to have some slack here.
+		// we can't do this when we're choked, because we aren't sending any
+		// requests yet, so there hasn't been an opportunity to ramp up the
+		// connection yet.
+		if (m_slow_start
+			&& !m_peer_choked
+			&& m_downloaded_last_second > 0
+			&& m_downloaded_last_second + 5000
+				>= m_statistics.last_payload_downloaded())
+		{
+			m_slow_start = false;
+#ifndef TORRENT_DISABLE_LOGGING
+			if (should_log(peer_log_alert::info))
+			{
+				peer_log(peer_log_alert::info, peer_log_alert::slow_start, "exit slow start: "
+					"prev-dl: %d dl: %d"
+					, int(m_downloaded_last_second)
+					, m_statistics.last_payload_downloaded());
+			}
+#endif
+		}
+		m_downloaded_last_second = m_statistics.last_payload_downloaded();
+		m_uploaded_last_second = m_statistics.last_payload_uploaded();
+
+		m_statistics.second_tick(tick_interval_ms);
+
+		if (m_statistics.upload_payload_rate() > m_upload_rate_peak)
+		{
+			m_upload_rate_peak = m_statistics.upload_payload_rate();
+		}
+		if (m_statistics.download_payload_rate() > m_download_rate_peak)
+		{
+			m_download_rate_peak = m_statistics.download_payload_rate();
+		}
+		if (is_disconnecting()) return;
+
+		if (!t->ready_for_connections()) return;
+
+		update_desired_queue_size();
+
+		if (m_desired_queue_size >= m_settings.get_int(settings_pack::max_out_request_queue)
+			&& t->alerts().should_post<performance_alert>())
+		{
+			t->alerts().emplace_alert<performance_alert>(t->get_handle()
+				, performance_alert::outstanding_request_limit_reached);
+		}
+
+		fill_send_buffer();
+	}
+
+	void peer_connection::on_timeout(time_point const at)
+	{
+		TORRENT_ASSERT(is_single_thread());
+
+		// we may have asked for an earlier time since this one was scheduled
+		if (at != m_timeout_at) return;
+		m_timeout_at = time_point::max();
+		if (m_disconnecting) return;
+
+		std::shared_ptr<peer_connection> me(self());
+		check_timeouts();
+		schedule_timeout();
+	}
+
+	void peer_connection::check_timeouts()
+	{
+		TORRENT_ASSERT(is_single_thread());
+		time_point const now = aux::time_now();
+
+		auto t = m_torrent.lock();
+		if (!t)
+		{
+			// this is an incoming connection that hasn't been attached to a
+			// torrent yet. It has to complete its handshake in time
+			if (now - m_connect > seconds(handshake_timeout()))
+				disconnect(errors::timed_out, operation_t::bittorrent);
+			return;
+		}
+
+		std::shared_ptr<peer_connection> me(self());
+
+		// the invariant check must be run before me is destructed
+		// in case the peer got disconnected
+		INVARIANT_CHECK;
+
 		// if the peer hasn't said a thing for a certain
 		// time, it is considered to have timed out
 		time_duration d = now - m_last_receive.get(m_connect);
 
 		if (m_connecting)
 		{
-			int connect_timeout = m_settings.get_int(settings_pack::peer_connect_timeout);
-			if (m_peer_info) connect_timeout += 3 * m_peer_info->failcount;
-
-			// SSL and i2p handshakes are slow
-			if (is_ssl(m_socket))
-				connect_timeout += 10;
-
-#if TORRENT_USE_I2P
-			if (is_i2p(m_socket))
-				connect_timeout += 20;
-#endif
-
-			if (d > seconds(connect_timeout)
+			if (d > seconds(connect_timeout())
 				&& can_disconnect(errors::timed_out))
 			{
 #ifndef TORRENT_DISABLE_LOGGING
@@ -4947,8 +5061,8 @@ namespace {
 					, int(total_seconds(d)));
 #endif
 				connect_failed(errors::timed_out);
-				return;
 			}
+			return;
 		}
 
 		// if the bw_network flag isn't set, it means we are not even trying to
@@ -4959,11 +5073,7 @@ namespace {
 		// can enforce the timeouts.
 		bool const reading_socket = bool(m_channel_state[download_channel] & peer_info::bw_network);
 
-		// TODO: 2 use a deadline_timer for timeouts. Don't rely on second_tick()!
-		// Hook this up to connect timeout as well. This would improve performance
-		// because of less work in second_tick(), and might let use remove ticking
-		// entirely eventually
-		if (reading_socket && d > seconds(timeout()) && !m_connecting && m_reading_bytes == 0
+		if (reading_socket && d > seconds(timeout()) && m_reading_bytes == 0
 			&& can_disconnect(errors::timed_out_inactivity))
 		{
 #ifndef TORRENT_DISABLE_LOGGING
@@ -4975,14 +5085,9 @@ namespace {
 		}
 
 		// do not stall waiting for a handshake
-		int timeout = m_settings.get_int (settings_pack::handshake_timeout);
-#if TORRENT_USE_I2P
-		timeout *= is_i2p(m_socket) ? 4 : 1;
-#endif
 		if (reading_socket
-			&& !m_connecting
 			&& in_handshake()
-			&& d > seconds(timeout))
+			&& d > seconds(handshake_timeout()))
 		{
 #ifndef TORRENT_DISABLE_LOGGING
 			peer_log(peer_log_alert::info, peer_log_alert::no_handshake, "waited %d seconds"
@@ -5001,12 +5106,11 @@ namespace {
 			, m_last_sent_payload.get(m_connect));
 
 		if (reading_socket
-			&& !m_connecting
 			&& m_requests.empty()
 			&& m_reading_bytes == 0
 			&& !m_choked
 			&& m_peer_interested
-			&& t && t->is_upload_only()
+			&& t->is_upload_only()
 			&& d > seconds(60)
 			&& can_disconnect(errors::timed_out_no_request))
 		{
@@ -5030,7 +5134,7 @@ namespace {
 		// list full. This will enable the inactive timeout
 		bool const max_session_conns = m_ses.num_connections()
 			>= m_settings.get_int(settings_pack::connections_limit) - 5;
-		bool const max_torrent_conns = t && t->num_peers()
+		bool const max_torrent_conns = t->num_peers()
 			>= t->max_connections() - 5;
 
 		// don't bother disconnect peers we haven't been interested
@@ -5065,55 +5169,10 @@ namespace {
 
 		// if we haven't sent something in too long, send a keep-alive
 		keep_alive();
-
-		// if our download rate isn't increasing significantly anymore, end slow
-		// start. The 10kB is to have some slack here.
-		// we can't do this when we're choked, because we aren't sending any
-		// requests yet, so there hasn't been an opportunity to ramp up the
-		// connection yet.
-		if (m_slow_start
-			&& !m_peer_choked
-			&& m_downloaded_last_second > 0
-			&& m_downloaded_last_second + 5000
-				>= m_statistics.last_payload_downloaded())
-		{
-			m_slow_start = false;
-#ifndef TORRENT_DISABLE_LOGGING
-			if (should_log(peer_log_alert::info))
-			{
-				peer_log(peer_log_alert::info, peer_log_alert::slow_start, "exit slow start: "
-					"prev-dl: %d dl: %d"
-					, int(m_downloaded_last_second)
-					, m_statistics.last_payload_downloaded());
-			}
-#endif
-		}
-		m_downloaded_last_second = m_statistics.last_payload_downloaded();
-		m_uploaded_last_second = m_statistics.last_payload_uploaded();
-
-		m_statistics.second_tick(tick_interval_ms);
-
-		if (m_statistics.upload_payload_rate() > m_upload_rate_peak)
-		{
-			m_upload_rate_peak = m_statistics.upload_payload_rate();
-		}
-		if (m_statistics.download_payload_rate() > m_download_rate_peak)
-		{
-			m_download_rate_peak = m_statistics.download_payload_rate();
-		}
 		if (is_disconnecting()) return;
 
 		if (!t->ready_for_connections()) return;
 
-		update_desired_queue_size();
-
-		if (m_desired_queue_size >= m_settings.get_int(settings_pack::max_out_request_queue)
-			&& t->alerts().should_post<performance_alert>())
-		{
-			t->alerts().emplace_alert<performance_alert>(t->get_handle()
-				, performance_alert::outstanding_request_limit_reached);
-		}
-
 		int const piece_timeout = m_settings.get_int(settings_pack::piece_timeout);
 
 		if (!m_download_queue.empty()
@@ -5136,8 +5195,68 @@ namespace {
 
 			snub_peer();
 		}
+	}
 
-		fill_send_buffer();
+	time_point peer_connection::next_timeout() const
+	{
+		TORRENT_ASSERT(is_single_thread());
+
+		auto t = m_torrent.lock();
+		if (!t) return m_connect + seconds(handshake_timeout());
+
+		time_point const last_receive = m_last_receive.get(m_connect);
+		if (m_connecting) return last_receive + seconds(connect_timeout());
+
+		// the conditions that only hold for a moment, like whether we're
+		// reading from the socket, are not considered here. If a timeout is
+		// held back by one, it's checked again a second later (see
+		// schedule_timeout())
+		time_point ret = last_receive + seconds(timeout());
+
+		if (in_handshake())
+			ret = std::min(ret, last_receive + seconds(handshake_timeout()));
+		else
+			ret = std::min(ret, m_last_sent.get(m_connect) + seconds(timeout() / 2));
+
+		if (m_requests.empty() && !m_choked && m_peer_interested && t->is_upload_only())
+		{
+			ret = std::min(ret, std::max(std::max(m_last_unchoke.get(m_connect)
+				, m_last_incoming_request.get(m_connect))
+				, m_last_sent_payload.get(m_connect)) + seconds(60));
+		}
+
+		if (!m_interesting && !m_peer_interested)
+		{
+			// this one only applies when we're close to the connection limit.
+			// Once it has passed, don't keep checking for it, the other
+			// timeouts wake us up often enough
+			time_point const no_interest = std::max(m_became_uninterested.get(m_connect)
+				, m_became_uninteresting.get(m_connect))
+				+ seconds(m_settings.get_int(settings_pack::inactivity_timeout));
+			if (no_interest >= aux::time_now()) ret = std::min(ret, no_interest);
+		}
+
+		if (!m_download_queue.empty())
+		{
+			ret = std::min(ret, m_requested.get(m_connect) + seconds(request_timeout()));
+			ret = std::min(ret, m_last_piece.get(m_connect)
+				+ seconds(m_settings.get_int(settings_pack::piece_timeout)));
+		}
+		return ret;
+	}
+
+	void peer_connection::schedule_timeout()
+	{
+		TORRENT_ASSERT(is_single_thread());
+		if (m_disconnecting) return;
+
+		// timeouts are checked with one second granularity. One that's due
+		// already, but was held back, is checked again in a second
+		time_point const at = std::max(next_timeout(), aux::time_now() + seconds(1));
+		if (at >= m_timeout_at) return;
+
+		m_timeout_at = at;
+		m_ses.schedule_timeout(self(), at);
 	}
 
 	void peer_connection::snub_peer()
@@ -5381,6 +5500,9 @@ namespace {
 				auto const read_mode = m_settings.get_int(settings_pack::disk_io_read_mode);
 				if (read_mode == settings_pack::disable_os_cache)
 					flags |= disk_interface::volatile_read;
+				else if (m_settings.get_bool(settings_pack::zero_copy_send)
+					&& supports_zero_copy_send())
+					flags |= disk_interface::zero_copy;
 
 				auto const issue_time = clock_type::now();
 				m_disk_thread.async_read(t->storage(), r
@@ -6325,6 +6447,7 @@ namespace {
 
 		if (m_disconnecting) return;
 		m_last_receive.set(m_connect, aux::time_now());
+		schedule_timeout();
 
 		error_code ec;
 		m_local = m_socket.local_endpoint(ec);
@@ -6857,6 +6980,18 @@ namespace {
 			&& m_num_pieces > 0 && t && t->valid_metadata();
 	}
 
+	bool peer_connection::supports_zero_copy_send() const
+	{
+		// SSL and uTP (and WebRTC) copy the send buffer into their own
+		// buffers in user space. Those copies may fault, if the file backing
+		// a mapped block is truncated
+		if (is_ssl(m_socket) || is_utp(m_socket)) return false;
+#if TORRENT_USE_RTC
+		if (is_rtc(m_socket)) return false;
+#endif
+		return true;
+	}
+
 #ifndef TORRENT_DISABLE_SHARE_MODE
 	void peer_connection::set_share_mode(bool u)
 	{
@@ -14,6 +14,7 @@ see LICENSE file.
 */
 
 #include <functional>
+#include <cstring> // for memcpy
 
 #include "libtorrent/aux_/peer_connection.hpp"
 #include "libtorrent/aux_/web_peer_connection.hpp"
@@ -84,8 +85,30 @@ namespace {
 		return lhs.trust_points < rhs.trust_points;
 	}
 
+	// a connect candidate in find_connect_candidates(). Its rank is
+	// computed the first time compare_peer() needs it, since it means
+	// hashing the peer's address. If the peer allocator has a rank slot for
+	// the peer, it's cached there, otherwise it's kept for the rest of the
+	// call
+	struct ranked_peer
+	{
+		aux::torrent_peer* peer;
+		std::uint32_t* slot;
+		mutable std::uint32_t rank = 0;
+
+		aux::torrent_peer const* operator->() const { return peer; }
+	};
+
+	std::uint32_t peer_rank(ranked_peer const& p
+		, aux::external_ip const& external, int const external_port)
+	{
+		std::uint32_t& rank = p.slot ? *p.slot : p.rank;
+		if (rank == 0) rank = p.peer->rank(external, external_port);
+		return rank;
+	}
+
 	// this returns true if lhs is a better connect candidate than rhs
-	bool compare_peer(aux::torrent_peer const* lhs, aux::torrent_peer const* rhs
+	bool compare_peer(ranked_peer const& lhs, ranked_peer const& rhs
 		, aux::external_ip const& external, int const external_port, bool const finished)
 	{
 		// prefer peers with lower failcount
@@ -113,18 +136,27 @@ namespace {
 		int const rhs_rank = aux::source_rank(rhs->peer_source());
 		if (lhs_rank != rhs_rank) return lhs_rank > rhs_rank;
 
-		std::uint32_t const lhs_peer_rank = lhs->rank(external, external_port);
-		std::uint32_t const rhs_peer_rank = rhs->rank(external, external_port);
-		return lhs_peer_rank > rhs_peer_rank;
+		return peer_rank(lhs, external, external_port)
+			> peer_rank(rhs, external, external_port);
 	}
 
 } // anonymous namespace
 
 namespace libtorrent::aux {
 
+	std::size_t peer_address_hash::operator()(address const& a) const
+	{
+		if (a.is_v4()) return std::hash<std::uint32_t>{}(a.to_v4().to_uint());
+		auto const b = a.to_v6().to_bytes();
+		std::uint64_t h[2];
+		std::memcpy(h, b.data(), sizeof(h));
+		return std::hash<std::uint64_t>{}(h[0] ^ (h[1] * 0x9e3779b97f4a7c15ULL));
+	}
+
 	peer_list::peer_list(torrent_peer_allocator_interface& alloc)
 		: m_locked_peer(nullptr)
 		, m_peer_allocator(alloc)
+		, m_rank_slots(alloc.has_rank_slots())
 		, m_num_seeds(0)
 		, m_finished(0)
 	{
@@ -139,6 +171,19 @@ namespace libtorrent::aux {
 		m_candidate_cache.clear();
 		m_num_connect_candidates = 0;
 		m_num_seeds = 0;
+		m_slots.clear();
+		m_address_index.clear();
+#if TORRENT_USE_I2P
+		m_i2p_index.clear();
+#endif
+		m_candidates.clear();
+	}
+
+	void peer_list::set_hash_index(bool const enable)
+	{
+		TORRENT_ASSERT(m_peers.empty());
+		if (!m_peers.empty()) return;
+		m_hash_index = enable;
 	}
 
 	peer_list::~peer_list()
@@ -213,8 +258,15 @@ namespace libtorrent::aux {
 	void peer_list::clear_peer_prio()
 	{
 		INVARIANT_CHECK;
-		for (auto& p : m_peers)
-			p->peer_rank = 0;
+		if (m_rank_slots)
+		{
+			for (auto const* p : m_peers)
+				torrent_peer_allocator::rank_slot(p) = 0;
+		}
+
+		// the ranks are part of the candidate keys. They can't be recomputed
+		// until we know our new external IP
+		if (m_hash_index) m_rebuild_candidates = true;
 	}
 
 	// disconnects and removes all peers that are now filtered
@@ -278,11 +330,8 @@ namespace libtorrent::aux {
 		TORRENT_ASSERT(p->in_use);
 		TORRENT_ASSERT(m_locked_peer != p);
 
-		auto const range = std::equal_range(m_peers.begin(), m_peers.end(), p, peer_address_compare{});
-		auto const iter = std::find_if(range.first, range.second, [&](torrent_peer const* needle) {
-			return torrent_peer_equal(needle, p);
-		});
-		if (iter == range.second) return;
+		auto const iter = find_entry(p);
+		if (iter == m_peers.end()) return;
 		erase_peer(iter, state);
 	}
 
@@ -314,8 +363,203 @@ namespace libtorrent::aux {
 		auto const ci = std::find(m_candidate_cache.begin(), m_candidate_cache.end(), *i);
 		if (ci != m_candidate_cache.end()) m_candidate_cache.erase(ci);
 
-		m_peer_allocator.free_peer_entry(*i);
-		m_peers.erase(i);
+		torrent_peer* p = *i;
+		remove_entry(i);
+		m_peer_allocator.free_peer_entry(p);
+	}
+
+	peer_list::iterator peer_list::find_address(address const& a)
+	{
+		if (m_hash_index)
+		{
+			auto const it = m_address_index.find(a);
+			if (it == m_address_index.end()) return m_peers.end();
+			return m_peers.begin() + m_slots.find(it->second)->second.pos;
+		}
+
+		auto const iter = std::lower_bound(m_peers.begin(), m_peers.end()
+			, a, peer_address_compare());
+		if (iter != m_peers.end() && (*iter)->address() == a) return iter;
+		return m_peers.end();
+	}
+
+	peer_list::iterator peer_list::find_endpoint(address const& a, std::uint16_t const port)
+	{
+		if (m_hash_index)
+		{
+			auto const range = m_address_index.equal_range(a);
+			for (auto it = range.first; it != range.second; ++it)
+			{
+				if (it->second->port != port) continue;
+				return m_peers.begin() + m_slots.find(it->second)->second.pos;
+			}
+			return m_peers.end();
+		}
+
+		auto const range = std::equal_range(m_peers.begin(), m_peers.end()
+			, a, peer_address_compare());
+		auto const iter = std::find_if(range.first, range.second
+			, match_peer_endpoint(a, port));
+		return iter == range.second ? m_peers.end() : iter;
+	}
+
+#if TORRENT_USE_I2P
+	peer_list::iterator peer_list::find_i2p(string_view const dest)
+	{
+		if (m_hash_index)
+		{
+			auto const it = m_i2p_index.find(dest);
+			if (it == m_i2p_index.end()) return m_peers.end();
+			return m_peers.begin() + m_slots.find(it->second)->second.pos;
+		}
+
+		auto const iter = std::lower_bound(m_peers.begin(), m_peers.end()
+			, dest, peer_address_compare());
+		if (iter != m_peers.end() && (*iter)->is_i2p_addr && (*iter)->dest() == dest)
+			return iter;
+		return m_peers.end();
+	}
+#endif
+
+	peer_list::iterator peer_list::find_entry(torrent_peer const* p)
+	{
+		if (m_hash_index)
+		{
+			auto const it = m_slots.find(p);
+			if (it == m_slots.end()) return m_peers.end();
+			return m_peers.begin() + it->second.pos;
+		}
+
+		auto const range = std::equal_range(m_peers.begin(), m_peers.end(), p, peer_address_compare{});
+		auto const iter = std::find_if(range.first, range.second, [&](torrent_peer const* needle) {
+			return torrent_peer_equal(needle, p);
+		});
+		return iter == range.second ? m_peers.end() : iter;
+	}
+
+	peer_list::iterator peer_list::add_entry(torrent_peer* p)
+	{
+		iterator iter;
+		if (m_hash_index)
+		{
+			m_slots.emplace(p, peer_slot{int(m_peers.size()), 0, not_queued});
+#if TORRENT_USE_I2P
+			if (p->is_i2p_addr)
+				m_i2p_index.emplace(p->dest(), p);
+			else
+#endif
+			m_address_index.emplace(p->address(), p);
+			m_peers.push_back(p);
+			iter = m_peers.end() - 1;
+		}
+		else
+		{
+#if TORRENT_USE_I2P
+			if (p->is_i2p_addr)
+			{
+				iter = std::lower_bound(m_peers.begin(), m_peers.end()
+					, p->dest(), peer_address_compare());
+			}
+			else
+#endif
+			iter = std::lower_bound(m_peers.begin(), m_peers.end()
+				, p->address(), peer_address_compare());
+			iter = m_peers.insert(iter, p);
+		}
+
+		if (m_round_robin >= iter - m_peers.begin()) ++m_round_robin;
+		return iter;
+	}
+
+	void peer_list::remove_entry(iterator i)
+	{
+		if (!m_hash_index)
+		{
+			m_peers.erase(i);
+			return;
+		}
+
+		torrent_peer* p = *i;
+		auto const slot = m_slots.find(p);
+		TORRENT_ASSERT(slot != m_slots.end());
+		if (slot->second.key != not_queued)
+			m_candidates.erase({slot->second.key, p});
+		m_slots.erase(slot);
+
+#if TORRENT_USE_I2P
+		if (p->is_i2p_addr)
+		{
+			m_i2p_index.erase(p->dest());
+		}
+		else
+#endif
+		{
+			auto const range = m_address_index.equal_range(p->address());
+			auto const it = std::find_if(range.first, range.second
+				, [p](auto const& e) { return e.second == p; });
+			TORRENT_ASSERT(it != range.second);
+			m_address_index.erase(it);
+		}
+
+		// the order of m_peers doesn't matter in this mode, fill the hole
+		// with the last peer
+		if (*i != m_peers.back())
+		{
+			*i = m_peers.back();
+			m_slots.find(*i)->second.pos = int(i - m_peers.begin());
+		}
+		m_peers.pop_back();
+	}
+
+	std::uint64_t peer_list::candidate_key(torrent_peer const& p
+		, std::uint32_t const rank) const
+	{
+		// the fields compare_peer() looks at, in the same order, packed
+		// such that a lower key is a better candidate
+		std::uint64_t key = std::uint64_t(p.failcount) << 56;
+		if (!aux::is_local(p.address())) key |= std::uint64_t(1) << 55;
+		key |= std::uint64_t(p.last_connected) << 39;
+		if (m_finished && p.maybe_upload_only) key |= std::uint64_t(1) << 38;
+		key |= std::uint64_t(63 - aux::source_rank(p.peer_source())) << 32;
+		key |= std::uint64_t(0xffffffff - rank);
+		return key;
+	}
+
+	void peer_list::update_candidate(torrent_peer* p, torrent_state const* state)
+	{
+		if (!m_hash_index) return;
+
+		auto const slot = m_slots.find(p);
+		if (slot == m_slots.end()) return;
+
+		std::uint64_t key = not_queued;
+		if (is_connect_candidate(*p))
+		{
+			if (state) slot->second.rank = p->rank(state->ip, state->port);
+			key = candidate_key(*p, slot->second.rank);
+		}
+
+		std::uint64_t& queued = slot->second.key;
+		if (queued == key) return;
+		if (queued != not_queued) m_candidates.erase({queued, p});
+		if (key != not_queued) m_candidates.insert({key, p});
+		queued = key;
+	}
+
+	void peer_list::rebuild_candidates(torrent_state const* state)
+	{
+		TORRENT_ASSERT(m_hash_index);
+		m_candidates.clear();
+		for (auto* p : m_peers)
+		{
+			peer_slot& slot = m_slots.find(p)->second;
+			slot.key = not_queued;
+			if (!is_connect_candidate(*p)) continue;
+			slot.rank = p->rank(state->ip, state->port);
+			slot.key = candidate_key(*p, slot.rank);
+			m_candidates.insert({slot.key, p});
+		}
+		m_rebuild_candidates = false;
 	}
 
 	bool peer_list::should_erase_immediately(torrent_peer const& p) const
@@ -355,8 +599,8 @@ namespace libtorrent::aux {
 
 		if (max_peerlist_size == 0 || m_peers.empty()) return;
 
-		int erase_candidate = -1;
-		int force_erase_candidate = -1;
+		torrent_peer* erase_candidate = nullptr;
+		torrent_peer* force_erase_candidate = nullptr;
 
 		if (bool(m_finished) != state->is_finished)
 			recalculate_connect_candidates(state);
@@ -379,41 +623,38 @@ namespace libtorrent::aux {
 			int const current = round_robin;
 
 			if (is_erase_candidate(pe)
-				&& (erase_candidate == -1
-					|| !compare_peer_erase(*m_peers[erase_candidate], pe)))
+				&& (erase_candidate == nullptr
+					|| !compare_peer_erase(*erase_candidate, pe)))
 			{
 				if (should_erase_immediately(pe))
 				{
-					if (erase_candidate > current) --erase_candidate;
-					if (force_erase_candidate > current) --force_erase_candidate;
 					TORRENT_ASSERT(current >= 0 && current < int(m_peers.size()));
+					if (force_erase_candidate == &pe) force_erase_candidate = nullptr;
 					erase_peer(m_peers.begin() + current, state);
 					continue;
 				}
 				else
 				{
-					erase_candidate = current;
+					erase_candidate = &pe;
 				}
 			}
 			if (is_force_erase_candidate(pe)
-				&& (force_erase_candidate == -1
-					|| !compare_peer_erase(*m_peers[force_erase_candidate], pe)))
+				&& (force_erase_candidate == nullptr
+					|| !compare_peer_erase(*force_erase_candidate, pe)))
 			{
-				force_erase_candidate = current;
+				force_erase_candidate = &pe;
 			}
 
 			++round_robin;
 		}
 
-		if (erase_candidate > -1)
+		if (erase_candidate != nullptr)
 		{
-			TORRENT_ASSERT(erase_candidate >= 0 && erase_candidate < int(m_peers.size()));
-			erase_peer(m_peers.begin() + erase_candidate, state);
+			erase_peer(find_entry(erase_candidate), state);
 		}
-		else if ((flags & force_erase) && force_erase_candidate > -1)
+		else if ((flags & force_erase) && force_erase_candidate != nullptr)
 		{
-			TORRENT_ASSERT(force_erase_candidate >= 0 && force_erase_candidate < int(m_peers.size()));
-			erase_peer(m_peers.begin() + force_erase_candidate, state);
+			erase_peer(find_entry(force_erase_candidate), state);
 		}
 	}
 
@@ -429,6 +670,7 @@ namespace libtorrent::aux {
 			update_connect_candidates(-1);
 
 		p->banned = true;
+		update_candidate(p);
 		TORRENT_ASSERT(!is_connect_candidate(*p));
 		return true;
 	}
@@ -447,6 +689,7 @@ namespace libtorrent::aux {
 		// anymore. We'll soon know.
 		p->maybe_upload_only = false;
 		if (was_conn_cand) update_connect_candidates(-1);
+		update_candidate(p);
 	}
 
 	void peer_list::inc_failcount(torrent_peer* p)
@@ -459,6 +702,7 @@ namespace libtorrent::aux {
 		++p->failcount;
 		if (was_conn_cand && !is_connect_candidate(*p))
 			update_connect_candidates(-1);
+		update_candidate(p);
 	}
 
 	void peer_list::set_failcount(torrent_peer* p, int const f)
@@ -473,6 +717,7 @@ namespace libtorrent::aux {
 		{
 			update_connect_candidates(was_conn_cand ? -1 : 1);
 		}
+		update_candidate(p);
 	}
 
 	bool peer_list::is_connect_candidate(torrent_peer const& p) const
@@ -509,6 +754,12 @@ namespace libtorrent::aux {
 		if (bool(m_finished) != state->is_finished)
 			recalculate_connect_candidates(state);
 
+		if (m_hash_index)
+		{
+			find_indexed_candidates(peers, session_time, state);
+			return;
+		}
+
 		aux::external_ip const& external = state->ip;
 		int external_port = state->port;
 
@@ -516,6 +767,9 @@ namespace libtorrent::aux {
 
 		int max_peerlist_size = state->max_peerlist_size;
 
+		std::vector<ranked_peer> candidates;
+		candidates.reserve(candidate_count);
+
 		// TODO: 2 it would be nice if there was a way to iterate over these
 		// torrent_peer objects in the order they are allocated in the pool
 		// instead. It would probably be more efficient
@@ -562,29 +816,79 @@ namespace libtorrent::aux {
 				(int(pe.failcount) + 1) * state->min_reconnect_time)
 				continue;
 
+			ranked_peer const candidate{&pe, m_rank_slots
+				? &torrent_peer_allocator::rank_slot(&pe) : nullptr};
+
 			// compare peer returns true if lhs is better than rhs. In this
 			// case, it returns true if the current candidate is better than
 			// pe, which is the peer m_round_robin points to. If it is, just
 			// keep looking.
-			if (peers.size() == candidate_count
-				&& compare_peer(peers.back(), &pe, external, external_port, m_finished)) continue;
+			if (candidates.size() == candidate_count
+				&& compare_peer(candidates.back(), candidate, external, external_port, m_finished)) continue;
 
-			if (peers.size() >= candidate_count)
-				peers.resize(candidate_count - 1);
+			if (candidates.size() >= candidate_count)
+				candidates.resize(candidate_count - 1);
 
-			// insert this candidate sorted into peers
-			auto const i = std::lower_bound(peers.begin(), peers.end()
-				, &pe, std::bind(&compare_peer, _1, _2, std::cref(external), external_port, bool(m_finished)));
+			// insert this candidate sorted into candidates
+			auto const i = std::lower_bound(candidates.begin(), candidates.end()
+				, candidate, std::bind(&compare_peer, _1, _2, std::cref(external), external_port, bool(m_finished)));
 
-			peers.insert(i, &pe);
+			candidates.insert(i, candidate);
 		}
 
+		for (auto const& c : candidates)
+			peers.push_back(c.peer);
+
 		if (erase_candidate > -1)
 		{
 			erase_peer(m_peers.begin() + erase_candidate, state);
 		}
 	}
 
+	void peer_list::find_indexed_candidates(std::vector<torrent_peer*>& peers
+		, int const session_time, torrent_state* state)
+	{
+		TORRENT_ASSERT(m_hash_index);
+		const int candidate_count = 10;
+
+		int const max_peerlist_size = state->max_peerlist_size;
+		if (max_peerlist_size > 0
+			&& int(m_peers.size()) >= max_peerlist_size * 0.95)
+			erase_peers(state);
+
+		if (m_rebuild_candidates) rebuild_candidates(state);
+
+		// peers whose key has changed behind our back, for instance because
+		// the torrent updated last_connected. They're re-inserted once we're
+		// done iterating
+		std::vector<torrent_peer*> stale;
+
+		int iterations = 300;
+		for (auto const& [key, p] : m_candidates)
+		{
+			if (--iterations < 0) break;
+			++state->loop_counter;
+
+			TORRENT_ASSERT(p->in_use);
+			if (!is_connect_candidate(*p)
+				|| candidate_key(*p, m_slots.find(p)->second.rank) != key)
+			{
+				stale.push_back(p);
+				continue;
+			}
+
+			if (p->last_connected
+				&& session_time - p->last_connected <
+				(int(p->failcount) + 1) * state->min_reconnect_time)
+				continue;
+
+			peers.push_back(p);
+			if (int(peers.size()) == candidate_count) break;
+		}
+
+		for (auto* p : stale) update_candidate(p);
+	}
+
 	bool peer_list::new_connection(peer_connection_interface& c, int session_time
 		, torrent_state* state)
 	{
@@ -593,7 +897,7 @@ namespace libtorrent::aux {
 
 		INVARIANT_CHECK;
 
-		iterator iter;
+		iterator iter = m_peers.end();
 		torrent_peer* i = nullptr;
 
 #if TORRENT_USE_I2P
@@ -607,46 +911,22 @@ namespace libtorrent::aux {
 		if (state->allow_multiple_connections_per_ip && i2p_dest.empty())
 		{
 			auto const& remote = c.remote();
-			auto const addr = remote.address();
-			auto const range = find_peers(addr);
-			iter = std::find_if(range.first, range.second, match_peer_endpoint(addr, remote.port()));
-
-			if (iter != range.second)
-			{
-				TORRENT_ASSERT((*iter)->in_use);
-				found = true;
-			}
+			iter = find_endpoint(remote.address(), remote.port());
 		}
 		else
 		{
 #if TORRENT_USE_I2P
 			if (!i2p_dest.empty())
-			{
-				iter = std::lower_bound(
-					m_peers.begin(), m_peers.end()
-					, i2p_dest, peer_address_compare()
-					);
-
-				if (iter != m_peers.end() && (*iter)->is_i2p_addr && (*iter)->dest() == i2p_dest)
-				{
-					TORRENT_ASSERT((*iter)->in_use);
-					found = true;
-				}
-			}
+				iter = find_i2p(i2p_dest);
 			else
 #endif
-			{
-				iter = std::lower_bound(
-					m_peers.begin(), m_peers.end()
-					, c.remote().address(), peer_address_compare()
-					);
+			iter = find_address(c.remote().address());
+		}
 
-				if (iter != m_peers.end() && (*iter)->address() == c.remote().address())
-				{
-					TORRENT_ASSERT((*iter)->in_use);
-					found = true;
-				}
-			}
+		if (iter != m_peers.end())
+		{
+			TORRENT_ASSERT((*iter)->in_use);
+			found = true;
 		}
 
 		// make sure the iterator we got is properly sorted relative
@@ -818,18 +1098,12 @@ namespace libtorrent::aux {
 			if (state->max_peerlist_size
 				&& int(m_peers.size()) >= state->max_peerlist_size)
 			{
-				// this may invalidate our iterator!
 				erase_peers(state, force_erase);
 				if (int(m_peers.size()) >= state->max_peerlist_size)
 				{
 					c.disconnect(errors::too_many_connections, operation_t::bittorrent);
 					return false;
 				}
-				// restore it
-				iter = std::lower_bound(
-					m_peers.begin(), m_peers.end()
-					, c.remote().address(), peer_address_compare()
-				);
 			}
 
 #if TORRENT_USE_I2P
@@ -854,12 +1128,7 @@ namespace libtorrent::aux {
 				else
 					p = new (p) ipv4_peer(c.remote(), false, {});
 
-				iter = m_peers.insert(iter, p);
-
-				if (m_round_robin >= iter - m_peers.begin()) ++m_round_robin;
-
-				i = *iter;
-
+				i = *add_entry(p);
 				i->source = static_cast<std::uint8_t>(peer_info::incoming);
 			}
 		}
@@ -875,6 +1144,7 @@ namespace libtorrent::aux {
 		TORRENT_ASSERT(i->connection);
 		if (!c.fast_reconnect())
 			i->last_connected = std::uint16_t(session_time);
+		update_candidate(i);
 
 		// this cannot be a connect candidate anymore, since i->connection is set
 		TORRENT_ASSERT(!is_connect_candidate(*i));
@@ -900,11 +1170,8 @@ namespace libtorrent::aux {
 
 		if (state->allow_multiple_connections_per_ip)
 		{
-			auto const addr = p->address();
-			auto const range = find_peers(addr);
-			auto const i = std::find_if(range.first, range.second
-				, match_peer_endpoint(addr, std::uint16_t(port)));
-			if (i != range.second)
+			auto const i = find_endpoint(p->address(), std::uint16_t(port));
+			if (i != m_peers.end())
 			{
 				torrent_peer& pp = **i;
 				TORRENT_ASSERT(pp.in_use);
@@ -917,6 +1184,7 @@ namespace libtorrent::aux {
 					pp.source |= static_cast<std::uint8_t>(src);
 					if (!was_conn_cand && is_connect_candidate(pp))
 						update_connect_candidates(1);
+					update_candidate(&pp, state);
 					// calling disconnect() on a peer, may actually end
 					// up "garbage collecting" its torrent_peer entry
 					// as well, if it's considered useless (which this specific)
@@ -936,8 +1204,7 @@ namespace libtorrent::aux {
 #if TORRENT_USE_ASSERTS
 		else
 		{
-			std::pair<iterator, iterator> range = find_peers(p->address());
-			TORRENT_ASSERT(std::distance(range.first, range.second) == 1);
+			TORRENT_ASSERT(find_peers(p->address()).size() == 1);
 		}
 #endif
 
@@ -948,6 +1215,7 @@ namespace libtorrent::aux {
 
 		if (was_conn_cand != is_connect_candidate(*p))
 			update_connect_candidates(was_conn_cand ? -1 : 1);
+		update_candidate(p, state);
 		return true;
 	}
 
@@ -957,10 +1225,31 @@ namespace libtorrent::aux {
 	bool peer_list::has_peer(torrent_peer const* p) const
 	{
 		TORRENT_ASSERT(is_single_thread());
+		if (m_hash_index) return m_slots.count(p) > 0;
 		// find p in m_peers
 		return std::find(m_peers.begin(), m_peers.end(), p) != m_peers.end();
 	}
 
+	std::vector<torrent_peer*> peer_list::find_peers(address const& a) const
+	{
+		std::vector<torrent_peer*> ret;
+#if TORRENT_USE_I2P
+		if (a == address()) return ret;
+#endif
+		if (m_hash_index)
+		{
+			auto const range = m_address_index.equal_range(a);
+			for (auto it = range.first; it != range.second; ++it)
+				ret.push_back(it->second);
+			return ret;
+		}
+
+		auto const range = std::equal_range(
+			m_peers.begin(), m_peers.end(), a, peer_address_compare());
+		ret.assign(range.first, range.second);
+		return ret;
+	}
+
 	void peer_list::set_seed(torrent_peer* p, bool s)
 	{
 		TORRENT_ASSERT(is_single_thread());
@@ -971,6 +1260,7 @@ namespace libtorrent::aux {
 		p->seed = s;
 		if (was_conn_cand && !is_connect_candidate(*p))
 			update_connect_candidates(-1);
+		update_candidate(p);
 
 		if (p->web_seed) return;
 		if (s)
@@ -986,7 +1276,7 @@ namespace libtorrent::aux {
 	}
 
 	// this is an internal function
-	bool peer_list::insert_peer(torrent_peer* p, iterator iter
+	bool peer_list::insert_peer(torrent_peer* p
 		, pex_flags_t const flags
 		, torrent_state* state)
 	{
@@ -1004,26 +1294,9 @@ namespace libtorrent::aux {
 			erase_peers(state);
 			if (int(m_peers.size()) >= max_peerlist_size)
 				return false;
-
-			// since some peers were removed, we need to
-			// update the iterator to make it valid again
-#if TORRENT_USE_I2P
-			if (p->is_i2p_addr)
-			{
-				iter = std::lower_bound(
-					m_peers.begin(), m_peers.end()
-					, p->dest(), peer_address_compare());
-			}
-			else
-#endif
-			iter = std::lower_bound(
-				m_peers.begin(), m_peers.end()
-				, p->address(), peer_address_compare());
 		}
 
-		iter = m_peers.insert(iter, p);
-
-		if (m_round_robin >= iter - m_peers.begin()) ++m_round_robin;
+		add_entry(p);
 
 #if !defined TORRENT_DISABLE_ENCRYPTION
 		if (flags & pex_encryption) p->pe_support = true;
@@ -1038,6 +1311,7 @@ namespace libtorrent::aux {
 			p->protocol_v2 = true;
 		if (is_connect_candidate(*p))
 			update_connect_candidates(1);
+		update_candidate(p, state);
 
 		return true;
 	}
@@ -1088,6 +1362,7 @@ namespace libtorrent::aux {
 		{
 			update_connect_candidates(was_conn_cand ? -1 : 1);
 		}
+		update_candidate(p);
 	}
 
 	void peer_list::update_connect_candidates(int delta)
@@ -1110,10 +1385,8 @@ namespace libtorrent::aux {
 		TORRENT_ASSERT(is_single_thread());
 		INVARIANT_CHECK;
 
-		auto iter = std::lower_bound(m_peers.begin(), m_peers.end()
-			, destination, peer_address_compare());
-
-		if (iter != m_peers.end() && (*iter)->dest() == destination)
+		auto const iter = find_i2p(destination);
+		if (iter != m_peers.end())
 		{
 			update_peer(*iter, src, flags, tcp::endpoint());
 			return *iter;
@@ -1126,7 +1399,7 @@ namespace libtorrent::aux {
 		if (p == nullptr) return nullptr;
 		p = new (p) i2p_peer(destination, true, src);
 
-		if (!insert_peer(p, iter, flags, state))
+		if (!insert_peer(p, flags, state))
 		{
 			m_peer_allocator.free_peer_entry(p);
 			return nullptr;
@@ -1143,11 +1416,10 @@ namespace libtorrent::aux {
 		TORRENT_ASSERT(is_single_thread());
 		INVARIANT_CHECK;
 
-		iterator const iter = std::lower_bound(m_peers.begin(), m_peers.end()
-				, remote.address(), peer_address_compare());
+		iterator const iter = find_address(remote.address());
 
 		if (!state->allow_multiple_connections_per_ip
-				&& iter != m_peers.end() && (*iter)->address() == remote.address())
+				&& iter != m_peers.end())
 		{
 			// the peer exists
 			torrent_peer* p = *iter;
@@ -1167,7 +1439,7 @@ namespace libtorrent::aux {
 		if (p == nullptr) return nullptr;
 		p = new (p) rtc_peer(remote, src);
 
-		if (!insert_peer(p, iter, flags, state))
+		if (!insert_peer(p, flags, state))
 		{
 			m_peer_allocator.free_peer_entry(p);
 			return nullptr;
@@ -1196,26 +1468,12 @@ namespace libtorrent::aux {
 		if (remote_address.is_v6() && remote_address.to_v6().is_link_local())
 			return nullptr;
 
-		iterator iter;
+		iterator const iter = state->allow_multiple_connections_per_ip
+			? find_endpoint(remote_address, remote.port())
+			: find_address(remote_address);
 		torrent_peer* p = nullptr;
 
-		bool found = false;
-		if (state->allow_multiple_connections_per_ip)
-		{
-			auto const range = find_peers(remote_address);
-			iter = std::find_if(range.first, range.second
-				, match_peer_endpoint(remote_address, remote.port()));
-			if (iter != range.second) found = true;
-		}
-		else
-		{
-			iter = std::lower_bound(m_peers.begin(), m_peers.end()
-				, remote_address, peer_address_compare());
-
-			if (iter != m_peers.end() && (*iter)->address() == remote_address) found = true;
-		}
-
-		if (!found)
+		if (iter == m_peers.end())
 		{
 			// we don't have any info about this peer.
 			// add a new entry
@@ -1233,7 +1491,7 @@ namespace libtorrent::aux {
 
 			try
 			{
-				if (!insert_peer(p, iter, flags, state))
+				if (!insert_peer(p, flags, state))
 				{
 					m_peer_allocator.free_peer_entry(p);
 					return nullptr;
@@ -1349,6 +1607,7 @@ namespace libtorrent::aux {
 
 		if (is_connect_candidate(*p))
 			update_connect_candidates(1);
+		update_candidate(p, state);
 
 		// if we're already a seed, it's not as important
 		// to keep all the possibly stale peers
@@ -1387,6 +1646,8 @@ namespace libtorrent::aux {
 		m_num_connect_candidates += static_cast<int>(std::count_if(m_peers.begin(), m_peers.end()
 			, [this](torrent_peer const* p) { return this->is_connect_candidate(*p); } ));
 
+		if (m_hash_index) rebuild_candidates(state);
+
 #if TORRENT_USE_INVARIANT_CHECKS
 		// the invariant is not likely to be upheld at the entry of this function
 		// but it is likely to have been restored by the end of it
@@ -1402,10 +1663,7 @@ namespace libtorrent::aux {
 
 		TORRENT_ASSERT(c);
 
-		auto const iter = std::lower_bound(m_peers.begin(), m_peers.end()
-			, c->remote().address(), peer_address_compare());
-
-		if (iter != m_peers.end() && (*iter)->address() == c->remote().address())
+		if (find_address(c->remote().address()) != m_peers.end())
 			return true;
 
 		return std::any_of(m_peers.begin(), m_peers.end()
@@ -1428,12 +1686,24 @@ namespace libtorrent::aux {
 #ifdef TORRENT_EXPENSIVE_INVARIANT_CHECKS
 		int connect_candidates = 0;
 
+		if (m_hash_index)
+		{
+			TORRENT_ASSERT(m_slots.size() == m_peers.size());
+			int queued = 0;
+			for (auto const& s : m_slots)
+			{
+				TORRENT_ASSERT(m_peers[s.second.pos] == s.first);
+				if (s.second.key != not_queued) ++queued;
+			}
+			TORRENT_ASSERT(queued == int(m_candidates.size()));
+		}
+
 		const_iterator prev = m_peers.end();
 		for (const_iterator i = m_peers.begin(); i != m_peers.end(); ++i)
 		{
 			if (prev != m_peers.end()) ++prev;
 			if (i == m_peers.begin() + 1) prev = m_peers.begin();
-			if (prev != m_peers.end())
+			if (prev != m_peers.end() && !m_hash_index)
 			{
 				TORRENT_ASSERT(!((*i)->address() < (*prev)->address()));
 			}
@@ -16,6 +16,7 @@ see LICENSE file.
 
 #include <vector>
 #include <cmath>
+#include <cstdlib> // for abs
 #include <algorithm>
 #include <numeric>
 #include <limits>
@@ -1148,7 +1149,47 @@ namespace libtorrent::aux {
 			// when m_seeds is increased from 0 to 1
 			// we may have to add pieces that previously
 			// didn't have any peers
-			m_dirty = true;
+			if (m_incremental && !m_dirty)
+			{
+				int const num_levels = int(m_priority_boundaries.size());
+				int min_priority = std::numeric_limits<int>::max();
+				std::int64_t cost = 0;
+				m_added.clear();
+				piece_index_t index{0};
+				for (auto const& p : m_piece_map)
+				{
+					if (p.peer_count == 0)
+					{
+						int const prio = p.priority(this);
+						if (prio >= 0)
+						{
+							m_added.push_back(index);
+							min_priority = std::min(min_priority, prio);
+							cost += std::max(num_levels - prio, 1);
+						}
+					}
+					++index;
+				}
+
+				switch (pick_bulk_update(cost, min_priority))
+				{
+					case bulk_update::per_piece:
+						for (piece_index_t const piece : m_added) add(piece);
+						m_added.clear();
+						break;
+					case bulk_update::rebucket:
+						rebucket(min_priority);
+						break;
+					case bulk_update::rebuild:
+						m_added.clear();
+						m_dirty = true;
+						break;
+				}
+			}
+			else
+			{
+				m_dirty = true;
+			}
 		}
 #ifdef TORRENT_DEBUG_REFCOUNTS
 		for (std::vector<piece_pos>::iterator i = m_piece_map.begin()
@@ -1170,13 +1211,36 @@ namespace libtorrent::aux {
 
 		if (m_seeds > 0)
 		{
-			--m_seeds;
-			if (m_seeds == 0)
+			if (m_seeds == 1 && m_incremental && !m_dirty)
 			{
-				// when m_seeds is decreased from 1 to 0
-				// we may have to remove pieces that previously
-				// didn't have any peers
-				m_dirty = true;
+				// the pieces without any peers are about to be removed from the
+				// piece list. They can't be removed one at a time, since they
+				// all leave at once
+				int min_priority = std::numeric_limits<int>::max();
+				for (auto const& p : m_piece_map)
+				{
+					if (p.peer_count != 0) continue;
+					int const prio = p.priority(this);
+					if (prio >= 0) min_priority = std::min(min_priority, prio);
+				}
+				--m_seeds;
+				m_added.clear();
+				if (pick_bulk_update(std::numeric_limits<std::int64_t>::max(), min_priority)
+					== bulk_update::rebucket)
+					rebucket(min_priority);
+				else if (min_priority != std::numeric_limits<int>::max())
+					m_dirty = true;
+			}
+			else
+			{
+				--m_seeds;
+				if (m_seeds == 0)
+				{
+					// when m_seeds is decreased from 1 to 0
+					// we may have to remove pieces that previously
+					// didn't have any peers
+					m_dirty = true;
+				}
 			}
 #ifdef TORRENT_DEBUG_REFCOUNTS
 			for (std::vector<piece_pos>::iterator i = m_piece_map.begin()
@@ -1366,6 +1430,61 @@ namespace libtorrent::aux {
 			}
 		}
 
+		if (m_incremental && !m_dirty)
+		{
+			std::int64_t cost;
+			int min_priority;
+			move_cost(bitmask, 1, cost, min_priority);
+			switch (pick_bulk_update(cost, min_priority))
+			{
+				case bulk_update::per_piece:
+				{
+					piece_index_t index{0};
+					for (auto i = bitmask.begin(), end(bitmask.end()); i != end; ++i, ++index)
+					{
+						if (!*i) continue;
+						piece_pos& p = m_piece_map[index];
+#ifdef TORRENT_DEBUG_REFCOUNTS
+						TORRENT_ASSERT(p.have_peers.count(peer) == 0);
+						p.have_peers.insert(peer);
+#else
+						TORRENT_UNUSED(peer);
+#endif
+						int const prev_priority = p.priority(this);
+						++p.peer_count;
+						int const new_priority = p.priority(this);
+						if (prev_priority == new_priority) continue;
+						else if (prev_priority >= 0) update(prev_priority, p.index);
+						else add(index);
+					}
+					return;
+				}
+				case bulk_update::rebucket:
+				{
+					m_added.clear();
+					piece_index_t index{0};
+					for (auto i = bitmask.begin(), end(bitmask.end()); i != end; ++i, ++index)
+					{
+						if (!*i) continue;
+						piece_pos& p = m_piece_map[index];
+#ifdef TORRENT_DEBUG_REFCOUNTS
+						TORRENT_ASSERT(p.have_peers.count(peer) == 0);
+						p.have_peers.insert(peer);
+#else
+						TORRENT_UNUSED(peer);
+#endif
+						bool const added = p.priority(this) < 0;
+						++p.peer_count;
+						if (added && p.priority(this) >= 0) m_added.push_back(index);
+					}
+					rebucket(min_priority);
+					return;
+				}
+				case bulk_update::rebuild:
+					break;
+			}
+		}
+
 		piece_index_t index{0};
 		bool updated = false;
 		for (auto i = bitmask.begin(), end(bitmask.end()); i != end; ++i, ++index)
@@ -1445,7 +1564,6 @@ namespace libtorrent::aux {
 				{
 					piece_index_t const piece = decremented[i];
 					piece_pos& p = m_piece_map[piece];
-					int prev_priority = p.priority(this);
 
 					if (p.peer_count == 0)
 					{
@@ -1456,6 +1574,7 @@ namespace libtorrent::aux {
 						// counters into actual peer counters on the pieces
 						break_one_seed();
 					}
+					int const prev_priority = p.priority(this);
 
 #ifdef TORRENT_DEBUG_REFCOUNTS
 					TORRENT_ASSERT(p.have_peers.count(peer) == 1);
@@ -1471,6 +1590,63 @@ namespace libtorrent::aux {
 			}
 		}
 
+		if (m_incremental && !m_dirty)
+		{
+			std::int64_t cost;
+			int min_priority;
+			// if this breaks up a seed, the whole piece list is invalidated
+			// anyway
+			if (move_cost(bitmask, -1, cost, min_priority))
+			{
+				switch (pick_bulk_update(cost, min_priority))
+				{
+					case bulk_update::per_piece:
+					{
+						piece_index_t index{0};
+						for (auto i = bitmask.begin(), end(bitmask.end()); i != end; ++i, ++index)
+						{
+							if (!*i) continue;
+							piece_pos& p = m_piece_map[index];
+							int const prev_priority = p.priority(this);
+#ifdef TORRENT_DEBUG_REFCOUNTS
+							TORRENT_ASSERT(p.have_peers.count(peer) == 1);
+							p.have_peers.erase(peer);
+#else
+							TORRENT_UNUSED(peer);
+#endif
+							TORRENT_ASSERT(p.peer_count > 0);
+							--p.peer_count;
+							if (prev_priority >= 0) update(prev_priority, p.index);
+						}
+						return;
+					}
+					case bulk_update::rebucket:
+					{
+						piece_index_t index{0};
+						for (auto i = bitmask.begin(), end(bitmask.end()); i != end; ++i, ++index)
+						{
+							if (!*i) continue;
+							piece_pos& p = m_piece_map[index];
+#ifdef TORRENT_DEBUG_REFCOUNTS
+							TORRENT_ASSERT(p.have_peers.count(peer) == 1);
+							p.have_peers.erase(peer);
+#else
+							TORRENT_UNUSED(peer);
+#endif
+							TORRENT_ASSERT(p.peer_count > 0);
+							--p.peer_count;
+						}
+						// a piece can't be added to the piece list by losing a peer
+						m_added.clear();
+						rebucket(min_priority);
+						return;
+					}
+					case bulk_update::rebuild:
+						break;
+				}
+			}
+		}
+
 		piece_index_t index{0};
 		bool updated = false;
 		for (auto i = bitmask.begin(), end(bitmask.end()); i != end; ++i, ++index)
@@ -1588,6 +1764,156 @@ namespace libtorrent::aux {
 #endif
 	}
 
+	void piece_picker::set_incremental_availability(bool const enable)
+	{
+		m_incremental = enable;
+	}
+
+	bool piece_picker::move_cost(typed_bitfield<piece_index_t> const& bitmask
+		, int const delta, std::int64_t& cost, int& min_priority)
+	{
+		TORRENT_ASSERT(delta == 1 || delta == -1);
+
+		// moving a piece with update() costs one swap per priority bucket it
+		// crosses. Adding or removing one costs one swap per bucket above it
+		int const num_levels = int(m_priority_boundaries.size());
+		cost = 0;
+		min_priority = std::numeric_limits<int>::max();
+		piece_index_t index{0};
+		for (auto i = bitmask.begin(), end(bitmask.end()); i != end; ++i, ++index)
+		{
+			if (!*i) continue;
+			piece_pos& p = m_piece_map[index];
+			if (delta < 0 && p.peer_count == 0) return false;
+			int const prev_priority = p.priority(this);
+			p.peer_count += std::uint32_t(delta);
+			int const new_priority = p.priority(this);
+			p.peer_count -= std::uint32_t(delta);
+			if (prev_priority == new_priority) continue;
+
+			if (prev_priority < 0)
+				cost += std::max(num_levels - new_priority, 1);
+			else if (new_priority < 0)
+				cost += std::max(num_levels - prev_priority, 1);
+			else
+				cost += std::abs(new_priority - prev_priority);
+
+			if (prev_priority >= 0) min_priority = std::min(min_priority, prev_priority);
+			if (new_priority >= 0) min_priority = std::min(min_priority, new_priority);
+		}
+		return true;
+	}
+
+	piece_picker::bulk_update piece_picker::pick_bulk_update(std::int64_t const cost
+		, int const min_priority) const
+	{
+		// no piece changes priority
+		if (min_priority == std::numeric_limits<int>::max())
+			return bulk_update::per_piece;
+
+		// rebucket() touches every piece from the first affected bucket and
+		// up, a few times each and in random order. update_pieces() makes a
+		// few sequential passes over all pieces, but it's deferred until the
+		// piece list is needed, which lets several changes share one rebuild
+		int const num_levels = int(m_priority_boundaries.size());
+		prio_index_t const start = min_priority < num_levels
+			? priority_begin(min_priority) : m_pieces.end_index();
+		std::int64_t const rebucket_cost
+			= std::int64_t(static_cast<int>(m_pieces.end_index() - start)) * 4;
+		std::int64_t const rebuild_cost = std::int64_t(m_piece_map.size()) * 2;
+
+		if (cost <= rebucket_cost && cost <= rebuild_cost)
+			return bulk_update::per_piece;
+		if (rebucket_cost <= rebuild_cost)
+			return bulk_update::rebucket;
+		return bulk_update::rebuild;
+	}
+
+	void piece_picker::rebucket(int const min_priority)
+	{
+		TORRENT_ASSERT(!m_dirty);
+		if (min_priority == std::numeric_limits<int>::max())
+		{
+			TORRENT_ASSERT(m_added.empty());
+			return;
+		}
+		TORRENT_ASSERT(min_priority >= 0);
+
+#ifdef TORRENT_PICKER_LOG
+		std::cerr << "[" << this << "] " << "rebucket(" << min_priority << ")" << std::endl;
+#endif
+
+		// pieces in the priority buckets below min_priority are not affected.
+		// Everything from the first piece at min_priority is re-bucketed
+		int const num_levels = int(m_priority_boundaries.size());
+		prio_index_t const start = min_priority < num_levels
+			? priority_begin(min_priority) : m_pieces.end_index();
+
+		// collect the pieces still in the piece list, along with their current
+		// priority. The order within each bucket is preserved
+		m_rebucket.clear();
+		int max_priority = num_levels - 1;
+		int level = min_priority;
+		for (prio_index_t i = start; i < m_pieces.end_index(); ++i)
+		{
+			while (i >= m_priority_boundaries[level]) ++level;
+			piece_index_t const piece = m_pieces[i];
+			int const prio = m_piece_map[piece].priority(this);
+			if (prio < 0) continue;
+			TORRENT_ASSERT(prio >= min_priority);
+			m_rebucket.push_back({piece, prio, prio != level});
+			max_priority = std::max(max_priority, prio);
+		}
+		for (piece_index_t const piece : m_added)
+		{
+			int const prio = m_piece_map[piece].priority(this);
+			TORRENT_ASSERT(prio >= min_priority);
+			m_rebucket.push_back({piece, prio, true});
+			max_priority = std::max(max_priority, prio);
+		}
+		m_added.clear();
+
+		if (max_priority >= num_levels)
+			m_priority_boundaries.resize(max_priority + 1, m_pieces.end_index());
+
+		// count the pieces in each bucket, and turn the counts into the
+		// position of the first piece in each bucket
+		m_bucket_pos.assign(std::size_t(max_priority + 1 - min_priority), 0);
+		for (auto const& e : m_rebucket)
+			++m_bucket_pos[std::size_t(e.priority - min_priority)];
+
+		int pos = static_cast<int>(start);
+		for (int prio = min_priority; prio <= max_priority; ++prio)
+		{
+			int& bucket = m_bucket_pos[std::size_t(prio - min_priority)];
+			int const count = bucket;
+			bucket = pos;
+			pos += count;
+			m_priority_boundaries[prio] = prio_index_t(pos);
+		}
+		m_pieces.resize(pos);
+
+		for (auto const& e : m_rebucket)
+		{
+			prio_index_t const idx(m_bucket_pos[std::size_t(e.priority - min_priority)]++);
+			m_pieces[idx] = e.piece;
+			m_piece_map[e.piece].index = idx;
+		}
+
+		// pieces that changed bucket ended up after the pieces that were
+		// already there. Move each of them to a random position within its new
+		// bucket, the same way add() and update() do
+		for (auto const& e : m_rebucket)
+		{
+			if (!e.moved) continue;
+			shuffle(e.priority, m_piece_map[e.piece].index);
+		}
+
+#ifdef TORRENT_PICKER_LOG
+		print_pieces(*this);
+#endif
+	}
+
 	void piece_picker::piece_passed(piece_index_t const index)
 	{
 		piece_pos& p = m_piece_map[index];
@@ -0,0 +1,761 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/aux_/storage_utils.hpp"
+#include "libtorrent/hasher.hpp"
+
+#include <ctime>
+#include <algorithm>
+#include <functional>
+
+#include "libtorrent/aux_/pread_storage.hpp"
+#include "libtorrent/aux_/path.hpp"
+#include "libtorrent/aux_/file_pool.hpp"
+#include "libtorrent/aux_/file.hpp" // for pread_all, pwrite_all, pwritev_all
+#include "libtorrent/aux_/drive_info.hpp"
+#include "libtorrent/aux_/stat_cache.hpp"
+#include "libtorrent/aux_/readwrite.hpp"
+#include "libtorrent/aux_/alloca.hpp"
+#include "libtorrent/settings_pack.hpp"
+#include "libtorrent/torrent_status.hpp"
+#include "libtorrent/add_torrent_params.hpp"
+#include "libtorrent/hex.hpp" // to_hex
+#include "libtorrent/aux_/scope_end.hpp"
+
+namespace libtorrent::aux {
+
+	pread_storage::pread_storage(storage_params const& params
+		, aux::file_pool& pool)
+		: m_files(params.files)
+		, m_renamed_files(params.renamed_files)
+		, m_file_priority(params.priorities)
+		, m_save_path(complete(params.path))
+		, m_part_file_dir(params.part_file_dir)
+		, m_part_file_name("." + aux::to_hex(params.info_hash) + ".parts")
+		, m_pool(pool)
+		, m_allocate_files(params.mode == storage_mode_allocate)
+	{
+		TORRENT_ASSERT(files().num_files() > 0);
+	}
+
+	pread_storage::~pread_storage()
+	{
+		error_code ec;
+		if (m_part_file) m_part_file->flush_metadata(ec);
+
+		// this may be called from a different
+		// thread than the disk thread
+		m_pool.release(storage_index());
+	}
+
+	filenames pread_storage::names() const
+	{
+		return {m_files, m_renamed_files};
+	}
+
+	void pread_storage::need_partfile()
+	{
+		if (m_part_file) return;
+
+		m_part_file = std::make_unique<part_file>(
+			m_part_file_dir.empty() ? m_save_path : combine_path(m_save_path, m_part_file_dir)
+			, m_part_file_name
+			, files().num_pieces(), files().piece_length());
+	}
+
+	void pread_storage::set_file_priority(settings_interface const& sett
+		, aux::vector<download_priority_t, file_index_t>& prio
+		, storage_error& ec)
+	{
+		// extend our file priorities in case it's truncated
+		// the default assumed priority is 4 (the default)
+		if (prio.size() > m_file_priority.size())
+			m_file_priority.resize(prio.size(), default_priority);
+
+		filenames const fs = names();
+		for (file_index_t i(0); i < prio.end_index(); ++i)
+		{
+			// pad files always have priority 0.
+			if (fs.pad_file_at(i)) continue;
+
+			download_priority_t const old_prio = m_file_priority[i];
+			download_priority_t new_prio = prio[i];
+
+			m_file_priority[i] = new_prio;
+
+			// in case there's an error, we make sure m_file_priority is only
+			// updated for the successful files. By leaving failed files as
+			// priority 0, we allow re-trying them.
+			auto restore_prio = aux::scope_end([&] {
+				m_file_priority[i] = old_prio;
+				prio = m_file_priority;
+			});
+
+			if (old_prio == dont_download && new_prio != dont_download)
+			{
+				// move stuff out of the part file
+				std::shared_ptr<aux::file_handle> f = open_file(sett, i, aux::open_mode::write, ec);
+				if (ec) return;
+
+				if (m_part_file && use_partfile(i))
+				{
+					try
+					{
+						m_part_file->export_file([&f](std::int64_t file_offset, span<char> buf) {
+							lt::error_code err;
+							aux::pwrite_all(f->fd(), buf, file_offset, err);
+							if (err) throw lt::system_error(err);
+						}, fs.file_offset(i), fs.file_size(i), ec.ec);
+
+						if (ec)
+						{
+							ec.file(i);
+							ec.operation = operation_t::partfile_write;
+							return;
+						}
+					}
+					catch (lt::system_error const& err)
+					{
+						ec.file(i);
+						ec.operation = operation_t::partfile_write;
+						ec.ec = err.code();
+						return;
+					}
+					catch (std::exception const& e)
+					{
+						TORRENT_UNUSED(e);
+						// this is not expected
+						TORRENT_ASSERT_FAIL_VAL(e.what());
+						ec.file(i);
+						ec.operation = operation_t::partfile_write;
+						ec.ec = error_code(boost::system::errc::io_error, generic_category());
+						return;
+					}
+				}
+			}
+			else if (old_prio != dont_download && new_prio == dont_download)
+			{
+				// move stuff into the part file
+				// this is not implemented yet.
+				// so we just don't use a partfile for this file
+
+				std::string const fp = fs.file_path(i, m_save_path);
+				bool const file_exists = exists(fp, ec.ec);
+				if (ec.ec)
+				{
+					ec.file(i);
+					ec.operation = operation_t::file_stat;
+					return;
+				}
+				use_partfile(i, !file_exists);
+			}
+			ec.ec.clear();
+			restore_prio.disarm();
+
+			if (m_file_priority[i] == dont_download && use_partfile(i))
+			{
+				need_partfile();
+			}
+		}
+		if (m_part_file) m_part_file->flush_metadata(ec.ec);
+		if (ec)
+		{
+			ec.file(torrent_status::error_file_partfile);
+			ec.operation = operation_t::partfile_write;
+		}
+	}
+
+	bool pread_storage::use_partfile(file_index_t const index) const
+	{
+		TORRENT_ASSERT_VAL(index >= file_index_t{}, index);
+		if (index >= m_use_partfile.end_index()) return true;
+		return m_use_partfile[index];
+	}
+
+	void pread_storage::use_partfile(file_index_t const index, bool const b)
+	{
+		if (index >= m_use_partfile.end_index())
+		{
+			// no need to extend this array if we're just setting it to "true",
+			// that's default already
+			if (b) return;
+			m_use_partfile.resize(static_cast<int>(index) + 1, true);
+		}
+		m_use_partfile[index] = b;
+	}
+
+	status_t pread_storage::initialize(settings_interface const& sett, storage_error& ec)
+	{
+		m_stat_cache.reserve(files().num_files());
+
+		if (aux::get_drive_info(m_save_path) == aux::drive_info::remote)
+		{
+			// don't do full file allocations on network drives
+			m_allocate_files = false;
+		}
+
+		{
+			std::unique_lock<std::mutex> l(m_file_created_mutex);
+			m_file_created.resize(files().num_files(), false);
+		}
+
+		filenames const fs = names();
+		status_t ret{};
+		// if some files have priority 0, we need to check if they exist on the
+		// filesystem, in which case we won't use a partfile for them.
+		// this is to be backwards compatible with previous versions of
+		// libtorrent, when part files were not supported.
+		for (file_index_t i(0); i < m_file_priority.end_index(); ++i)
+		{
+			if (m_file_priority[i] != dont_download || fs.pad_file_at(i))
+				continue;
+
+			error_code err;
+			auto const size = m_stat_cache.get_filesize(i, fs, m_save_path, err);
+			if (!err && size > 0)
+			{
+				use_partfile(i, false);
+				if (size > fs.file_size(i))
+					ret |= disk_status::oversized_file;
+			}
+			else
+			{
+				// we may have earlier determined we *can't* use a partfile for
+				// this file, we need to be able to change our mind in case the
+				// file disappeared
+				use_partfile(i, true);
+				need_partfile();
+			}
+		}
+
+		aux::initialize_storage(fs, m_save_path, m_stat_cache, m_file_priority
+			, [&sett, this](file_index_t const file_index, storage_error& e)
+			{ open_file(sett, file_index, aux::open_mode::write, e); }
+			, aux::create_symlink
+			, [&ret](file_index_t, std::int64_t) { ret |= disk_status::oversized_file; }
+			, ec);
+
+		// close files that were opened in write mode
+		m_pool.release(storage_index());
+		return ret;
+	}
+
+	bool pread_storage::has_any_file(storage_error& ec)
+	{
+		m_stat_cache.reserve(files().num_files());
+
+		if (aux::has_any_file(names(), m_save_path, m_stat_cache, ec))
+			return true;
+
+		if (ec) return false;
+
+		file_status s;
+		stat_file(combine_path(
+			m_part_file_dir.empty() ? m_save_path : combine_path(m_save_path, m_part_file_dir)
+			, m_part_file_name), &s, ec.ec);
+		if (!ec) return true;
+
+		// the part file not existing is expected
+		if (ec.ec == boost::system::errc::no_such_file_or_directory)
+			ec.ec.clear();
+
+		if (ec)
+		{
+			ec.file(torrent_status::error_file_partfile);
+			ec.operation = operation_t::file_stat;
+		}
+		return false;
+	}
+
+	void pread_storage::rename_file(file_index_t const index, std::string const& new_filename
+		, storage_error& ec)
+	{
+		if (index < file_index_t(0) || index >= files().end_file()) return;
+		std::string const old_name = m_renamed_files.file_path(files(), index, m_save_path);
+		m_pool.release(storage_index(), index);
+
+		// if the old file doesn't exist, just succeed and change the filename
+		// that will be created. This shortcut is important because the
+		// destination directory may not exist yet, which would cause a failure
+		// even though we're not moving a file (yet). It's better for it to
+		// fail later when we try to write to the file the first time, because
+		// the user then will have had a chance to make the destination directory
+		// valid.
+		if (exists(old_name, ec.ec))
+		{
+			std::string new_path;
+			if (is_complete(new_filename)) new_path = new_filename;
+			else new_path = combine_path(m_save_path, new_filename);
+			std::string new_dir = parent_path(new_path);
+
+			error_code best_effort;
+			if (exists(new_path, best_effort))
+			{
+				// We don't want to overwrite an existing file
+				ec.ec = error_code(boost::system::errc::file_exists, generic_category());
+				ec.file(index);
+				ec.operation = operation_t::file_rename;
+				return;
+			}
+
+			// create any missing directories that the new filename
+			// lands in
+			create_directories(new_dir, ec.ec);
+			if (ec.ec)
+			{
+				ec.file(index);
+				ec.operation = operation_t::mkdir;
+				return;
+			}
+
+			rename(old_name, new_path, ec.ec);
+
+			// if old_name doesn't exist, that's not an error
+			// here. Once we start writing to the file, it will
+			// be written to the new filename
+			if (ec.ec == boost::system::errc::no_such_file_or_directory)
+				ec.ec.clear();
+
+			if (ec)
+			{
+				ec.ec.clear();
+				aux::copy_file(old_name, new_path, ec);
+
+				if (ec)
+				{
+					ec.file(index);
+					return;
+				}
+
+				error_code ignore;
+				remove(old_name, ignore);
+			}
+		}
+		else if (ec.ec)
+		{
+			// if exists fails, report that error
+			ec.file(index);
+			ec.operation = operation_t::file_stat;
+			return;
+		}
+
+		// if old path doesn't exist, just record the rename
+		// so it will get the new name when it is created.
+		m_renamed_files.rename_file(files(), index, new_filename);
+	}
+
+	void pread_storage::release_files(storage_error&)
+	{
+		if (m_part_file)
+		{
+			error_code ignore;
+			m_part_file->flush_metadata(ignore);
+		}
+
+		// make sure we don't have the files open
+		m_pool.release(storage_index());
+
+		// make sure we can pick up new files added to the download directory when
+		// we start the torrent again
+		m_stat_cache.clear();
+	}
+
+	void pread_storage::delete_files(remove_flags_t const options, storage_error& ec)
+	{
+		// make sure we don't have the files open
+		m_pool.release(storage_index());
+
+		// if there's a part file open, make sure to destruct it to have it
+		// release the underlying part file. Otherwise we may not be able to
+		// delete it
+		if (m_part_file) m_part_file.reset();
+
+		std::string part_file = combine_path(
+			m_part_file_dir.empty() ? m_save_path : combine_path(m_save_path, m_part_file_dir)
+			, m_part_file_name);
+
+		aux::delete_files(names()
+			, m_save_path
+			, part_file
+			, options
+			, ec);
+	}
+
+	bool pread_storage::verify_resume_data(add_torrent_params const& rd
+		, aux::vector<std::string, file_index_t> const& links
+		, storage_error& ec)
+	{
+		return aux::verify_resume_data(rd, links, names()
+			, m_file_priority, m_stat_cache, m_save_path, ec);
+	}
+
+	std::pair<status_t, std::string> pread_storage::move_storage(std::string save_path
+		, move_flags_t const flags, storage_error& ec)
+	{
+		m_pool.release(storage_index());
+
+		status_t ret;
+		auto move_partfile = [&](std::string const& new_save_path, error_code& e)
+		{
+			if (!m_part_file) return;
+			std::string new_part_file_dir;
+			if (!m_part_file_dir.empty())
+			{
+				new_part_file_dir = combine_path(new_save_path, m_part_file_dir);
+				create_directories(new_part_file_dir, e);
+				if (e) return;
+			}
+			else
+			{
+				new_part_file_dir = new_save_path;
+			}
+			m_part_file->move_partfile(new_part_file_dir, e);
+		};
+		std::tie(ret, m_save_path) = aux::move_storage(
+			names()
+			, m_save_path
+			, std::move(save_path)
+			, std::move(move_partfile)
+			, flags
+			, ec);
+
+		// clear the stat cache in case the new location has new files
+		m_stat_cache.clear();
+
+		return { ret, m_save_path };
+	}
+
+	int pread_storage::read(settings_interface const& sett
+		, span<char> buffer
+		, piece_index_t const piece, int const offset
+		, aux::open_mode_t const mode
+		, disk_job_flags_t
+		, storage_error& error)
+	{
+		return readwrite(files(), buffer, piece, offset, error
+			, [this, mode, &sett](file_index_t const file_index
+				, std::int64_t const file_offset
+				, span<char> buf, storage_error& ec)
+		{
+			// reading from a pad file yields zeroes
+			if (files().pad_file_at(file_index)) return aux::read_zeroes(buf);
+
+			if (in_partfile(file_index))
+				return read_partfile(buf, file_index, file_offset, ec);
+
+			auto handle = open_file(sett, file_index, mode, ec);
+			if (ec) return -1;
+			TORRENT_ASSERT(handle);
+
+			// set this unconditionally in case the upper layer would like to treat
+			// short reads as errors
+			ec.operation = operation_t::file_read;
+			return aux::pread_all(handle->fd(), buf, file_offset, ec.ec);
+		});
+	}
+
+	int pread_storage::write(settings_interface const& sett
+		, span<char const> buffer
+		, piece_index_t const piece, int const offset
+		, aux::open_mode_t const mode
+		, disk_job_flags_t const flags
+		, storage_error& error)
+	{
+		span<char const> const buffers[1] = {buffer};
+		return write(sett, span<span<char const> const>(buffers), piece, offset
+			, mode, flags, error);
+	}
+
+	int pread_storage::write(settings_interface const& sett
+		, span<span<char const> const> buffers
+		, piece_index_t const piece, int const offset
+		, aux::open_mode_t const mode
+		, disk_job_flags_t
+		, storage_error& error)
+	{
+		std::ptrdiff_t total_size = 0;
+		for (auto const& b : buffers) total_size += b.size();
+
+		// readwrite() splits the write up at file boundaries. The dummy buffer
+		// is only used for its size, the actual data is picked out of
+		// ``buffers`` as we go
+		// the position in ``buffers`` of the next byte to write
+		std::ptrdiff_t buf_idx = 0;
+		std::ptrdiff_t buf_offset = 0;
+
+		char dummy = 0;
+		return readwrite(files(), span<char const>{&dummy, total_size}, piece, offset, error
+			, [this, mode, &sett, buffers, &buf_idx, &buf_offset](file_index_t const file_index
+				, std::int64_t const file_offset
+				, span<char const> const buf, storage_error& ec)
+		{
+			// pick out the buffers (or parts of buffers) covering this file
+			TORRENT_ALLOCA(file_bufs, span<char const>, buffers.size() - buf_idx);
+			int num_bufs = 0;
+			std::ptrdiff_t left = buf.size();
+			while (left > 0)
+			{
+				TORRENT_ASSERT(buf_idx < buffers.size());
+				span<char const> const b = buffers[buf_idx].subspan(buf_offset);
+				std::ptrdiff_t const n = std::min(left, b.size());
+				file_bufs[num_bufs++] = b.first(n);
+				left -= n;
+				buf_offset += n;
+				if (buf_offset == buffers[buf_idx].size())
+				{
+					++buf_idx;
+					buf_offset = 0;
+				}
+			}
+			auto const this_file = file_bufs.first(num_bufs);
+
+			if (files().pad_file_at(file_index))
+			{
+				// writing to a pad-file is a no-op
+				return int(buf.size());
+			}
+
+			if (in_partfile(file_index))
+				return write_partfile(this_file, file_index, file_offset, ec);
+
+			// invalidate our stat cache for this file, since
+			// we're writing to it
+			m_stat_cache.set_dirty(file_index);
+
+			TORRENT_ASSERT(file_index < m_files.end_file());
+
+			auto handle = open_file(sett, file_index
+				, aux::open_mode::write | mode, ec);
+			if (ec) return -1;
+
+			// set this unconditionally in case the upper layer would like to treat
+			// short reads as errors
+			ec.operation = operation_t::file_write;
+
+			if (this_file.size() == 1)
+				return aux::pwrite_all(handle->fd(), this_file.front(), file_offset, ec.ec);
+			return aux::pwritev_all(handle->fd(), this_file, file_offset, ec.ec);
+		});
+	}
+
+	int pread_storage::prepare_read(settings_interface const& sett
+		, span<char> buffer
+		, piece_index_t const piece, int const offset
+		, aux::open_mode_t const mode
+		, std::vector<file_slice>& slices
+		, storage_error& error)
+	{
+		return readwrite(files(), buffer, piece, offset, error
+			, [&](file_index_t const file_index
+				, std::int64_t const file_offset
+				, span<char> buf, storage_error& ec)
+		{
+			if (files().pad_file_at(file_index)) return aux::read_zeroes(buf);
+
+			if (in_partfile(file_index))
+				return read_partfile(buf, file_index, file_offset, ec);
+
+			auto handle = open_file(sett, file_index, mode, ec);
+			if (ec) return -1;
+			TORRENT_ASSERT(handle);
+
+			slices.push_back({std::move(handle), file_index, file_offset
+				, int(buf.data() - buffer.data()), int(buf.size())});
+			return int(buf.size());
+		});
+	}
+
+	int pread_storage::prepare_write(settings_interface const& sett
+		, span<char const> buffer
+		, piece_index_t const piece, int const offset
+		, aux::open_mode_t const mode
+		, std::vector<file_slice>& slices
+		, storage_error& error)
+	{
+		return readwrite(files(), buffer, piece, offset, error
+			, [&](file_index_t const file_index
+				, std::int64_t const file_offset
+				, span<char const> buf, storage_error& ec)
+		{
+			// writing to a pad-file is a no-op
+			if (files().pad_file_at(file_index)) return int(buf.size());
+
+			if (in_partfile(file_index))
+			{
+				span<char const> const bufs[1] = {buf};
+				return write_partfile(bufs, file_index, file_offset, ec);
+			}
+
+			m_stat_cache.set_dirty(file_index);
+
+			auto handle = open_file(sett, file_index
+				, aux::open_mode::write | mode, ec);
+			if (ec) return -1;
+			TORRENT_ASSERT(handle);
+
+			slices.push_back({std::move(handle), file_index, file_offset
+				, int(buf.data() - buffer.data()), int(buf.size())});
+			return int(buf.size());
+		});
+	}
+
+	bool pread_storage::in_partfile(file_index_t const file_index) const
+	{
+		return file_index < m_file_priority.end_index()
+			&& m_file_priority[file_index] == dont_download
+			&& use_partfile(file_index);
+	}
+
+	int pread_storage::read_partfile(span<char> const buf
+		, file_index_t const file_index, std::int64_t const file_offset
+		, storage_error& ec)
+	{
+		TORRENT_ASSERT(m_part_file);
+
+		error_code e;
+		peer_request const map = files().map_file(file_index, file_offset, 0);
+		int const ret = m_part_file->read(buf, map.piece, map.start, e);
+
+		if (e)
+		{
+			ec.ec = e;
+			ec.operation = operation_t::partfile_read;
+			return -1;
+		}
+		return ret;
+	}
+
+	int pread_storage::write_partfile(span<span<char const> const> const bufs
+		, file_index_t const file_index, std::int64_t const file_offset
+		, storage_error& ec)
+	{
+		TORRENT_ASSERT(m_part_file);
+
+		error_code e;
+		peer_request map = files().map_file(file_index, file_offset, 0);
+		int ret = 0;
+		for (auto const& b : bufs)
+		{
+			int const r = m_part_file->write(b, map.piece, map.start, e);
+			if (e)
+			{
+				ec.ec = e;
+				ec.operation = operation_t::partfile_write;
+				return -1;
+			}
+			ret += r;
+			map.start += r;
+		}
+		return ret;
+	}
+
+	// a wrapper around open_file_impl that, if it fails, makes sure the
+	// directories have been created and retries
+	std::shared_ptr<aux::file_handle> pread_storage::open_file(settings_interface const& sett
+		, file_index_t const file
+		, aux::open_mode_t mode, storage_error& ec) const
+	{
+		if (mode & aux::open_mode::write
+			&& !(mode & aux::open_mode::truncate))
+		{
+			std::unique_lock<std::mutex> l(m_file_created_mutex);
+			if (m_file_created.size() != files().num_files())
+				m_file_created.resize(files().num_files(), false);
+
+			// if we haven't created this file already, make sure to truncate it to
+			// its final size
+			mode |= (m_file_created[file] == false) ? aux::open_mode::truncate : aux::open_mode::read_only;
+		}
+
+		if (files().file_flags(file) & file_storage::flag_executable)
+			mode |= aux::open_mode::executable;
+
+		if (files().file_flags(file) & file_storage::flag_hidden)
+			mode |= aux::open_mode::hidden;
+
+#ifdef _WIN32
+		if (sett.get_bool(settings_pack::enable_set_file_valid_data))
+		{
+			mode |= aux::open_mode::allow_set_file_valid_data;
+		}
+#endif
+
+		std::shared_ptr<aux::file_handle> h = open_file_impl(sett, file, mode, ec);
+		if (ec.ec)
+		{
+			ec.file(file);
+			return {};
+		}
+		TORRENT_ASSERT(h);
+
+		if (mode & aux::open_mode::truncate)
+		{
+			// remember that we've truncated this file, so we don't have to do it
+			// again
+			std::unique_lock<std::mutex> l(m_file_created_mutex);
+			m_file_created.set_bit(file);
+		}
+
+		return h;
+	}
+
+	std::shared_ptr<aux::file_handle> pread_storage::open_file_impl(settings_interface const& sett
+		, file_index_t file
+		, aux::open_mode_t mode
+		, storage_error& ec) const
+	{
+		TORRENT_ASSERT(!files().pad_file_at(file));
+		if (!m_allocate_files) mode |= aux::open_mode::sparse;
+
+		// files with priority 0 should always be sparse
+		if (m_file_priority.end_index() > file && m_file_priority[file] == dont_download)
+			mode |= aux::open_mode::sparse;
+
+		if (sett.get_bool(settings_pack::no_atime_storage))
+			mode |= aux::open_mode::no_atime;
+
+		if (sett.get_bool(settings_pack::disk_disable_copy_on_write))
+			mode |= aux::open_mode::no_cow;
+
+		// we keep our own write cache, don't store the data twice by leaving it
+		// in the OS cache as well, if so configured
+		auto const write_mode = sett.get_int(settings_pack::disk_io_write_mode);
+		if (write_mode == settings_pack::disable_os_cache
+			|| write_mode == settings_pack::write_through)
+		{
+			mode |= aux::open_mode::no_cache;
+		}
+
+		try {
+			return m_pool.open_file(storage_index(), m_save_path, file
+				, names(), mode
+#if TORRENT_HAVE_MAP_VIEW_OF_FILE
+				, nullptr
+#endif
+				);
+		}
+		catch (storage_error const& se)
+		{
+			ec = se;
+			ec.file(file);
+			TORRENT_ASSERT(ec);
+			return {};
+		}
+	}
+
+	bool pread_storage::tick()
+	{
+		error_code ec;
+		if (m_part_file) m_part_file->flush_metadata(ec);
+
+		return false;
+	}
+} // namespace libtorrent::aux
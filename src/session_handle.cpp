@@ -168,6 +168,11 @@ namespace libtorrent {
 		async_call(&session_impl::post_torrent_updates, flags);
 	}
 
+	void session_handle::post_status_deltas()
+	{
+		async_call(&session_impl::post_status_deltas);
+	}
+
 	void session_handle::post_session_stats()
 	{
 		async_call(&session_impl::post_session_stats);
@@ -423,7 +428,11 @@ namespace {
 		async_add_torrent(add_torrent_params(params));
 	}
 
-	void session_handle::async_add_torrent(add_torrent_params&& params)
+namespace {
+
+	// the parts of adding a torrent asynchronously that don't involve the
+	// session. These are done on the calling thread
+	void prepare_async_add_torrent(add_torrent_params& params)
 	{
 #ifndef BOOST_NO_EXCEPTIONS
 		if (params.save_path.empty())
@@ -442,22 +451,35 @@ namespace {
 		if (params.ti)
 			params.ti = std::make_shared<torrent_info>(*params.ti);
 
+		params.save_path = complete(params.save_path);
+
+#if TORRENT_ABI_VERSION == 1
+		handle_backwards_compatible_resume_data(params);
+#endif
+	}
+} // anonymous namespace
+
+	void session_handle::async_add_torrent(add_torrent_params&& params)
+	{
+		prepare_async_add_torrent(params);
+
 		// we cannot capture a unique_ptr into a lambda in c++11, so we use a raw
 		// pointer for now. async_call uses a lambda expression to post the call
 		// to the main thread
 		// TODO: in C++14, use unique_ptr and move it into the lambda
 		auto* p = new add_torrent_params(std::move(params));
 		auto guard = aux::scope_end([p]{ delete p; });
-		p->save_path = complete(p->save_path);
-
-#if TORRENT_ABI_VERSION == 1
-		handle_backwards_compatible_resume_data(*p);
-#endif
-
 		async_call(&session_impl::async_add_torrent, p);
 		guard.disarm();
 	}
 
+	void session_handle::async_add_torrents(std::vector<add_torrent_params> params)
+	{
+		for (auto& p : params)
+			prepare_async_add_torrent(p);
+		async_call(&session_impl::async_add_torrents, std::move(params));
+	}
+
 #ifndef BOOST_NO_EXCEPTIONS
 #if TORRENT_ABI_VERSION == 1
 	// if the torrent already exists, this will throw duplicate_torrent
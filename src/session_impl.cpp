@@ -2584,6 +2584,40 @@ retry:
 			s->sock.async_write(std::bind(&session_impl::on_udp_writeable
 				, this, s, _1));
 		}
+
+		// packets sent with the batch flag may have been queued. They are sent
+		// once we're done with the current handler, along with any other
+		// packets queued until then
+		if (s->sock.has_batch() && !s->flush_pending && !s->write_blocked)
+		{
+			s->flush_pending = true;
+			post(m_io_context, [this, ws = std::weak_ptr<session_udp_socket>(s)]
+				{ wrap(&session_impl::on_udp_flush, ws); });
+		}
+	}
+
+	void session_impl::on_udp_flush(std::weak_ptr<session_udp_socket> sock)
+	{
+		auto s = sock.lock();
+		if (!s) return;
+		s->flush_pending = false;
+		flush_udp_batch(s);
+	}
+
+	void session_impl::flush_udp_batch(std::shared_ptr<session_udp_socket> const& s)
+	{
+		if (!s->sock.has_batch()) return;
+
+		error_code ec;
+		s->sock.flush_batch(ec);
+
+		if ((ec == error::would_block || ec == error::try_again) && !s->write_blocked)
+		{
+			s->write_blocked = true;
+			ADD_OUTSTANDING_ASYNC("session_impl::on_udp_writeable");
+			s->sock.async_write(std::bind(&session_impl::on_udp_writeable
+				, this, s, _1));
+		}
 	}
 
 	void session_impl::on_udp_writeable(std::weak_ptr<session_udp_socket> sock, error_code const& ec)
@@ -2596,6 +2630,11 @@ retry:
 
 		s->write_blocked = false;
 
+		// send what's left in the queue before letting the uTP sockets send
+		// more packets
+		flush_udp_batch(s);
+		if (s->write_blocked) return;
+
 #ifdef TORRENT_SSL_PEERS
 		auto i = std::find_if(
 			m_listen_sockets.begin(), m_listen_sockets.end()
@@ -2653,12 +2692,18 @@ retry:
 #endif
 			m_utp_socket_manager;
 
+		aux::array<udp_socket::packet, udp_socket::max_read_packets> p;
 		for (;;)
 		{
-			aux::array<udp_socket::packet, 50> p;
 			error_code err;
 			int const num_packets = s->sock.read(p, err);
 
+			if (num_packets > 0)
+			{
+				m_stats_counters.inc_stats_counter(counters::udp_read_batches);
+				m_stats_counters.inc_stats_counter(counters::udp_packets_in, num_packets);
+			}
+
 			for (udp_socket::packet& packet : span<udp_socket::packet>(p).first(num_packets))
 			{
 				if (packet.error)
@@ -2766,6 +2811,10 @@ retry:
 
 		mgr.socket_drained();
 
+		// send the ACKs and payload packets the uTP sockets queued up in
+		// response to the packets we just received
+		flush_udp_batch(s);
+
 		ADD_OUTSTANDING_ASYNC("session_impl::on_udp_packet");
 		s->sock.async_read(make_handler([this, socket, ls, ssl](error_code const& e)
 			{ this->on_udp_packet(std::move(socket), std::move(ls), ssl, e); }
@@ -3652,25 +3701,22 @@ retry:
 		}
 
 		// --------------------------------------------------------------
-		// check for incoming connections that might have timed out
+		// check connections and torrents whose timeouts are due
 		// --------------------------------------------------------------
 
-		for (auto i = m_connections.begin(); i != m_connections.end();)
+		m_peer_timeouts.advance(total_seconds(now.time_since_epoch())
+			, [](std::pair<std::weak_ptr<peer_connection>, time_point> const& e)
 		{
-			peer_connection* p = (*i).get();
-			++i;
-			// ignore connections that already have a torrent, since they
-			// are ticked through the torrents' second_tick
-			if (!p->associated_torrent().expired()) continue;
+			std::shared_ptr<peer_connection> p = e.first.lock();
+			if (p) p->on_timeout(e.second);
+		});
 
-			// TODO: have a separate list for these connections, instead of having to loop through all of them
-			int timeout = m_settings.get_int(settings_pack::handshake_timeout);
-#if TORRENT_USE_I2P
-			timeout *= is_i2p(p->get_socket()) ? 4 : 1;
-#endif
-			if (m_last_tick - p->connected_time () > seconds(timeout))
-				p->disconnect(errors::timed_out, operation_t::bittorrent);
-		}
+		m_torrent_housekeeping.advance(total_seconds(now.time_since_epoch())
+			, [](std::pair<std::weak_ptr<torrent>, time_point> const& e)
+		{
+			std::shared_ptr<torrent> t = e.first.lock();
+			if (t) t->on_housekeeping(e.second);
+		});
 
 		// --------------------------------------------------------------
 		// second_tick every torrent (that wants it)
@@ -3839,6 +3885,26 @@ retry:
 				}
 			}
 		}
+
+		// record how long this tick took, in the second_tick_time histogram
+		std::int64_t const tick_time = std::max(total_microseconds(clock_type::now() - now)
+			, std::int64_t(0));
+		int const index = std::min(aux::log2p1(std::uint32_t(std::min(tick_time >> 7
+			, std::int64_t(0xffffffff)))), 13);
+		m_stats_counters.inc_stats_counter(counters::second_tick_time7 + index);
+	}
+
+	void session_impl::schedule_timeout(std::shared_ptr<peer_connection> const& p
+		, time_point const at)
+	{
+		// round up, the entry must not fire before at has passed
+		m_peer_timeouts.schedule({p, at}, total_seconds(at.time_since_epoch()) + 1);
+	}
+
+	void session_impl::schedule_housekeeping(std::shared_ptr<torrent> const& t
+		, time_point const at)
+	{
+		m_torrent_housekeeping.schedule({t, at}, total_seconds(at.time_since_epoch()) + 1);
 	}
 
 	void session_impl::received_buffer(int s)
@@ -4885,6 +4951,35 @@ retry:
 		m_alerts.emplace_alert<state_update_alert>(std::move(status));
 	}
 
+	void session_impl::post_status_deltas()
+	{
+		INVARIANT_CHECK;
+
+		TORRENT_ASSERT(is_single_thread());
+
+		std::vector<torrent*>& state_updates
+			= m_torrent_lists[aux::session_impl::torrent_state_updates];
+
+#if TORRENT_USE_ASSERTS
+		m_posting_torrent_updates = true;
+#endif
+
+		torrent_status_deltas deltas;
+		for (auto& t : state_updates)
+		{
+			TORRENT_ASSERT(t->m_links[aux::session_impl::torrent_state_updates].in_list());
+			t->status_delta(deltas);
+			t->clear_in_state_update();
+		}
+		state_updates.clear();
+
+#if TORRENT_USE_ASSERTS
+		m_posting_torrent_updates = false;
+#endif
+
+		m_alerts.emplace_alert<state_delta_alert>(std::move(deltas));
+	}
+
 	void session_impl::post_session_stats()
 	{
 		if (!m_posted_stats_header)
@@ -4962,6 +5057,33 @@ retry:
 		add_torrent(std::move(*params), ec);
 	}
 
+	void session_impl::async_add_torrents(std::vector<add_torrent_params>&& params)
+	{
+		if (params.empty()) return;
+		add_torrents_batch(std::make_shared<std::vector<add_torrent_params>>(
+			std::move(params)), 0);
+	}
+
+	void session_impl::add_torrents_batch(
+		std::shared_ptr<std::vector<add_torrent_params>> params
+		, std::size_t const start)
+	{
+		// the number of torrents to add before yielding to other handlers
+		// (like socket I/O and timers) queued up on the network thread
+		std::size_t const batch_size = 100;
+
+		std::size_t const end = std::min(params->size(), start + batch_size);
+		for (std::size_t i = start; i < end; ++i)
+		{
+			error_code ec;
+			add_torrent(std::move((*params)[i]), ec);
+		}
+		if (end == params->size()) return;
+
+		post(m_io_context, [this, p = std::move(params), end]() mutable
+			{ wrap(&session_impl::add_torrents_batch, std::move(p), end); });
+	}
+
 #ifndef TORRENT_DISABLE_EXTENSIONS
 	void session_impl::add_extensions_to_torrent(
 		std::shared_ptr<torrent> const& torrent_ptr, client_data_t const userdata)
@@ -5182,11 +5304,13 @@ retry:
 
 		// make sure we have enough memory in the torrent lists up-front,
 		// since when torrents changes states, we cannot allocate memory that
-		// might fail.
+		// might fail. Grow them geometrically though, adding a large number
+		// of torrents would be quadratic otherwise.
 		size_t const num_torrents = m_torrents.size();
 		for (auto& l : m_torrent_lists)
 		{
-			l.reserve(num_torrents + 1);
+			if (l.capacity() < num_torrents + 1)
+				l.reserve(std::max(num_torrents + 1, l.capacity() * 2));
 		}
 
 		try
@@ -7105,6 +7229,13 @@ retry:
 		m_alerts.emplace_alert<dht_outgoing_get_peers_alert>(target, sent_target, ep);
 	}
 
+	void session_impl::indexer_results(std::vector<sha1_hash> const& info_hashes
+		, std::vector<std::pair<sha1_hash, tcp::endpoint>> const& peers)
+	{
+		if (!m_alerts.should_post<dht_indexer_alert>()) return;
+		m_alerts.emplace_alert<dht_indexer_alert>(info_hashes, peers);
+	}
+
 #ifndef TORRENT_DISABLE_LOGGING
 	bool session_impl::should_log(module_t) const
 	{
@@ -307,6 +307,19 @@ namespace {
 
 		METRIC(disk, disk_blocks_in_use)
 
+		// disk buffers are allocated from slabs of 2 MiB.
+		// ``disk_buffer_slabs`` is the number of slabs currently allocated
+		// and ``disk_buffer_huge_page_slabs`` how many of them are backed by
+		// huge pages. ``disk_buffer_cached_blocks`` is the number of free
+		// blocks held in the allocator's thread caches and
+		// ``disk_buffer_free_slab_blocks`` the number of free blocks in
+		// slabs that can't be released because some of their blocks are in
+		// use, i.e. the fragmentation of the disk buffer pool.
+		METRIC(disk, disk_buffer_slabs)
+		METRIC(disk, disk_buffer_huge_page_slabs)
+		METRIC(disk, disk_buffer_cached_blocks)
+		METRIC(disk, disk_buffer_free_slab_blocks)
+
 		// ``queued_disk_jobs`` is the number of disk jobs currently queued,
 		// waiting to be executed by a disk thread.
 		METRIC(disk, queued_disk_jobs)
@@ -347,6 +360,11 @@ namespace {
 		// hash a piece (when verifying against the piece hash)
 		METRIC(disk, num_read_back)
 
+		// the number of blocks read for uploading that were handed out as a
+		// reference into a memory mapped file, rather than copied into a disk
+		// buffer. See the zero_copy_send setting.
+		METRIC(disk, num_zero_copy_reads)
+
 		// The number of file pool hits (the file we want is already open) and
 		// misses (we need to open the file).
 		METRIC(disk, file_pool_hits)
@@ -423,6 +441,8 @@ namespace {
 		// 3. ignore_dark_internet is enabled, and the packet came from a
 		//    non-public IP address
 		// 4. the bencoding of the message was invalid
+		// 5. too many mutable puts were waiting for a DHT worker thread to
+		//    verify their signature
 		METRIC(dht, dht_messages_in_dropped)
 
 		// the number of outgoing messages that failed to be
@@ -458,6 +478,20 @@ namespace {
 		METRIC(dht, dht_invalid_get)
 		METRIC(dht, dht_invalid_sample_infohashes)
 
+		// The cumulative time, in microseconds, spent in each stage of
+		// handling incoming DHT messages. ``dht_decode_time`` is the time
+		// spent bdecoding packets and ``dht_incoming_time`` the time the DHT
+		// nodes spent handling the decoded messages (including storage
+		// lookups and routing table updates). ``dht_verify_time`` is the time
+		// spent verifying the signatures of mutable puts, either on the
+		// network thread or on a DHT worker thread (see
+		// ``dht_worker_threads``). ``dht_verify_wait_time`` is the time puts
+		// spent queued for, and returning from, a worker thread.
+		METRIC(dht, dht_decode_time)
+		METRIC(dht, dht_incoming_time)
+		METRIC(dht, dht_verify_time)
+		METRIC(dht, dht_verify_wait_time)
+
 		// The number of times a lost packet has been interpreted as congestion,
 		// cutting the congestion window in half. Some lost packets are not
 		// interpreted as congestion, notably MTU-probes
@@ -500,6 +534,14 @@ namespace {
 		// the outgoing ACK is lost.
 		METRIC(utp, utp_redundant_pkts_in)
 
+		// The number of times one or more packets were read from a UDP socket
+		// (``udp_read_batches``) and the total number of packets read
+		// (``udp_packets_in``). Where supported, each batch is received with a
+		// single system call. The average batch size is
+		// ``udp_packets_in / udp_read_batches``.
+		METRIC(net, udp_read_batches)
+		METRIC(net, udp_packets_in)
+
 		// the number of uTP sockets in each respective state
 		METRIC(utp, num_utp_idle)
 		METRIC(utp, num_utp_syn_sent)
@@ -554,6 +596,27 @@ namespace {
 		METRIC(sock_bufs, socket_recv_size19)
 		METRIC(sock_bufs, socket_recv_size20)
 
+		// a histogram of the time spent in the once-per-second session
+		// tick, which ticks all torrents (and their peers) that want it.
+		// A tick is counted in the bucket for the smallest 1 << n
+		// microseconds it completed in, where n is the number at the end
+		// of the counter name (128 us to 1 s). The last bucket also counts
+		// every tick longer than that.
+		METRIC(ses, second_tick_time7)
+		METRIC(ses, second_tick_time8)
+		METRIC(ses, second_tick_time9)
+		METRIC(ses, second_tick_time10)
+		METRIC(ses, second_tick_time11)
+		METRIC(ses, second_tick_time12)
+		METRIC(ses, second_tick_time13)
+		METRIC(ses, second_tick_time14)
+		METRIC(ses, second_tick_time15)
+		METRIC(ses, second_tick_time16)
+		METRIC(ses, second_tick_time17)
+		METRIC(ses, second_tick_time18)
+		METRIC(ses, second_tick_time19)
+		METRIC(ses, second_tick_time20)
+
 		// if the outstanding tracker announce limit is reached, tracker
 		// announces are queued, to be issued when an announce slot opens up.
 		// this measure the number of tracker announces currently in the
@@ -215,6 +215,12 @@ namespace {
 		SET(socks5_udp_send_local_ep, false, nullptr),
 		SET(proxy_send_host_in_connect, false, nullptr),
 		SET(disk_disable_copy_on_write, true, nullptr),
+		SET(disk_buffer_huge_pages, false, nullptr),
+		SET(disk_buffer_numa_arenas, false, nullptr),
+		SET(zero_copy_send, false, nullptr),
+		SET(incremental_piece_availability, false, nullptr),
+		SET(hashed_peer_list, false, nullptr),
+		SET(compact_peer_storage, false, nullptr),
 	}});
 
 	CONSTEXPR_SETTINGS
@@ -382,7 +388,9 @@ namespace {
 		SET(i2p_inbound_length_variance, 0, nullptr),
 		SET(i2p_outbound_length_variance, 0, nullptr),
 		SET(min_websocket_announce_interval, 1 * 60, nullptr),
-		SET(webtorrent_connection_timeout, 2 * 60, nullptr)
+		SET(webtorrent_connection_timeout, 2 * 60, nullptr),
+		SET(dht_worker_threads, 0, nullptr),
+		SET(dht_indexer_requests, 0, nullptr)
 	}});
 
 #undef SET
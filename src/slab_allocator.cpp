@@ -0,0 +1,394 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/aux_/slab_allocator.hpp"
+#include "libtorrent/assert.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+
+#ifdef TORRENT_WINDOWS
+#include "libtorrent/aux_/windows.hpp"
+#elif TORRENT_HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
+#ifdef TORRENT_LINUX
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+
+namespace libtorrent::aux {
+
+namespace {
+
+	std::size_t const slab_bytes = slab_allocator::slab_size;
+
+#if TORRENT_HAVE_MMAP && !defined TORRENT_WINDOWS
+	char* map_anonymous(std::size_t const size, int const flags)
+	{
+		void* ret = ::mmap(nullptr, size, PROT_READ | PROT_WRITE
+			, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+		return ret == MAP_FAILED ? nullptr : static_cast<char*>(ret);
+	}
+#endif
+
+	// returns nullptr if we're out of memory. ``huge_pages`` is set to true
+	// if the memory is backed by huge pages
+	char* map_slab(bool const try_huge_pages, bool& huge_pages)
+	{
+		huge_pages = false;
+#if defined TORRENT_WINDOWS
+		TORRENT_UNUSED(try_huge_pages);
+		// large pages on windows require the SeLockMemoryPrivilege, which we
+		// won't have
+		return static_cast<char*>(VirtualAlloc(nullptr, slab_bytes
+			, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+#elif TORRENT_HAVE_MMAP
+		if (try_huge_pages)
+		{
+#ifdef MAP_HUGETLB
+			// this only succeeds if the administrator has reserved huge pages
+			if (char* ret = map_anonymous(slab_bytes, MAP_HUGETLB))
+			{
+				huge_pages = true;
+				return ret;
+			}
+#endif
+#ifdef MADV_HUGEPAGE
+			// transparent huge pages must be aligned to the huge page size.
+			// Map twice the size and trim the ends. If there isn't enough
+			// address space for that, fall back to a regular mapping
+			char* const p = map_anonymous(slab_bytes * 2, 0);
+			if (p == nullptr) return map_anonymous(slab_bytes, 0);
+			auto const addr = reinterpret_cast<std::uintptr_t>(p);
+			auto const head = ((addr + slab_bytes - 1) & ~std::uintptr_t(slab_bytes - 1)) - addr;
+			if (head > 0) ::munmap(p, head);
+			::munmap(p + head + slab_bytes, slab_bytes - head);
+			char* const ret = p + head;
+			huge_pages = ::madvise(ret, slab_bytes, MADV_HUGEPAGE) == 0;
+			return ret;
+#endif
+		}
+		return map_anonymous(slab_bytes, 0);
+#else
+		TORRENT_UNUSED(try_huge_pages);
+		return static_cast<char*>(std::malloc(slab_bytes));
+#endif
+	}
+
+	void unmap_slab(char* p)
+	{
+#if defined TORRENT_WINDOWS
+		VirtualFree(p, 0, MEM_RELEASE);
+#elif TORRENT_HAVE_MMAP
+		::munmap(p, slab_bytes);
+#else
+		std::free(p);
+#endif
+	}
+
+#ifdef TORRENT_LINUX
+	// MPOL_PREFERRED from <linux/mempolicy.h>
+	int const mpol_preferred = 1;
+
+	// the pages are allocated on first touch, which may happen in a
+	// different thread, running on a different node. Prefer the node of the
+	// arena, but fall back to any node if it's out of memory
+	void bind_to_node(char* p, int const node)
+	{
+		if (node >= int(sizeof(unsigned long) * 8)) return;
+		unsigned long const mask = 1ul << node;
+		::syscall(SYS_mbind, p, slab_bytes, mpol_preferred, &mask
+			, sizeof(mask) * 8, 0);
+	}
+
+	int num_numa_nodes()
+	{
+		// this is a range, like "0" or "0-3"
+		FILE* f = std::fopen("/sys/devices/system/node/possible", "r");
+		if (f == nullptr) return 1;
+		int first = 0;
+		int last = 0;
+		int const ret = std::fscanf(f, "%d-%d", &first, &last);
+		std::fclose(f);
+		if (ret < 2) return 1;
+		return std::max(1, std::min(last + 1, 64));
+	}
+
+	int current_numa_node()
+	{
+		// threads rarely migrate between nodes, don't ask for every
+		// allocation
+		thread_local int node = 0;
+		thread_local int countdown = 0;
+		if (countdown-- > 0) return node;
+		countdown = 1024;
+		unsigned cpu = 0;
+		unsigned n = 0;
+		if (::syscall(SYS_getcpu, &cpu, &n, nullptr) == 0) node = int(n);
+		return node;
+	}
+#else
+	void bind_to_node(char*, int) {}
+	int num_numa_nodes() { return 1; }
+	int current_numa_node() { return 0; }
+#endif
+
+	int thread_cache_index()
+	{
+		static std::atomic<int> next_index{0};
+		thread_local int const idx = next_index++ % slab_allocator::num_caches;
+		return idx;
+	}
+
+	char*& next_block(char* block)
+	{
+		return *reinterpret_cast<char**>(block);
+	}
+
+} // anonymous namespace
+
+	slab_allocator::slab_allocator(int const block_size)
+		: m_block_size(block_size)
+		, m_blocks_per_slab(slab_size / block_size)
+	{
+		TORRENT_ASSERT(block_size >= int(sizeof(char*)));
+		TORRENT_ASSERT(block_size <= slab_size);
+		int const nodes = num_numa_nodes();
+		for (int i = 0; i < nodes; ++i)
+		{
+			m_arenas.emplace_back(new arena);
+			m_arenas.back()->index = i;
+		}
+	}
+
+	slab_allocator::~slab_allocator()
+	{
+		// all blocks are expected to have been freed by now, but whether
+		// they have or not, the slabs are released
+		for (auto& s : m_slabs) unmap_slab(s->base);
+	}
+
+	void slab_allocator::set_huge_pages(bool const enable)
+	{
+		m_huge_pages = enable;
+	}
+
+	void slab_allocator::set_numa(bool const enable)
+	{
+		m_numa = enable;
+	}
+
+	void slab_allocator::set_slab_observer(slab_observer o)
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_observer = std::move(o);
+		if (!m_observer) return;
+		for (auto const& s : m_slabs) m_observer(s->base, slab_size, true);
+	}
+
+	slab_allocator::arena& slab_allocator::current_arena()
+	{
+		if (!m_numa || m_arenas.size() == 1) return *m_arenas.front();
+		return *m_arenas[std::size_t(current_numa_node()) % m_arenas.size()];
+	}
+
+	char* slab_allocator::allocate()
+	{
+#ifdef TORRENT_ADDRESS_SANITIZER
+		// allocate every block individually, to let the sanitizer catch use
+		// after free
+		return static_cast<char*>(std::malloc(std::size_t(m_block_size)));
+#else
+		arena& a = current_arena();
+		cache& c = a.caches[std::size_t(thread_cache_index())];
+		std::lock_guard<std::mutex> l(c.mutex);
+		if (c.size == 0 && !refill(a, c)) return nullptr;
+		return c.blocks[std::size_t(--c.size)];
+#endif
+	}
+
+	void slab_allocator::free(char* const block)
+	{
+		TORRENT_ASSERT(block != nullptr);
+#ifdef TORRENT_ADDRESS_SANITIZER
+		std::free(block);
+#else
+		// the block goes into the cache of the freeing thread, not the thread
+		// that allocated it. It's returned to its slab when the cache is
+		// flushed
+		cache& c = current_arena().caches[std::size_t(thread_cache_index())];
+		std::lock_guard<std::mutex> l(c.mutex);
+		if (c.size == cache_size) flush(c, cache_size / 2);
+		c.blocks[std::size_t(c.size++)] = block;
+#endif
+	}
+
+	bool slab_allocator::refill(arena& a, cache& c)
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		auto& partial = a.partial;
+		int const target = cache_size / 2;
+		while (c.size < target)
+		{
+			slab* s = nullptr;
+			if (partial.empty())
+			{
+				s = new_slab(a.index);
+				if (s == nullptr) return c.size > 0;
+				partial.push_back(s);
+			}
+			else
+			{
+				// prefer the fullest slab, to give the emptier ones a chance
+				// to become entirely free and be released
+				s = *std::min_element(partial.begin(), partial.end()
+					, [](slab const* lhs, slab const* rhs) { return lhs->num_free < rhs->num_free; });
+			}
+
+			while (c.size < target && s->num_free > 0)
+			{
+				char* block;
+				if (s->free_list != nullptr)
+				{
+					block = s->free_list;
+					s->free_list = next_block(block);
+				}
+				else
+				{
+					TORRENT_ASSERT(s->next_untouched < m_blocks_per_slab);
+					block = s->base + std::ptrdiff_t(s->next_untouched++) * m_block_size;
+				}
+				--s->num_free;
+				--m_free_slab_blocks;
+				c.blocks[std::size_t(c.size++)] = block;
+			}
+
+			if (s->num_free == 0)
+				partial.erase(std::find(partial.begin(), partial.end(), s));
+		}
+		return true;
+	}
+
+	void slab_allocator::flush(cache& c, int const count)
+	{
+		TORRENT_ASSERT(count <= c.size);
+		std::unique_lock<std::mutex> l(m_mutex);
+		for (int i = 0; i < count; ++i)
+		{
+			char* const block = c.blocks[std::size_t(i)];
+			slab* const s = find_slab(block);
+			TORRENT_ASSERT(s != nullptr);
+			TORRENT_ASSERT((block - s->base) % m_block_size == 0);
+
+			next_block(block) = s->free_list;
+			s->free_list = block;
+			++s->num_free;
+			++m_free_slab_blocks;
+
+			auto& partial = m_arenas[std::size_t(s->arena)]->partial;
+			if (s->num_free == 1)
+			{
+				partial.push_back(s);
+			}
+			else if (s->num_free == m_blocks_per_slab && partial.size() > 1)
+			{
+				// keep the last slab with free blocks around, to avoid
+				// mapping and unmapping a slab when the number of blocks in
+				// use hovers around a slab boundary
+				partial.erase(std::find(partial.begin(), partial.end(), s));
+				release_slab(s);
+			}
+		}
+		l.unlock();
+
+		// the most recently freed blocks are at the top of the cache, and
+		// are the most likely to still be in the CPU cache. Keep those
+		c.size -= count;
+		std::move(c.blocks.begin() + count, c.blocks.begin() + count + c.size
+			, c.blocks.begin());
+	}
+
+	slab_allocator::slab* slab_allocator::new_slab(int const arena_idx)
+	{
+		bool huge_pages = false;
+		char* const base = map_slab(m_huge_pages, huge_pages);
+		if (base == nullptr) return nullptr;
+		if (m_numa && m_arenas.size() > 1) bind_to_node(base, arena_idx);
+
+		auto s = std::make_unique<slab>();
+		s->base = base;
+		s->num_free = m_blocks_per_slab;
+		s->arena = arena_idx;
+		s->huge_pages = huge_pages;
+		slab* const ret = s.get();
+
+		auto const it = std::upper_bound(m_slabs.begin(), m_slabs.end(), base
+			, [](char const* b, std::unique_ptr<slab> const& e) { return b < e->base; });
+		m_slabs.insert(it, std::move(s));
+
+		m_free_slab_blocks += m_blocks_per_slab;
+		if (huge_pages) ++m_huge_page_slabs;
+		if (m_observer) m_observer(base, slab_size, true);
+		return ret;
+	}
+
+	void slab_allocator::release_slab(slab* const s)
+	{
+		TORRENT_ASSERT(s->num_free == m_blocks_per_slab);
+		auto const it = std::lower_bound(m_slabs.begin(), m_slabs.end(), s->base
+			, [](std::unique_ptr<slab> const& e, char const* b) { return e->base < b; });
+		TORRENT_ASSERT(it != m_slabs.end() && it->get() == s);
+
+		m_free_slab_blocks -= m_blocks_per_slab;
+		if (s->huge_pages) --m_huge_page_slabs;
+		if (m_observer) m_observer(s->base, slab_size, false);
+		unmap_slab(s->base);
+		m_slabs.erase(it);
+	}
+
+	slab_allocator::slab* slab_allocator::find_slab(char const* block) const
+	{
+		// the last slab whose base address is not greater than the block
+		auto it = std::upper_bound(m_slabs.begin(), m_slabs.end(), block
+			, [](char const* b, std::unique_ptr<slab> const& e) { return b < e->base; });
+		if (it == m_slabs.begin()) return nullptr;
+		--it;
+		if (block >= (*it)->base + slab_size) return nullptr;
+		return it->get();
+	}
+
+	slab_allocator::stats_t slab_allocator::stats() const
+	{
+		stats_t ret;
+		for (auto const& a : m_arenas)
+		{
+			for (auto& c : a->caches)
+			{
+				std::lock_guard<std::mutex> l(c.mutex);
+				ret.cached_blocks += c.size;
+			}
+		}
+
+		std::lock_guard<std::mutex> l(m_mutex);
+		ret.slabs = int(m_slabs.size());
+		ret.huge_page_slabs = m_huge_page_slabs;
+		ret.free_slab_blocks = m_free_slab_blocks;
+		return ret;
+	}
+}
@@ -185,7 +185,6 @@ bool is_downloading_state(int const st)
 		, m_added_time(p.added_time ? p.added_time : aux::posix_time())
 		, m_completed_time(p.completed_time)
 		, m_last_seen_complete(p.last_seen_complete)
-		, m_swarm_last_seen_complete(p.last_seen_complete)
 		, m_info_hash(p.info_hashes)
 		, m_comment(p.comment)
 		, m_created_by(p.created_by)
@@ -538,6 +537,7 @@ bool is_downloading_state(int const st)
 #endif
 
 		update_want_tick();
+		schedule_housekeeping();
 
 		// Some of these calls may log to the torrent debug log, which requires a
 		// call to get_handle(), which requires the torrent object to be fully
@@ -1000,6 +1000,7 @@ bool is_downloading_state(int const st)
 			}
 			// this is used to try leaving upload only mode periodically
 			m_upload_mode_time = aux::time_now32();
+			schedule_housekeeping();
 		}
 		else if (m_peer_list)
 		{
@@ -1023,7 +1024,16 @@ bool is_downloading_state(int const st)
 	void torrent::need_peer_list()
 	{
 		if (m_peer_list) return;
-		m_peer_list = std::make_unique<peer_list>(m_ses.get_peer_allocator());
+		if (settings().get_bool(settings_pack::compact_peer_storage))
+		{
+			m_peer_storage = std::make_unique<aux::torrent_peer_slab_allocator>();
+			m_peer_list = std::make_unique<peer_list>(*m_peer_storage);
+		}
+		else
+		{
+			m_peer_list = std::make_unique<peer_list>(m_ses.get_peer_allocator());
+		}
+		m_peer_list->set_hash_index(settings().get_bool(settings_pack::hashed_peer_list));
 	}
 
 	void torrent::handle_exception()
@@ -1282,6 +1292,8 @@ bool is_downloading_state(int const st)
 
 		auto pp = std::make_unique<piece_picker>(m_torrent_file->total_size()
 			, m_torrent_file->piece_length());
+		pp->set_incremental_availability(
+			settings().get_bool(settings_pack::incremental_piece_availability));
 
 		if (m_have_all) pp->we_have_all();
 
@@ -4093,21 +4105,19 @@ namespace {
 			- std::int64_t(pc.pad_bytes);
 	}
 
-	// fills in total_wanted, total_wanted_done and total_done
 // TODO: 3 this could probably be pulled out into a free function
-	void torrent::bytes_done(torrent_status& st, status_flags_t const flags) const
+	torrent::byte_counts torrent::bytes_done(status_flags_t const flags) const
 	{
 		INVARIANT_CHECK;
 
-		st.total_done = 0;
-		st.total_wanted_done = 0;
+		byte_counts st;
 		st.total_wanted = m_size_on_disk;
 
 		TORRENT_ASSERT(st.total_wanted <= m_torrent_file->total_size());
 		TORRENT_ASSERT(st.total_wanted >= 0);
 
 		TORRENT_ASSERT(!valid_metadata() || m_torrent_file->num_pieces() > 0);
-		if (!valid_metadata()) return;
+		if (!valid_metadata()) return st;
 
 		if (m_seed_mode || is_seed())
 		{
@@ -4120,14 +4130,14 @@ namespace {
 			TORRENT_ASSERT(st.total_wanted <= st.total_done);
 			TORRENT_ASSERT(st.total_wanted_done <= st.total_wanted);
 			TORRENT_ASSERT(st.total_done <= m_torrent_file->total_size());
-			return;
+			return st;
 		}
 		else if (!has_picker())
 		{
 			st.total_done = 0;
 			st.total_wanted_done = 0;
 			st.total_wanted = m_size_on_disk;
-			return;
+			return st;
 		}
 
 		TORRENT_ASSERT(has_picker());
@@ -4150,7 +4160,7 @@ namespace {
 		TORRENT_ASSERT(st.total_done >= st.total_wanted_done);
 
 		// this is expensive, we might not want to do it all the time
-		if (!(flags & torrent_handle::query_accurate_download_counters)) return;
+		if (!(flags & torrent_handle::query_accurate_download_counters)) return st;
 
 		// to get higher accuracy of the download progress, include
 		// blocks from currently downloading pieces as well
@@ -4179,6 +4189,7 @@ namespace {
 
 		TORRENT_ASSERT(st.total_wanted_done >= 0);
 		TORRENT_ASSERT(st.total_done >= st.total_wanted_done);
+		return st;
 	}
 
 	void torrent::on_piece_verified(aux::vector<sha256_hash> block_hashes
@@ -9176,7 +9187,8 @@ namespace {
 #ifdef TORRENT_EXPENSIVE_INVARIANT_CHECKS
 		// make sure we haven't modified the peer object
 		// in a way that breaks the sort order
-		if (m_peer_list && m_peer_list->begin() != m_peer_list->end())
+		if (m_peer_list && !m_peer_list->hash_index()
+			&& m_peer_list->begin() != m_peer_list->end())
 		{
 			auto i = m_peer_list->begin();
 			auto p = i++;
@@ -9478,6 +9490,7 @@ namespace {
 		update_gauge();
 		update_want_scrape();
 		update_state_list();
+		schedule_housekeeping();
 
 		state_updated();
 
@@ -10331,15 +10344,6 @@ namespace {
 		if (m_abort) return;
 #endif
 
-		// if we're in upload only mode and we're auto-managed
-		// leave upload mode every 10 minutes hoping that the error
-		// condition has been fixed
-		if (m_upload_mode && m_auto_managed && upload_mode_time() >=
-			seconds(settings().get_int(settings_pack::optimistic_disk_retry)))
-		{
-			set_upload_mode(false);
-		}
-
 		if (is_paused() && !m_graceful_pause_mode)
 		{
 			// let the stats fade out to 0
@@ -10413,14 +10417,10 @@ namespace {
 
 		maybe_connect_web_seeds();
 
-		m_swarm_last_seen_complete = m_last_seen_complete;
 		for (auto* p : m_connections)
 		{
 			TORRENT_INCREMENT(m_iterating_connections);
 
-			// look for the peer that saw a seed most recently
-			m_swarm_last_seen_complete = std::max(p->last_seen_complete(), m_swarm_last_seen_complete);
-
 			// updates the peer connection's ul/dl bandwidth
 			// resource requests
 			p->second_tick(tick_interval_ms);
@@ -10504,6 +10504,48 @@ namespace {
 		{ return (val <= 0) ? def_val : val; }
 	}
 
+	void torrent::on_housekeeping(time_point const at)
+	{
+		TORRENT_ASSERT(is_single_thread());
+
+		// we may have asked for an earlier time since this one was scheduled
+		if (at != m_housekeeping_at) return;
+		m_housekeeping_at = time_point::max();
+		if (m_abort) return;
+
+		auto self = shared_from_this();
+
+		// if we're in upload only mode and we're auto-managed
+		// leave upload mode every 10 minutes hoping that the error
+		// condition has been fixed
+		if (m_upload_mode && m_auto_managed && upload_mode_time() >=
+			seconds(settings().get_int(settings_pack::optimistic_disk_retry)))
+		{
+			set_upload_mode(false);
+		}
+
+		schedule_housekeeping();
+	}
+
+	void torrent::schedule_housekeeping()
+	{
+		if (m_abort) return;
+
+		time_point at = time_point::max();
+		if (m_upload_mode && m_auto_managed)
+		{
+			at = aux::time_now() + seconds(settings().get_int(settings_pack::optimistic_disk_retry))
+				- upload_mode_time();
+		}
+
+		// housekeeping is done with one second granularity
+		at = std::max(at, aux::time_now() + seconds(1));
+		if (at >= m_housekeeping_at) return;
+
+		m_housekeeping_at = at;
+		m_ses.schedule_housekeeping(shared_from_this(), at);
+	}
+
 	void torrent::maybe_connect_web_seeds()
 	{
 		if (m_abort) return;
@@ -11462,7 +11504,7 @@ namespace {
 		update_want_peers();
 	}
 
-	std::pair<peer_list::iterator, peer_list::iterator> torrent::find_peers(address const& a)
+	std::vector<torrent_peer*> torrent::find_peers(address const& a)
 	{
 		need_peer_list();
 		return m_peer_list->find_peers(a);
@@ -11769,6 +11811,7 @@ namespace {
 	void torrent::new_external_ip()
 	{
 		if (m_peer_list) m_peer_list->clear_peer_prio();
+		for (auto* p : m_connections) p->clear_peer_rank();
 	}
 
 	void torrent::stop_when_ready(bool const b)
@@ -12028,7 +12071,11 @@ namespace {
 #endif
 #endif
 		st->has_metadata = valid_metadata();
-		bytes_done(*st, flags);
+		byte_counts const bytes = bytes_done(flags);
+		st->total_done = bytes.total_done;
+		st->total_wanted_done = bytes.total_wanted_done;
+		st->total_wanted = bytes.total_wanted;
+		st->total = bytes.total;
 		TORRENT_ASSERT(st->total_wanted_done >= 0);
 		TORRENT_ASSERT(st->total_done >= st->total_wanted_done);
 
@@ -12133,40 +12180,20 @@ namespace {
 		}
 #endif
 
+		st->progress_ppm = progress_ppm(bytes);
+#if !TORRENT_NO_FPU
+		st->progress = float(st->progress_ppm) / 1000000.f;
+#endif
+
 		if (!valid_metadata())
 		{
 			st->state = torrent_status::downloading_metadata;
-			st->progress_ppm = m_progress_ppm;
-#if !TORRENT_NO_FPU
-			st->progress = m_progress_ppm / 1000000.f;
-#endif
 			st->block_size = 0;
 			return;
 		}
 
 		st->block_size = block_size();
 
-		if (m_state == torrent_status::checking_files)
-		{
-			st->progress_ppm = m_progress_ppm;
-#if !TORRENT_NO_FPU
-			st->progress = m_progress_ppm / 1000000.f;
-#endif
-		}
-		else if (st->total_wanted == 0)
-		{
-			st->progress_ppm = 1000000;
-			st->progress = 1.f;
-		}
-		else
-		{
-			st->progress_ppm = int(st->total_wanted_done * 1000000
-				/ st->total_wanted);
-#if !TORRENT_NO_FPU
-			st->progress = float(st->progress_ppm) / 1000000.f;
-#endif
-		}
-
 		if (flags & torrent_handle::query_pieces)
 		{
 			int const num_pieces = m_torrent_file->num_pieces();
@@ -12226,7 +12253,94 @@ namespace {
 			st->distributed_copies = -1.f;
 		}
 
-		st->last_seen_complete = m_swarm_last_seen_complete;
+		st->last_seen_complete = m_last_seen_complete;
+		if (flags & torrent_handle::query_last_seen_complete)
+		{
+			// look for the peer that saw a seed most recently
+			for (auto const* p : m_connections)
+			{
+				TORRENT_INCREMENT(m_iterating_connections);
+				st->last_seen_complete = std::max(p->last_seen_complete(), st->last_seen_complete);
+			}
+		}
+	}
+
+	int torrent::progress_ppm(byte_counts const& bytes) const
+	{
+		if (!valid_metadata() || m_state == torrent_status::checking_files)
+			return int(m_progress_ppm);
+		if (bytes.total_wanted == 0) return 1000000;
+		return int(bytes.total_wanted_done * 1000000 / bytes.total_wanted);
+	}
+
+	void torrent::status_delta(torrent_status_deltas& d)
+	{
+		INVARIANT_CHECK;
+
+		// the byte counters don't include query_accurate_download_counters,
+		// to avoid walking the download queue. They only count whole pieces
+		byte_counts const bytes = bytes_done({});
+
+		status_snapshot cur;
+		cur.state = valid_metadata() ? static_cast<torrent_status::state_t>(m_state)
+			: torrent_status::downloading_metadata;
+		cur.flags = this->flags();
+		cur.errc = m_error;
+		cur.progress_ppm = progress_ppm(bytes);
+		cur.total_done = bytes.total_done;
+		cur.total_wanted_done = bytes.total_wanted_done;
+		cur.total_wanted = bytes.total_wanted;
+		cur.all_time_upload = m_total_uploaded;
+		cur.all_time_download = m_total_downloaded;
+		cur.download_payload_rate = m_stat.download_payload_rate();
+		cur.upload_payload_rate = m_stat.upload_payload_rate();
+		cur.num_peers = num_peers() - m_num_connecting;
+		cur.num_seeds = num_seeds();
+
+		status_fields_t changed{};
+		if (!m_last_delta)
+		{
+			// the first delta reports every field
+			changed = status_fields_t::all();
+			m_last_delta = std::make_unique<status_snapshot>(cur);
+		}
+		else
+		{
+			status_snapshot const& last = *m_last_delta;
+#define TORRENT_DELTA_FIELD(f) if (cur.f != last.f) changed |= status_field::f
+			TORRENT_DELTA_FIELD(state);
+			TORRENT_DELTA_FIELD(flags);
+			TORRENT_DELTA_FIELD(errc);
+			TORRENT_DELTA_FIELD(progress_ppm);
+			TORRENT_DELTA_FIELD(total_done);
+			TORRENT_DELTA_FIELD(total_wanted_done);
+			TORRENT_DELTA_FIELD(total_wanted);
+			TORRENT_DELTA_FIELD(all_time_upload);
+			TORRENT_DELTA_FIELD(all_time_download);
+			TORRENT_DELTA_FIELD(download_payload_rate);
+			TORRENT_DELTA_FIELD(upload_payload_rate);
+			TORRENT_DELTA_FIELD(num_peers);
+			TORRENT_DELTA_FIELD(num_seeds);
+#undef TORRENT_DELTA_FIELD
+			if (!changed) return;
+			*m_last_delta = cur;
+		}
+
+		d.handles.push_back(get_handle());
+		d.changed.push_back(changed);
+		d.state.push_back(cur.state);
+		d.flags.push_back(cur.flags);
+		d.errc.push_back(cur.errc);
+		d.progress_ppm.push_back(cur.progress_ppm);
+		d.total_done.push_back(cur.total_done);
+		d.total_wanted_done.push_back(cur.total_wanted_done);
+		d.total_wanted.push_back(cur.total_wanted);
+		d.all_time_upload.push_back(cur.all_time_upload);
+		d.all_time_download.push_back(cur.all_time_download);
+		d.download_payload_rate.push_back(cur.download_payload_rate);
+		d.upload_payload_rate.push_back(cur.upload_payload_rate);
+		d.num_peers.push_back(cur.num_peers);
+		d.num_seeds.push_back(cur.num_seeds);
 	}
 
 	int torrent::priority() const
@@ -164,12 +164,9 @@ namespace libtorrent::aux {
 	std::uint32_t torrent_peer::rank(aux::external_ip const& external, int external_port) const
 	{
 		TORRENT_ASSERT(in_use);
-		//TODO: how do we deal with our external address changing?
-		if (peer_rank == 0)
-			peer_rank = peer_priority(
-				tcp::endpoint(external.external_address(this->address()), std::uint16_t(external_port))
-				, tcp::endpoint(this->address(), this->port));
-		return peer_rank;
+		return peer_priority(
+			tcp::endpoint(external.external_address(this->address()), std::uint16_t(external_port))
+			, tcp::endpoint(this->address(), this->port));
 	}
 
 #ifndef TORRENT_DISABLE_LOGGING
@@ -14,56 +14,30 @@ see LICENSE file.
 #include "libtorrent/assert.hpp"
 #include "libtorrent/aux_/torrent_peer_allocator.hpp"
 
+#include <algorithm>
+#include <new>
+
 namespace libtorrent::aux {
 
 	torrent_peer* torrent_peer_allocator::allocate_peer_entry(int type)
 	{
 		TORRENT_ASSERT(m_in_use);
-		torrent_peer* p = nullptr;
 		switch(type)
 		{
 			case torrent_peer_allocator_interface::ipv4_peer_type:
-				p = static_cast<torrent_peer*>(m_ipv4_peer_pool.malloc());
-				if (p == nullptr) return nullptr;
-				m_ipv4_peer_pool.set_next_size(500);
-				m_total_bytes += sizeof(ipv4_peer);
-				m_live_bytes += sizeof(ipv4_peer);
-				++m_live_allocations;
-				++m_total_allocations;
-				break;
+				return allocate(m_ipv4_peer_pool, int(sizeof(ipv4_peer)));
 			case torrent_peer_allocator_interface::ipv6_peer_type:
-				p = static_cast<torrent_peer*>(m_ipv6_peer_pool.malloc());
-				if (p == nullptr) return nullptr;
-				m_ipv6_peer_pool.set_next_size(500);
-				m_total_bytes += sizeof(ipv6_peer);
-				m_live_bytes += sizeof(ipv6_peer);
-				++m_live_allocations;
-				++m_total_allocations;
-				break;
+				return allocate(m_ipv6_peer_pool, int(sizeof(ipv6_peer)));
 #if TORRENT_USE_I2P
 			case torrent_peer_allocator_interface::i2p_peer_type:
-				p = static_cast<torrent_peer*>(m_i2p_peer_pool.malloc());
-				if (p == nullptr) return nullptr;
-				m_i2p_peer_pool.set_next_size(500);
-				m_total_bytes += sizeof(i2p_peer);
-				m_live_bytes += sizeof(i2p_peer);
-				++m_live_allocations;
-				++m_total_allocations;
-				break;
+				return allocate(m_i2p_peer_pool, int(sizeof(i2p_peer)));
 #endif
 #if TORRENT_USE_RTC
-            case torrent_peer_allocator_interface::rtc_peer_type:
-                p = static_cast<torrent_peer*>(m_rtc_peer_pool.malloc());
-                if (p == nullptr) return nullptr;
-                m_rtc_peer_pool.set_next_size(500);
-                m_total_bytes += sizeof(rtc_peer);
-                m_live_bytes += sizeof(rtc_peer);
-                ++m_live_allocations;
-                ++m_total_allocations;
-                break;
+			case torrent_peer_allocator_interface::rtc_peer_type:
+				return allocate(m_rtc_peer_pool, int(sizeof(rtc_peer)));
 #endif
 		}
-		return p;
+		return nullptr;
 	}
 
 	void torrent_peer_allocator::free_peer_entry(torrent_peer* p)
@@ -72,48 +46,232 @@ namespace libtorrent::aux {
 		TORRENT_ASSERT(p->in_use);
 		if (p->is_v6_addr)
 		{
-			TORRENT_ASSERT(m_ipv6_peer_pool.is_from(static_cast<ipv6_peer*>(p)));
 			static_cast<ipv6_peer*>(p)->~ipv6_peer();
-			m_ipv6_peer_pool.free(p);
-			TORRENT_ASSERT(m_live_bytes >= int(sizeof(ipv6_peer)));
-			m_live_bytes -= int(sizeof(ipv6_peer));
-			TORRENT_ASSERT(m_live_allocations > 0);
-			--m_live_allocations;
+			free(m_ipv6_peer_pool, p, int(sizeof(ipv6_peer)));
 			return;
 		}
 #if TORRENT_USE_I2P
 		if (p->is_i2p_addr)
 		{
-			TORRENT_ASSERT(m_i2p_peer_pool.is_from(static_cast<i2p_peer*>(p)));
 			static_cast<i2p_peer*>(p)->~i2p_peer();
-			m_i2p_peer_pool.free(p);
-			TORRENT_ASSERT(m_live_bytes >= int(sizeof(i2p_peer)));
-			m_live_bytes -= int(sizeof(i2p_peer));
-			TORRENT_ASSERT(m_live_allocations > 0);
-			--m_live_allocations;
+			free(m_i2p_peer_pool, p, int(sizeof(i2p_peer)));
 			return;
 		}
 #endif
 #if TORRENT_USE_RTC
-        if (p->is_rtc_addr)
-        {
-            TORRENT_ASSERT(m_rtc_peer_pool.is_from(static_cast<rtc_peer*>(p)));
-            static_cast<rtc_peer*>(p)->~rtc_peer();
-            m_rtc_peer_pool.free(p);
-            TORRENT_ASSERT(m_live_bytes >= int(sizeof(rtc_peer)));
-            m_live_bytes -= int(sizeof(rtc_peer));
-            TORRENT_ASSERT(m_live_allocations > 0);
-            --m_live_allocations;
-            return;
-        }
+		if (p->is_rtc_addr)
+		{
+			static_cast<rtc_peer*>(p)->~rtc_peer();
+			free(m_rtc_peer_pool, p, int(sizeof(rtc_peer)));
+			return;
+		}
 #endif
-		TORRENT_ASSERT(m_ipv4_peer_pool.is_from(static_cast<ipv4_peer*>(p)));
 		static_cast<ipv4_peer*>(p)->~ipv4_peer();
-		m_ipv4_peer_pool.free(p);
-		TORRENT_ASSERT(m_live_bytes >= int(sizeof(ipv4_peer)));
-		m_live_bytes -= int(sizeof(ipv4_peer));
+		free(m_ipv4_peer_pool, p, int(sizeof(ipv4_peer)));
+	}
+
+	torrent_peer* torrent_peer_allocator::allocate(aux::pool& pool, int const size)
+	{
+		char* const chunk = static_cast<char*>(pool.malloc());
+		if (chunk == nullptr) return nullptr;
+		pool.set_next_size(500);
+		auto* p = reinterpret_cast<torrent_peer*>(chunk + rank_slot_size);
+		rank_slot(p) = 0;
+		int const bytes = rank_slot_size + size;
+		m_total_bytes += std::uint64_t(bytes);
+		m_live_bytes += bytes;
+		++m_live_allocations;
+		++m_total_allocations;
+		return p;
+	}
+
+	void torrent_peer_allocator::free(aux::pool& pool, torrent_peer* p, int const size)
+	{
+		char* const chunk = reinterpret_cast<char*>(p) - rank_slot_size;
+		TORRENT_ASSERT(pool.is_from(chunk));
+		pool.free(chunk);
+		int const bytes = rank_slot_size + size;
+		TORRENT_ASSERT(m_live_bytes >= bytes);
+		m_live_bytes -= bytes;
+		TORRENT_ASSERT(m_live_allocations > 0);
+		--m_live_allocations;
+	}
+
+	namespace {
+
+	// slabs are aligned to cache lines
+	std::size_t const slab_alignment = 64;
+
+	std::uint32_t& next_entry(void* entry)
+	{
+		return *static_cast<std::uint32_t*>(entry);
+	}
+
+	}
+
+	torrent_peer_slab_allocator::torrent_peer_slab_allocator()
+	{
+		m_pools[ipv4_peer_type].entry_size = int(sizeof(ipv4_peer));
+		m_pools[ipv6_peer_type].entry_size = int(sizeof(ipv6_peer));
+#if TORRENT_USE_I2P
+		m_pools[i2p_peer_type].entry_size = int(sizeof(i2p_peer));
+#endif
+#if TORRENT_USE_RTC
+		m_pools[rtc_peer_type].entry_size = int(sizeof(rtc_peer));
+#endif
+	}
+
+	torrent_peer_slab_allocator::~torrent_peer_slab_allocator()
+	{
+		// all peers are expected to have been freed by the peer_list by now
+		TORRENT_ASSERT(m_live_allocations == 0);
+		for (auto& pool : m_pools)
+		{
+			for (auto& s : pool.slabs)
+				::operator delete(s->base, std::align_val_t(slab_alignment));
+		}
+	}
+
+	torrent_peer* torrent_peer_slab_allocator::allocate_peer_entry(int const type)
+	{
+		TORRENT_ASSERT(type >= 0 && type < int(m_pools.size()));
+		peer_pool& pool = m_pools[std::size_t(type)];
+		// this peer type is not supported in this build
+		if (pool.entry_size == 0) return nullptr;
+		void* const ret = allocate(pool);
+		if (ret == nullptr) return nullptr;
+		m_total_bytes += std::uint64_t(pool.entry_size);
+		m_live_bytes += pool.entry_size;
+		++m_live_allocations;
+		++m_total_allocations;
+		return static_cast<torrent_peer*>(ret);
+	}
+
+	void torrent_peer_slab_allocator::free_peer_entry(torrent_peer* p)
+	{
+		TORRENT_ASSERT(p->in_use);
+		int type = ipv4_peer_type;
+		if (p->is_v6_addr)
+		{
+			type = ipv6_peer_type;
+			static_cast<ipv6_peer*>(p)->~ipv6_peer();
+		}
+#if TORRENT_USE_I2P
+		else if (p->is_i2p_addr)
+		{
+			type = i2p_peer_type;
+			static_cast<i2p_peer*>(p)->~i2p_peer();
+		}
+#endif
+#if TORRENT_USE_RTC
+		else if (p->is_rtc_addr)
+		{
+			type = rtc_peer_type;
+			static_cast<rtc_peer*>(p)->~rtc_peer();
+		}
+#endif
+		else
+		{
+			static_cast<ipv4_peer*>(p)->~ipv4_peer();
+		}
+
+		peer_pool& pool = m_pools[std::size_t(type)];
+		free(pool, p);
+		TORRENT_ASSERT(m_live_bytes >= pool.entry_size);
+		m_live_bytes -= pool.entry_size;
 		TORRENT_ASSERT(m_live_allocations > 0);
 		--m_live_allocations;
 	}
 
+	void* torrent_peer_slab_allocator::allocate(peer_pool& pool)
+	{
+		if (pool.partial.empty())
+		{
+			slab* const s = new_slab(pool);
+			if (s == nullptr) return nullptr;
+			pool.partial.push_back(s);
+		}
+
+		// allocating from the most recently used slab is most likely to
+		// touch memory that's already in the CPU cache
+		slab* const s = pool.partial.back();
+		TORRENT_ASSERT(s->num_free > 0);
+		char* entry;
+		if (s->free_list != 0xffffffff)
+		{
+			entry = s->base + std::ptrdiff_t(s->free_list) * pool.entry_size;
+			s->free_list = next_entry(entry);
+		}
+		else
+		{
+			TORRENT_ASSERT(s->next_untouched < s->num_entries);
+			entry = s->base + std::ptrdiff_t(s->next_untouched++) * pool.entry_size;
+		}
+		if (--s->num_free == 0) pool.partial.pop_back();
+		return entry;
+	}
+
+	void torrent_peer_slab_allocator::free(peer_pool& pool, void* const entry)
+	{
+		char* const e = static_cast<char*>(entry);
+
+		// the last slab whose base address is not greater than the entry
+		auto it = std::upper_bound(pool.slabs.begin(), pool.slabs.end(), e
+			, [](char const* b, std::unique_ptr<slab> const& sl) { return b < sl->base; });
+		TORRENT_ASSERT(it != pool.slabs.begin());
+		slab* const s = std::prev(it)->get();
+		TORRENT_ASSERT(e < s->base + std::ptrdiff_t(s->num_entries) * pool.entry_size);
+		TORRENT_ASSERT((e - s->base) % pool.entry_size == 0);
+
+		next_entry(e) = s->free_list;
+		s->free_list = std::uint32_t((e - s->base) / pool.entry_size);
+		++s->num_free;
+
+		if (s->num_free == 1)
+		{
+			pool.partial.push_back(s);
+		}
+		else if (s->num_free == s->num_entries && pool.partial.size() > 1)
+		{
+			// keep the last slab with free entries around, to avoid
+			// allocating and releasing a slab when the number of peers
+			// hovers around a slab boundary
+			pool.partial.erase(std::find(pool.partial.begin(), pool.partial.end(), s));
+			release_slab(pool, s);
+		}
+	}
+
+	torrent_peer_slab_allocator::slab* torrent_peer_slab_allocator::new_slab(peer_pool& pool)
+	{
+		int const entries = pool.next_slab_entries;
+		std::size_t const size = std::size_t(entries) * std::size_t(pool.entry_size);
+		auto* const base = static_cast<char*>(::operator new(size
+			, std::align_val_t(slab_alignment), std::nothrow));
+		if (base == nullptr) return nullptr;
+		pool.next_slab_entries = std::min(entries * 2, int(max_slab_entries));
+
+		auto s = std::make_unique<slab>();
+		s->base = base;
+		s->num_entries = entries;
+		s->num_free = entries;
+		slab* const ret = s.get();
+
+		auto const it = std::upper_bound(pool.slabs.begin(), pool.slabs.end(), base
+			, [](char const* b, std::unique_ptr<slab> const& e) { return b < e->base; });
+		pool.slabs.insert(it, std::move(s));
+		m_reserved_bytes += int(size);
+		return ret;
+	}
+
+	void torrent_peer_slab_allocator::release_slab(peer_pool& pool, slab* const s)
+	{
+		TORRENT_ASSERT(s->num_free == s->num_entries);
+		auto const it = std::lower_bound(pool.slabs.begin(), pool.slabs.end(), s->base
+			, [](std::unique_ptr<slab> const& e, char const* b) { return e->base < b; });
+		TORRENT_ASSERT(it != pool.slabs.end() && it->get() == s);
+
+		m_reserved_bytes -= s->num_entries * pool.entry_size;
+		::operator delete(s->base, std::align_val_t(slab_alignment));
+		pool.slabs.erase(it);
+	}
 }
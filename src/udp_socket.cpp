@@ -28,7 +28,11 @@ see LICENSE file.
 #include "libtorrent/aux_/resolver_interface.hpp"
 
 #include <cstdlib>
+#include <cerrno>
+#include <cstring>
 #include <functional>
+#include <algorithm>
+#include <array>
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 #include <boost/asio/ip/v6_only.hpp>
@@ -39,6 +43,16 @@ see LICENSE file.
 #include <mstcpip.h>
 #endif
 
+#if TORRENT_HAS_RECVMMSG || TORRENT_HAS_SENDMMSG
+#include <sys/socket.h> // for recvmmsg, sendmmsg
+#include <sys/uio.h> // for iovec
+#endif
+
+#if TORRENT_HAS_SENDMMSG
+#include <netinet/in.h>
+#include <netinet/udp.h> // for UDP_SEGMENT
+#endif
+
 namespace libtorrent::aux {
 
 using namespace std::placeholders;
@@ -165,49 +179,91 @@ struct set_dont_frag
 udp_socket::udp_socket(io_context& ios, aux::listen_socket_handle ls)
 	: m_socket(ios)
 	, m_ioc(ios)
-	, m_buf(new receive_buffer())
+	, m_buf(new receive_buffer[max_read_packets])
 	, m_listen_socket(std::move(ls))
 	, m_bind_port(0)
 	, m_abort(true)
+	, m_batch_blocked(false)
+	, m_use_gso(true)
 {}
 
-int udp_socket::read(span<packet> pkts, error_code& ec)
+#if TORRENT_HAS_RECVMMSG
+int udp_socket::receive(span<packet> pkts, int const first_buf, error_code& ec)
 {
 	auto const num = int(pkts.size());
-	int ret = 0;
-	packet p;
+	TORRENT_ASSERT(num > 0);
+	TORRENT_ASSERT(first_buf + num <= max_read_packets);
 
-	while (ret < num)
+	std::array<::mmsghdr, max_read_packets> msgs;
+	std::array<::iovec, max_read_packets> iov;
+	for (int i = 0; i < num; ++i)
 	{
-		int const len = int(m_socket.receive_from(boost::asio::buffer(*m_buf)
-			, p.from, 0, ec));
+		pkts[i] = packet{};
+		receive_buffer& buf = m_buf[first_buf + i];
+		iov[i].iov_base = buf.data();
+		iov[i].iov_len = buf.size();
+		::msghdr& h = msgs[i].msg_hdr;
+		h = ::msghdr{};
+		h.msg_name = pkts[i].from.data();
+		h.msg_namelen = static_cast<socklen_t>(pkts[i].from.capacity());
+		h.msg_iov = &iov[i];
+		h.msg_iovlen = 1;
+	}
 
-		if (ec == error::would_block
-			|| ec == error::try_again
-			|| ec == error::operation_aborted
-			|| ec == error::bad_descriptor)
-		{
-			return ret;
-		}
+	int const ret = ::recvmmsg(m_socket.native_handle(), msgs.data()
+		, static_cast<unsigned int>(num), MSG_DONTWAIT, nullptr);
+	if (ret < 0)
+	{
+		ec.assign(errno, system_category());
+		return 0;
+	}
+	ec.clear();
 
-		if (ec == error::interrupted)
-		{
-			continue;
-		}
+	for (int i = 0; i < ret; ++i)
+	{
+		pkts[i].from.resize(msgs[i].msg_hdr.msg_namelen);
+		pkts[i].data = {m_buf[first_buf + i].data(), int(msgs[i].msg_len)};
+	}
+	return ret;
+}
+#else
+int udp_socket::receive(span<packet> pkts, int const first_buf, error_code& ec)
+{
+	TORRENT_ASSERT(!pkts.empty());
+	TORRENT_ASSERT(first_buf < max_read_packets);
+
+	// without recvmmsg(), we receive one packet per system call. read() will
+	// call us again to fill in more packets
+	packet& p = pkts[0];
+	p = packet{};
+	receive_buffer& buf = m_buf[first_buf];
+	int const len = int(m_socket.receive_from(boost::asio::buffer(buf)
+		, p.from, 0, ec));
+	if (ec) return 0;
+	p.data = {buf.data(), len};
+	return 1;
+}
+#endif
 
-		if (ec)
-		{
-			// SOCKS5 cannot wrap ICMP errors. And even if it could, they certainly
-			// would not arrive as unwrapped (regular) ICMP errors. If we're using
-			// a proxy we must ignore these
-			if (m_proxy_settings.type != settings_pack::none) continue;
+int udp_socket::read(span<packet> pkts, error_code& ec)
+{
+	auto const num = std::min(int(pkts.size()), int(max_read_packets));
+	int ret = 0;
 
-			p.error = ec;
-			p.data = span<char>();
-		}
-		else
+	// the next receive buffer to use. Packets that we ignore still use up
+	// their buffer until the next call to read()
+	int next_buf = 0;
+
+	while (ret < num && next_buf < max_read_packets)
+	{
+		int const received = receive(pkts.subspan(ret
+			, std::min(num - ret, max_read_packets - next_buf)), next_buf, ec);
+		next_buf += received;
+
+		int const end = ret + received;
+		for (int i = ret; i < end; ++i)
 		{
-			p.data = {m_buf->data(), len};
+			packet& p = pkts[i];
 
 			// support packets coming from the SOCKS5 proxy
 			if (active_socks5())
@@ -230,15 +286,39 @@ int udp_socket::read(span<packet> pkts, error_code& ec)
 				// the proxy
 				if (m_proxy_settings.type != settings_pack::none && proxy_only) continue;
 			}
+
+			if (i != ret) pkts[ret] = p;
+			++ret;
 		}
 
-		pkts[ret] = p;
-		++ret;
+		if (ec == error::would_block
+			|| ec == error::try_again
+			|| ec == error::operation_aborted
+			|| ec == error::bad_descriptor)
+		{
+			return ret;
+		}
+
+		if (ec == error::interrupted)
+		{
+			continue;
+		}
 
-		// we only have a single buffer for now, so we can only return a
-		// single packet. In the future though, we could attempt to drain
-		// the socket here, or maybe even use recvmmsg()
-		break;
+		if (ec)
+		{
+			// SOCKS5 cannot wrap ICMP errors. And even if it could, they certainly
+			// would not arrive as unwrapped (regular) ICMP errors. If we're using
+			// a proxy we must ignore these
+			if (m_proxy_settings.type != settings_pack::none) continue;
+
+			// the error is reported as a packet (as well as via ec), after
+			// all the packets received before it
+			packet& p = pkts[ret];
+			p.error = ec;
+			p.data = span<char>();
+			++ret;
+			break;
+		}
 	}
 
 	return ret;
@@ -249,6 +329,16 @@ bool udp_socket::active_socks5() const
 	return (m_socks5_connection && m_socks5_connection->active());
 }
 
+bool udp_socket::use_proxy(udp_send_flags_t const flags) const
+{
+	if (m_proxy_settings.type == settings_pack::none) return false;
+
+	return ((flags & peer_connection) && m_proxy_settings.proxy_peer_connections)
+		|| ((flags & tracker_connection) && m_proxy_settings.proxy_tracker_connections)
+		|| !(flags & (tracker_connection | peer_connection))
+		;
+}
+
 void udp_socket::send_hostname(char const* hostname, int const port
 	, span<char const> p, error_code& ec, udp_send_flags_t const flags)
 {
@@ -261,13 +351,7 @@ void udp_socket::send_hostname(char const* hostname, int const port
 		return;
 	}
 
-	bool const use_proxy
-		= ((flags & peer_connection) && m_proxy_settings.proxy_peer_connections)
-		|| ((flags & tracker_connection) && m_proxy_settings.proxy_tracker_connections)
-		|| !(flags & (tracker_connection | peer_connection))
-		;
-
-	if (use_proxy && m_proxy_settings.type != settings_pack::none)
+	if (use_proxy(flags))
 	{
 		if (active_socks5())
 		{
@@ -299,13 +383,7 @@ void udp_socket::send(udp::endpoint const& ep, span<char const> p
 		return;
 	}
 
-	bool const use_proxy
-		= ((flags & peer_connection) && m_proxy_settings.proxy_peer_connections)
-		|| ((flags & tracker_connection) && m_proxy_settings.proxy_tracker_connections)
-		|| !(flags & (tracker_connection | peer_connection))
-		;
-
-	if (use_proxy && m_proxy_settings.type != settings_pack::none)
+	if (use_proxy(flags))
 	{
 		if (active_socks5())
 		{
@@ -319,6 +397,21 @@ void udp_socket::send(udp::endpoint const& ep, span<char const> p
 		return;
 	}
 
+	if ((flags & batch) && !(flags & dont_fragment)
+		&& p.size() <= max_batch_packet_size)
+	{
+		queue_packet(ep, p, ec);
+		return;
+	}
+
+	// packets that are sent immediately must not overtake the ones
+	// already in the queue
+	if (has_batch())
+	{
+		flush_batch(ec);
+		if (ec) return;
+	}
+
 	// set the DF flag for the socket and clear it again in the destructor
 	set_dont_frag df(m_socket, (flags & dont_fragment)
 		&& aux::is_v4(ep));
@@ -326,6 +419,184 @@ void udp_socket::send(udp::endpoint const& ep, span<char const> p
 	m_socket.send_to(boost::asio::buffer(p.data(), static_cast<std::size_t>(p.size())), ep, 0, ec);
 }
 
+void udp_socket::queue_packet(udp::endpoint const& ep, span<char const> p
+	, error_code& ec)
+{
+	if (m_batch_blocked)
+	{
+		ec = error::would_block;
+		return;
+	}
+
+	if (int(m_send_queue.size()) == max_batch_packets)
+	{
+		flush_batch(ec);
+		if (ec) return;
+	}
+
+	if (!m_send_buf)
+	{
+		m_send_buf.reset(new char[max_batch_packets * max_batch_packet_size]);
+		m_send_queue.reserve(max_batch_packets);
+	}
+
+	int const offset = m_send_queue.empty() ? 0
+		: m_send_queue.back().offset + m_send_queue.back().size;
+	TORRENT_ASSERT(offset + p.size() <= max_batch_packets * max_batch_packet_size);
+	std::memcpy(m_send_buf.get() + offset, p.data(), std::size_t(p.size()));
+	m_send_queue.push_back({ep, offset, int(p.size())});
+}
+
+void udp_socket::flush_batch(error_code& ec)
+{
+	TORRENT_ASSERT(is_single_thread());
+
+	ec.clear();
+	while (has_batch())
+	{
+		m_send_queue_head += send_queued(ec);
+		if (ec)
+		{
+			m_batch_blocked = true;
+			return;
+		}
+	}
+	m_send_queue.clear();
+	m_send_queue_head = 0;
+	m_batch_blocked = false;
+}
+
+#if TORRENT_HAS_SENDMMSG
+int udp_socket::send_queued(error_code& ec)
+{
+	auto const end = int(m_send_queue.size());
+
+	std::array<::mmsghdr, max_batch_packets> msgs;
+	std::array<::iovec, max_batch_packets> iov;
+	// the number of queued packets in each message
+	std::array<int, max_batch_packets> msg_packets;
+#ifdef UDP_SEGMENT
+	struct control_buffer
+	{
+		alignas(::cmsghdr) char buf[CMSG_SPACE(sizeof(std::uint16_t))];
+	};
+	std::array<control_buffer, max_batch_packets> control;
+
+	// the limits imposed by the kernel on a single GSO message
+	int const max_gso_segments = 64;
+	int const max_gso_bytes = 65000;
+#endif
+
+	int num_msgs = 0;
+	for (int i = m_send_queue_head; i < end;)
+	{
+		queued_packet const& qp = m_send_queue[std::size_t(i)];
+		int n = 1;
+		int bytes = qp.size;
+#ifdef UDP_SEGMENT
+		// coalesce runs of packets to the same endpoint into a single GSO
+		// message. The kernel splits it into segments of the size of the
+		// first packet, only the last one may be smaller
+		while (m_use_gso && i + n < end && n < max_gso_segments)
+		{
+			queued_packet const& next = m_send_queue[std::size_t(i + n)];
+			if (next.ep != qp.ep
+				|| next.size > qp.size
+				|| bytes + next.size > max_gso_bytes)
+				break;
+			bytes += next.size;
+			++n;
+			if (next.size < qp.size) break;
+		}
+#endif
+
+		// the packets are stored back to back in m_send_buf, so a run of
+		// them is a single buffer
+		iov[std::size_t(num_msgs)].iov_base = m_send_buf.get() + qp.offset;
+		iov[std::size_t(num_msgs)].iov_len = std::size_t(bytes);
+		::msghdr& h = msgs[std::size_t(num_msgs)].msg_hdr;
+		h = ::msghdr{};
+		h.msg_name = const_cast<sockaddr*>(qp.ep.data());
+		h.msg_namelen = static_cast<socklen_t>(qp.ep.size());
+		h.msg_iov = &iov[std::size_t(num_msgs)];
+		h.msg_iovlen = 1;
+#ifdef UDP_SEGMENT
+		if (n > 1)
+		{
+			h.msg_control = control[std::size_t(num_msgs)].buf;
+			h.msg_controllen = sizeof(control_buffer::buf);
+			::cmsghdr* cm = CMSG_FIRSTHDR(&h);
+			cm->cmsg_level = IPPROTO_UDP;
+			cm->cmsg_type = UDP_SEGMENT;
+			cm->cmsg_len = CMSG_LEN(sizeof(std::uint16_t));
+			auto const segment_size = static_cast<std::uint16_t>(qp.size);
+			std::memcpy(CMSG_DATA(cm), &segment_size, sizeof(segment_size));
+		}
+#endif
+		msg_packets[std::size_t(num_msgs)] = n;
+		++num_msgs;
+		i += n;
+	}
+
+	int ret = 0;
+	int msg = 0;
+	while (msg < num_msgs)
+	{
+		int const r = ::sendmmsg(m_socket.native_handle(), msgs.data() + msg
+			, static_cast<unsigned int>(num_msgs - msg), 0);
+		if (r < 0)
+		{
+			int const err = errno;
+			if (err == EINTR) continue;
+			if (err == EAGAIN || err == EWOULDBLOCK)
+			{
+				ec.assign(err, system_category());
+				return ret;
+			}
+#ifdef UDP_SEGMENT
+			if (msg_packets[std::size_t(msg)] > 1 && (err == EIO || err == EINVAL))
+			{
+				// the kernel or the network interface doesn't support GSO
+				// (EIO), or doesn't accept this segment size (EINVAL). The
+				// remaining packets will be sent without it
+				m_use_gso = false;
+				return ret;
+			}
+#endif
+			// any other error is specific to this message (e.g. its
+			// destination). We just drop the packets we failed to send, as if
+			// they had been lost
+			ret += msg_packets[std::size_t(msg)];
+			++msg;
+			continue;
+		}
+
+		for (int k = msg; k < msg + r; ++k)
+			ret += msg_packets[std::size_t(k)];
+		msg += r;
+	}
+	return ret;
+}
+#else
+int udp_socket::send_queued(error_code& ec)
+{
+	auto const end = int(m_send_queue.size());
+	int ret = 0;
+	for (int i = m_send_queue_head; i < end; ++i)
+	{
+		queued_packet const& qp = m_send_queue[std::size_t(i)];
+		m_socket.send_to(boost::asio::buffer(m_send_buf.get() + qp.offset
+			, std::size_t(qp.size)), qp.ep, 0, ec);
+		if (ec == error::would_block || ec == error::try_again)
+			return ret;
+		// any other error is treated as if the packet had been lost
+		ec.clear();
+		++ret;
+	}
+	return ret;
+}
+#endif
+
 void udp_socket::wrap(udp::endpoint const& ep, span<char const> p
 	, error_code& ec, udp_send_flags_t const flags)
 {
@@ -438,6 +709,9 @@ void udp_socket::close()
 	error_code ec;
 	m_socket.close(ec);
 	TORRENT_ASSERT_VAL(!ec || ec == error::bad_descriptor, ec);
+	m_send_queue.clear();
+	m_send_queue_head = 0;
+	m_batch_blocked = false;
 	if (m_socks5_connection)
 	{
 		m_socks5_connection->close();
@@ -35,6 +35,7 @@ namespace libtorrent::aux {
 		, void* ssl_context)
 		: m_send_fun(std::move(send_fun))
 		, m_cb(std::move(cb))
+		, m_utp_sockets(random(0xffffffff))
 		, m_sett(sett)
 		, m_counters(cnt)
 		, m_ios(ios)
@@ -47,18 +48,19 @@ namespace libtorrent::aux {
 
 	void utp_socket_manager::tick(time_point now)
 	{
-		for (auto i = m_utp_sockets.begin()
-			, end(m_utp_sockets.end()); i != end;)
+		m_tick_sockets.clear();
+		m_utp_sockets.for_each([&](utp_socket_impl* s) { m_tick_sockets.push_back(s); });
+
+		for (auto* s : m_tick_sockets)
 		{
-			if (i->second->should_delete())
+			if (s->should_delete())
 			{
-				if (m_last_socket == i->second.get()) m_last_socket = nullptr;
-				if (m_deferred_ack == i->second.get()) m_deferred_ack = nullptr;
-				i = m_utp_sockets.erase(i);
+				if (m_last_socket == s) m_last_socket = nullptr;
+				if (m_deferred_ack == s) m_deferred_ack = nullptr;
+				m_utp_sockets.remove(s->receive_id(), s->remote_endpoint(), s);
 				continue;
 			}
-			i->second->tick(now);
-			++i;
+			s->tick(now);
 		}
 	}
 
@@ -106,9 +108,13 @@ namespace libtorrent::aux {
 		if ((flags & dont_fragment) && len > TORRENT_DEBUG_MTU) return;
 #endif
 
+		// uTP packets are queued, and sent in batches once the current
+		// handler returns. MTU probes (with the dont_fragment flag) are sent
+		// immediately, since the caller needs to know if they fail
 		m_send_fun(std::move(sock), ep, {p, len}, ec
 			, (flags & udp_socket::dont_fragment)
-				| udp_socket::peer_connection);
+				| udp_socket::peer_connection
+				| udp_socket::batch);
 	}
 
 	bool utp_socket_manager::incoming_packet(std::weak_ptr<utp_socket_interface> socket
@@ -148,13 +154,10 @@ namespace libtorrent::aux {
 			m_deferred_ack = nullptr;
 		}
 
-		auto r = m_utp_sockets.equal_range(id);
-
-		for (; r.first != r.second; ++r.first)
+		if (utp_socket_impl* s = m_utp_sockets.find(id, ep))
 		{
-			if (!r.first->second->match(ep, id)) continue;
-			bool const ret = r.first->second->incoming_packet(p, ep, receive_time);
-			if (ret) m_last_socket = r.first->second.get();
+			bool const ret = s->incoming_packet(p, ep, receive_time);
+			if (ret) m_last_socket = s;
 			return ret;
 		}
 
@@ -168,7 +171,7 @@ namespace libtorrent::aux {
 		if (ph->get_type() == ST_SYN)
 		{
 			// possible SYN flood. Just ignore
-			if (int(m_utp_sockets.size()) > m_sett.get_int(settings_pack::connections_limit) * 2)
+			if (m_utp_sockets.size() > m_sett.get_int(settings_pack::connections_limit) * 2)
 				return false;
 
 			TORRENT_ASSERT(m_new_connection == -1);
@@ -269,22 +272,20 @@ namespace libtorrent::aux {
 	void utp_socket_manager::remove_udp_socket(std::weak_ptr<utp_socket_interface> sock)
 	{
 		auto iface = sock.lock();
-		for (auto& s : m_utp_sockets)
+		m_tick_sockets.clear();
+		m_utp_sockets.for_each([&](utp_socket_impl* s)
 		{
-			if (s.second->m_sock.lock() != iface)
-				continue;
+			if (s->m_sock.lock() == iface) m_tick_sockets.push_back(s);
+		});
 
-			s.second->abort();
-		}
+		for (auto* s : m_tick_sockets)
+			s->abort();
 	}
 
-	void utp_socket_manager::remove_socket(std::uint16_t const id)
+	void utp_socket_manager::rekey_socket(utp_socket_impl* s
+		, udp::endpoint const& old_ep, udp::endpoint const& new_ep)
 	{
-		auto const i = m_utp_sockets.find(id);
-		if (i == m_utp_sockets.end()) return;
-		if (m_last_socket == i->second.get()) m_last_socket = nullptr;
-		if (m_deferred_ack == i->second.get()) m_deferred_ack = nullptr;
-		m_utp_sockets.erase(i);
+		m_utp_sockets.rekey(s->receive_id(), old_ep, new_ep, s);
 	}
 
 	void utp_socket_manager::inc_stats_counter(int counter, int delta)
@@ -312,8 +313,7 @@ namespace libtorrent::aux {
 			recv_id = send_id - 1;
 		}
 		auto impl = std::make_unique<utp_socket_impl>(recv_id, send_id, str, *this);
-		auto* const ret = impl.get();
-		m_utp_sockets.emplace(recv_id, std::move(impl));
-		return ret;
+		udp::endpoint const ep = impl->remote_endpoint();
+		return m_utp_sockets.insert(recv_id, ep, std::move(impl));
 	}
 }
@@ -224,6 +224,15 @@ udp::endpoint utp_socket_impl::remote_endpoint() const
 	return {m_remote_address, m_port};
 }
 
+void utp_socket_impl::set_remote_endpoint(udp::endpoint const& ep)
+{
+	udp::endpoint const old_ep = remote_endpoint();
+	if (old_ep == ep) return;
+	m_remote_address = ep.address();
+	m_port = ep.port();
+	m_sm.rekey_socket(this, old_ep, ep);
+}
+
 void utp_socket_impl::send_deferred_ack()
 {
 	TORRENT_ASSERT(m_deferred_ack);
@@ -761,8 +770,7 @@ void utp_socket_impl::do_connect(tcp::endpoint const& ep)
 	int const mtu = m_sm.mtu_for_dest(ep.address());
 	init_mtu(mtu);
 	TORRENT_ASSERT(m_connect_handler == false);
-	m_remote_address = ep.address();
-	m_port = ep.port();
+	set_remote_endpoint(udp::endpoint(ep.address(), ep.port()));
 
 	m_connect_handler = true;
 
@@ -2516,8 +2524,7 @@ bool utp_socket_impl::incoming_packet(span<char const> b
 
 	if (state() == state_t::none && ph->get_type() == ST_SYN)
 	{
-		m_remote_address = ep.address();
-		m_port = ep.port();
+		set_remote_endpoint(ep);
 	}
 
 	if (state() != state_t::none && ph->get_type() == ST_SYN)
@@ -2864,8 +2871,7 @@ bool utp_socket_impl::incoming_packet(span<char const> b
 				// we accept are SYN packets.
 				set_state(state_t::connected);
 
-				m_remote_address = ep.address();
-				m_port = ep.port();
+				set_remote_endpoint(ep);
 
 				m_ack_nr = ph->seq_nr;
 				m_seq_nr = std::uint16_t(random(0xffff));
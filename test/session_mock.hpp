@@ -86,6 +86,8 @@ struct session_mock : aux::session_interface
 
 	void close_connection(aux::peer_connection*) noexcept override {}
 	int num_connections() const override { return 0; }
+	void schedule_timeout(std::shared_ptr<aux::peer_connection> const&, time_point) override {}
+	void schedule_housekeeping(std::shared_ptr<aux::torrent> const&, time_point) override {}
 
 	void deferred_submit_jobs() override {}
 
@@ -18,7 +18,11 @@ see LICENSE file.
 #include "libtorrent/extensions.hpp"
 #include "setup_transfer.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <functional>
+#include <mutex>
 #include <thread>
 
 using namespace lt;
@@ -311,6 +315,103 @@ TORRENT_TEST(alerts_dropped_alert)
 	TEST_CHECK(a->dropped_alerts[torrent_finished_alert::alert_type] == true);
 }
 
+// alerts posted by multiple threads, while another thread drains the queue,
+// are all delivered, in the order each thread posted them
+TORRENT_TEST(multi_threaded_producers)
+{
+	int const num_threads = 4;
+	int const num_alerts = 20000;
+	aux::alert_manager mgr(num_threads * num_alerts, alert_category::all);
+
+	std::atomic<int> running{num_threads};
+	std::vector<std::thread> producers;
+	for (int t = 0; t < num_threads; ++t)
+	{
+		producers.emplace_back([&mgr, &running, t] {
+			for (int i = 0; i < num_alerts; ++i)
+				mgr.emplace_alert<piece_finished_alert>(torrent_handle()
+					, piece_index_t(t * num_alerts + i));
+			--running;
+		});
+	}
+
+	std::vector<int> next(num_threads, 0);
+	std::vector<alert*> alerts;
+	for (;;)
+	{
+		bool const done = running == 0;
+		mgr.get_all(alerts);
+		for (alert* a : alerts)
+		{
+			auto* pf = alert_cast<piece_finished_alert>(a);
+			TEST_CHECK(pf);
+			if (pf == nullptr) continue;
+			int const idx = static_cast<int>(pf->piece_index);
+			int const t = idx / num_alerts;
+			TEST_EQUAL(idx % num_alerts, next[std::size_t(t)]);
+			next[std::size_t(t)] = idx % num_alerts + 1;
+		}
+		if (done && alerts.empty()) break;
+	}
+	for (auto& t : producers) t.join();
+
+	for (int const n : next) TEST_EQUAL(n, num_alerts);
+	TEST_EQUAL(mgr.pending(), false);
+}
+
+// a client relying on the notify function only polls for alerts once it's
+// been notified. Make sure no alert is left in the queue without a
+// notification, while alerts are posted concurrently with get_all()
+TORRENT_TEST(multi_threaded_producers_notify)
+{
+	int const num_threads = 4;
+	int const num_alerts = 20000;
+	aux::alert_manager mgr(num_threads * num_alerts, alert_category::all);
+
+	std::mutex m;
+	std::condition_variable cond;
+	bool notified = false;
+	mgr.set_notify_function([&] {
+		std::lock_guard<std::mutex> l(m);
+		notified = true;
+		cond.notify_all();
+	});
+
+	std::vector<std::thread> producers;
+	for (int t = 0; t < num_threads; ++t)
+	{
+		producers.emplace_back([&mgr, t] {
+			for (int i = 0; i < num_alerts; ++i)
+			{
+				mgr.emplace_alert<piece_finished_alert>(torrent_handle()
+					, piece_index_t(t * num_alerts + i));
+				// give the client a chance to drain the queue
+				if ((i % 64) == 0) std::this_thread::yield();
+			}
+		});
+	}
+
+	int received = 0;
+	std::vector<alert*> alerts;
+	while (received < num_threads * num_alerts)
+	{
+		{
+			std::unique_lock<std::mutex> l(m);
+			if (!cond.wait_for(l, std::chrono::seconds(10), [&] { return notified; }))
+			{
+				TEST_ERROR("alerts left in the queue without a notification");
+				break;
+			}
+			notified = false;
+		}
+		mgr.get_all(alerts);
+		received += int(alerts.size());
+	}
+	for (auto& t : producers) t.join();
+
+	TEST_EQUAL(received, num_threads * num_alerts);
+}
+
 #ifndef TORRENT_DISABLE_EXTENSIONS
 struct post_plugin : lt::plugin
 {
@@ -166,10 +166,12 @@ TORRENT_TEST(alerts_types)
 	TEST_ALERT_TYPE(piece_info_alert, 102, alert_priority::critical, alert_category::piece_progress);
 	TEST_ALERT_TYPE(piece_availability_alert, 103, alert_priority::critical, alert_category::status);
 	TEST_ALERT_TYPE(tracker_list_alert, 104, alert_priority::critical, alert_category::status);
+	TEST_ALERT_TYPE(state_delta_alert, 105, alert_priority::high, alert_category::status);
+	TEST_ALERT_TYPE(dht_indexer_alert, 106, alert_priority::normal, alert_category::dht_operation);
 
 #undef TEST_ALERT_TYPE
 
-	TEST_EQUAL(num_alert_types, 105);
+	TEST_EQUAL(num_alert_types, 107);
 	TEST_EQUAL(num_alert_types, count_alert_types);
 }
 
@@ -318,6 +320,59 @@ TORRENT_TEST(dht_sample_infohashes_alert)
 	TEST_CHECK(nv == nodes);
 }
 
+TORRENT_TEST(dht_indexer_alert)
+{
+	aux::alert_manager mgr(1, dht_indexer_alert::static_category);
+
+	TEST_EQUAL(mgr.should_post<dht_indexer_alert>(), true);
+
+	std::vector<sha1_hash> const v = {rand_hash(), rand_hash(), rand_hash()};
+
+	std::vector<std::pair<sha1_hash, tcp::endpoint>> pv;
+	pv.emplace_back(v[0], tcp::endpoint(rand_v4(), 1337));
+	pv.emplace_back(v[0], tcp::endpoint(rand_v6(), 1338));
+	pv.emplace_back(v[2], tcp::endpoint(rand_v4(), 1339));
+
+	mgr.emplace_alert<dht_indexer_alert>(v, pv);
+
+	auto const* a = alert_cast<dht_indexer_alert>(mgr.wait_for_alert(seconds(0)));
+	TEST_CHECK(a != nullptr);
+
+	TEST_EQUAL(a->num_info_hashes(), 3);
+	TEST_CHECK(a->info_hashes() == v);
+	TEST_EQUAL(a->num_peers(), 3);
+
+	auto peers = a->peers();
+	std::sort(pv.begin(), pv.end());
+	std::sort(peers.begin(), peers.end());
+	TEST_CHECK(pv == peers);
+}
+
+TORRENT_TEST(dht_indexer_alert_peers_only)
+{
+	aux::alert_manager mgr(1, dht_indexer_alert::static_category);
+
+	// get_peers responses arrive after their info-hashes were posted, so a
+	// batch often has peers but no info-hashes
+	std::vector<std::pair<sha1_hash, tcp::endpoint>> pv;
+	pv.emplace_back(rand_hash(), tcp::endpoint(rand_v4(), 1337));
+	pv.emplace_back(rand_hash(), tcp::endpoint(rand_v6(), 1338));
+
+	mgr.emplace_alert<dht_indexer_alert>(std::vector<sha1_hash>(), pv);
+
+	auto const* a = alert_cast<dht_indexer_alert>(mgr.wait_for_alert(seconds(0)));
+	TEST_CHECK(a != nullptr);
+
+	TEST_EQUAL(a->num_info_hashes(), 0);
+	TEST_CHECK(a->info_hashes().empty());
+	TEST_EQUAL(a->num_peers(), 2);
+
+	auto peers = a->peers();
+	std::sort(pv.begin(), pv.end());
+	std::sort(peers.begin(), peers.end());
+	TEST_CHECK(pv == peers);
+}
+
 #ifndef TORRENT_DISABLE_ALERT_MSG
 TORRENT_TEST(performance_warning)
 {
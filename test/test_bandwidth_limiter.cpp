@@ -442,6 +442,89 @@ void test_no_starvation(int limit)
 	TEST_CHECK(close_to(p->m_quota / sample_time, float(limit) / 200 / num_peers, 5));
 }
 
+// a peer whose requests are small enough to be satisfied within a tick or
+// two, so requests are removed from all over the queue every tick
+struct small_request_peer : aux::bandwidth_socket
+	, std::enable_shared_from_this<small_request_peer>
+{
+	small_request_peer(aux::bandwidth_manager& bwm, int const request_size)
+		: m_bwm(bwm)
+		, m_request_size(request_size)
+	{}
+
+	bool is_disconnecting() const override { return m_disconnecting; }
+	void assign_bandwidth(int /*channel*/, int const amount) override
+	{
+		if (m_disconnecting)
+		{
+			// the request of a disconnecting peer is cancelled
+			TEST_EQUAL(amount, 0);
+			++m_cancelled;
+			return;
+		}
+		TEST_CHECK(amount > 0);
+		m_quota += amount;
+		start();
+	}
+
+	void start()
+	{
+		aux::array<aux::bandwidth_channel*, 1> channels{{&global_bwc}};
+		int ret = 0;
+		while ((ret = m_bwm.request_bandwidth(shared_from_this()
+			, m_request_size, 1, channels)) > 0)
+		{
+			m_quota += ret;
+		}
+	}
+
+	aux::bandwidth_manager& m_bwm;
+	int m_request_size;
+	bool m_disconnecting = false;
+	int m_cancelled = 0;
+	std::int64_t m_quota = 0;
+};
+
+void test_small_requests(int const num, int const limit)
+{
+	std::cout << "\ntest small requests " << num << " " << limit << std::endl;
+	aux::bandwidth_manager manager(0);
+	global_bwc.throttle(limit);
+
+	std::vector<std::shared_ptr<small_request_peer>> v;
+	for (int i = 0; i < num; ++i)
+		v.push_back(std::make_shared<small_request_peer>(manager, 100 + i * 50));
+	for (auto& p : v) p->start();
+
+	lt::aux::session_settings s;
+	int const tick_interval = s.get_int(settings_pack::tick_interval);
+	int const num_ticks = int(sample_time * 1000 / tick_interval);
+	for (int i = 0; i < num_ticks; ++i)
+	{
+		// half-way through, every other peer disconnects while its request
+		// is still queued
+		if (i == num_ticks / 2)
+		{
+			for (int k = 0; k < num; k += 2)
+				v[std::size_t(k)]->m_disconnecting = true;
+		}
+		manager.update_quotas(milliseconds(tick_interval));
+	}
+
+	float sum = 0.f;
+	for (int k = 0; k < num; ++k)
+	{
+		auto const& p = v[std::size_t(k)];
+		sum += p->m_quota;
+		TEST_CHECK(p->m_quota > 0);
+		TEST_EQUAL(p->m_cancelled, (k % 2) == 0 ? 1 : 0);
+	}
+	sum /= sample_time;
+	std::cout << "sum: " << sum << " target: " << limit << std::endl;
+	TEST_CHECK(close_to(sum, float(limit), limit * 0.1f));
+	TEST_EQUAL(manager.queue_size(), num / 2);
+}
+
 #ifdef __clang__
 #pragma clang diagnostic pop
 #endif
@@ -505,3 +588,10 @@ TORRENT_TEST(no_starvation)
 {
 	test_no_starvation(40000);
 }
+
+TORRENT_TEST(small_requests)
+{
+	test_small_requests(10, 20000);
+	test_small_requests(100, 100000);
+	test_small_requests(1000, 1000000);
+}
@@ -39,6 +39,7 @@ see LICENSE file.
 #include "libtorrent/kademlia/item.hpp"
 #include "libtorrent/kademlia/dht_observer.hpp"
 #include "libtorrent/kademlia/dht_tracker.hpp"
+#include "libtorrent/kademlia/indexer.hpp"
 
 #include <numeric>
 #include <cstdarg>
@@ -253,7 +254,8 @@ struct msg_args
 
 void send_dht_request(node& node, char const* msg, udp::endpoint const& ep
 	, bdecode_node* reply, msg_args const& args = msg_args()
-	, char const* t = "10", bool has_response = true)
+	, char const* t = "10", bool has_response = true
+	, std::optional<bool> valid_signature = std::nullopt)
 {
 	// we're about to clear out the backing buffer
 	// for this bdecode_node, so we better clear it now
@@ -274,6 +276,7 @@ void send_dht_request(node& node, char const* msg, udp::endpoint const& ep
 	if (ec) std::printf("bdecode failed: %s\n", ec.message().c_str());
 
 	dht::msg m(decoded, ep);
+	m.valid_signature = valid_signature;
 	node.incoming(node.m_sock, m);
 
 	// If the request is supposed to get a response, by now the node should have
@@ -541,12 +544,21 @@ struct obs : dht::dht_observer
 #endif
 	bool on_dht_request(string_view
 		, dht::msg const&, entry&) override { return false; }
+	void indexer_results(std::vector<sha1_hash> const& info_hashes
+		, std::vector<std::pair<sha1_hash, tcp::endpoint>> const& peers) override
+	{
+		m_indexer_info_hashes.insert(m_indexer_info_hashes.end()
+			, info_hashes.begin(), info_hashes.end());
+		m_indexer_peers.insert(m_indexer_peers.end(), peers.begin(), peers.end());
+	}
 
 	virtual ~obs() = default;
 
 #ifndef TORRENT_DISABLE_LOGGING
 	std::vector<std::string> m_log;
 #endif
+	std::vector<sha1_hash> m_indexer_info_hashes;
+	std::vector<std::pair<sha1_hash, tcp::endpoint>> m_indexer_peers;
 };
 
 aux::session_settings test_settings()
@@ -1492,6 +1504,39 @@ TORRENT_TEST(put_v6)
 		test_put(rand_v6);
 }
 
+// when a DHT worker thread has already verified the signature of a mutable
+// put, the node goes by its result instead of verifying it again
+TORRENT_TEST(put_preverified_signature)
+{
+	dht_test_setup t(udp::endpoint(rand_v4(), 20));
+	bdecode_node response;
+
+	public_key pk;
+	secret_key sk;
+	get_test_keypair(pk, sk);
+	sha1_hash const target_id = item_target_id(empty_salt, pk);
+	std::string const token = t.dht_node.generate_token(t.source, target_id);
+
+	char buffer[1200];
+	sequence_number const seq(4);
+	span<char const> const itemv(buffer, bencode(buffer, items[0].ent));
+	signature const sig = sign_mutable_item(itemv, empty_salt, seq, pk, sk);
+	msg_args args;
+	args.token(token).value(items[0].ent).key(pk).sig(sig).seq(seq);
+
+	// the signature is valid, but the worker found it wasn't
+	send_dht_request(t.dht_node, "put", t.source, &response, args, "10", true, false);
+	TEST_EQUAL(response.dict_find_string_value("y"), "e");
+	TEST_EQUAL(response.dict_find_list("e").list_int_value_at(0), 206);
+	sequence_number stored_seq;
+	TEST_CHECK(!t.dht_storage->get_mutable_item_seq(target_id, stored_seq));
+
+	send_dht_request(t.dht_node, "put", t.source, &response, args, "10", true, true);
+	TEST_EQUAL(response.dict_find_string_value("y"), "r");
+	TEST_CHECK(t.dht_storage->get_mutable_item_seq(target_id, stored_seq));
+	TEST_CHECK(stored_seq == seq);
+}
+
 namespace {
 
 void test_routing_table(address(&rand_addr)())
@@ -3001,6 +3046,85 @@ TORRENT_TEST(routing_table_extended)
 	print_state(std::cout, tbl);
 }
 
+namespace {
+// the nodes find_node() is expected to return. Buckets are visited starting
+// at the one the target falls in, towards our own ID and then away from it.
+// Only the last bucket that's visited is cut down to the nodes closest to the
+// target
+std::set<node_id> find_node_reference(routing_table const& tbl
+	, node_id const& target, bool const include_failed, int const count)
+{
+	auto const& buckets = tbl.buckets();
+	int const start = std::min(159 - distance_exp(tbl.id(), target)
+		, int(buckets.size()) - 1);
+	std::vector<int> order;
+	for (int i = start; i < int(buckets.size()); ++i) order.push_back(i);
+	for (int i = start - 1; i >= 0; --i) order.push_back(i);
+
+	std::set<node_id> ret;
+	for (int const b : order)
+	{
+		std::vector<node_id> ids;
+		for (auto const& n : buckets[b].live_nodes)
+			if (include_failed || n.confirmed()) ids.push_back(n.id);
+		std::sort(ids.begin(), ids.end(), [&](node_id const& lhs, node_id const& rhs)
+			{ return compare_ref(lhs, rhs, target); });
+		for (auto const& id : ids)
+		{
+			if (int(ret.size()) == count) return ret;
+			ret.insert(id);
+		}
+	}
+	return ret;
+}
+} // anonymous namespace
+
+TORRENT_TEST(routing_table_find_node_closest)
+{
+	auto sett = test_settings();
+	obs observer;
+	sett.set_bool(settings_pack::dht_extended_routing_table, true);
+	sett.set_bool(settings_pack::dht_prefer_verified_node_ids, false);
+	node_id const id = generate_random_id();
+
+	// fill the table with a mix of confirmed and unpinged nodes. The first
+	// buckets of the extended routing table hold more nodes than find_node()
+	// returns
+	routing_table tbl(id, udp::v4(), 8, sett, &observer);
+	for (int i = 0; i < 5000; ++i)
+	{
+		node_id const n = generate_random_id();
+		if (i % 3 == 0) tbl.heard_about(n, rand_udp_ep());
+		else tbl.node_seen(n, rand_udp_ep(), 20 + (n[19] & 0xff));
+	}
+	TEST_CHECK(tbl.bucket_size(0) > 8);
+
+	for (int r = 0; r < 200; ++r)
+	{
+		node_id target = generate_random_id();
+		// half of the lookups are for targets close to our own ID
+		if (r % 2)
+		{
+			target >>= r % 24;
+			target ^= id;
+		}
+
+		for (bool const include_failed : {false, true})
+		{
+			for (int const count : {1, 8, 20, 200})
+			{
+				std::vector<node_entry> const nodes = tbl.find_node(target
+					, include_failed ? routing_table::include_failed : find_nodes_flags_t{}
+					, count);
+				std::set<node_id> got;
+				for (auto const& n : nodes) got.insert(n.id);
+				TEST_EQUAL(got.size(), nodes.size());
+				TEST_CHECK(got == find_node_reference(tbl, target, include_failed, count));
+			}
+		}
+	}
+}
+
 namespace {
 void inserter(std::set<node_id>* nodes, node_entry const& ne)
 {
@@ -3699,6 +3823,137 @@ TORRENT_TEST(sample_infohashes)
 	TEST_CHECK(g_sent_packets.empty());
 }
 
+TORRENT_TEST(indexer)
+{
+	init_rand_address();
+
+	dht_test_setup t(rand_udp_ep());
+	bdecode_node response;
+
+	udp::endpoint const initial_node = rand_udp_ep(rand_v4);
+	t.dht_node.m_table.add_node(node_entry{initial_node});
+
+	// the indexer is disabled by default
+	g_sent_packets.clear();
+	t.dht_node.connection_timeout();
+	TEST_CHECK(g_sent_packets.empty());
+	TEST_CHECK(t.dht_node.get_indexer() == nullptr);
+
+	// the only node we know of is the one in the routing table
+	t.sett.set_int(settings_pack::dht_indexer_requests, 4);
+	t.dht_node.connection_timeout();
+	TEST_CHECK(t.dht_node.get_indexer() != nullptr);
+
+	TEST_EQUAL(g_sent_packets.size(), 1);
+	if (g_sent_packets.empty()) return;
+	TEST_EQUAL(g_sent_packets.front().first, initial_node);
+
+	node_from_entry(g_sent_packets.front().second, response);
+	bdecode_node sample_infohashes_keys[6];
+	if (!verify_message(response, sample_infohashes_desc, sample_infohashes_keys
+		, t.error_string))
+	{
+		std::printf("   invalid sample_infohashes request: %s\n", print_entry(response).c_str());
+		TEST_ERROR(t.error_string);
+		return;
+	}
+	TEST_EQUAL(sample_infohashes_keys[2].string_value(), "sample_infohashes");
+
+	node_id const nid = generate_random_id();
+	sha1_hash const ih = rand_hash();
+	udp::endpoint const next_node = rand_udp_ep(rand_v4);
+	std::vector<node_entry> nodes;
+	nodes.emplace_back(rand_hash(), next_node);
+
+	g_sent_packets.clear();
+	send_dht_response(t.dht_node, response, initial_node
+		, msg_args()
+			.nid(nid)
+			.interval(seconds(10))
+			.num(1)
+			.samples({ih})
+			.nodes(nodes));
+
+	// the sampled info-hash is looked up at the node that returned it, and the
+	// node it told us about is sampled next
+	TEST_EQUAL(g_sent_packets.size(), 2);
+	auto const get_peers_packet = find_packet(initial_node);
+	auto const sample_packet = find_packet(next_node);
+	if (get_peers_packet == g_sent_packets.end() || sample_packet == g_sent_packets.end())
+	{
+		TEST_ERROR("expected a get_peers and a sample_infohashes request");
+		return;
+	}
+
+	// node_from_entry() decodes into a shared buffer, hold on to the request
+	// to respond to it later
+	entry const sample_request = sample_packet->second;
+	node_from_entry(sample_request, response);
+	TEST_EQUAL(response.dict_find_string_value("q"), "sample_infohashes");
+
+	node_from_entry(get_peers_packet->second, response);
+	TEST_EQUAL(response.dict_find_string_value("q"), "get_peers");
+	bdecode_node const args = response.dict_find_dict("a");
+	TEST_CHECK(args && args.dict_find_string_value("info_hash") == ih.to_string());
+
+	std::set<tcp::endpoint> peers;
+	peers.insert(rand_tcp_ep(rand_v4));
+	peers.insert(rand_tcp_ep(rand_v4));
+
+	g_sent_packets.clear();
+	send_dht_response(t.dht_node, response, initial_node
+		, msg_args().nid(nid).token("10").peers(peers));
+
+	// the results are passed on to the observer once per tick
+	TEST_CHECK(t.observer.m_indexer_info_hashes.empty());
+	t.dht_node.connection_timeout();
+
+	TEST_EQUAL(t.observer.m_indexer_info_hashes.size(), 1);
+	if (!t.observer.m_indexer_info_hashes.empty())
+		TEST_EQUAL(t.observer.m_indexer_info_hashes.front(), ih);
+	TEST_EQUAL(t.observer.m_indexer_peers.size(), 2);
+	for (auto const& p : t.observer.m_indexer_peers)
+	{
+		TEST_EQUAL(p.first, ih);
+		TEST_CHECK(peers.count(p.second) == 1);
+	}
+
+	// when disabled, the response to the outstanding request is ignored
+	t.sett.set_int(settings_pack::dht_indexer_requests, 0);
+	t.dht_node.connection_timeout();
+	TEST_CHECK(t.dht_node.get_indexer() == nullptr);
+
+	g_sent_packets.clear();
+	node_from_entry(sample_request, response);
+	send_dht_response(t.dht_node, response, next_node
+		, msg_args()
+			.interval(seconds(10))
+			.num(1)
+			.samples({rand_hash()})
+			.nodes({node_entry(rand_hash(), rand_udp_ep(rand_v4))}));
+	t.dht_node.connection_timeout();
+	TEST_CHECK(g_sent_packets.empty());
+	TEST_EQUAL(t.observer.m_indexer_info_hashes.size(), 1);
+}
+
+TORRENT_TEST(indexer_recently_seen)
+{
+	dht::recently_seen seen;
+	std::vector<sha1_hash> keys;
+	for (int i = 0; i < 1000; ++i) keys.push_back(rand_hash());
+
+	int false_positives = 0;
+	for (auto const& k : keys)
+		if (seen.insert(k)) ++false_positives;
+	TEST_CHECK(false_positives < 20);
+
+	for (auto const& k : keys)
+		TEST_CHECK(seen.insert(k));
+
+	seen.clear();
+	TEST_CHECK(!seen.insert(keys.front()));
+}
+
 namespace {
 node_entry fake_node(bool verified, int rtt = 0)
 {
@@ -4056,6 +4311,125 @@ TORRENT_TEST(rate_limit_accrue_limit)
 	});
 }
 
+// with dht_worker_threads set, mutable puts have their signatures verified
+// on a worker thread and are then handled by the node like any other put
+TORRENT_TEST(put_worker_threads)
+{
+	io_context ios;
+	obs observer;
+	counters cnt;
+	aux::session_settings sett = test_settings();
+	sett.set_int(settings_pack::dht_worker_threads, 2);
+	sett.set_int(settings_pack::dht_max_dht_items, 10);
+	auto dht_storage = dht_default_storage_constructor(sett);
+
+	std::vector<entry> responses;
+	auto send = [&](aux::listen_socket_handle const&, udp::endpoint const&
+		, span<char const> buf, error_code&, aux::udp_send_flags_t)
+	{ responses.push_back(bdecode(buf)); };
+
+	auto dht = std::make_shared<dht_tracker>(&observer, ios, send, sett, cnt
+		, *dht_storage, dht_state());
+	auto ls = dummy_listen_socket4();
+	aux::listen_socket_handle const sock(ls);
+	dht->new_socket(sock);
+	dht->start({});
+
+	udp::endpoint const source(rand_v4(), 20);
+	auto send_request = [&](char const* q, entry const& args)
+	{
+		entry e;
+		e["y"] = "q";
+		e["q"] = q;
+		e["t"] = "10";
+		e["a"] = args;
+		e["a"]["id"] = generate_next().to_string();
+		std::vector<char> const buf = bencode(e);
+		TEST_CHECK(dht->incoming_packet(sock, source, buf));
+	};
+	// waits for the DHT to have sent num responses in total
+	auto wait_for_responses = [&](std::size_t const num)
+	{
+		for (int i = 0; i < 500 && responses.size() < num; ++i)
+		{
+			ios.poll();
+			std::this_thread::sleep_for(milliseconds(10));
+		}
+		TEST_EQUAL(responses.size(), num);
+	};
+	auto request = [&](char const* q, entry const& args)
+	{
+		std::size_t const num_responses = responses.size() + 1;
+		send_request(q, args);
+		wait_for_responses(num_responses);
+		return responses.empty() ? entry() : responses.back();
+	};
+
+	public_key pk;
+	secret_key sk;
+	get_test_keypair(pk, sk);
+	sha1_hash const target_id = item_target_id(empty_salt, pk);
+
+	entry get_args;
+	get_args["target"] = target_id.to_string();
+	entry const get_response = request("get", get_args);
+	std::string const token = get_response["r"]["token"].string();
+
+	char buffer[1200];
+	sequence_number const seq(4);
+	span<char const> const itemv(buffer, bencode(buffer, items[0].ent));
+	signature sig = sign_mutable_item(itemv, empty_salt, seq, pk, sk);
+
+	entry put_args;
+	put_args["token"] = token;
+	put_args["v"] = items[0].ent;
+	put_args["k"] = std::string(pk.bytes.data(), pk.bytes.size());
+	put_args["seq"] = seq.value;
+	sig.bytes[2] ^= 0xaa;
+	put_args["sig"] = std::string(sig.bytes.data(), sig.bytes.size());
+	entry const invalid_response = request("put", put_args);
+	TEST_EQUAL(invalid_response["y"].string(), "e");
+	TEST_EQUAL(invalid_response["e"].list().front().integer(), 206);
+
+	sig.bytes[2] ^= 0xaa;
+	put_args["sig"] = std::string(sig.bytes.data(), sig.bytes.size());
+	entry const put_response = request("put", put_args);
+	TEST_EQUAL(put_response["y"].string(), "r");
+
+	sequence_number stored_seq;
+	TEST_CHECK(dht_storage->get_mutable_item_seq(target_id, stored_seq));
+	TEST_CHECK(stored_seq == seq);
+
+	// both puts went through a worker thread
+	TEST_CHECK(cnt[counters::dht_verify_wait_time] > 0);
+
+	// puts received back-to-back are verified as a batch
+	std::vector<sha1_hash> targets;
+	std::vector<entry> puts;
+	for (int i = 0; i < 5; ++i)
+	{
+		std::tie(pk, sk) = ed25519_create_keypair(ed25519_create_seed());
+		targets.push_back(item_target_id(empty_salt, pk));
+		get_args["target"] = targets.back().to_string();
+		put_args["token"] = request("get", get_args)["r"]["token"].string();
+		put_args["k"] = std::string(pk.bytes.data(), pk.bytes.size());
+		sig = sign_mutable_item(itemv, empty_salt, seq, pk, sk);
+		// the third put has an invalid signature
+		if (i == 2) sig.bytes[0] ^= 1;
+		put_args["sig"] = std::string(sig.bytes.data(), sig.bytes.size());
+		puts.push_back(put_args);
+	}
+	std::size_t const num_responses = responses.size();
+	for (auto const& p : puts) send_request("put", p);
+	wait_for_responses(num_responses + puts.size());
+	for (std::size_t i = 0; i < puts.size(); ++i)
+	{
+		TEST_EQUAL(responses[num_responses + i]["y"].string(), i == 2 ? "e" : "r");
+		TEST_EQUAL(dht_storage->get_mutable_item_seq(targets[i], stored_seq), i != 2);
+	}
+
+	dht->stop();
+}
 
 // TODO: test obfuscated_get_peers
 
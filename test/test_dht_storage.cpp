@@ -27,6 +27,7 @@ see LICENSE file.
 #include "libtorrent/kademlia/dht_observer.hpp"
 
 #include <numeric>
+#include <set>
 
 #include "test.hpp"
 #include "setup_transfer.hpp"
@@ -66,6 +67,29 @@ namespace
 
 		return s;
 	}
+
+	std::unique_ptr<dht_storage_interface> create_sharded_dht_storage(
+		settings_interface const& sett)
+	{
+		std::unique_ptr<dht_storage_interface> s(dht_sharded_storage_constructor(sett));
+		TEST_CHECK(s != nullptr);
+
+		s->update_node_ids({to_hash("0000000000000000000000000000000000000200")});
+
+		return s;
+	}
+
+	std::set<tcp::endpoint> peer_set(entry& peers, bool const v6)
+	{
+		std::set<tcp::endpoint> ret;
+		for (auto const& p : peers["values"].list())
+		{
+			auto i = p.string().begin();
+			ret.insert(v6 ? aux::read_v6_endpoint<tcp::endpoint>(i)
+				: aux::read_v4_endpoint<tcp::endpoint>(i));
+		}
+		return ret;
+	}
 }
 
 sha1_hash const n1 = to_hash("5fbfbff10c5d6a4ec8a88e4c6ab4c28b95eee401");
@@ -483,6 +507,131 @@ TORRENT_TEST(infohashes_sample_dist)
 	std::printf("infohashes set size: %d\n", int(infohash_set.size()));
 	TEST_CHECK(infohash_set.size() > 500);
 }
+
+TORRENT_TEST(sharded_announce_peer)
+{
+	auto sett = test_settings();
+	sett.set_int(settings_pack::dht_max_peers, 3);
+	std::unique_ptr<dht_storage_interface> s(create_sharded_dht_storage(sett));
+
+	entry peers;
+	TEST_CHECK(!s->get_peers(n1, false, false, address(), peers));
+	TEST_CHECK(!peers.find_key("values"));
+
+	tcp::endpoint const p1 = ep("124.31.75.21", 1);
+	tcp::endpoint const p2 = ep("124.31.75.22", 2);
+	tcp::endpoint const p3 = ep("124.31.75.23", 3);
+	tcp::endpoint const p4 = ep("2000::1", 4);
+	tcp::endpoint const p5 = ep("2000::2", 5);
+
+	s->announce_peer(n1, p1, "torrent_name", false);
+	s->announce_peer(n1, p2, "other_name", true);
+	s->announce_peer(n1, p4, "", false);
+	s->announce_peer(n1, p5, "", true);
+	// announcing again just refreshes the peer
+	s->announce_peer(n1, p1, "", false);
+	TEST_EQUAL(s->counters().torrents, 1);
+	TEST_EQUAL(s->counters().peers, 4);
+
+	peers = entry();
+	TEST_CHECK(!s->get_peers(n1, false, false, address(), peers));
+	TEST_EQUAL(peers["n"].string(), "torrent_name");
+	TEST_CHECK((peer_set(peers, false) == std::set<tcp::endpoint>{p1, p2}));
+
+	peers = entry();
+	s->get_peers(n1, true, false, address(), peers);
+	TEST_CHECK((peer_set(peers, false) == std::set<tcp::endpoint>{p1}));
+
+	peers = entry();
+	s->get_peers(n1, false, false, address_v6(), peers);
+	TEST_CHECK((peer_set(peers, true) == std::set<tcp::endpoint>{p4, p5}));
+
+	// the torrent is full. Only requesters already in the set are
+	// considered to be announcing
+	s->announce_peer(n1, p3, "", false);
+	TEST_EQUAL(s->counters().peers, 5);
+	s->announce_peer(n1, ep("124.31.75.24", 4), "", false);
+	TEST_EQUAL(s->counters().peers, 5);
+	peers = entry();
+	TEST_CHECK(!s->get_peers(n1, false, false, addr("124.31.75.22"), peers));
+	TEST_CHECK(s->get_peers(n1, false, false, addr("124.31.75.24"), peers));
+
+	// the scrape matches the default storage's
+	std::unique_ptr<dht_storage_interface> d(create_default_dht_storage(sett));
+	for (auto const& p : {p1, p2, p3, p4, p5})
+		d->announce_peer(n1, p, "", p == p2 || p == p5);
+	for (auto const& a : {address(), address(address_v6())})
+	{
+		entry scrape;
+		entry expected;
+		s->get_peers(n1, false, true, a, scrape);
+		d->get_peers(n1, false, true, a, expected);
+		TEST_EQUAL(scrape["BFpe"].string(), expected["BFpe"].string());
+		TEST_EQUAL(scrape["BFsd"].string(), expected["BFsd"].string());
+	}
+}
+
+TORRENT_TEST(sharded_limits)
+{
+	auto sett = test_settings();
+	sett.set_int(settings_pack::dht_max_peers, 42);
+	sett.set_int(settings_pack::dht_max_torrents, 42);
+	std::unique_ptr<dht_storage_interface> s(create_sharded_dht_storage(sett));
+
+	for (int i = 0; i < 200; ++i)
+	{
+		s->announce_peer(n1, {rand_v4(), std::uint16_t(aux::random(0xffff))}
+			, "torrent_name", false);
+		s->announce_peer(rand_hash(), {rand_v6(), std::uint16_t(aux::random(0xffff))}
+			, "", false);
+		dht_storage_counters const cnt = s->counters();
+		TEST_CHECK(cnt.peers <= 42 + 41);
+		TEST_CHECK(cnt.torrents <= 42);
+	}
+	dht_storage_counters const cnt = s->counters();
+	TEST_EQUAL(cnt.peers, 42 + 41);
+	TEST_EQUAL(cnt.torrents, 42);
+
+	// a torrent we don't have, when we're full, is reported as full
+	entry peers;
+	TEST_CHECK(s->get_peers(rand_hash(), false, false, address(), peers));
+}
+
+TORRENT_TEST(sharded_many_torrents)
+{
+	auto sett = test_settings();
+	sett.set_int(settings_pack::dht_max_torrents, 100000);
+	sett.set_int(settings_pack::dht_sample_infohashes_interval, 0);
+	sett.set_int(settings_pack::dht_max_infohashes_sample_count, 20);
+	std::unique_ptr<dht_storage_interface> s(create_sharded_dht_storage(sett));
+
+	std::vector<sha1_hash> info_hashes;
+	for (int i = 0; i < 20000; ++i)
+	{
+		info_hashes.push_back(rand_hash());
+		s->announce_peer(info_hashes.back(), ep("124.31.75.21", std::uint16_t(i))
+			, "", false);
+	}
+	TEST_EQUAL(s->counters().torrents, 20000);
+	TEST_EQUAL(s->counters().peers, 20000);
+
+	for (int i = 0; i < 20000; ++i)
+	{
+		entry peers;
+		s->get_peers(info_hashes[std::size_t(i)], false, false, address(), peers);
+		TEST_CHECK((peer_set(peers, false) == std::set<tcp::endpoint>{ep("124.31.75.21", std::uint16_t(i))}));
+	}
+
+	std::set<sha1_hash> const all(info_hashes.begin(), info_hashes.end());
+	entry item;
+	TEST_EQUAL(s->get_infohashes_sample(item), 20);
+	TEST_EQUAL(item["num"].integer(), 20000);
+	std::string const samples = item["samples"].string();
+	TEST_EQUAL(samples.size(), 20 * 20);
+	for (std::size_t i = 0; i < samples.size(); i += 20)
+		TEST_CHECK(all.count(sha1_hash(samples.substr(i, 20))) == 1);
+}
+
 #else
 TORRENT_TEST(dummy) {}
 #endif
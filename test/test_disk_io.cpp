@@ -13,6 +13,8 @@ see LICENSE file.
 #include "libtorrent/disk_interface.hpp"
 #include "libtorrent/mmap_disk_io.hpp"
 #include "libtorrent/posix_disk_io.hpp"
+#include "libtorrent/pread_disk_io.hpp"
+#include "libtorrent/io_uring_disk_io.hpp"
 #include "libtorrent/session_params.hpp" // for disk_io_constructor_type
 #include "libtorrent/settings_pack.hpp" // for default_settings
 #include "libtorrent/flags.hpp"
@@ -22,6 +24,10 @@ see LICENSE file.
 #include "libtorrent/file_storage.hpp"
 #include "libtorrent/aux_/vector.hpp"
 #include "libtorrent/sha1_hash.hpp"
+#include "libtorrent/disk_buffer_holder.hpp"
+#include "libtorrent/aux_/path.hpp"
+
+#include <fstream>
 
 using disk_test_mode_t = lt::flags::bitfield_flag<std::uint32_t, struct disk_test_mode_tag>;
 
@@ -111,6 +117,74 @@ void disk_io_test_suite(lt::disk_io_constructor_type disk_io
 	disk_thread->abort(true);
 }
 
+// reads blocks that extend past the end of a file that is shorter than the
+// torrent says. This must fail with eof, rather than hand out the block with
+// whatever was in the buffer before
+void test_read_truncated(lt::disk_io_constructor_type disk_io)
+{
+	lt::io_context ios;
+	lt::counters cnt;
+	lt::settings_pack sett = lt::default_settings();
+	std::unique_ptr<lt::disk_interface> disk_thread = disk_io(ios, sett, cnt);
+
+	int const piece_size = 0x8000;
+	lt::file_storage fs;
+	fs.set_piece_length(piece_size);
+	fs.add_file("test-torrent/file-0", piece_size * 2, {});
+	fs.set_num_pieces(2);
+
+	// the file on disk ends half way into the second block
+	std::string const name = "test_read_truncated";
+	lt::error_code ec;
+	lt::create_directories(lt::combine_path(name, "test-torrent"), ec);
+	{
+		std::vector<char> const buf(0x6000, 'a');
+		std::ofstream f(lt::combine_path(name, "test-torrent/file-0")
+			, std::ios::binary | std::ios::trunc);
+		f.write(buf.data(), std::streamsize(buf.size()));
+	}
+
+	lt::aux::vector<lt::download_priority_t, lt::file_index_t> priorities;
+	lt::renamed_files rf;
+	lt::storage_params params{
+		fs,
+		rf,
+		name,
+		{},
+		lt::storage_mode_t::storage_mode_sparse,
+		priorities,
+		lt::sha1_hash{},
+		true,
+		false,
+	};
+
+	lt::storage_holder storage = disk_thread->new_torrent(params
+		, std::shared_ptr<void>());
+
+	// a short read, and a read entirely past the end of the file
+	for (auto const& r : {lt::peer_request{lt::piece_index_t{0}, 0x4000, 0x4000}
+		, lt::peer_request{lt::piece_index_t{1}, 0, 0x4000}})
+	{
+		bool done = false;
+		lt::storage_error error;
+		disk_thread->async_read(storage, r
+			, [&](lt::disk_buffer_holder, lt::storage_error const& e)
+			{
+				error = e;
+				done = true;
+			});
+		disk_thread->submit_jobs();
+		ios.restart();
+		while (!done) ios.run_for(std::chrono::milliseconds(100));
+
+		TEST_EQUAL(error.ec, boost::asio::error::eof);
+		TEST_CHECK(error.operation == lt::operation_t::file_read);
+		TEST_EQUAL(error.file(), lt::file_index_t{0});
+	}
+
+	disk_thread->abort(true);
+}
+
 }
 
 #if TORRENT_HAVE_MMAP || TORRENT_HAVE_MAP_VIEW_OF_FILE
@@ -129,3 +203,35 @@ TORRENT_TEST(test_posix_disk_io)
 {
 	disk_io_test_suite(&lt::posix_disk_io_constructor, test_mode::v1 | test_mode::v2, 0x8000, 3);
 }
+
+TORRENT_TEST(test_pread_disk_io_small_pieces)
+{
+	disk_io_test_suite(&lt::pread_disk_io_constructor, test_mode::v1 | test_mode::v2, 300, 3);
+}
+
+TORRENT_TEST(test_pread_disk_io)
+{
+	disk_io_test_suite(&lt::pread_disk_io_constructor, test_mode::v1 | test_mode::v2, 0x8000, 3);
+}
+
+TORRENT_TEST(test_pread_disk_io_read_truncated)
+{
+	test_read_truncated(&lt::pread_disk_io_constructor);
+}
+
+#if TORRENT_HAVE_IO_URING
+TORRENT_TEST(test_io_uring_disk_io_small_pieces)
+{
+	disk_io_test_suite(&lt::io_uring_disk_io_constructor, test_mode::v1 | test_mode::v2, 300, 3);
+}
+
+TORRENT_TEST(test_io_uring_disk_io)
+{
+	disk_io_test_suite(&lt::io_uring_disk_io_constructor, test_mode::v1 | test_mode::v2, 0x8000, 3);
+}
+
+TORRENT_TEST(test_io_uring_disk_io_read_truncated)
+{
+	test_read_truncated(&lt::io_uring_disk_io_constructor);
+}
+#endif
@@ -13,6 +13,9 @@ see LICENSE file.
 #ifndef TORRENT_DISABLE_DHT
 
 #include <memory>
+#include <algorithm>
+#include <string>
+#include <vector>
 
 #include "libtorrent/kademlia/ed25519.hpp"
 #include "libtorrent/hex.hpp"
@@ -252,6 +255,93 @@ TORRENT_TEST(key_exchange)
 	TEST_EQUAL(aux::to_hex(secretA), aux::to_hex(secretB));
 }
 
+TORRENT_TEST(verify_batch)
+{
+	std::vector<std::string> messages;
+	std::vector<signature> sigs;
+	std::vector<public_key> pks;
+	for (int i = 0; i < 150; ++i)
+	{
+		auto const [pk, sk] = ed25519_create_keypair(ed25519_create_seed());
+		messages.push_back("message " + std::to_string(i) + std::string(std::size_t(i), 'x'));
+		sigs.push_back(ed25519_sign(messages.back(), pk, sk));
+		pks.push_back(pk);
+	}
+	std::vector<span<char const>> msgs(messages.begin(), messages.end());
+
+	// batches smaller than the minimum, spanning more than one batch, and
+	// everything in between
+	for (int const n : {0, 1, 3, 4, 64, 65, 150})
+	{
+		std::vector<bool> const valid = ed25519_verify_batch(
+			span<signature const>(sigs).first(n)
+			, span<span<char const> const>(msgs).first(n)
+			, span<public_key const>(pks).first(n));
+		TEST_EQUAL(int(valid.size()), n);
+		TEST_CHECK(std::count(valid.begin(), valid.end(), true) == n);
+	}
+
+	// a broken signature, the wrong message, the wrong key and a signature
+	// with a non-canonical S
+	sigs[3].bytes[10] ^= 1;
+	msgs[50] = messages[51];
+	pks[70] = pks[71];
+	sigs[149].bytes[63] |= 0x80;
+
+	std::vector<bool> const valid = ed25519_verify_batch(sigs, msgs, pks);
+	TEST_EQUAL(int(valid.size()), 150);
+	for (int i = 0; i < 150; ++i)
+		TEST_EQUAL(valid[std::size_t(i)], i != 3 && i != 50 && i != 70 && i != 149);
+}
+
+// R of this signature has a component of order 8. It's valid under the
+// cofactored verification equation, but not under the cofactorless one.
+// Single and batch verification must agree on it, regardless of the random
+// scalars the batch is verified with
+TORRENT_TEST(verify_small_order_component)
+{
+	std::string const message = "small order component";
+	public_key pk;
+	signature sig;
+	aux::from_hex("e4030998cfd5ad1723c169f956aa0b9eb8619b5992bd612c2af428ebc79f8df0"
+		, pk.bytes.data());
+	aux::from_hex("4138e9534525b2935fdd33c07f16d80cc67749abdec0cb4d8f924307be9c944d"
+		"3fa80897b3dca8ef0bb78366a39a313f91a66e4b529296e70405a0b34a0d4f0d"
+		, sig.bytes.data());
+
+	TEST_CHECK(ed25519_verify(sig, message, pk));
+	TEST_CHECK(!ed25519_verify(sig, "another message", pk));
+
+	std::vector<std::string> messages;
+	std::vector<signature> sigs;
+	std::vector<public_key> pks;
+	for (int i = 0; i < 7; ++i)
+	{
+		auto const [k, sk] = ed25519_create_keypair(ed25519_create_seed());
+		messages.push_back("message " + std::to_string(i));
+		sigs.push_back(ed25519_sign(messages.back(), k, sk));
+		pks.push_back(k);
+	}
+	messages.push_back(message);
+	sigs.push_back(sig);
+	pks.push_back(pk);
+	std::vector<span<char const>> msgs(messages.begin(), messages.end());
+
+	for (int i = 0; i < 50; ++i)
+	{
+		std::vector<bool> const valid = ed25519_verify_batch(sigs, msgs, pks);
+		TEST_CHECK(std::count(valid.begin(), valid.end(), true) == 8);
+	}
+
+	msgs.back() = span<char const>("another message");
+	for (int i = 0; i < 50; ++i)
+	{
+		std::vector<bool> const valid = ed25519_verify_batch(sigs, msgs, pks);
+		TEST_CHECK(std::count(valid.begin(), valid.end(), true) == 7);
+		TEST_CHECK(!valid.back());
+	}
+}
+
 #else
 TORRENT_TEST(empty)
 {
@@ -0,0 +1,198 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "libtorrent/aux_/multi_hasher.hpp"
+#include "libtorrent/aux_/random.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/hex.hpp"
+#include "libtorrent/time.hpp"
+
+#include "test.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+aux::hash_kernel const all_kernels[] = {
+	aux::hash_kernel::generic, aux::hash_kernel::sha_ni, aux::hash_kernel::avx2 };
+
+char const* kernel_name(aux::hash_kernel const k)
+{
+	switch (k)
+	{
+		case aux::hash_kernel::generic: return "generic";
+		case aux::hash_kernel::sha_ni: return "sha_ni";
+		case aux::hash_kernel::avx2: return "avx2";
+	}
+	return "";
+}
+
+// hasher doesn't accept empty buffers
+template <typename Hasher>
+auto reference_hash(std::vector<char> const& buf)
+{
+	Hasher h;
+	if (!buf.empty()) h.update(buf);
+	return h.final();
+}
+
+std::vector<char> random_buffer(int const size)
+{
+	std::vector<char> ret(static_cast<std::size_t>(size));
+	aux::random_bytes(ret);
+	return ret;
+}
+
+// hashes buffers of the specified sizes with every supported kernel and
+// compares the result to hasher and hasher256
+void test_sizes(std::vector<int> const& sizes)
+{
+	std::vector<std::vector<char>> bufs;
+	std::vector<span<char const>> spans;
+	for (int const s : sizes) bufs.push_back(random_buffer(s));
+	for (auto const& b : bufs) spans.emplace_back(b);
+
+	for (auto const k : all_kernels)
+	{
+		if (!aux::hash_kernel_supported(k)) continue;
+
+		std::vector<sha1_hash> out1(sizes.size());
+		std::vector<sha256_hash> out2(sizes.size());
+		aux::multi_sha1(spans, out1, k);
+		aux::multi_sha256(spans, out2, k);
+		for (std::size_t i = 0; i < bufs.size(); ++i)
+		{
+			TEST_EQUAL(out1[i], reference_hash<hasher>(bufs[i]));
+			TEST_EQUAL(out2[i], reference_hash<hasher256>(bufs[i]));
+		}
+	}
+
+	// and the automatic kernel selection
+	std::vector<sha1_hash> out1(sizes.size());
+	std::vector<sha256_hash> out2(sizes.size());
+	aux::multi_sha1(spans, out1);
+	aux::multi_sha256(spans, out2);
+	for (std::size_t i = 0; i < bufs.size(); ++i)
+	{
+		TEST_EQUAL(out1[i], reference_hash<hasher>(bufs[i]));
+		TEST_EQUAL(out2[i], reference_hash<hasher256>(bufs[i]));
+	}
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(test_vectors)
+{
+	span<char const> const abc("abc", 3);
+	span<char const> const empty;
+	span<char const> const bufs[] = {abc, empty};
+
+	for (auto const k : all_kernels)
+	{
+		if (!aux::hash_kernel_supported(k)) continue;
+		std::printf("kernel: %s\n", kernel_name(k));
+
+		sha1_hash h1[2];
+		aux::multi_sha1(bufs, h1, k);
+		TEST_EQUAL(aux::to_hex(h1[0]), "a9993e364706816aba3e25717850c26c9cd0d89d");
+		TEST_EQUAL(aux::to_hex(h1[1]), "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+
+		sha256_hash h2[2];
+		aux::multi_sha256(bufs, h2, k);
+		TEST_EQUAL(aux::to_hex(h2[0]), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+		TEST_EQUAL(aux::to_hex(h2[1]), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+	}
+}
+
+TORRENT_TEST(padding_boundaries)
+{
+	// the lengths around the block size, where the padding spills over into
+	// an extra block
+	test_sizes({0, 1, 55, 56, 57, 63, 64, 65, 119, 120, 127, 128, 129});
+}
+
+TORRENT_TEST(equal_sizes)
+{
+	for (int const num : {1, 7, 8, 9, 16, 17})
+		test_sizes(std::vector<int>(static_cast<std::size_t>(num), 0x4000));
+}
+
+TORRENT_TEST(mixed_sizes)
+{
+	// the last block of a v2 piece is typically shorter than the others
+	test_sizes({0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 0x4000, 1337});
+	test_sizes({1000, 0x4000, 64, 0, 0x8000, 3, 0x4000, 200, 0x4000, 70});
+
+	std::vector<int> sizes;
+	for (int i = 0; i < 30; ++i) sizes.push_back(int(aux::random(0x5000)));
+	test_sizes(sizes);
+}
+
+TORRENT_TEST(sibling_pairs)
+{
+	for (int const num_pairs : {0, 1, 2, 3, 7, 8, 9, 16, 31})
+	{
+		std::vector<sha256_hash> children(static_cast<std::size_t>(num_pairs * 2));
+		for (auto& c : children) aux::random_bytes(c);
+
+		std::vector<sha256_hash> expected;
+		for (int i = 0; i < num_pairs; ++i)
+		{
+			expected.push_back(hasher256().update(children[std::size_t(i * 2)])
+				.update(children[std::size_t(i * 2 + 1)]).final());
+		}
+
+		for (auto const k : all_kernels)
+		{
+			if (!aux::hash_kernel_supported(k)) continue;
+
+			std::vector<sha256_hash> parents(static_cast<std::size_t>(num_pairs));
+			aux::multi_sha256_pairs(children, parents, k);
+			TEST_CHECK(parents == expected);
+
+			// reduce the layer in place
+			std::vector<sha256_hash> layer = children;
+			aux::multi_sha256_pairs(layer, layer, k);
+			TEST_CHECK(std::equal(expected.begin(), expected.end(), layer.begin()));
+		}
+	}
+}
+
+TORRENT_TEST(benchmark)
+{
+	// 16 kiB v2 blocks
+	int const num_blocks = 1024;
+	std::vector<char> const buf = random_buffer(num_blocks * 0x4000);
+	std::vector<span<char const>> spans;
+	for (int i = 0; i < num_blocks; ++i)
+		spans.emplace_back(buf.data() + i * 0x4000, 0x4000);
+	std::vector<sha1_hash> out1(spans.size());
+	std::vector<sha256_hash> out2(spans.size());
+
+	for (auto const k : all_kernels)
+	{
+		if (!aux::hash_kernel_supported(k)) continue;
+
+		time_point start = clock_type::now();
+		aux::multi_sha1(spans, out1, k);
+		auto const sha1_time = total_microseconds(clock_type::now() - start);
+
+		start = clock_type::now();
+		aux::multi_sha256(spans, out2, k);
+		auto const sha256_time = total_microseconds(clock_type::now() - start);
+
+		std::printf("%8s: SHA-1: %.0f MB/s SHA-256: %.0f MB/s\n", kernel_name(k)
+			, double(buf.size()) / double(std::max(sha1_time, std::int64_t(1)))
+			, double(buf.size()) / double(std::max(sha256_time, std::int64_t(1))));
+	}
+}
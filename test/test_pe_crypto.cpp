@@ -11,11 +11,13 @@ see LICENSE file.
 */
 
 #include <algorithm>
+#include <cstring>
 #include <iostream>
 
 #include "libtorrent/hasher.hpp"
 #include "libtorrent/aux_/pe_crypto.hpp"
 #include "libtorrent/aux_/random.hpp"
+#include "libtorrent/hex.hpp" // for to_hex
 #include "libtorrent/span.hpp"
 
 #include "test.hpp"
@@ -122,6 +124,69 @@ TORRENT_TEST(rc4)
 	test_enc_handler(rc41, rc42);
 }
 
+TORRENT_TEST(rc4_test_vectors)
+{
+	using namespace lt;
+
+	struct test_vector
+	{
+		char const* key;
+		char const* plaintext;
+		char const* ciphertext;
+	};
+
+	test_vector const tests[] = {
+		{ "Key", "Plaintext", "bbf316e8d940af0ad3" },
+		{ "Wiki", "pedia", "1021bf0420" },
+		{ "Secret", "Attack at dawn", "45a01f645fc35b383552544b9bf5" },
+	};
+
+	for (auto const& t : tests)
+	{
+		aux::rc4 state;
+		aux::rc4_init(reinterpret_cast<unsigned char const*>(t.key)
+			, std::strlen(t.key), &state);
+		std::string buf = t.plaintext;
+		TEST_EQUAL(aux::rc4_encrypt(reinterpret_cast<unsigned char*>(&buf[0])
+			, buf.size(), &state), buf.size());
+		TEST_EQUAL(aux::to_hex(buf), t.ciphertext);
+	}
+
+	// RFC 6229, 40 bit key, the first 32 bytes of keystream
+	unsigned char const key[] = {1, 2, 3, 4, 5};
+	aux::rc4 state;
+	aux::rc4_init(key, sizeof(key), &state);
+	std::string buf(32, '\0');
+	aux::rc4_encrypt(reinterpret_cast<unsigned char*>(&buf[0]), buf.size(), &state);
+	TEST_EQUAL(aux::to_hex(buf)
+		, "b2396305f03dc027ccc3524a0a1118a86982944f18fc82d589c403a47a0d0919");
+}
+
+TORRENT_TEST(rc4_split_buffers)
+{
+	using namespace lt;
+
+	// the keystream must not depend on how the buffer is split up
+	unsigned char const key[] = "split buffer test key";
+	std::vector<unsigned char> whole(5000);
+	aux::random_bytes({reinterpret_cast<char*>(whole.data()), std::ptrdiff_t(whole.size())});
+	std::vector<unsigned char> split = whole;
+
+	aux::rc4 state;
+	aux::rc4_init(key, 20, &state);
+	aux::rc4_encrypt(whole.data(), whole.size(), &state);
+
+	aux::rc4_init(key, 20, &state);
+	std::size_t pos = 0;
+	while (pos < split.size())
+	{
+		std::size_t const len = std::min(split.size() - pos, std::size_t(aux::random(9)));
+		aux::rc4_encrypt(split.data() + pos, len, &state);
+		pos += len;
+	}
+	TEST_CHECK(whole == split);
+}
+
 #else
 TORRENT_TEST(disabled)
 {
@@ -169,8 +169,7 @@ void mock_peer_connection::disconnect(error_code const&
 
 bool has_peer(peer_list const& p, tcp::endpoint const& ep)
 {
-	auto const its = p.find_peers(ep.address());
-	return its.first != its.second;
+	return !p.find_peers(ep.address()).empty();
 }
 
 torrent_state init_state()
@@ -1216,6 +1215,249 @@ TORRENT_TEST(clear_peers)
 	TEST_EQUAL(p.num_seeds(), 0);
 }
 
+// run the same sequence of operations against a sorted and a hash indexed
+// peer list, and make sure they agree
+TORRENT_TEST(hash_index)
+{
+	torrent_state st = init_state();
+	st.allow_multiple_connections_per_ip = true;
+	// which peer is evicted from a full list is random, don't limit the size
+	st.max_peerlist_size = 0;
+	peer_list sorted(allocator);
+	peer_list hashed(allocator);
+	hashed.set_hash_index(true);
+	TEST_CHECK(hashed.hash_index());
+	TEST_CHECK(!sorted.hash_index());
+
+	// a small pool of addresses, to get multiple peers per IP
+	std::vector<address> addrs;
+	for (int i = 0; i < 100; ++i) addrs.push_back(rand_v4());
+	addrs.push_back(addr("2001::1"));
+
+	std::vector<std::pair<torrent_peer*, torrent_peer*>> peers;
+	auto const check = [&](address const& a)
+	{
+		TEST_EQUAL(sorted.num_peers(), hashed.num_peers());
+		TEST_EQUAL(sorted.num_connect_candidates(), hashed.num_connect_candidates());
+		TEST_EQUAL(sorted.num_seeds(), hashed.num_seeds());
+		TEST_EQUAL(sorted.find_peers(a).size(), hashed.find_peers(a).size());
+	};
+
+	for (int i = 0; i < 5000; ++i)
+	{
+		int const op = int(random(9));
+		if (op < 5 || peers.empty())
+		{
+			tcp::endpoint const e(addrs[random(std::uint32_t(addrs.size() - 1))]
+				, std::uint16_t(1024 + random(7)));
+			torrent_peer* s = sorted.add_peer(e, peer_info::tracker, {}, &st);
+			torrent_peer* h = hashed.add_peer(e, peer_info::tracker, {}, &st);
+			TEST_EQUAL(s == nullptr, h == nullptr);
+			if (s && h && std::none_of(peers.begin(), peers.end()
+				, [s](auto const& pp) { return pp.first == s; }))
+				peers.emplace_back(s, h);
+			check(e.address());
+			continue;
+		}
+
+		auto const idx = random(std::uint32_t(peers.size() - 1));
+		auto const [s, h] = peers[idx];
+		TEST_CHECK(s->ip() == h->ip());
+		TEST_CHECK(sorted.has_peer(s));
+		TEST_CHECK(hashed.has_peer(h));
+		switch (op)
+		{
+			case 5:
+			{
+				int const f = int(random(4));
+				sorted.set_failcount(s, f);
+				hashed.set_failcount(h, f);
+				break;
+			}
+			case 6:
+			{
+				bool const seed = random(1);
+				sorted.set_seed(s, seed);
+				hashed.set_seed(h, seed);
+				break;
+			}
+			case 7:
+				sorted.ban_peer(s);
+				hashed.ban_peer(h);
+				break;
+			case 8:
+				sorted.erase_peer(s, &st);
+				hashed.erase_peer(h, &st);
+				st.erased.clear();
+				peers.erase(peers.begin() + idx);
+				TEST_CHECK(!hashed.has_peer(h));
+				break;
+		}
+		check(s->address());
+	}
+
+	// the best candidate is the same, up to ties
+	st.is_finished = true;
+	torrent_peer* s = sorted.connect_one_peer(0, &st);
+	torrent_peer* h = hashed.connect_one_peer(0, &st);
+	TEST_EQUAL(s == nullptr, h == nullptr);
+	if (s && h)
+	{
+		TEST_EQUAL(s->failcount, h->failcount);
+		TEST_CHECK(!h->seed);
+		TEST_CHECK(!h->banned);
+	}
+	TEST_EQUAL(sorted.num_connect_candidates(), hashed.num_connect_candidates());
+}
+
+// in hash index mode, the best connect candidate is found even if it's not
+// in the part of the peer list that would be scanned
+TORRENT_TEST(hash_index_candidate_order)
+{
+	torrent_state st = init_state();
+	st.max_peerlist_size = 0;
+	peer_list p(allocator);
+	p.set_hash_index(true);
+
+	torrent_peer* best = nullptr;
+	for (int i = 0; i < 2000; ++i)
+	{
+		torrent_peer* peer = add_peer(p, st, rand_tcp_ep());
+		TEST_CHECK(peer);
+		if (peer == nullptr) continue;
+		if (i == 1234) best = peer;
+		else p.set_failcount(peer, 1);
+	}
+	TEST_EQUAL(p.num_peers(), 2000);
+	TEST_EQUAL(p.num_connect_candidates(), 2000);
+
+	mock_torrent t(&st);
+	t.m_p = &p;
+	torrent_peer* tp = p.connect_one_peer(0, &st);
+	TEST_EQUAL(tp, best);
+	t.connect_to_peer(tp);
+	TEST_EQUAL(p.num_connect_candidates(), 1999);
+
+	// once it fails, it's no better than the others
+	p.inc_failcount(best);
+	auto const con = t.m_connections.back();
+	con->disconnect(errors::timed_out, operation_t::connect);
+	tp = p.connect_one_peer(0, &st);
+	TEST_CHECK(tp != nullptr);
+	TEST_CHECK(tp != best);
+	TEST_EQUAL(int(tp->failcount), 1);
+}
+
+// the sorted peer list caches ranks in the slots of the shared allocator
+TORRENT_TEST(peer_rank_slot)
+{
+	torrent_peer_allocator alloc;
+	TEST_CHECK(alloc.has_rank_slots());
+	torrent_state st = init_state();
+	peer_list p(alloc);
+
+	torrent_peer* peer = p.add_peer(ep("10.0.0.2", 3000), {}, {}, &st);
+	TEST_CHECK(peer != nullptr);
+	TEST_EQUAL(torrent_peer_allocator::rank_slot(peer), 0);
+	TEST_EQUAL(alloc.live_bytes(), int(alignof(torrent_peer) + sizeof(ipv4_peer)));
+
+	// a single candidate is never compared, so it needs a second one
+	p.add_peer(ep("10.0.0.3", 3000), {}, {}, &st);
+	TEST_CHECK(p.connect_one_peer(0, &st) != nullptr);
+	TEST_EQUAL(torrent_peer_allocator::rank_slot(peer)
+		, peer->rank(st.ip, st.port));
+
+	// our external IP changed
+	p.clear_peer_prio();
+	TEST_EQUAL(torrent_peer_allocator::rank_slot(peer), 0);
+}
+
+TORRENT_TEST(peer_slab_allocator)
+{
+	torrent_peer_slab_allocator alloc;
+	TEST_EQUAL(alloc.live_allocations(), 0);
+	TEST_EQUAL(alloc.reserved_bytes(), 0);
+
+	std::vector<torrent_peer*> peers;
+	for (int i = 0; i < 1000; ++i)
+	{
+		torrent_peer* p = alloc.allocate_peer_entry(
+			torrent_peer_allocator_interface::ipv4_peer_type);
+		TEST_CHECK(p != nullptr);
+		new (p) ipv4_peer(ep("10.0.0.1", std::uint16_t(1000 + i)), true, {});
+		peers.push_back(p);
+	}
+	TEST_EQUAL(alloc.live_allocations(), 1000);
+	TEST_EQUAL(alloc.live_bytes(), int(1000 * sizeof(ipv4_peer)));
+	TEST_CHECK(alloc.reserved_bytes() >= alloc.live_bytes());
+	TEST_CHECK(alloc.reserved_bytes() < alloc.live_bytes()
+		+ int(torrent_peer_slab_allocator::max_slab_entries * sizeof(ipv4_peer)));
+
+	// the entries are packed back to back
+	TEST_EQUAL(reinterpret_cast<char*>(peers[1]) - reinterpret_cast<char*>(peers[0])
+		, int(sizeof(ipv4_peer)));
+	TEST_EQUAL(reinterpret_cast<std::uintptr_t>(peers[0]) % 64, 0);
+
+	torrent_peer* v6 = alloc.allocate_peer_entry(
+		torrent_peer_allocator_interface::ipv6_peer_type);
+	TEST_CHECK(v6 != nullptr);
+	new (v6) ipv6_peer(ep("2001::1", 6881), true, {});
+	TEST_EQUAL(alloc.live_bytes(), int(1000 * sizeof(ipv4_peer) + sizeof(ipv6_peer)));
+	alloc.free_peer_entry(v6);
+
+	// freed entries are reused
+	torrent_peer* const freed = peers[500];
+	alloc.free_peer_entry(freed);
+	peers.erase(peers.begin() + 500);
+	torrent_peer* p = alloc.allocate_peer_entry(
+		torrent_peer_allocator_interface::ipv4_peer_type);
+	TEST_EQUAL(p, freed);
+	new (p) ipv4_peer(ep("10.0.0.2", 1), true, {});
+	peers.push_back(p);
+
+	for (auto* e : peers) alloc.free_peer_entry(e);
+	TEST_EQUAL(alloc.live_allocations(), 0);
+	TEST_EQUAL(alloc.live_bytes(), 0);
+	TEST_EQUAL(alloc.total_allocations(), 1002);
+
+	// only one slab per peer type is kept
+	TEST_CHECK(alloc.reserved_bytes() <= int(torrent_peer_slab_allocator::max_slab_entries
+		* (sizeof(ipv4_peer) + sizeof(ipv6_peer))));
+}
+
+// a peer list allocating its peers from a torrent_peer_slab_allocator
+TORRENT_TEST(peer_slab_allocator_peer_list)
+{
+	torrent_peer_slab_allocator alloc;
+	torrent_state st = init_state();
+	st.max_peerlist_size = 0;
+	st.allow_multiple_connections_per_ip = true;
+	{
+		peer_list p(alloc);
+		std::vector<torrent_peer*> peers;
+		for (int i = 0; i < 3000; ++i)
+		{
+			tcp::endpoint const e = (i % 3 == 0)
+				? tcp::endpoint(addr("2001::1"), std::uint16_t(1000 + i))
+				: rand_tcp_ep();
+			torrent_peer* peer = p.add_peer(e, peer_info::tracker, {}, &st);
+			TEST_CHECK(peer);
+			if (peer) peers.push_back(peer);
+		}
+		TEST_EQUAL(p.num_peers(), alloc.live_allocations());
+
+		aux::random_shuffle(peers);
+		peers.resize(peers.size() / 2);
+		for (auto* peer : peers) p.erase_peer(peer, &st);
+		TEST_EQUAL(p.num_peers(), alloc.live_allocations());
+
+		torrent_peer* peer = p.connect_one_peer(0, &st);
+		TEST_CHECK(peer != nullptr);
+	}
+	TEST_EQUAL(alloc.live_allocations(), 0);
+	TEST_EQUAL(alloc.live_bytes(), 0);
+}
+
 // TODO: test erasing peers
 // TODO: test update_peer_port with allow_multiple_connections_per_ip and without
 // TODO: test add i2p peers
@@ -2947,3 +2947,124 @@ TORRENT_TEST(piece_block_exported)
 
 //TODO: 2 test picking with partial pieces and other peers present so that both
 // backup_pieces and backup_pieces2 are used
+
+namespace {
+
+// returns the pieces in the order they are picked by a peer that has all of
+// them
+std::vector<piece_index_t> pick_order(piece_picker const& p)
+{
+	typed_bitfield<piece_index_t> all(p.num_pieces(), true);
+	std::vector<piece_block> picked;
+	counters cnt;
+	p.pick_pieces(all, picked, p.num_pieces() * blocks_per_piece, 0, nullptr
+		, piece_picker::rarest_first, empty_vector, 20, cnt);
+	std::vector<piece_index_t> ret;
+	for (auto const& b : picked)
+		if (ret.empty() || ret.back() != b.piece_index) ret.push_back(b.piece_index);
+	return ret;
+}
+
+} // anonymous namespace
+
+// peers with bitfields and seeds joining and leaving, applied to a piece
+// picker that updates its piece list incrementally and to one that rebuilds
+// it. Both must agree on availability, and pick pieces in priority order
+TORRENT_TEST(incremental_availability)
+{
+	int const num_pieces = 300;
+	std::int64_t const total_size = std::int64_t(num_pieces) * default_piece_size;
+	piece_picker reference(total_size, default_piece_size);
+	piece_picker incremental(total_size, default_piece_size);
+	incremental.set_incremental_availability(true);
+
+	// pieces we have, and pieces with a non-default priority
+	for (int i = 0; i < num_pieces; i += 7)
+	{
+		reference.piece_flushed(piece_index_t(i));
+		incremental.piece_flushed(piece_index_t(i));
+	}
+	aux::vector<download_priority_t, piece_index_t> prio(num_pieces, default_priority);
+	for (int i = 3; i < num_pieces; i += 5)
+	{
+		prio[piece_index_t(i)] = download_priority_t(std::uint8_t((i % 7) + 1));
+		if (i % 11 == 0) prio[piece_index_t(i)] = dont_download;
+		reference.set_piece_priority(piece_index_t(i), prio[piece_index_t(i)]);
+		incremental.set_piece_priority(piece_index_t(i), prio[piece_index_t(i)]);
+	}
+
+	// the peers (not seeds) we're connected to, and how many of them have
+	// each piece
+	std::vector<std::pair<std::unique_ptr<ipv4_peer>, typed_bitfield<piece_index_t>>> peers;
+	std::vector<std::unique_ptr<ipv4_peer>> seeds;
+	aux::vector<int, piece_index_t> peer_count(num_pieces, 0);
+
+	auto new_peer = [] {
+		auto ret = std::make_unique<ipv4_peer>(endp, false, peer_source_flags_t{});
+#if TORRENT_USE_ASSERTS
+		ret->in_use = true;
+#endif
+		return ret;
+	};
+
+	for (int round = 0; round < 400; ++round)
+	{
+		int const action = int(aux::random(9));
+		if (action < 4 || peers.empty())
+		{
+			// a peer joins, with a bitfield of random density. It never has
+			// all pieces, since that counts as a seed
+			typed_bitfield<piece_index_t> bits(num_pieces, false);
+			int const density = int(aux::random(100));
+			for (auto i = 0_piece; i < bits.end_index(); ++i)
+				if (int(aux::random(100)) < density) bits.set_bit(i);
+			bits.clear_bit(piece_index_t(int(aux::random(num_pieces - 1))));
+			for (auto i = 0_piece; i < bits.end_index(); ++i)
+				if (bits.get_bit(i)) ++peer_count[i];
+			peers.emplace_back(new_peer(), bits);
+			reference.inc_refcount(bits, peers.back().first.get());
+			incremental.inc_refcount(bits, peers.back().first.get());
+		}
+		else if (action < 7)
+		{
+			// a peer leaves
+			std::size_t const idx = aux::random(std::uint32_t(peers.size() - 1));
+			auto const& bits = peers[idx].second;
+			for (auto i = 0_piece; i < bits.end_index(); ++i)
+				if (bits.get_bit(i)) --peer_count[i];
+			reference.dec_refcount(bits, peers[idx].first.get());
+			incremental.dec_refcount(bits, peers[idx].first.get());
+			peers.erase(peers.begin() + std::ptrdiff_t(idx));
+		}
+		else if (action == 7 || seeds.empty())
+		{
+			seeds.push_back(new_peer());
+			reference.inc_refcount_all(seeds.back().get());
+			incremental.inc_refcount_all(seeds.back().get());
+		}
+		else
+		{
+			reference.dec_refcount_all(seeds.back().get());
+			incremental.dec_refcount_all(seeds.back().get());
+			seeds.pop_back();
+		}
+
+		aux::vector<int, piece_index_t> ref_avail;
+		aux::vector<int, piece_index_t> inc_avail;
+		reference.get_availability(ref_avail);
+		incremental.get_availability(inc_avail);
+		TEST_CHECK(ref_avail == inc_avail);
+
+		// pieces are picked in the order of their priority, which is based on
+		// the number of peers (not counting seeds) that have them
+		auto const ref_order = pick_order(reference);
+		auto const inc_order = pick_order(incremental);
+		TEST_EQUAL(ref_order.size(), inc_order.size());
+		TEST_CHECK(std::is_permutation(ref_order.begin(), ref_order.end(), inc_order.begin()));
+
+		auto const key = [&](piece_index_t const i)
+		{ return (peer_count[i] + 1) * (8 - static_cast<int>(static_cast<std::uint8_t>(prio[i]))); };
+		for (std::size_t i = 1; i < inc_order.size(); ++i)
+			TEST_CHECK(key(inc_order[i - 1]) <= key(inc_order[i]));
+	}
+}
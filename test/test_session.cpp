@@ -268,6 +268,59 @@ TORRENT_TEST(paused_session)
 	TEST_CHECK(!(h.flags() & torrent_flags::paused));
 }
 
+namespace {
+torrent_status_deltas wait_for_deltas(lt::session& ses)
+{
+	ses.post_status_deltas();
+	auto* a = alert_cast<state_delta_alert>(wait_for_alert(ses
+		, state_delta_alert::alert_type, "ses"));
+	TEST_CHECK(a);
+	if (a == nullptr) return {};
+	return a->deltas;
+}
+}
+
+TORRENT_TEST(post_status_deltas)
+{
+	lt::session ses(settings());
+
+	std::ofstream file("temporary");
+	lt::add_torrent_params p = ::create_torrent(&file, "temporary", 16 * 1024, 13, false);
+	p.flags |= torrent_flags::paused;
+	p.flags &= ~torrent_flags::auto_managed;
+	p.save_path = ".";
+	torrent_handle h = ses.add_torrent(std::move(p));
+
+	// the first delta of a torrent reports all fields
+	torrent_status_deltas d = wait_for_deltas(ses);
+	TEST_EQUAL(d.size(), 1);
+	if (d.size() != 1) return;
+	TEST_CHECK(d.handles[0] == h);
+	TEST_CHECK(d.changed[0] == status_fields_t::all());
+	TEST_EQUAL(int(d.state.size()), 1);
+	TEST_EQUAL(int(d.num_seeds.size()), 1);
+
+	torrent_status const st = h.status();
+	TEST_EQUAL(d.total_wanted[0], st.total_wanted);
+	TEST_EQUAL(d.total_done[0], st.total_done);
+	TEST_CHECK(d.flags[0] & torrent_flags::paused);
+
+	// once the torrent settles, it's not reported anymore
+	for (int i = 0; i < 20 && d.size() > 0; ++i)
+	{
+		std::this_thread::sleep_for(lt::milliseconds(100));
+		d = wait_for_deltas(ses);
+	}
+	TEST_EQUAL(d.size(), 0);
+
+	h.resume();
+	d = wait_for_deltas(ses);
+	TEST_EQUAL(d.size(), 1);
+	if (d.size() != 1) return;
+	TEST_CHECK(d.changed[0] & status_field::flags);
+	TEST_CHECK(!(d.flags[0] & torrent_flags::paused));
+}
+
 template <typename Set, typename Save, typename Test>
 void test_save_restore(Set setup, Save s, Test t)
 {
@@ -0,0 +1,245 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "libtorrent/aux_/slab_allocator.hpp"
+#include "libtorrent/aux_/random.hpp"
+#include "libtorrent/time.hpp"
+
+#include "test.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+int const block_size = 0x4000;
+
+std::vector<char*> allocate_blocks(aux::slab_allocator& a, int const num)
+{
+	std::vector<char*> ret;
+	for (int i = 0; i < num; ++i)
+	{
+		char* b = a.allocate();
+		TEST_CHECK(b != nullptr);
+		ret.push_back(b);
+	}
+	return ret;
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(allocate_free)
+{
+	aux::slab_allocator a(block_size);
+	TEST_EQUAL(a.blocks_per_slab(), aux::slab_allocator::slab_size / block_size);
+
+	// allocate a bit more than seven slabs worth of blocks
+	int const num_blocks = a.blocks_per_slab() * 7 + 10;
+	std::vector<char*> blocks = allocate_blocks(a, num_blocks);
+
+	// every block is distinct and writable
+	std::set<char*> unique(blocks.begin(), blocks.end());
+	TEST_EQUAL(int(unique.size()), num_blocks);
+	for (int i = 0; i < num_blocks; ++i)
+		std::memset(blocks[std::size_t(i)], i & 0xff, block_size);
+	for (int i = 0; i < num_blocks; ++i)
+	{
+		char const* b = blocks[std::size_t(i)];
+		TEST_CHECK(std::all_of(b, b + block_size, [i](char c) { return c == char(i & 0xff); }));
+	}
+
+#ifndef TORRENT_ADDRESS_SANITIZER
+	auto st = a.stats();
+	TEST_EQUAL(st.slabs, 8);
+	TEST_EQUAL(st.huge_page_slabs, 0);
+	// the allocated blocks plus the ones left in the cache and the slabs
+	TEST_EQUAL(st.slabs * a.blocks_per_slab(), num_blocks + st.cached_blocks + st.free_slab_blocks);
+#endif
+
+	for (char* b : blocks) a.free(b);
+
+#ifndef TORRENT_ADDRESS_SANITIZER
+	// the slabs are released, except the ones the blocks still in the cache
+	// belong to, and the last one with free blocks
+	st = a.stats();
+	TEST_CHECK(st.slabs <= 3);
+	TEST_EQUAL(st.cached_blocks + st.free_slab_blocks, st.slabs * a.blocks_per_slab());
+#endif
+}
+
+TORRENT_TEST(reuse)
+{
+	aux::slab_allocator a(block_size);
+
+	// blocks that are freed are handed out again, rather than mapping more
+	// memory
+	for (int i = 0; i < 10; ++i)
+	{
+		std::vector<char*> blocks = allocate_blocks(a, 100);
+		for (char* b : blocks) a.free(b);
+	}
+#ifndef TORRENT_ADDRESS_SANITIZER
+	TEST_EQUAL(a.stats().slabs, 1);
+#endif
+}
+
+TORRENT_TEST(fragmentation)
+{
+	aux::slab_allocator a(block_size);
+	std::vector<char*> blocks = allocate_blocks(a, a.blocks_per_slab() * 4);
+
+	// free every other block. None of the slabs can be released
+	std::vector<char*> keep;
+	for (std::size_t i = 0; i < blocks.size(); ++i)
+	{
+		if (i & 1) a.free(blocks[i]);
+		else keep.push_back(blocks[i]);
+	}
+
+#ifndef TORRENT_ADDRESS_SANITIZER
+	auto const st = a.stats();
+	TEST_EQUAL(st.slabs, 4);
+	TEST_EQUAL(st.cached_blocks + st.free_slab_blocks, a.blocks_per_slab() * 2);
+#endif
+
+	for (char* b : keep) a.free(b);
+}
+
+TORRENT_TEST(huge_pages)
+{
+	// huge pages may not be available, but allocation must still succeed
+	aux::slab_allocator a(block_size);
+	a.set_huge_pages(true);
+	std::vector<char*> blocks = allocate_blocks(a, a.blocks_per_slab());
+	for (char* b : blocks) std::memset(b, 0xcc, block_size);
+#ifndef TORRENT_ADDRESS_SANITIZER
+	auto const st = a.stats();
+	TEST_CHECK(st.huge_page_slabs <= st.slabs);
+	std::printf("slabs: %d huge page slabs: %d\n", st.slabs, st.huge_page_slabs);
+#endif
+	for (char* b : blocks) a.free(b);
+}
+
+TORRENT_TEST(numa_arenas)
+{
+	aux::slab_allocator a(block_size);
+	a.set_numa(true);
+	std::vector<char*> blocks = allocate_blocks(a, 1000);
+	for (char* b : blocks) a.free(b);
+}
+
+TORRENT_TEST(multi_threaded)
+{
+	// blocks are allocated in one set of threads and freed in another, the
+	// way the network thread allocates blocks that the disk threads free
+	aux::slab_allocator a(block_size);
+	int const num_threads = 4;
+	int const num_blocks = 20000;
+
+	std::vector<std::vector<char*>> allocated(num_threads);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < num_threads; ++t)
+	{
+		threads.emplace_back([&a, &allocated, t] {
+			auto& blocks = allocated[std::size_t(t)];
+			for (int i = 0; i < num_blocks; ++i)
+			{
+				char* b = a.allocate();
+				if (b == nullptr) continue;
+				// write a pattern that's checked by the thread freeing it
+				std::memcpy(b, &i, sizeof(i));
+				blocks.push_back(b);
+				if (blocks.size() > 200)
+				{
+					// free some of our own blocks too
+					for (int k = 0; k < 50; ++k)
+					{
+						a.free(blocks.back());
+						blocks.pop_back();
+					}
+				}
+			}
+		});
+	}
+	for (auto& t : threads) t.join();
+	threads.clear();
+
+	std::set<char*> unique;
+	int total = 0;
+	for (auto const& v : allocated)
+	{
+		total += int(v.size());
+		unique.insert(v.begin(), v.end());
+	}
+	TEST_EQUAL(int(unique.size()), total);
+
+	for (int t = 0; t < num_threads; ++t)
+	{
+		threads.emplace_back([&a, &allocated, t] {
+			// free the blocks allocated by another thread
+			for (char* b : allocated[std::size_t((t + 1) % num_threads)])
+				a.free(b);
+		});
+	}
+	for (auto& t : threads) t.join();
+
+#ifndef TORRENT_ADDRESS_SANITIZER
+	auto const st = a.stats();
+	TEST_EQUAL(st.slabs * a.blocks_per_slab(), st.cached_blocks + st.free_slab_blocks);
+#endif
+}
+
+// compares allocating and freeing blocks with the slab allocator to malloc()
+// and free(), from two threads, where blocks allocated in one thread are freed
+// in the other
+TORRENT_TEST(benchmark)
+{
+	int const num_blocks = 200000;
+	int const in_flight = 256;
+
+	auto run = [&](auto alloc, auto dealloc) {
+		time_point const start = clock_type::now();
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 2; ++t)
+		{
+			threads.emplace_back([&] {
+				std::vector<char*> blocks;
+				for (int i = 0; i < num_blocks; ++i)
+				{
+					char* b = alloc();
+					b[0] = char(i);
+					blocks.push_back(b);
+					if (int(blocks.size()) == in_flight)
+					{
+						for (char* p : blocks) dealloc(p);
+						blocks.clear();
+					}
+				}
+				for (char* p : blocks) dealloc(p);
+			});
+		}
+		for (auto& t : threads) t.join();
+		return total_microseconds(clock_type::now() - start);
+	};
+
+	aux::slab_allocator a(block_size);
+	auto const slab_time = run([&] { return a.allocate(); }, [&](char* b) { a.free(b); });
+	auto const malloc_time = run([] { return static_cast<char*>(std::malloc(block_size)); }
+		, [](char* b) { std::free(b); });
+
+	std::printf("slab_allocator: %.1f Mops/s malloc: %.1f Mops/s\n"
+		, 2.0 * num_blocks / double(std::max(slab_time, std::int64_t(1)))
+		, 2.0 * num_blocks / double(std::max(malloc_time, std::int64_t(1))));
+}
@@ -34,8 +34,12 @@ see LICENSE file.
 #include "libtorrent/aux_/random.hpp"
 #include "libtorrent/mmap_disk_io.hpp"
 #include "libtorrent/posix_disk_io.hpp"
+#include "libtorrent/pread_disk_io.hpp"
+#include "libtorrent/io_uring_disk_io.hpp"
 #include "libtorrent/flags.hpp"
 #include "libtorrent/aux_/readwrite.hpp"
+#include "libtorrent/aux_/pread_storage.hpp"
+#include "libtorrent/aux_/file_pool.hpp"
 #include "libtorrent/load_torrent.hpp"
 
 #include <memory>
@@ -60,6 +64,7 @@ namespace {
 using lt::aux::mmap_storage;
 #endif
 using lt::aux::posix_storage;
+using lt::aux::pread_storage;
 
 constexpr int piece_size = 16 * 1024 * 16;
 constexpr int half = piece_size / 2;
@@ -176,6 +181,12 @@ struct file_pool_type<posix_storage>
 	using type = int;
 };
 
+template <>
+struct file_pool_type<pread_storage>
+{
+	using type = aux::file_pool;
+};
+
 template <typename StorageType>
 std::shared_ptr<StorageType> make_storage(storage_params const& p
 	, typename file_pool_type<StorageType>::type& fp);
@@ -196,6 +207,13 @@ std::shared_ptr<posix_storage> make_storage(storage_params const& p
 	return std::make_shared<posix_storage>(p);
 }
 
+template <>
+std::shared_ptr<pread_storage> make_storage(storage_params const& p
+	, aux::file_pool& fp)
+{
+	return std::make_shared<pread_storage>(p, fp);
+}
+
 template <typename StorageType, typename FilePool>
 std::pair<std::shared_ptr<StorageType>, std::shared_ptr<torrent_info const>>
 setup_torrent(
@@ -287,6 +305,32 @@ int read(std::shared_ptr<posix_storage> s
 
 void release_files(std::shared_ptr<posix_storage>, storage_error&) {}
 
+int write(std::shared_ptr<pread_storage> s
+	, aux::session_settings const& sett
+	, span<char> buf
+	, piece_index_t const piece, int const offset
+	, aux::open_mode_t const mode
+	, storage_error& error)
+{
+	return s->write(sett, buf, piece, offset, mode, disk_job_flags_t{}, error);
+}
+
+int read(std::shared_ptr<pread_storage> s
+	, aux::session_settings const& sett
+	, span<char> buf
+	, piece_index_t piece
+	, int const offset
+	, aux::open_mode_t mode
+	, storage_error& ec)
+{
+	return s->read(sett, buf, piece, offset, mode, disk_job_flags_t{}, ec);
+}
+
+void release_files(std::shared_ptr<pread_storage> s, storage_error& ec)
+{
+	s->release_files(ec);
+}
+
 std::vector<char> new_piece(std::size_t const size)
 {
 	std::vector<char> ret(size);
@@ -843,6 +887,38 @@ TORRENT_TEST(check_files_allocate_posix)
 	test_check_files(zero_prio, lt::posix_disk_io_constructor);
 }
 
+TORRENT_TEST(check_files_sparse_pread)
+{
+	test_check_files(sparse | zero_prio, lt::pread_disk_io_constructor);
+}
+
+TORRENT_TEST(check_files_oversized_pread)
+{
+	test_check_files(sparse | test_oversized, lt::pread_disk_io_constructor);
+}
+
+TORRENT_TEST(check_files_allocate_pread)
+{
+	test_check_files(zero_prio, lt::pread_disk_io_constructor);
+}
+
+#if TORRENT_HAVE_IO_URING
+TORRENT_TEST(check_files_sparse_io_uring)
+{
+	test_check_files(sparse | zero_prio, lt::io_uring_disk_io_constructor);
+}
+
+TORRENT_TEST(check_files_oversized_io_uring)
+{
+	test_check_files(sparse | test_oversized, lt::io_uring_disk_io_constructor);
+}
+
+TORRENT_TEST(check_files_allocate_io_uring)
+{
+	test_check_files(zero_prio, lt::io_uring_disk_io_constructor);
+}
+#endif
+
 // posix_storage is meant to only use the most portable API for disk I/O, and so
 // doesn't support pre-allocating files
 /*
@@ -874,6 +950,16 @@ TORRENT_TEST(remove_posix_disk_io)
 	test_remove<posix_storage>(current_working_directory());
 }
 
+TORRENT_TEST(rename_pread_disk_io)
+{
+	test_rename<pread_storage>(current_working_directory());
+}
+
+TORRENT_TEST(remove_pread_disk_io)
+{
+	test_remove<pread_storage>(current_working_directory());
+}
+
 void test_fastresume(bool const test_deprecated)
 {
 	std::string test_path = current_working_directory();
@@ -1221,6 +1307,7 @@ bool check_pattern(std::vector<char> const& buf, int counter)
 TORRENT_TEST(mmap_disk_io) { run_test<mmap_storage>(); }
 #endif
 TORRENT_TEST(posix_disk_io) { run_test<posix_storage>(); }
+TORRENT_TEST(pread_disk_io) { run_test<pread_storage>(); }
 
 namespace {
 
@@ -1575,6 +1662,22 @@ TORRENT_TEST(move_posix_storage_reset)
 	test_move_storage_reset<posix_storage>(move_flags_t::reset_save_path_unchecked);
 }
 
+TORRENT_TEST(move_pread_storage_to_self)
+{
+	test_move_storage_to_self<pread_storage>();
+}
+
+TORRENT_TEST(move_pread_storage_into_self)
+{
+	test_move_storage_into_self<pread_storage>();
+}
+
+TORRENT_TEST(move_pread_storage_reset)
+{
+	test_move_storage_reset<pread_storage>(move_flags_t::reset_save_path);
+	test_move_storage_reset<pread_storage>(move_flags_t::reset_save_path_unchecked);
+}
+
 TORRENT_TEST(storage_paths_string_pooling)
 {
 	file_storage file_storage;
@@ -1846,6 +1949,82 @@ TORRENT_TEST(mmap_unaligned_read_both_store_buffer)
 }
 #endif
 
+#if TORRENT_HAVE_MMAP
+TORRENT_TEST(mmap_zero_copy_read)
+{
+	lt::io_context ioc;
+	lt::counters cnt;
+	lt::settings_pack pack;
+	pack.set_int(lt::settings_pack::aio_threads, 1);
+
+	std::unique_ptr<lt::disk_interface> disk_io
+		= lt::mmap_disk_io_constructor(ioc, pack, cnt);
+
+	// files smaller than 1 MiB are not memory mapped
+	int const piece_size = lt::default_block_size * 4;
+	lt::file_storage fs;
+	fs.add_file("test", std::int64_t(piece_size) * 32);
+	fs.set_num_pieces(32);
+	fs.set_piece_length(piece_size);
+
+	std::string const save_path = complete("save_path");
+	delete_dirs(combine_path(save_path, "test"));
+
+	lt::aux::vector<lt::download_priority_t, lt::file_index_t> prios;
+	lt::renamed_files rf;
+	lt::storage_params params(fs, rf, save_path, {}, lt::storage_mode_sparse
+		, prios, lt::sha1_hash("01234567890123456789"), true, true);
+	lt::storage_holder t = disk_io->new_torrent(params, {});
+
+	int outstanding = 0;
+	lt::add_torrent_params atp;
+	disk_io->async_check_files(t, &atp, lt::aux::vector<std::string, lt::file_index_t>{}
+		, [&](lt::status_t, lt::storage_error const&) { --outstanding; });
+	++outstanding;
+	disk_io->submit_jobs();
+	sync(ioc, outstanding);
+
+	std::vector<char> write_buffer(static_cast<std::size_t>(piece_size));
+	aux::random_bytes(write_buffer);
+	for (int i = 0; i < piece_size; i += lt::default_block_size)
+	{
+		++outstanding;
+		disk_io->async_write(t, {0_piece, i, lt::default_block_size}
+			, write_buffer.data() + i, {}, write_handler(outstanding));
+	}
+	disk_io->submit_jobs();
+	sync(ioc, outstanding);
+
+	// an aligned and an unaligned read, both served straight out of the
+	// mapping
+	lt::peer_request const reqs[] = {
+		{0_piece, lt::default_block_size, lt::default_block_size},
+		{0_piece, lt::default_block_size / 2, lt::default_block_size},
+	};
+	for (auto const& r : reqs)
+	{
+		++outstanding;
+		disk_io->async_read(t, r, read_handler(outstanding
+			, {write_buffer.data() + r.start, r.length}), lt::disk_interface::zero_copy);
+	}
+	disk_io->submit_jobs();
+	sync(ioc, outstanding);
+
+	TEST_EQUAL(cnt[lt::counters::num_zero_copy_reads], 2);
+
+	// without the flag, the blocks are copied
+	++outstanding;
+	disk_io->async_read(t, reqs[0], read_handler(outstanding
+		, {write_buffer.data() + reqs[0].start, reqs[0].length}));
+	disk_io->submit_jobs();
+	sync(ioc, outstanding);
+	TEST_EQUAL(cnt[lt::counters::num_zero_copy_reads], 2);
+
+	t.reset();
+	disk_io->abort(true);
+}
+#endif
+
 TORRENT_TEST(posix_unaligned_read_both_store_buffer)
 {
 	test_unaligned_read(lt::posix_disk_io_constructor, both_sides_from_store_buffer);
@@ -1854,6 +2033,24 @@ TORRENT_TEST(posix_unaligned_read_both_store_buffer)
 	test_unaligned_read(lt::posix_disk_io_constructor, none_from_store_buffer);
 }
 
+TORRENT_TEST(pread_unaligned_read_both_store_buffer)
+{
+	test_unaligned_read(lt::pread_disk_io_constructor, both_sides_from_store_buffer);
+	test_unaligned_read(lt::pread_disk_io_constructor, first_side_from_store_buffer);
+	test_unaligned_read(lt::pread_disk_io_constructor, second_side_from_store_buffer);
+	test_unaligned_read(lt::pread_disk_io_constructor, none_from_store_buffer);
+}
+
+#if TORRENT_HAVE_IO_URING
+TORRENT_TEST(io_uring_unaligned_read_both_store_buffer)
+{
+	test_unaligned_read(lt::io_uring_disk_io_constructor, both_sides_from_store_buffer);
+	test_unaligned_read(lt::io_uring_disk_io_constructor, first_side_from_store_buffer);
+	test_unaligned_read(lt::io_uring_disk_io_constructor, second_side_from_store_buffer);
+	test_unaligned_read(lt::io_uring_disk_io_constructor, none_from_store_buffer);
+}
+#endif
+
 
 using part_file_flag_t = lt::flags::bitfield_flag<std::uint64_t, struct test_part_file_flag_type_tag>;
 
@@ -1977,3 +2174,14 @@ TORRENT_TEST(posix_disk_io_part_file)
 		}
 	}
 }
+
+TORRENT_TEST(pread_disk_io_part_file)
+{
+	for (auto storage_mode : { storage_mode_sparse, storage_mode_allocate })
+	{
+		for (auto flags : {part_file_flag_t{}, custom_path})
+		{
+			test_part_file<pread_storage>(storage_mode, flags);
+		}
+	}
+}
@@ -0,0 +1,127 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "test.hpp"
+#include "libtorrent/aux_/timer_wheel.hpp"
+#include "libtorrent/aux_/random.hpp"
+
+#include <map>
+#include <vector>
+
+using namespace lt;
+
+TORRENT_TEST(fire_in_order)
+{
+	aux::timer_wheel<int> w(1000);
+	w.schedule(3, 1003);
+	w.schedule(1, 1001);
+	w.schedule(2, 1002);
+	w.schedule(0, 1000);
+	TEST_EQUAL(w.size(), 4);
+
+	std::vector<int> fired;
+	auto const f = [&](int const i) { fired.push_back(i); };
+
+	w.advance(1001, f);
+	TEST_CHECK((fired == std::vector<int>{0, 1}));
+	TEST_EQUAL(w.size(), 2);
+	TEST_EQUAL(w.now(), 1002);
+
+	w.advance(1010, f);
+	TEST_CHECK((fired == std::vector<int>{0, 1, 2, 3}));
+	TEST_CHECK(w.empty());
+}
+
+TORRENT_TEST(schedule_in_past)
+{
+	aux::timer_wheel<int> w(100);
+	w.advance(200, [](int) { TEST_ERROR("nothing should fire"); });
+	w.schedule(1, 50);
+	int count = 0;
+	w.advance(200, [&](int) { TEST_ERROR("not due until next tick"); });
+	w.advance(201, [&](int const i) { TEST_EQUAL(i, 1); ++count; });
+	TEST_EQUAL(count, 1);
+}
+
+TORRENT_TEST(reschedule_from_callback)
+{
+	aux::timer_wheel<int> w(0);
+	w.schedule(0, 10);
+	std::vector<std::int64_t> ticks;
+	for (std::int64_t now = 0; now < 100; ++now)
+	{
+		w.advance(now, [&](int const i)
+		{
+			ticks.push_back(now);
+			if (i < 3) w.schedule(i + 1, now + 10);
+		});
+	}
+	TEST_CHECK((ticks == std::vector<std::int64_t>{10, 20, 30, 40}));
+	TEST_CHECK(w.empty());
+}
+
+// schedule items at random distances, covering every level of the wheel as
+// well as ticks beyond its range, and make sure each one fires exactly at its
+// tick
+TORRENT_TEST(cascade)
+{
+	std::int64_t const start = 123456;
+	aux::timer_wheel<int> w(start);
+	std::map<int, std::int64_t> expected;
+	std::int64_t const ranges[] = {64, 64 * 64, 64 * 64 * 64, 64 * 64 * 64 * 64 * 3};
+	int id = 0;
+	for (auto const r : ranges)
+	{
+		for (int i = 0; i < 200; ++i)
+		{
+			std::int64_t const tick = start + std::int64_t(aux::random(std::uint32_t(r)));
+			expected[id] = tick;
+			w.schedule(id, tick);
+			++id;
+		}
+	}
+	TEST_EQUAL(w.size(), id);
+
+	std::int64_t const end = start + ranges[3];
+	int count = 0;
+	// advance in uneven steps
+	for (std::int64_t now = start; now <= end; now += 1 + std::int64_t(aux::random(1000)))
+	{
+		w.advance(now, [&](int const i)
+		{
+			TEST_CHECK(expected[i] <= now);
+			// the tick being processed
+			TEST_EQUAL(expected[i], w.now() - 1);
+			++count;
+		});
+	}
+	w.advance(end, [&](int) { ++count; });
+	TEST_EQUAL(count, id);
+	TEST_CHECK(w.empty());
+}
+
+TORRENT_TEST(exact_tick)
+{
+	// advancing one tick at a time, every item must fire at exactly its tick
+	aux::timer_wheel<std::int64_t> w(0);
+	std::int64_t const ticks[] = {0, 1, 63, 64, 65, 4095, 4096, 4097
+		, 64 * 64 * 64 - 1, 64 * 64 * 64, 64 * 64 * 64 + 1};
+	for (auto const t : ticks) w.schedule(t, t);
+
+	int count = 0;
+	for (std::int64_t now = 0; now <= 64 * 64 * 64 + 1; ++now)
+	{
+		w.advance(now, [&](std::int64_t const t)
+		{
+			TEST_EQUAL(t, now);
+			++count;
+		});
+	}
+	TEST_EQUAL(count, int(std::size(ticks)));
+}
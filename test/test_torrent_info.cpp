@@ -25,9 +25,12 @@ see LICENSE file.
 #include "libtorrent/aux_/escape_string.hpp" // for convert_path_to_posix
 #include "libtorrent/aux_/piece_picker.hpp"
 #include "libtorrent/hex.hpp" // to_hex
+#include "libtorrent/bencode.hpp"
+#include "libtorrent/aux_/merkle_tree.hpp"
 #include "libtorrent/write_resume_data.hpp" // write_torrent_file
 
 #include <iostream>
+#include <fstream>
 
 using namespace lt;
 
@@ -1350,6 +1353,101 @@ TORRENT_TEST(parse_invalid_torrents_no_throw)
 
 namespace {
 
+load_torrent_limits no_piece_layer_validation()
+{
+	load_torrent_limits cfg;
+	cfg.validate_piece_layers = false;
+	return cfg;
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(deferred_piece_layer_validation)
+{
+	// loading a torrent without validating the piece layers should result in
+	// exactly the same add_torrent_params
+	std::string const root_dir = parent_path(current_working_directory());
+	for (char const* t : {"v2.torrent", "v2_multipiece_file.torrent", "v2_only.torrent"
+		, "v2_multiple_files.torrent", "v2_hybrid.torrent", "v2_incomplete_piece_layer.torrent"})
+	{
+		std::printf("loading %s\n", t);
+		std::string const filename = combine_path(combine_path(root_dir, "test_torrents"), t);
+		add_torrent_params const validated = load_torrent_file(filename);
+		add_torrent_params const deferred = load_torrent_file(filename, no_piece_layer_validation());
+
+		TEST_CHECK(validated.ti->info_hashes() == deferred.ti->info_hashes());
+		TEST_CHECK(validated.merkle_trees == deferred.merkle_trees);
+		TEST_CHECK(validated.merkle_tree_mask == deferred.merkle_tree_mask);
+		TEST_CHECK(validated.verified_leaf_hashes == deferred.verified_leaf_hashes);
+	}
+}
+
+TORRENT_TEST(deferred_piece_layer_validation_invalid)
+{
+	std::string const root_dir = parent_path(current_working_directory());
+	std::string const filename = combine_path(combine_path(root_dir, "test_torrents")
+		, "v2_invalid_piece_layer_root.torrent");
+
+	error_code ec;
+	add_torrent_params const atp = load_torrent_file(filename, ec, no_piece_layer_validation());
+	TEST_CHECK(!ec);
+	TEST_CHECK(atp.ti);
+	if (!atp.ti) return;
+
+	// the invalid piece layer is rejected once it's loaded into a merkle tree
+	auto const& fs = atp.ti->layout();
+	int num_trees = 0;
+	for (file_index_t i : fs.file_range())
+	{
+		if (i >= atp.merkle_trees.end_index() || atp.merkle_trees[i].empty()) continue;
+		aux::merkle_tree tree(fs.file_num_blocks(i), fs.blocks_per_piece(), fs.root_ptr(i));
+		tree.load_sparse_tree(atp.merkle_trees[i], atp.merkle_tree_mask[i]
+			, atp.verified_leaf_hashes[i]);
+		TEST_CHECK(tree.get_piece_layer().empty());
+		++num_trees;
+	}
+	TEST_CHECK(num_trees > 0);
+
+	// the size of the piece layers is still checked up-front
+	load_torrent_file(combine_path(combine_path(root_dir, "test_torrents")
+		, "v2_invalid_piece_layer_size.torrent"), ec, no_piece_layer_validation());
+	TEST_EQUAL(ec, error_code(errors::torrent_invalid_piece_layer));
+}
+
+TORRENT_TEST(load_large_torrent_file)
+{
+	// .torrent files larger than 1 MiB are copied out of a memory mapping
+	// of the file
+	std::string const root_dir = parent_path(current_working_directory());
+	error_code ec;
+	std::vector<char> data;
+	TEST_CHECK(load_file(combine_path(combine_path(root_dir, "test_torrents")
+		, "v2_multipiece_file.torrent"), data, ec) == 0);
+
+	entry e = bdecode(data);
+	e["padding"] = std::string(2 * 1024 * 1024, 'x');
+	data = bencode(e);
+	{
+		std::ofstream f("large.torrent", std::ios::binary | std::ios::trunc);
+		f.write(data.data(), std::streamsize(data.size()));
+	}
+
+	add_torrent_params const from_buffer = load_torrent_buffer(data);
+	add_torrent_params const from_file = load_torrent_file("large.torrent");
+	TEST_CHECK(from_file.ti);
+	TEST_CHECK(from_buffer.ti->info_hashes() == from_file.ti->info_hashes());
+	TEST_CHECK(from_buffer.merkle_trees == from_file.merkle_trees);
+	TEST_EQUAL(from_file.ti->num_files(), from_buffer.ti->num_files());
+	TEST_EQUAL(from_file.ti->name(), from_buffer.ti->name());
+
+	load_torrent_limits cfg;
+	cfg.max_buffer_size = 1024 * 1024 + 1;
+	load_torrent_file("large.torrent", ec, cfg);
+	TEST_EQUAL(ec, error_code(errors::metadata_too_large));
+}
+
+namespace {
+
 struct file_t
 {
 	std::string filename;
@@ -0,0 +1,183 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "libtorrent/aux_/udp_socket.hpp"
+#include "libtorrent/aux_/array.hpp"
+#include "libtorrent/io_context.hpp"
+#include "libtorrent/address.hpp"
+#include "libtorrent/error.hpp"
+
+#include "test.hpp"
+
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+using namespace lt;
+
+namespace {
+
+struct socket_pair
+{
+	socket_pair()
+		: sender(ios, aux::listen_socket_handle())
+		, receiver(ios, aux::listen_socket_handle())
+	{
+		error_code ec;
+		receiver.bind(udp::endpoint(make_address_v4("127.0.0.1"), 0), ec);
+		TEST_CHECK(!ec);
+		sender.bind(udp::endpoint(make_address_v4("127.0.0.1"), 0), ec);
+		TEST_CHECK(!ec);
+		target = udp::endpoint(make_address_v4("127.0.0.1")
+			, std::uint16_t(receiver.local_port()));
+	}
+
+	void send(int const num)
+	{
+		for (int i = 0; i < num; ++i)
+		{
+			char buf[4];
+			std::memcpy(buf, &i, sizeof(i));
+			error_code ec;
+			sender.send(target, buf, ec);
+			TEST_CHECK(!ec);
+		}
+	}
+
+	io_context ios;
+	aux::udp_socket sender;
+	aux::udp_socket receiver;
+	udp::endpoint target;
+};
+
+} // anonymous namespace
+
+TORRENT_TEST(read_batch)
+{
+	socket_pair s;
+	s.send(10);
+
+	aux::array<aux::udp_socket::packet, 50> p;
+	error_code ec;
+	int const num = s.receiver.read(p, ec);
+	TEST_EQUAL(num, 10);
+	TEST_CHECK(ec == boost::asio::error::would_block
+		|| ec == boost::asio::error::try_again);
+
+	for (int i = 0; i < num; ++i)
+	{
+		TEST_CHECK(!p[i].error);
+		TEST_EQUAL(p[i].from, s.sender.local_endpoint());
+		TEST_EQUAL(p[i].data.size(), 4);
+		int val;
+		std::memcpy(&val, p[i].data.data(), sizeof(val));
+		TEST_EQUAL(val, i);
+	}
+}
+
+TORRENT_TEST(read_batch_limit)
+{
+	socket_pair s;
+	int const num_packets = aux::udp_socket::max_read_packets + 8;
+	s.send(num_packets);
+
+	// read() never returns more than max_read_packets
+	aux::array<aux::udp_socket::packet, 50> p;
+	error_code ec;
+	int const num = s.receiver.read(p, ec);
+	TEST_EQUAL(num, aux::udp_socket::max_read_packets);
+	TEST_CHECK(!ec);
+
+	int received = num;
+	int const num2 = s.receiver.read(p, ec);
+	TEST_EQUAL(num2, 8);
+	received += num2;
+	TEST_EQUAL(received, num_packets);
+
+	int val;
+	std::memcpy(&val, p[0].data.data(), sizeof(val));
+	TEST_EQUAL(val, aux::udp_socket::max_read_packets);
+}
+
+TORRENT_TEST(read_small_span)
+{
+	socket_pair s;
+	s.send(5);
+
+	aux::array<aux::udp_socket::packet, 3> p;
+	error_code ec;
+	TEST_EQUAL(s.receiver.read(p, ec), 3);
+	TEST_CHECK(!ec);
+	TEST_EQUAL(s.receiver.read(p, ec), 2);
+
+	int val;
+	std::memcpy(&val, p[1].data.data(), sizeof(val));
+	TEST_EQUAL(val, 4);
+}
+
+TORRENT_TEST(send_batch)
+{
+	socket_pair s;
+
+	// a run of same-sized packets followed by a shorter one, which may all
+	// be sent as a single GSO message, and a packet to a different endpoint
+	std::vector<int> const sizes = {1000, 1000, 1000, 1000, 500, 1200, 1200};
+	for (std::size_t i = 0; i < sizes.size(); ++i)
+	{
+		std::vector<char> buf(std::size_t(sizes[i]), char(i));
+		error_code ec;
+		s.sender.send(s.target, buf, ec, aux::udp_socket::batch);
+		TEST_CHECK(!ec);
+	}
+	TEST_CHECK(s.sender.has_batch());
+
+	// nothing is sent until the batch is flushed
+	aux::array<aux::udp_socket::packet, 50> p;
+	error_code ec;
+	TEST_EQUAL(s.receiver.read(p, ec), 0);
+
+	s.sender.flush_batch(ec);
+	TEST_CHECK(!ec);
+	TEST_CHECK(!s.sender.has_batch());
+
+	int const num = s.receiver.read(p, ec);
+	TEST_EQUAL(num, int(sizes.size()));
+	for (int i = 0; i < num; ++i)
+	{
+		TEST_EQUAL(p[i].data.size(), sizes[std::size_t(i)]);
+		TEST_CHECK(std::all_of(p[i].data.begin(), p[i].data.end()
+			, [i](char c) { return c == char(i); }));
+	}
+}
+
+TORRENT_TEST(send_batch_order)
+{
+	socket_pair s;
+
+	// a packet sent without the batch flag is not sent ahead of the queued
+	// ones
+	int i = 0;
+	error_code ec;
+	s.sender.send(s.target, {reinterpret_cast<char const*>(&i), sizeof(i)}
+		, ec, aux::udp_socket::batch);
+	TEST_CHECK(!ec);
+	i = 1;
+	s.sender.send(s.target, {reinterpret_cast<char const*>(&i), sizeof(i)}, ec);
+	TEST_CHECK(!ec);
+	TEST_CHECK(!s.sender.has_batch());
+
+	aux::array<aux::udp_socket::packet, 50> p;
+	TEST_EQUAL(s.receiver.read(p, ec), 2);
+	for (int k = 0; k < 2; ++k)
+	{
+		int val;
+		std::memcpy(&val, p[k].data.data(), sizeof(val));
+		TEST_EQUAL(val, k);
+	}
+}
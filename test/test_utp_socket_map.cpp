@@ -0,0 +1,205 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+#include "libtorrent/aux_/utp_socket_map.hpp"
+#include "libtorrent/aux_/random.hpp"
+#include "libtorrent/time.hpp"
+#include "libtorrent/address.hpp"
+
+#include "test.hpp"
+
+#include <cstdio>
+#include <map>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+struct mock_socket
+{
+	mock_socket(std::uint16_t const i, udp::endpoint const& e) : id(i), ep(e) {}
+	bool match(udp::endpoint const& e, std::uint16_t const i) const
+	{ return id == i && ep == e; }
+	std::uint16_t id;
+	udp::endpoint ep;
+};
+
+using socket_map = aux::utp_socket_map<mock_socket>;
+
+udp::endpoint rand_ep(bool const v6 = false)
+{
+	if (v6)
+	{
+		address_v6::bytes_type b;
+		for (auto& c : b) c = std::uint8_t(aux::random(0xff));
+		return {address_v6(b), std::uint16_t(aux::random(0xffff))};
+	}
+	return {address_v4(aux::random(0xffffffff)), std::uint16_t(aux::random(0xffff))};
+}
+
+mock_socket* insert(socket_map& m, std::uint16_t const id, udp::endpoint const& ep)
+{
+	return m.insert(id, ep, std::make_unique<mock_socket>(id, ep));
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(insert_find_remove)
+{
+	socket_map m(1337);
+	udp::endpoint const ep1(make_address_v4("10.0.0.1"), 6881);
+	udp::endpoint const ep2(make_address_v4("10.0.0.2"), 6881);
+	udp::endpoint const ep3(make_address("2001::1"), 6881);
+
+	TEST_CHECK(m.find(1, ep1) == nullptr);
+
+	auto* s1 = insert(m, 1, ep1);
+	auto* s2 = insert(m, 1, ep2);
+	auto* s3 = insert(m, 2, ep3);
+	TEST_EQUAL(m.size(), 3);
+
+	TEST_CHECK(m.find(1, ep1) == s1);
+	TEST_CHECK(m.find(1, ep2) == s2);
+	TEST_CHECK(m.find(2, ep3) == s3);
+	TEST_CHECK(m.find(2, ep1) == nullptr);
+	TEST_CHECK(m.find(1, ep3) == nullptr);
+
+	auto p = m.remove(1, ep1, s1);
+	TEST_CHECK(p.get() == s1);
+	TEST_EQUAL(m.size(), 2);
+	TEST_CHECK(m.find(1, ep1) == nullptr);
+	TEST_CHECK(m.find(1, ep2) == s2);
+
+	// removing a socket that isn't in the table
+	TEST_CHECK(!m.remove(1, ep1, s1));
+}
+
+TORRENT_TEST(duplicate_keys)
+{
+	socket_map m;
+	udp::endpoint const ep;
+	auto* s1 = insert(m, 1, ep);
+	auto* s2 = insert(m, 1, ep);
+	TEST_EQUAL(m.size(), 2);
+
+	auto* f = m.find(1, ep);
+	TEST_CHECK(f == s1 || f == s2);
+
+	TEST_CHECK(m.remove(1, ep, s2));
+	TEST_CHECK(m.find(1, ep) == s1);
+	TEST_CHECK(m.remove(1, ep, s1));
+	TEST_CHECK(m.find(1, ep) == nullptr);
+	TEST_CHECK(m.empty());
+}
+
+TORRENT_TEST(rekey)
+{
+	socket_map m;
+	udp::endpoint const ep1;
+	udp::endpoint const ep2(make_address_v4("10.0.0.2"), 1024);
+	auto* s = insert(m, 10, ep1);
+
+	s->ep = ep2;
+	m.rekey(10, ep1, ep2, s);
+	TEST_CHECK(m.find(10, ep2) == s);
+	TEST_CHECK(m.find(10, ep1) == nullptr);
+	TEST_EQUAL(m.size(), 1);
+}
+
+TORRENT_TEST(random_operations)
+{
+	// compare against the list of inserted sockets, with lots of inserts and
+	// removals to exercise growing and backward-shift deletion
+	socket_map m;
+	std::vector<mock_socket*> sockets;
+
+	for (int i = 0; i < 20000; ++i)
+	{
+		if (!sockets.empty() && aux::random(2) == 0)
+		{
+			auto const idx = aux::random(std::uint32_t(sockets.size() - 1));
+			mock_socket* s = sockets[idx];
+			auto p = m.remove(s->id, s->ep, s);
+			TEST_CHECK(p.get() == s);
+			sockets[idx] = sockets.back();
+			sockets.pop_back();
+		}
+		else
+		{
+			// use a small range of IDs to get collisions
+			auto const id = std::uint16_t(aux::random(100));
+			sockets.push_back(insert(m, id, rand_ep(i % 3 == 0)));
+		}
+	}
+
+	TEST_EQUAL(m.size(), int(sockets.size()));
+	for (auto* s : sockets)
+		TEST_CHECK(m.find(s->id, s->ep) == s);
+
+	int count = 0;
+	m.for_each([&](mock_socket*) { ++count; });
+	TEST_EQUAL(count, int(sockets.size()));
+}
+
+// micro-benchmark comparing lookups in the utp_socket_map with the
+// std::multimap keyed on connection ID that it replaced
+TORRENT_TEST(lookup_benchmark)
+{
+	for (int const num_sockets : {1000, 10000, 100000})
+	{
+		socket_map m(aux::random(0xffffffff));
+		std::multimap<std::uint16_t, std::unique_ptr<mock_socket>> mm;
+		std::vector<std::pair<std::uint16_t, udp::endpoint>> keys;
+
+		for (int i = 0; i < num_sockets; ++i)
+		{
+			auto const id = std::uint16_t(aux::random(0xffff));
+			auto const ep = rand_ep();
+			insert(m, id, ep);
+			mm.emplace(id, std::make_unique<mock_socket>(id, ep));
+			keys.emplace_back(id, ep);
+		}
+
+		int const num_lookups = 1000000;
+		std::vector<std::uint32_t> order(static_cast<std::size_t>(num_lookups));
+		for (auto& o : order) o = aux::random(std::uint32_t(num_sockets - 1));
+
+		int found = 0;
+		time_point start = clock_type::now();
+		for (auto const o : order)
+		{
+			auto const& k = keys[o];
+			if (m.find(k.first, k.second)) ++found;
+		}
+		auto const hash_time = total_microseconds(clock_type::now() - start);
+		TEST_EQUAL(found, num_lookups);
+
+		found = 0;
+		start = clock_type::now();
+		for (auto const o : order)
+		{
+			auto const& k = keys[o];
+			auto r = mm.equal_range(k.first);
+			for (; r.first != r.second; ++r.first)
+			{
+				if (!r.first->second->match(k.second, k.first)) continue;
+				++found;
+				break;
+			}
+		}
+		auto const map_time = total_microseconds(clock_type::now() - start);
+		TEST_EQUAL(found, num_lookups);
+
+		std::printf("%6d sockets: utp_socket_map: %.1f Mlookups/s multimap: %.1f Mlookups/s\n"
+			, num_sockets
+			, double(num_lookups) / double(std::max(hash_time, std::int64_t(1)))
+			, double(num_lookups) / double(std::max(map_time, std::int64_t(1))));
+	}
+}
@@ -0,0 +1,119 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+// measures the alert throughput (alerts per second) of the alert_manager
+// with a number of threads posting alerts, while one thread drains the queue
+// with get_all(), the way a client would
+
+#include "libtorrent/aux_/alert_manager.hpp"
+#include "libtorrent/alert_types.hpp"
+#include "libtorrent/time.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <thread>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+struct result
+{
+	std::int64_t microseconds;
+	std::int64_t received;
+};
+
+result run(int const num_threads, int const alerts_per_thread)
+{
+	aux::alert_manager mgr(std::numeric_limits<int>::max()
+		, alert_category::all);
+
+	std::atomic<int> running{num_threads};
+	std::int64_t received = 0;
+
+	time_point const start = clock_type::now();
+	std::vector<std::thread> producers;
+	for (int t = 0; t < num_threads; ++t)
+	{
+		producers.emplace_back([&] {
+			for (int i = 0; i < alerts_per_thread; ++i)
+				mgr.emplace_alert<piece_finished_alert>(torrent_handle(), piece_index_t(i));
+			--running;
+		});
+	}
+
+	std::vector<alert*> alerts;
+	for (;;)
+	{
+		bool const done = running == 0;
+		mgr.wait_for_alert(milliseconds(10));
+		mgr.get_all(alerts);
+		received += std::int64_t(alerts.size());
+		if (done && alerts.empty()) break;
+	}
+	for (auto& t : producers) t.join();
+	return {total_microseconds(clock_type::now() - start), received};
+}
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: alert_benchmark [max-threads] [alerts-per-thread]\n\n"
+		"max-threads defaults to 8 and alerts-per-thread to 1000000\n");
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	int max_threads = 8;
+	int alerts_per_thread = 1000000;
+	if (argc > 3)
+	{
+		print_usage();
+		return 1;
+	}
+	if (argc > 1) max_threads = std::atoi(argv[1]);
+	if (argc > 2) alerts_per_thread = std::atoi(argv[2]);
+	if (max_threads < 1 || alerts_per_thread < 1)
+	{
+		print_usage();
+		return 1;
+	}
+
+	// powers of two, up to and including max_threads
+	std::vector<int> thread_counts;
+	for (int threads = 1; threads < max_threads; threads *= 2)
+		thread_counts.push_back(threads);
+	thread_counts.push_back(max_threads);
+
+	for (int const threads : thread_counts)
+	{
+		// run a few times and report the fastest run
+		result best{std::numeric_limits<std::int64_t>::max(), 0};
+		for (int i = 0; i < 3; ++i)
+		{
+			result const r = run(threads, alerts_per_thread);
+			if (r.received != std::int64_t(threads) * alerts_per_thread)
+			{
+				std::fprintf(stderr, "%d threads: expected %" PRId64 " alerts, received %" PRId64 "\n"
+					, threads, std::int64_t(threads) * alerts_per_thread, r.received);
+				return 1;
+			}
+			if (r.microseconds < best.microseconds) best = r;
+		}
+		std::printf("%2d producer threads: %9.1f ms %8.2f Malerts/s\n", threads
+			, double(best.microseconds) / 1000.0
+			, double(best.received) / std::max(double(best.microseconds), 1.0));
+	}
+}
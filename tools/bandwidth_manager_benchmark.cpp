@@ -0,0 +1,241 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+// simulates a large number of peers, spread over many rate limited peer
+// classes, requesting bandwidth from the bandwidth_manager. This is the
+// scenario of test_bandwidth_limiter.cpp, scaled up. Each peer requests a
+// (random) number of bytes and asks for more as soon as its request is
+// satisfied. Reports the time spent in update_quotas() per tick, compared
+// with the implementation that erased satisfied requests from the middle of
+// the queue, one at a time
+
+#include "libtorrent/aux_/bandwidth_manager.hpp"
+#include "libtorrent/aux_/bandwidth_queue_entry.hpp"
+#include "libtorrent/aux_/bandwidth_limit.hpp"
+#include "libtorrent/aux_/bandwidth_socket.hpp"
+#include "libtorrent/time.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+// update_quotas() before satisfied requests were compacted out of the queue
+struct legacy_bandwidth_manager
+{
+	explicit legacy_bandwidth_manager(int const channel) : m_channel(channel) {}
+
+	int request_bandwidth(std::shared_ptr<aux::bandwidth_socket> peer
+		, int const blk, int const priority, span<aux::bandwidth_channel*> channels)
+	{
+		int k = 0;
+		aux::bw_request bwr(std::move(peer), blk, priority);
+		for (auto const& c : channels)
+		{
+			if (c->need_queueing(blk))
+				bwr.channel[k++] = c;
+		}
+		if (k == 0) return blk;
+		m_queue.push_back(std::move(bwr));
+		return 0;
+	}
+
+	void update_quotas(time_duration const& dt)
+	{
+		if (m_queue.empty()) return;
+
+		std::int64_t dt_milliseconds = total_milliseconds(dt);
+		if (dt_milliseconds > 3000) dt_milliseconds = 3000;
+
+		std::vector<aux::bandwidth_channel*> channels;
+		std::vector<aux::bw_request> queue;
+
+		for (auto i = m_queue.begin(); i != m_queue.end();)
+		{
+			if (i->peer->is_disconnecting())
+			{
+				for (int j = 0; j < aux::bw_request::max_bandwidth_channels && i->channel[j]; ++j)
+					i->channel[j]->return_quota(i->assigned);
+				i->assigned = 0;
+				queue.push_back(std::move(*i));
+				i = m_queue.erase(i);
+				continue;
+			}
+			for (int j = 0; j < aux::bw_request::max_bandwidth_channels && i->channel[j]; ++j)
+				i->channel[j]->tmp = 0;
+			++i;
+		}
+
+		for (auto const& r : m_queue)
+		{
+			for (int j = 0; j < aux::bw_request::max_bandwidth_channels && r.channel[j]; ++j)
+			{
+				aux::bandwidth_channel* bwc = r.channel[j];
+				if (bwc->tmp == 0) channels.push_back(bwc);
+				bwc->tmp += r.priority;
+			}
+		}
+
+		for (auto const& ch : channels)
+			ch->update_quota(int(dt_milliseconds));
+
+		for (auto i = m_queue.begin(); i != m_queue.end();)
+		{
+			i->assign_bandwidth();
+			if (i->assigned == i->request_size
+				|| (i->ttl <= 0 && i->assigned > 0))
+			{
+				queue.push_back(std::move(*i));
+				i = m_queue.erase(i);
+			}
+			else
+			{
+				++i;
+			}
+		}
+
+		while (!queue.empty())
+		{
+			aux::bw_request& bwr = queue.back();
+			bwr.peer->assign_bandwidth(m_channel, bwr.assigned);
+			queue.pop_back();
+		}
+	}
+
+	std::vector<aux::bw_request> m_queue;
+	int m_channel;
+};
+
+template <typename Manager>
+struct peer : aux::bandwidth_socket, std::enable_shared_from_this<peer<Manager>>
+{
+	peer(Manager& bwm, aux::bandwidth_channel& global, aux::bandwidth_channel& cls
+		, int const priority, std::uint32_t const seed)
+		: m_bwm(bwm)
+		, m_global(global)
+		, m_class(cls)
+		, m_priority(priority)
+		, m_rng(seed)
+	{}
+
+	bool is_disconnecting() const override { return false; }
+	void assign_bandwidth(int, int const amount) override
+	{
+		m_received += amount;
+		request();
+	}
+
+	void request()
+	{
+		aux::bandwidth_channel* channels[] = {&m_channel, &m_class, &m_global};
+		std::uniform_int_distribution<int> size(1, 64 * 1024);
+		while (int const ret = m_bwm.request_bandwidth(this->shared_from_this()
+			, size(m_rng), m_priority, channels))
+		{
+			m_received += ret;
+		}
+	}
+
+	Manager& m_bwm;
+	aux::bandwidth_channel m_channel;
+	aux::bandwidth_channel& m_global;
+	aux::bandwidth_channel& m_class;
+	int m_priority;
+	std::mt19937 m_rng;
+	std::int64_t m_received = 0;
+};
+
+struct result
+{
+	std::int64_t tick_us = 0;
+	std::int64_t received = 0;
+};
+
+template <typename Manager>
+result run(int const num_peers, int const num_classes, int const num_ticks)
+{
+	Manager manager(0);
+	aux::bandwidth_channel global;
+	// 10 MB/s in total, with the classes limited to a fair share each, times
+	// two (so some classes are limited by the global limit)
+	global.throttle(10000000);
+	std::vector<aux::bandwidth_channel> classes(static_cast<std::size_t>(num_classes));
+	for (auto& c : classes) c.throttle(2 * 10000000 / num_classes);
+
+	std::vector<std::shared_ptr<peer<Manager>>> peers;
+	peers.reserve(std::size_t(num_peers));
+	for (int i = 0; i < num_peers; ++i)
+	{
+		peers.push_back(std::make_shared<peer<Manager>>(manager, global
+			, classes[std::size_t(i % num_classes)], 1 + i % 3, std::uint32_t(i)));
+	}
+	for (auto& p : peers) p->request();
+
+	// the default tick_interval
+	time_duration const tick = milliseconds(500);
+	time_point const start = clock_type::now();
+	for (int i = 0; i < num_ticks; ++i)
+		manager.update_quotas(tick);
+
+	result ret;
+	ret.tick_us = total_microseconds(clock_type::now() - start) / num_ticks;
+	for (auto const& p : peers) ret.received += p->m_received;
+	return ret;
+}
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: bandwidth_manager_benchmark [num-peers] [num-classes]\n\n"
+		"num-peers defaults to 20000 and num-classes to 200\n");
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	int num_peers = 20000;
+	int num_classes = 200;
+	if (argc > 3)
+	{
+		print_usage();
+		return 1;
+	}
+	if (argc > 1) num_peers = std::atoi(argv[1]);
+	if (argc > 2) num_classes = std::atoi(argv[2]);
+	if (num_peers < 1 || num_classes < 1)
+	{
+		print_usage();
+		return 1;
+	}
+
+	int const num_ticks = 200;
+	std::printf("%d peers, %d peer classes, %d ticks\n", num_peers, num_classes, num_ticks);
+
+	result const legacy = run<legacy_bandwidth_manager>(num_peers, num_classes, num_ticks);
+	result const current = run<aux::bandwidth_manager>(num_peers, num_classes, num_ticks);
+
+	std::printf("%-10s %14s %16s\n", "", "us per tick", "bytes assigned");
+	std::printf("%-10s %14lld %16lld\n", "erase", static_cast<long long>(legacy.tick_us)
+		, static_cast<long long>(legacy.received));
+	std::printf("%-10s %14lld %16lld\n", "compact", static_cast<long long>(current.tick_us)
+		, static_cast<long long>(current.received));
+	std::printf("speed-up: %.2fx\n", double(legacy.tick_us) / std::max(double(current.tick_us), 1.0));
+
+	if (legacy.received != current.received)
+	{
+		std::fprintf(stderr, "the implementations assigned different amounts of bandwidth\n");
+		return 1;
+	}
+}
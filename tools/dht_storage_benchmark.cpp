@@ -0,0 +1,186 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+// an in-process version of dht_flood.py, for the DHT storage. Announces a
+// large number of peers to a large number of torrents (with a few popular
+// ones), then looks up peers for random torrents (half of which don't exist,
+// like the random info-hashes of dht_flood.py) and finally calls tick(). Runs
+// against both the default and the sharded storage and reports the time
+// each phase took
+
+#include "libtorrent/kademlia/dht_storage.hpp"
+#include "libtorrent/settings_pack.hpp"
+#include "libtorrent/entry.hpp"
+#include "libtorrent/time.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+struct announce
+{
+	int torrent;
+	tcp::endpoint peer;
+	bool seed;
+};
+
+struct lookup
+{
+	sha1_hash info_hash;
+	address requester;
+	bool scrape;
+};
+
+struct result
+{
+	std::int64_t announce_us;
+	std::int64_t get_peers_us;
+	std::int64_t tick_us;
+	dht::dht_storage_counters counters;
+};
+
+result run(dht::dht_storage_constructor_type const& constructor
+	, settings_pack const& settings
+	, std::vector<sha1_hash> const& torrents
+	, std::vector<announce> const& announces
+	, std::vector<lookup> const& lookups)
+{
+	std::unique_ptr<dht::dht_storage_interface> s = constructor(settings);
+	s->update_node_ids({sha1_hash()});
+
+	result ret;
+	time_point start = clock_type::now();
+	for (auto const& a : announces)
+		s->announce_peer(torrents[std::size_t(a.torrent)], a.peer, "", a.seed);
+	ret.announce_us = total_microseconds(clock_type::now() - start);
+
+	start = clock_type::now();
+	for (auto const& l : lookups)
+	{
+		entry peers;
+		s->get_peers(l.info_hash, false, l.scrape, l.requester, peers);
+	}
+	ret.get_peers_us = total_microseconds(clock_type::now() - start);
+
+	start = clock_type::now();
+	s->tick();
+	ret.tick_us = total_microseconds(clock_type::now() - start);
+	ret.counters = s->counters();
+	return ret;
+}
+
+address random_address(std::mt19937& rng)
+{
+	// one in five peers is IPv6
+	if (rng() % 5 == 0)
+	{
+		address_v6::bytes_type b;
+		for (auto& c : b) c = static_cast<unsigned char>(rng());
+		b[0] = 0x20;
+		return address_v6(b);
+	}
+	return address_v4(std::uint32_t(rng()));
+}
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: dht_storage_benchmark [num-torrents] [num-announces]\n\n"
+		"num-torrents defaults to 100000 and num-announces to 1000000\n");
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	int num_torrents = 100000;
+	int num_announces = 1000000;
+	if (argc > 3)
+	{
+		print_usage();
+		return 1;
+	}
+	if (argc > 1) num_torrents = std::atoi(argv[1]);
+	if (argc > 2) num_announces = std::atoi(argv[2]);
+	if (num_torrents < 1 || num_announces < 1)
+	{
+		print_usage();
+		return 1;
+	}
+
+	std::mt19937 rng(0x1337);
+	auto random_hash = [&] {
+		sha1_hash ret;
+		for (auto& b : ret) b = static_cast<std::uint8_t>(rng());
+		return ret;
+	};
+
+	std::vector<sha1_hash> torrents;
+	torrents.reserve(std::size_t(num_torrents));
+	for (int i = 0; i < num_torrents; ++i) torrents.push_back(random_hash());
+
+	// the popularity of torrents is skewed, the torrents with lower indices
+	// get most of the announces
+	std::uniform_real_distribution<double> popularity(0.0, 1.0);
+	auto pick_torrent = [&] {
+		double const p = popularity(rng);
+		return std::min(num_torrents - 1, int(p * p * p * num_torrents));
+	};
+
+	std::vector<announce> announces;
+	announces.reserve(std::size_t(num_announces));
+	for (int i = 0; i < num_announces; ++i)
+	{
+		announces.push_back({pick_torrent()
+			, tcp::endpoint(random_address(rng), std::uint16_t(rng()))
+			, rng() % 3 == 0});
+	}
+
+	std::vector<lookup> lookups;
+	lookups.reserve(std::size_t(num_announces));
+	for (int i = 0; i < num_announces; ++i)
+	{
+		lookups.push_back({rng() % 2 == 0 ? torrents[std::size_t(pick_torrent())] : random_hash()
+			, random_address(rng), rng() % 10 == 0});
+	}
+
+	settings_pack settings = default_settings();
+	settings.set_int(settings_pack::dht_max_torrents, num_torrents);
+
+	std::printf("%d torrents, %d announces, %d lookups\n", num_torrents, num_announces
+		, int(lookups.size()));
+
+	result const def = run(dht::dht_default_storage_constructor, settings, torrents
+		, announces, lookups);
+	result const sharded = run(dht::dht_sharded_storage_constructor, settings, torrents
+		, announces, lookups);
+
+	std::printf("%-10s %14s %14s %10s %10s %10s\n", "", "announces/s", "get_peers/s"
+		, "tick (ms)", "torrents", "peers");
+	for (auto const& r : {std::make_pair("default", def), std::make_pair("sharded", sharded)})
+	{
+		std::printf("%-10s %14.0f %14.0f %10.2f %10d %10d\n", r.first
+			, double(num_announces) * 1000000.0 / std::max(double(r.second.announce_us), 1.0)
+			, double(lookups.size()) * 1000000.0 / std::max(double(r.second.get_peers_us), 1.0)
+			, double(r.second.tick_us) / 1000.0
+			, r.second.counters.torrents, r.second.counters.peers);
+	}
+
+	if (def.counters.torrents != sharded.counters.torrents
+		|| def.counters.peers != sharded.counters.peers)
+	{
+		std::fprintf(stderr, "the storages hold different numbers of torrents or peers\n");
+		return 1;
+	}
+}
@@ -0,0 +1,102 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+// compares the number of ed25519 signatures per second verified one at a
+// time, with ed25519_verify(), and in batches, with ed25519_verify_batch().
+// The messages are the size of typical mutable DHT items. The batches are
+// also timed with one invalid signature in every 100, which forces the
+// batches containing them to be verified one signature at a time
+
+#include "libtorrent/kademlia/ed25519.hpp"
+#include "libtorrent/time.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace lt;
+using namespace lt::dht;
+
+namespace {
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: ed25519_benchmark [num-signatures]\n\n"
+		"num-signatures defaults to 5000\n");
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	int num_signatures = 5000;
+	if (argc > 2)
+	{
+		print_usage();
+		return 1;
+	}
+	if (argc > 1) num_signatures = std::atoi(argv[1]);
+	if (num_signatures < 1)
+	{
+		print_usage();
+		return 1;
+	}
+
+	std::vector<std::string> messages;
+	std::vector<signature> sigs;
+	std::vector<public_key> pks;
+	for (int i = 0; i < num_signatures; ++i)
+	{
+		auto const [pk, sk] = ed25519_create_keypair(ed25519_create_seed());
+		messages.push_back("3:seqi" + std::to_string(i) + "e1:v300:"
+			+ std::string(300, char('a' + i % 26)));
+		sigs.push_back(ed25519_sign(messages.back(), pk, sk));
+		pks.push_back(pk);
+	}
+	std::vector<span<char const>> const msgs(messages.begin(), messages.end());
+
+	time_point start = clock_type::now();
+	int single_valid = 0;
+	for (int i = 0; i < num_signatures; ++i)
+		single_valid += ed25519_verify(sigs[std::size_t(i)], msgs[std::size_t(i)], pks[std::size_t(i)]);
+	std::int64_t const single_us = total_microseconds(clock_type::now() - start);
+
+	start = clock_type::now();
+	std::vector<bool> const batch = ed25519_verify_batch(sigs, msgs, pks);
+	std::int64_t const batch_us = total_microseconds(clock_type::now() - start);
+	int const batch_valid = int(std::count(batch.begin(), batch.end(), true));
+
+	std::vector<signature> broken_sigs = sigs;
+	for (std::size_t i = 0; i < broken_sigs.size(); i += 100)
+		broken_sigs[i].bytes[0] ^= 1;
+	start = clock_type::now();
+	std::vector<bool> const broken = ed25519_verify_batch(broken_sigs, msgs, pks);
+	std::int64_t const broken_us = total_microseconds(clock_type::now() - start);
+	int const broken_valid = int(std::count(broken.begin(), broken.end(), true));
+
+	std::printf("%-28s %12s %10s\n", "", "signatures/s", "valid");
+	auto print = [&](char const* name, std::int64_t const us, int const valid)
+	{
+		std::printf("%-28s %12.0f %10d\n", name
+			, double(num_signatures) * 1000000.0 / std::max(double(us), 1.0), valid);
+	};
+	print("ed25519_verify", single_us, single_valid);
+	print("ed25519_verify_batch", batch_us, batch_valid);
+	print("  1% invalid", broken_us, broken_valid);
+
+	int const expect_broken = num_signatures - (num_signatures + 99) / 100;
+	if (single_valid != num_signatures || batch_valid != num_signatures
+		|| broken_valid != expect_broken)
+	{
+		std::fprintf(stderr, "unexpected verification result\n");
+		return 1;
+	}
+}
@@ -0,0 +1,145 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+// measures how long it takes to load every .torrent file in a directory, the
+// way a client does at startup. Each file is loaded by reading it into a
+// buffer first (the way load_torrent_file() used to), with load_torrent_file()
+// (which decodes large files out of a memory mapping) and with
+// load_torrent_file() not validating the piece layers of v2 torrents (leaving
+// that to the torrent, once it's added to a session)
+
+#include "libtorrent/load_torrent.hpp"
+#include "libtorrent/time.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+// the way load_torrent_file() used to load a file, reading all of it into a
+// buffer before decoding it
+add_torrent_params load_buffered(std::string const& filename, error_code& ec
+	, load_torrent_limits const& cfg)
+{
+	std::FILE* f = std::fopen(filename.c_str(), "rb");
+	if (f == nullptr)
+	{
+		ec.assign(errno, generic_category());
+		return {};
+	}
+	std::fseek(f, 0, SEEK_END);
+	long const size = std::ftell(f);
+	std::fseek(f, 0, SEEK_SET);
+	std::vector<char> buf(static_cast<std::size_t>(std::max(size, 0L)));
+	buf.resize(std::fread(buf.data(), 1, buf.size(), f));
+	std::fclose(f);
+	return load_torrent_buffer(buf, ec, cfg);
+}
+
+add_torrent_params load_file(std::string const& filename, error_code& ec
+	, load_torrent_limits const& cfg)
+{
+	return load_torrent_file(filename, ec, cfg);
+}
+
+template <typename Fun>
+std::int64_t run(std::vector<std::string> const& files, int const rounds
+	, load_torrent_limits const& cfg, Fun f)
+{
+	int failed = 0;
+	time_point const start = clock_type::now();
+	for (int r = 0; r < rounds; ++r)
+	{
+		for (auto const& name : files)
+		{
+			error_code ec;
+			add_torrent_params const atp = f(name, ec, cfg);
+			if (ec) ++failed;
+		}
+	}
+	std::int64_t const us = total_microseconds(clock_type::now() - start);
+	if (failed > 0)
+		std::fprintf(stderr, "failed to load %d torrents\n", failed / rounds);
+	return std::max(us / rounds, std::int64_t(1));
+}
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: load_torrent_benchmark <directory> [rounds]\n\n"
+		"loads all .torrent files in <directory> (recursively). rounds\n"
+		"defaults to 5\n");
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	if (argc < 2 || argc > 3)
+	{
+		print_usage();
+		return 1;
+	}
+	int const rounds = argc > 2 ? std::atoi(argv[2]) : 5;
+	if (rounds < 1)
+	{
+		print_usage();
+		return 1;
+	}
+
+	namespace fs = std::filesystem;
+	std::vector<std::string> files;
+	std::int64_t total_size = 0;
+	std::error_code err;
+	for (auto const& p : fs::recursive_directory_iterator(argv[1], err))
+	{
+		if (!p.is_regular_file() || p.path().extension() != ".torrent") continue;
+		files.push_back(p.path().string());
+		total_size += std::int64_t(p.file_size());
+	}
+	if (err)
+	{
+		std::fprintf(stderr, "failed to list directory: %s\n", err.message().c_str());
+		return 1;
+	}
+	if (files.empty())
+	{
+		std::fprintf(stderr, "no .torrent files found in \"%s\"\n", argv[1]);
+		return 1;
+	}
+
+	std::printf("%d torrents, %.1f MB, %d rounds\n", int(files.size())
+		, double(total_size) / 1000000.0, rounds);
+
+	load_torrent_limits cfg;
+	load_torrent_limits deferred;
+	deferred.validate_piece_layers = false;
+
+	// warm up the page cache
+	run(files, 1, cfg, &load_buffered);
+
+	std::int64_t const buffered_us = run(files, rounds, cfg, &load_buffered);
+	std::int64_t const file_us = run(files, rounds, cfg, &load_file);
+	std::int64_t const deferred_us = run(files, rounds, deferred, &load_file);
+
+	std::printf("%-22s %12s %14s\n", "", "total (ms)", "torrents/s");
+	for (auto const& r : {std::make_pair("read + parse", buffered_us)
+		, std::make_pair("load_torrent_file", file_us)
+		, std::make_pair("deferred piece layers", deferred_us)})
+	{
+		std::printf("%-22s %12.2f %14.0f\n", r.first, double(r.second) / 1000.0
+			, double(files.size()) * 1000000.0 / double(r.second));
+	}
+}
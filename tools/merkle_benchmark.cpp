@@ -0,0 +1,145 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+// compares building a merkle tree by hashing one sibling pair at a time with
+// hasher256, with the batched multi-buffer builder (merkle_fill_tree()), with
+// each of the SHA-256 kernels supported by this CPU
+
+#include "libtorrent/aux_/merkle.hpp"
+#include "libtorrent/aux_/multi_hasher.hpp"
+#include "libtorrent/aux_/random.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/time.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <utility>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+// the tree construction before the batched builder
+void fill_tree_sequential(span<sha256_hash> tree, int const num_leafs)
+{
+	int level_start = merkle_first_leaf(num_leafs);
+	int level_size = num_leafs;
+	while (level_size > 1)
+	{
+		int parent = merkle_get_parent(level_start);
+		for (int i = level_start; i < level_start + level_size; i += 2, ++parent)
+		{
+			hasher256 h;
+			h.update(tree[i]);
+			h.update(tree[i + 1]);
+			tree[parent] = h.final();
+		}
+		level_start = merkle_get_parent(level_start);
+		level_size /= 2;
+	}
+}
+
+void fill_tree_kernel(span<sha256_hash> tree, int const num_leafs
+	, aux::hash_kernel const k)
+{
+	int level_start = merkle_first_leaf(num_leafs);
+	int level_size = num_leafs;
+	while (level_size > 1)
+	{
+		int const parent = merkle_get_parent(level_start);
+		aux::multi_sha256_pairs(tree.subspan(level_start, level_size)
+			, tree.subspan(parent, level_size / 2), k);
+		level_start = parent;
+		level_size /= 2;
+	}
+}
+
+template <typename Fun>
+double run(char const* name, std::vector<sha256_hash>& tree, int const num_leafs
+	, sha256_hash& root, Fun f)
+{
+	// hash the tree a few times and report the fastest run
+	std::int64_t best = std::numeric_limits<std::int64_t>::max();
+	for (int i = 0; i < 3; ++i)
+	{
+		time_point const start = clock_type::now();
+		f(tree);
+		best = std::min(best, total_microseconds(clock_type::now() - start));
+	}
+	if (root.is_all_zeros()) root = tree[0];
+	else if (root != tree[0])
+	{
+		std::fprintf(stderr, "%s: root hash mismatch\n", name);
+		std::exit(1);
+	}
+
+	double const ms = double(best) / 1000.0;
+	std::printf("%-12s %9.1f ms %8.2f Mhashes/s\n", name, ms
+		, double(num_leafs - 1) / std::max(double(best), 1.0));
+	return ms;
+}
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: merkle_benchmark [num-leafs]\n\n"
+		"num-leafs defaults to 1048576, and is rounded up to a power of 2\n");
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	int num_leafs = 1024 * 1024;
+	if (argc > 2)
+	{
+		print_usage();
+		return 1;
+	}
+	if (argc == 2)
+	{
+		num_leafs = std::atoi(argv[1]);
+		if (num_leafs < 2)
+		{
+			print_usage();
+			return 1;
+		}
+		num_leafs = merkle_num_leafs(num_leafs);
+	}
+
+	std::vector<sha256_hash> tree(std::size_t(merkle_num_nodes(num_leafs)));
+	int const first_leaf = merkle_first_leaf(num_leafs);
+	for (int i = first_leaf; i < int(tree.size()); ++i)
+		aux::random_bytes(tree[std::size_t(i)]);
+
+	std::printf("building merkle tree with %d leafs\n", num_leafs);
+
+	sha256_hash root;
+	double const base = run("sequential", tree, num_leafs, root
+		, [&](span<sha256_hash> t) { fill_tree_sequential(t, num_leafs); });
+
+	std::pair<aux::hash_kernel, char const*> const kernels[] = {
+		{aux::hash_kernel::generic, "generic"},
+		{aux::hash_kernel::sha_ni, "sha_ni"},
+		{aux::hash_kernel::avx2, "avx2"},
+	};
+	for (auto const& k : kernels)
+	{
+		if (!aux::hash_kernel_supported(k.first)) continue;
+		run(k.second, tree, num_leafs, root
+			, [&](span<sha256_hash> t) { fill_tree_kernel(t, num_leafs, k.first); });
+	}
+
+	double const batched = run("fill_tree", tree, num_leafs, root
+		, [&](span<sha256_hash> t) { merkle_fill_tree(t, num_leafs); });
+
+	std::printf("speed-up: %.2fx\n", base / batched);
+}
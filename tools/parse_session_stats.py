@@ -733,6 +733,29 @@ def main(input_file: Path, num_threads: int, output_dir: Path) -> None:
             ],
             {"type": stacked, "gradient": 18},
         ),
+        (
+            "second_tick_time",
+            "num",
+            "",
+            "histogram of the time spent in the once-per-second session tick",
+            [
+                "ses.second_tick_time7",
+                "ses.second_tick_time8",
+                "ses.second_tick_time9",
+                "ses.second_tick_time10",
+                "ses.second_tick_time11",
+                "ses.second_tick_time12",
+                "ses.second_tick_time13",
+                "ses.second_tick_time14",
+                "ses.second_tick_time15",
+                "ses.second_tick_time16",
+                "ses.second_tick_time17",
+                "ses.second_tick_time18",
+                "ses.second_tick_time19",
+                "ses.second_tick_time20",
+            ],
+            {"type": stacked, "gradient": 14},
+        ),
         (
             "request latency",
             "us",
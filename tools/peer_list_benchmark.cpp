@@ -0,0 +1,159 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+// adds a large number of peers to a peer_list, picks peers to connect to
+// (where every connection attempt fails) and erases all peers again, once with
+// the peer list sorted by address and once with the hash index
+// (hashed_peer_list)
+
+#include "libtorrent/aux_/peer_list.hpp"
+#include "libtorrent/aux_/torrent_peer_allocator.hpp"
+#include "libtorrent/aux_/random.hpp"
+#include "libtorrent/peer_info.hpp"
+#include "libtorrent/time.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+struct result
+{
+	std::int64_t add = 0;
+	std::int64_t connect = 0;
+	std::int64_t erase = 0;
+	int loop_counter = 0;
+};
+
+std::vector<tcp::endpoint> generate_endpoints(int const num_peers)
+{
+	std::vector<tcp::endpoint> ret;
+	ret.reserve(std::size_t(num_peers));
+	for (int i = 0; i < num_peers; ++i)
+	{
+		address_v4 a;
+		do a = address_v4(aux::random(0xffffffff));
+		while (a.is_unspecified() || a.is_loopback());
+		ret.emplace_back(a, std::uint16_t(1024 + aux::random(60000)));
+	}
+	return ret;
+}
+
+result run(std::vector<tcp::endpoint> const& endpoints, int const num_connects
+	, bool const hashed)
+{
+	aux::torrent_peer_allocator allocator;
+	aux::peer_list list(allocator);
+	list.set_hash_index(hashed);
+
+	aux::torrent_state st;
+	st.max_peerlist_size = 0;
+	st.port = 6881;
+	st.max_failcount = 3;
+
+	peer_source_flags_t const sources[] = {
+		peer_info::tracker, peer_info::dht, peer_info::pex };
+
+	result ret;
+	std::vector<aux::torrent_peer*> peers;
+	peers.reserve(endpoints.size());
+
+	time_point start = clock_type::now();
+	for (auto const& ep : endpoints)
+	{
+		auto* p = list.add_peer(ep, sources[aux::random(2)], {}, &st);
+		if (p != nullptr && st.first_time_seen) peers.push_back(p);
+	}
+	ret.add = total_microseconds(clock_type::now() - start);
+
+	start = clock_type::now();
+	for (int i = 0; i < num_connects; ++i)
+	{
+		// the session clock ticks once a second, and the torrent tries a
+		// handful of peers per tick
+		int const session_time = 100 + i / 8;
+		aux::torrent_peer* p = list.connect_one_peer(session_time, &st);
+		if (p == nullptr) break;
+		p->last_connected = std::uint16_t(session_time);
+		list.inc_failcount(p);
+	}
+	ret.connect = total_microseconds(clock_type::now() - start);
+	ret.loop_counter = st.loop_counter;
+
+	aux::random_shuffle(peers);
+	start = clock_type::now();
+	for (auto* p : peers) list.erase_peer(p, &st);
+	ret.erase = total_microseconds(clock_type::now() - start);
+	return ret;
+}
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: peer_list_benchmark [num-peers] [num-connects]\n\n"
+		"num-peers defaults to 100000 and num-connects to 20000\n");
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	int num_peers = 100000;
+	int num_connects = 20000;
+	if (argc > 3)
+	{
+		print_usage();
+		return 1;
+	}
+	if (argc > 1) num_peers = std::atoi(argv[1]);
+	if (argc > 2) num_connects = std::atoi(argv[2]);
+	if (num_peers < 1 || num_connects < 0)
+	{
+		print_usage();
+		return 1;
+	}
+
+	std::vector<tcp::endpoint> const endpoints = generate_endpoints(num_peers);
+	std::printf("%d peers, %d connection attempts\n", num_peers, num_connects);
+	std::printf("%-8s %14s %14s %14s %12s\n"
+		, "", "add (us/peer)", "connect (us)", "erase (us)", "peers tried");
+
+	result results[2];
+	for (int const hashed : {0, 1})
+	{
+		// run a few times and report the fastest run of each phase
+		result best;
+		best.add = best.connect = best.erase = std::numeric_limits<std::int64_t>::max();
+		for (int i = 0; i < 3; ++i)
+		{
+			result const r = run(endpoints, num_connects, hashed != 0);
+			best.add = std::min(best.add, r.add);
+			best.connect = std::min(best.connect, r.connect);
+			best.erase = std::min(best.erase, r.erase);
+			best.loop_counter = r.loop_counter;
+		}
+		results[hashed] = best;
+		std::printf("%-8s %14.3f %14.3f %14.3f %12d\n"
+			, hashed ? "hashed" : "sorted"
+			, double(best.add) / num_peers
+			, double(best.connect) / std::max(num_connects, 1)
+			, double(best.erase) / num_peers
+			, best.loop_counter);
+	}
+	auto const speedup = [](std::int64_t const a, std::int64_t const b)
+	{ return double(a) / std::max(double(b), 1.0); };
+	std::printf("speed-up: add %.2fx connect %.2fx erase %.2fx\n"
+		, speedup(results[0].add, results[1].add)
+		, speedup(results[0].connect, results[1].connect)
+		, speedup(results[0].erase, results[1].erase));
+}
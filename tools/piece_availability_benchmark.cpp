@@ -0,0 +1,216 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+// replays a trace of peers joining (with bitfields), leaving, sending have
+// messages and seeds coming and going, interleaved with picking pieces, against
+// a piece picker that rebuilds its list of pieces sorted by rarity when it's
+// invalidated, and one that updates it incrementally
+// (incremental_piece_availability)
+
+#include "libtorrent/aux_/piece_picker.hpp"
+#include "libtorrent/aux_/torrent_peer.hpp"
+#include "libtorrent/aux_/random.hpp"
+#include "libtorrent/bitfield.hpp"
+#include "libtorrent/performance_counters.hpp"
+#include "libtorrent/time.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+struct event
+{
+	enum type_t { join, leave, have, seed_join, seed_leave };
+	type_t type;
+	// the peer slot for join, leave and have
+	int peer;
+	// the piece for have events, the index into trace::bitfields for joins
+	int arg;
+};
+
+struct trace
+{
+	int num_pieces;
+	int num_peers;
+	std::vector<event> events;
+	std::vector<typed_bitfield<piece_index_t>> bitfields;
+};
+
+// peers start out with a random fraction of the pieces, where most peers have
+// a few, and some have most
+typed_bitfield<piece_index_t> random_bitfield(int const num_pieces)
+{
+	typed_bitfield<piece_index_t> ret(num_pieces, false);
+	double const f = double(aux::random(1000)) / 1000.0;
+	std::uint32_t const density = std::uint32_t(f * f * f * 1000.0);
+	for (piece_index_t i{0}; i < ret.end_index(); ++i)
+		if (aux::random(999) < density) ret.set_bit(i);
+	return ret;
+}
+
+trace generate_trace(int const num_pieces, int const num_peers, int const num_events)
+{
+	trace t;
+	t.num_pieces = num_pieces;
+	t.num_peers = num_peers;
+
+	// keep track of the peers' bitfields, to only generate have messages for
+	// pieces they don't already have
+	std::vector<typed_bitfield<piece_index_t>> peers;
+	for (int i = 0; i < num_peers; ++i)
+	{
+		t.bitfields.push_back(random_bitfield(num_pieces));
+		peers.push_back(t.bitfields.back());
+		t.events.push_back({event::join, i, int(t.bitfields.size() - 1)});
+	}
+
+	int seeds = 0;
+	for (int i = 0; i < num_events; ++i)
+	{
+		int const peer = int(aux::random(std::uint32_t(num_peers - 1)));
+		std::uint32_t const r = aux::random(99);
+		if (r < 70)
+		{
+			auto& bits = peers[std::size_t(peer)];
+			if (bits.all_set()) continue;
+			piece_index_t p;
+			do p = piece_index_t(int(aux::random(std::uint32_t(num_pieces - 1))));
+			while (bits.get_bit(p));
+			bits.set_bit(p);
+			t.events.push_back({event::have, peer, static_cast<int>(p)});
+		}
+		else if (r < 95)
+		{
+			// a peer disconnects and another one takes its place
+			t.events.push_back({event::leave, peer, 0});
+			t.bitfields.push_back(random_bitfield(num_pieces));
+			peers[std::size_t(peer)] = t.bitfields.back();
+			t.events.push_back({event::join, peer, int(t.bitfields.size() - 1)});
+		}
+		else if (r < 98 || seeds == 0)
+		{
+			t.events.push_back({event::seed_join, 0, 0});
+			++seeds;
+		}
+		else
+		{
+			t.events.push_back({event::seed_leave, 0, 0});
+			--seeds;
+		}
+	}
+	return t;
+}
+
+std::int64_t replay(trace const& t, bool const incremental)
+{
+	int const piece_size = 0x40000;
+	aux::piece_picker picker(std::int64_t(t.num_pieces) * piece_size, piece_size);
+	picker.set_incremental_availability(incremental);
+
+	std::vector<std::unique_ptr<aux::ipv4_peer>> peer_structs;
+	for (int i = 0; i < t.num_peers; ++i)
+		peer_structs.push_back(std::make_unique<aux::ipv4_peer>(tcp::endpoint{}, false, peer_source_flags_t{}));
+	std::vector<std::unique_ptr<aux::ipv4_peer>> seeds;
+	std::vector<typed_bitfield<piece_index_t>> peers(std::size_t(t.num_peers));
+
+	counters cnt;
+	std::vector<piece_block> picked;
+	std::vector<piece_index_t> const suggested;
+	typed_bitfield<piece_index_t> const all(t.num_pieces, true);
+
+	time_point const start = clock_type::now();
+	for (auto const& e : t.events)
+	{
+		auto* const peer = peer_structs[std::size_t(e.peer)].get();
+		auto& bits = peers[std::size_t(e.peer)];
+		switch (e.type)
+		{
+			case event::join:
+				bits = t.bitfields[std::size_t(e.arg)];
+				picker.inc_refcount(bits, peer);
+				break;
+			case event::leave:
+				picker.dec_refcount(bits, peer);
+				break;
+			case event::have:
+				bits.set_bit(piece_index_t(e.arg));
+				picker.inc_refcount(piece_index_t(e.arg), peer);
+				break;
+			case event::seed_join:
+				seeds.push_back(std::make_unique<aux::ipv4_peer>(tcp::endpoint{}, false, peer_source_flags_t{}));
+				picker.inc_refcount_all(seeds.back().get());
+				break;
+			case event::seed_leave:
+				picker.dec_refcount_all(seeds.back().get());
+				seeds.pop_back();
+				break;
+		}
+
+		// the network thread picks pieces to request all the time, which
+		// is when the piece list is rebuilt, if it's been invalidated
+		picked.clear();
+		picker.pick_pieces(all, picked, 16, 0, nullptr
+			, aux::piece_picker::rarest_first, suggested, 20, cnt);
+	}
+	return total_microseconds(clock_type::now() - start);
+}
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: piece_availability_benchmark [num-pieces] [num-peers] [num-events]\n\n"
+		"num-pieces defaults to 500000, num-peers to 200 and num-events to 2000\n");
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	int num_pieces = 500000;
+	int num_peers = 200;
+	int num_events = 2000;
+	if (argc > 4)
+	{
+		print_usage();
+		return 1;
+	}
+	if (argc > 1) num_pieces = std::atoi(argv[1]);
+	if (argc > 2) num_peers = std::atoi(argv[2]);
+	if (argc > 3) num_events = std::atoi(argv[3]);
+	if (num_pieces < 2 || num_peers < 1 || num_events < 0)
+	{
+		print_usage();
+		return 1;
+	}
+
+	trace const t = generate_trace(num_pieces, num_peers, num_events);
+	std::printf("replaying %d events, %d pieces, %d peers\n"
+		, int(t.events.size()), num_pieces, num_peers);
+
+	std::int64_t results[2];
+	for (int const incremental : {0, 1})
+	{
+		// run a few times and report the fastest run
+		std::int64_t best = std::numeric_limits<std::int64_t>::max();
+		for (int i = 0; i < 3; ++i)
+			best = std::min(best, replay(t, incremental != 0));
+		results[incremental] = best;
+		std::printf("%-12s %9.1f ms %8.2f us/event\n"
+			, incremental ? "incremental" : "rebuild"
+			, double(best) / 1000.0
+			, double(best) / std::max(double(t.events.size()), 1.0));
+	}
+	std::printf("speed-up: %.2fx\n", double(results[0]) / std::max(double(results[1]), 1.0));
+}
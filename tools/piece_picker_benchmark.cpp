@@ -0,0 +1,456 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+// downloads a synthetic torrent from a synthetic swarm, driving the piece
+// picker the way peer connections do, and reports the time and the number of
+// heap allocations per call of its hottest operations: pick_pieces(),
+// mark_as_downloading(), mark_as_writing(), mark_as_finished() and
+// piece_passed().
+//
+// Every tick, each peer delivers a few of the blocks it's been asked for, and
+// peers whose request queue has room pick more blocks to request, the same way
+// request_a_block() does (including picking busy blocks in end-game mode).
+
+#include "libtorrent/aux_/piece_picker.hpp"
+#include "libtorrent/aux_/torrent_peer.hpp"
+#include "libtorrent/aux_/random.hpp"
+#include "libtorrent/bitfield.hpp"
+#include "libtorrent/disk_interface.hpp" // for default_block_size
+#include "libtorrent/download_priority.hpp"
+#include "libtorrent/performance_counters.hpp"
+#include "libtorrent/time.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+// the number of heap allocations made by the process so far
+std::int64_t g_allocations = 0;
+
+} // anonymous namespace
+
+void* operator new(std::size_t size)
+{
+	++g_allocations;
+	void* ret = std::malloc(size == 0 ? 1 : size);
+	if (ret == nullptr) throw std::bad_alloc();
+	return ret;
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+namespace {
+
+enum class distribution
+{
+	// every peer has every piece with a probability of 1/2
+	uniform,
+	// most pieces are rare, and a few are common
+	long_tail,
+	// every peer is a seed
+	seeds
+};
+
+enum class mode
+{
+	rarest_first,
+	sequential,
+	// a window of pieces ahead of the cursor has top priority, the way
+	// set_piece_deadline() sets it, for streaming
+	time_critical,
+	// all but the last few pieces are already downloaded, so peers end up
+	// requesting blocks that are already requested from other peers
+	endgame
+};
+
+char const* mode_name(mode const m)
+{
+	switch (m)
+	{
+		case mode::rarest_first: return "rarest-first";
+		case mode::sequential: return "sequential";
+		case mode::time_critical: return "time-critical";
+		case mode::endgame: return "endgame";
+	}
+	return "";
+}
+
+char const* distribution_name(distribution const d)
+{
+	switch (d)
+	{
+		case distribution::uniform: return "uniform";
+		case distribution::long_tail: return "long-tail";
+		case distribution::seeds: return "seeds";
+	}
+	return "";
+}
+
+struct config
+{
+	int num_pieces = 100000;
+	int blocks_per_piece = 16;
+	int num_peers = 200;
+	// the max number of outstanding requests per peer
+	int queue_depth = 32;
+	// the number of blocks each peer delivers per tick
+	int blocks_per_tick = 4;
+	// the number of pieces ahead of the cursor with a deadline, in
+	// time-critical mode
+	int deadline_window = 32;
+	distribution dist = distribution::uniform;
+};
+
+struct op_stats
+{
+	char const* name;
+	std::int64_t calls = 0;
+	std::int64_t nanoseconds = 0;
+	std::int64_t allocations = 0;
+};
+
+// accumulates the time and allocations of the calls made between
+// construction and destruction
+struct measure
+{
+	measure(op_stats& s, int const calls)
+		: m_stats(s)
+		, m_allocations(g_allocations)
+		, m_start(clock_type::now())
+	{
+		m_stats.calls += calls;
+	}
+
+	~measure()
+	{
+		m_stats.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+			clock_type::now() - m_start).count();
+		m_stats.allocations += g_allocations - m_allocations;
+	}
+
+	measure(measure const&) = delete;
+	measure& operator=(measure const&) = delete;
+
+private:
+	op_stats& m_stats;
+	std::int64_t const m_allocations;
+	time_point const m_start;
+};
+
+struct peer
+{
+	std::unique_ptr<aux::ipv4_peer> info;
+	// the pieces this peer has. All set for seeds
+	typed_bitfield<piece_index_t> pieces;
+	bool seed = false;
+	// the blocks requested from this peer, in the order they were requested
+	std::deque<piece_block> queue;
+};
+
+std::vector<peer> generate_swarm(config const& cfg)
+{
+	std::vector<peer> ret(std::size_t(cfg.num_peers));
+
+	// the probability (out of 1000) of a peer having each piece
+	std::vector<std::uint32_t> availability(std::size_t(cfg.num_pieces), 500);
+	if (cfg.dist == distribution::long_tail)
+	{
+		for (auto& a : availability)
+		{
+			double const f = double(aux::random(1000)) / 1000.0;
+			a = std::uint32_t(f * f * f * f * 1000.0);
+		}
+	}
+
+	for (auto& p : ret)
+	{
+		p.info = std::make_unique<aux::ipv4_peer>(tcp::endpoint{}, false, peer_source_flags_t{});
+#if TORRENT_USE_ASSERTS
+		p.info->in_use = true;
+#endif
+		p.seed = cfg.dist == distribution::seeds;
+		p.pieces.resize(cfg.num_pieces, p.seed);
+		if (p.seed) continue;
+		for (piece_index_t i{0}; i < p.pieces.end_index(); ++i)
+			if (aux::random(999) < availability[std::size_t(static_cast<int>(i))])
+				p.pieces.set_bit(i);
+	}
+
+	if (cfg.dist == distribution::seeds) return ret;
+
+	// make sure every piece is available from at least one peer, otherwise
+	// the download would never complete
+	for (piece_index_t i{0}; i < piece_index_t(cfg.num_pieces); ++i)
+	{
+		if (std::any_of(ret.begin(), ret.end()
+			, [=](peer const& p) { return p.pieces.get_bit(i); }))
+			continue;
+		ret[aux::random(std::uint32_t(cfg.num_peers - 1))].pieces.set_bit(i);
+	}
+	return ret;
+}
+
+struct result
+{
+	std::int64_t microseconds;
+	int ticks;
+	op_stats pick{"pick_pieces"};
+	op_stats download{"mark_as_downloading"};
+	op_stats writing{"mark_as_writing"};
+	op_stats finished{"mark_as_finished"};
+	op_stats passed{"piece_passed"};
+	op_stats priority{"set_piece_priority"};
+};
+
+result run(config const& cfg, mode const m)
+{
+	result ret{};
+	std::vector<peer> peers = generate_swarm(cfg);
+
+	int const piece_size = cfg.blocks_per_piece * default_block_size;
+	aux::piece_picker picker(std::int64_t(cfg.num_pieces) * piece_size, piece_size);
+
+	if (m == mode::endgame)
+	{
+		// leave fewer blocks than the swarm can have requested at a time
+		int const remaining = std::max(1, std::min(cfg.num_pieces
+			, cfg.num_peers * cfg.queue_depth / cfg.blocks_per_piece / 2));
+		for (piece_index_t i{0}; i < piece_index_t(cfg.num_pieces - remaining); ++i)
+			picker.piece_flushed(i);
+	}
+
+	for (auto& p : peers)
+	{
+		if (p.seed) picker.inc_refcount_all(p.info.get());
+		else picker.inc_refcount(p.pieces, p.info.get());
+	}
+
+	aux::picker_options_t options{};
+	switch (m)
+	{
+		case mode::sequential: options = aux::piece_picker::sequential; break;
+		case mode::rarest_first:
+		case mode::time_critical:
+		case mode::endgame: options = aux::piece_picker::rarest_first; break;
+	}
+
+	counters cnt;
+	std::vector<piece_block> picked;
+	std::vector<piece_block> requested;
+	std::vector<piece_index_t> const suggested;
+	std::vector<std::pair<piece_block, aux::torrent_peer*>> delivered;
+	std::vector<std::pair<piece_block, aux::torrent_peer*>> written;
+	std::vector<piece_index_t> completed;
+	piece_index_t deadline_end{0};
+
+	time_point const start = clock_type::now();
+	while (!picker.is_finished())
+	{
+		++ret.ticks;
+
+		if (m == mode::time_critical)
+		{
+			// move the deadline window forward, past the pieces we have
+			piece_index_t const end = std::min(piece_index_t(cfg.num_pieces)
+				, piece_index_t(static_cast<int>(picker.cursor()) + cfg.deadline_window));
+			int const num = std::max(0, static_cast<int>(end - deadline_end));
+			if (num > 0)
+			{
+				measure ms(ret.priority, num);
+				for (; deadline_end < end; ++deadline_end)
+					picker.set_piece_priority(deadline_end, top_priority);
+			}
+		}
+
+		// peers deliver the blocks they were asked for first. In end-game
+		// mode, some of them have already been delivered by other peers
+		delivered.clear();
+		for (auto& p : peers)
+		{
+			for (int i = 0; i < cfg.blocks_per_tick && !p.queue.empty(); ++i)
+			{
+				delivered.emplace_back(p.queue.front(), p.info.get());
+				p.queue.pop_front();
+			}
+		}
+
+		written.clear();
+		written.reserve(delivered.size());
+		{
+			measure ms(ret.writing, int(delivered.size()));
+			for (auto const& b : delivered)
+				if (picker.mark_as_writing(b.first, b.second)) written.push_back(b);
+		}
+
+		{
+			measure ms(ret.finished, int(written.size()));
+			for (auto const& b : written)
+				picker.mark_as_finished(b.first, b.second);
+		}
+
+		completed.clear();
+		for (auto const& b : written)
+		{
+			piece_index_t const piece = b.first.piece_index;
+			if (!picker.is_piece_finished(piece) || picker.have_piece(piece)) continue;
+			if (std::find(completed.begin(), completed.end(), piece) != completed.end()) continue;
+			completed.push_back(piece);
+		}
+
+		{
+			measure ms(ret.passed, int(completed.size()));
+			for (piece_index_t const piece : completed)
+				picker.piece_passed(piece);
+		}
+
+		// peers with room in their request queue pick more blocks
+		for (auto& p : peers)
+		{
+			int const num_requests = cfg.queue_depth - int(p.queue.size());
+			if (num_requests <= 0) continue;
+
+			picked.clear();
+			{
+				measure ms(ret.pick, 1);
+				picker.pick_pieces(p.pieces, picked, num_requests, 0, p.info.get()
+					, options, suggested, cfg.num_peers, cnt);
+			}
+
+			// like request_a_block(), request blocks no other peer is
+			// downloading, and only fall back to a busy block if there's
+			// nothing else to request, and nothing outstanding
+			requested.clear();
+			piece_block busy_block = piece_block::invalid;
+			for (piece_block const& b : picked)
+			{
+				if (int(requested.size()) >= num_requests) break;
+				if (picker.num_peers(b) > 0)
+				{
+					busy_block = b;
+					continue;
+				}
+				requested.push_back(b);
+			}
+			if (requested.empty() && p.queue.empty() && busy_block != piece_block::invalid)
+				requested.push_back(busy_block);
+
+			{
+				measure ms(ret.download, int(requested.size()));
+				for (piece_block const& b : requested)
+					picker.mark_as_downloading(b, p.info.get(), options);
+			}
+			p.queue.insert(p.queue.end(), requested.begin(), requested.end());
+		}
+	}
+	ret.microseconds = total_microseconds(clock_type::now() - start);
+	return ret;
+}
+
+void print_result(config const& cfg, mode const m, result const& r)
+{
+	std::printf("%s: %d pieces, %d blocks per piece, %d peers (%s)\n"
+		"  %d ticks, %.1f ms\n"
+		, mode_name(m), cfg.num_pieces, cfg.blocks_per_piece, cfg.num_peers
+		, distribution_name(cfg.dist), r.ticks, double(r.microseconds) / 1000.0);
+	std::printf("  %-20s %12s %10s %10s\n", "operation", "calls", "ns/op", "allocs/op");
+	for (op_stats const* s : {&r.pick, &r.download, &r.writing, &r.finished, &r.passed, &r.priority})
+	{
+		if (s->calls == 0) continue;
+		std::printf("  %-20s %12" PRId64 " %10.1f %10.3f\n", s->name, s->calls
+			, double(s->nanoseconds) / double(s->calls)
+			, double(s->allocations) / double(s->calls));
+	}
+	std::printf("\n");
+}
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: piece_picker_benchmark [options]\n\n"
+		"options:\n"
+		"  -p <num>     number of pieces (default: 100000)\n"
+		"  -b <num>     blocks per piece (default: 16)\n"
+		"  -n <num>     number of peers (default: 200)\n"
+		"  -q <num>     max outstanding requests per peer (default: 32)\n"
+		"  -r <num>     blocks delivered per peer and tick (default: 4)\n"
+		"  -w <num>     number of pieces with a deadline in time-critical\n"
+		"               mode (default: 32)\n"
+		"  -d <dist>    piece availability. One of: uniform, long-tail,\n"
+		"               seeds (default: uniform)\n"
+		"  -m <mode>    one of: rarest-first, sequential, time-critical,\n"
+		"               endgame, all (default: all)\n");
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	config cfg;
+	std::vector<mode> modes{mode::rarest_first, mode::sequential
+		, mode::time_critical, mode::endgame};
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (i + 1 >= argc || argv[i][0] != '-' || std::strlen(argv[i]) != 2)
+		{
+			print_usage();
+			return 1;
+		}
+		char const* const arg = argv[i + 1];
+		switch (argv[i][1])
+		{
+			case 'p': cfg.num_pieces = std::atoi(arg); break;
+			case 'b': cfg.blocks_per_piece = std::atoi(arg); break;
+			case 'n': cfg.num_peers = std::atoi(arg); break;
+			case 'q': cfg.queue_depth = std::atoi(arg); break;
+			case 'r': cfg.blocks_per_tick = std::atoi(arg); break;
+			case 'w': cfg.deadline_window = std::atoi(arg); break;
+			case 'd':
+				if (arg == std::string("uniform")) cfg.dist = distribution::uniform;
+				else if (arg == std::string("long-tail")) cfg.dist = distribution::long_tail;
+				else if (arg == std::string("seeds")) cfg.dist = distribution::seeds;
+				else { print_usage(); return 1; }
+				break;
+			case 'm':
+				if (arg == std::string("rarest-first")) modes = {mode::rarest_first};
+				else if (arg == std::string("sequential")) modes = {mode::sequential};
+				else if (arg == std::string("time-critical")) modes = {mode::time_critical};
+				else if (arg == std::string("endgame")) modes = {mode::endgame};
+				else if (arg != std::string("all")) { print_usage(); return 1; }
+				break;
+			default:
+				print_usage();
+				return 1;
+		}
+		++i;
+	}
+
+	if (cfg.num_pieces < 1 || cfg.num_peers < 1
+		|| cfg.blocks_per_piece < 1 || cfg.blocks_per_piece > aux::piece_picker::max_blocks_per_piece
+		|| cfg.queue_depth < 1 || cfg.blocks_per_tick < 1 || cfg.deadline_window < 1)
+	{
+		print_usage();
+		return 1;
+	}
+
+	for (mode const m : modes)
+		print_result(cfg, m, run(cfg, m));
+}
@@ -0,0 +1,146 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+// measures the throughput (MB/s, on a single core) of the RC4 stream cipher
+// used by encrypted peer connections, compared with the byte-at-a-time
+// implementation it replaced. Both are run on buffers of a few different
+// sizes, with the large buffers split into 16 kiB blocks, the way the send
+// buffer is handed to rc4_handler::encrypt()
+
+#include "libtorrent/aux_/pe_crypto.hpp"
+#include "libtorrent/aux_/random.hpp"
+#include "libtorrent/time.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#if !defined TORRENT_DISABLE_ENCRYPTION
+
+using namespace lt;
+
+namespace {
+
+// the RC4 implementation before the permutation was widened to 32 bit words.
+// Like the one in pe_crypto.cpp, it's based on libTomCrypt
+// (http://www.libtomcrypt.com/), which is public domain and has been
+// specially tailored for libtorrent by Arvid Norberg
+struct rc4_bytes
+{
+	std::uint8_t x = 0;
+	std::uint8_t y = 0;
+	std::array<std::uint8_t, 256> s;
+};
+
+void rc4_bytes_init(std::uint8_t const* key, std::size_t const len, rc4_bytes& st)
+{
+	for (int i = 0; i < 256; ++i) st.s[std::size_t(i)] = std::uint8_t(i);
+	std::uint8_t y = 0;
+	for (std::size_t i = 0; i < 256; ++i)
+	{
+		y = std::uint8_t(y + st.s[i] + key[i % len]);
+		std::swap(st.s[i], st.s[y]);
+	}
+	st.x = 0;
+	st.y = 0;
+}
+
+void rc4_bytes_encrypt(std::uint8_t* out, std::size_t n, rc4_bytes& st)
+{
+	std::uint8_t x = st.x;
+	std::uint8_t y = st.y;
+	std::uint8_t* const s = st.s.data();
+	while (n--)
+	{
+		x = std::uint8_t(x + 1);
+		y = std::uint8_t(y + s[x]);
+		std::uint8_t const tmp = s[x];
+		s[x] = s[y];
+		s[y] = tmp;
+		*out++ ^= s[std::uint8_t(s[x] + s[y])];
+	}
+	st.x = x;
+	st.y = y;
+}
+
+template <typename Fun>
+double run(std::vector<std::uint8_t>& buf, int const block_size, Fun f)
+{
+	// encrypt about 256 MB
+	int const rounds = std::max(1, int(256 * 1024 * 1024 / buf.size()));
+	time_point const start = clock_type::now();
+	for (int r = 0; r < rounds; ++r)
+	{
+		for (std::size_t pos = 0; pos < buf.size(); pos += std::size_t(block_size))
+		{
+			f(buf.data() + pos, std::min(buf.size() - pos, std::size_t(block_size)));
+		}
+	}
+	std::int64_t const us = std::max(total_microseconds(clock_type::now() - start)
+		, std::int64_t(1));
+	return double(buf.size()) * rounds / double(us);
+}
+
+} // anonymous namespace
+
+int main()
+{
+	std::uint8_t key[20];
+	aux::random_bytes({reinterpret_cast<char*>(key), sizeof(key)});
+
+	// make sure both implementations agree before timing them
+	{
+		std::vector<std::uint8_t> a(1021);
+		std::vector<std::uint8_t> b(a.size());
+		rc4_bytes ref;
+		rc4_bytes_init(key, sizeof(key), ref);
+		rc4_bytes_encrypt(a.data(), a.size(), ref);
+		aux::rc4 st;
+		aux::rc4_init(key, sizeof(key), &st);
+		aux::rc4_encrypt(b.data(), b.size(), &st);
+		if (a != b)
+		{
+			std::fprintf(stderr, "RC4 implementations disagree\n");
+			return 1;
+		}
+	}
+
+	std::printf("%-12s %14s %14s %10s\n", "buffer size", "bytes (MB/s)", "words (MB/s)", "speed-up");
+	for (int const size : {64, 1500, 16 * 1024, 1024 * 1024})
+	{
+		std::vector<std::uint8_t> buf(static_cast<std::size_t>(size));
+		aux::random_bytes({reinterpret_cast<char*>(buf.data()), std::ptrdiff_t(buf.size())});
+		int const block_size = std::min(size, 16 * 1024);
+
+		rc4_bytes ref;
+		rc4_bytes_init(key, sizeof(key), ref);
+		double const old_rate = run(buf, block_size, [&](std::uint8_t* p, std::size_t const n)
+			{ rc4_bytes_encrypt(p, n, ref); });
+
+		aux::rc4 st;
+		aux::rc4_init(key, sizeof(key), &st);
+		double const new_rate = run(buf, block_size, [&](std::uint8_t* p, std::size_t const n)
+			{ aux::rc4_encrypt(p, n, &st); });
+
+		std::printf("%-12d %14.1f %14.1f %9.2fx\n", size, old_rate, new_rate
+			, new_rate / old_rate);
+	}
+}
+
+#else
+
+int main()
+{
+	std::fprintf(stderr, "rc4_benchmark requires encryption support\n");
+	return 1;
+}
+
+#endif
@@ -0,0 +1,115 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+// fills a DHT routing table (with the extended bucket sizes) until no more
+// nodes fit, and then looks up the nodes closest to a large number of random
+// targets with routing_table::find_node(), the way incoming get_peers and
+// find_node requests and our own traversals do
+
+#include "libtorrent/kademlia/routing_table.hpp"
+#include "libtorrent/kademlia/node_id.hpp"
+#include "libtorrent/aux_/session_settings.hpp"
+#include "libtorrent/aux_/random.hpp"
+#include "libtorrent/time.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <tuple>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+udp::endpoint random_endpoint()
+{
+	address_v4 a;
+	do a = address_v4(aux::random(0xffffffff));
+	while (a.is_unspecified() || a.is_loopback());
+	return udp::endpoint(a, std::uint16_t(1024 + aux::random(60000)));
+}
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: routing_table_benchmark [num-lookups]\n\n"
+		"num-lookups defaults to 1000000\n");
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	int num_lookups = 1000000;
+	if (argc > 2)
+	{
+		print_usage();
+		return 1;
+	}
+	if (argc > 1) num_lookups = std::atoi(argv[1]);
+	if (num_lookups < 1)
+	{
+		print_usage();
+		return 1;
+	}
+
+	aux::session_settings sett;
+	sett.set_bool(settings_pack::dht_extended_routing_table, true);
+	sett.set_bool(settings_pack::dht_enforce_node_id, false);
+	sett.set_bool(settings_pack::dht_prefer_verified_node_ids, false);
+	sett.set_bool(settings_pack::dht_restrict_routing_ips, false);
+
+	sha1_hash const our_id = dht::generate_random_id();
+	dht::routing_table table(our_id, udp::v4(), 8, sett, nullptr);
+
+	// nodes sharing a longer prefix with our ID are increasingly rare. Pick
+	// the number of shared bits uniformly, to fill the deeper buckets too
+	int stalled = 0;
+	while (stalled < 100000)
+	{
+		int const before = std::get<0>(table.size());
+		sha1_hash id = dht::generate_random_id();
+		id >>= int(aux::random(32));
+		id ^= our_id;
+		table.node_seen(id, random_endpoint(), int(20 + aux::random(300)));
+		if (std::get<0>(table.size()) == before) ++stalled;
+		else stalled = 0;
+	}
+
+	std::printf("%d nodes in %d buckets, %d in the first bucket\n"
+		, std::get<0>(table.size()), table.num_active_buckets(), table.bucket_size(0));
+
+	std::vector<sha1_hash> targets;
+	targets.reserve(std::size_t(num_lookups));
+	for (int i = 0; i < num_lookups; ++i) targets.push_back(dht::generate_random_id());
+
+	std::printf("%-18s %8s %14s\n", "", "count", "lookups/s");
+	for (int const count : {8, 16})
+	{
+		for (bool const include_failed : {false, true})
+		{
+			std::size_t returned = 0;
+			time_point const start = clock_type::now();
+			for (auto const& t : targets)
+			{
+				returned += table.find_node(t, include_failed
+					? dht::routing_table::include_failed : dht::find_nodes_flags_t{}, count).size();
+			}
+			std::int64_t const us = total_microseconds(clock_type::now() - start);
+			std::printf("%-18s %8d %14.0f\n", include_failed ? "include_failed" : "confirmed", count
+				, double(num_lookups) * 1000000.0 / std::max(double(us), 1.0));
+			if (returned != targets.size() * std::size_t(count))
+			{
+				std::fprintf(stderr, "find_node() returned %d nodes, expected %d\n"
+					, int(returned), num_lookups * count);
+				return 1;
+			}
+		}
+	}
+}
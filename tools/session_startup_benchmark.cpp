@@ -0,0 +1,200 @@
+/*
+
+Copyright (c) 2022, Arvid Norberg
+All rights reserved.
+
+You may use, distribute and modify this code under the terms of the BSD license,
+see LICENSE file.
+*/
+
+// measures how long it takes to restore a large number of torrents from their
+// resume data (including the metadata) at startup. Torrents are either
+// parsed and added one at a time, with async_add_torrent(), on a single
+// thread, or parsed by a number of threads, each adding the torrents it has
+// parsed with async_add_torrents(). The longest time a call into the session
+// had to wait for the network thread, while the torrents were being added, is
+// reported as well
+
+#include "libtorrent/session.hpp"
+#include "libtorrent/session_params.hpp"
+#include "libtorrent/settings_pack.hpp"
+#include "libtorrent/alert_types.hpp"
+#include "libtorrent/create_torrent.hpp"
+#include "libtorrent/read_resume_data.hpp"
+#include "libtorrent/write_resume_data.hpp"
+#include "libtorrent/disabled_disk_io.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/time.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+// resume data for a single-file torrent, including its info-dictionary
+std::vector<char> make_resume_data(int const i)
+{
+	std::string const name = "torrent-" + std::to_string(i);
+	create_torrent t({create_file_entry(name, 16 * 1024 * 1024)}, 1024 * 1024
+		, create_torrent::v1_only);
+	for (piece_index_t p : t.piece_range())
+		t.set_hash(p, hasher(name + std::to_string(static_cast<int>(p))).final());
+	std::vector<char> const buf = bencode(t.generate());
+
+	add_torrent_params atp;
+	atp.ti = std::make_shared<torrent_info>(buf, from_span);
+	atp.info_hashes = atp.ti->info_hashes();
+	atp.save_path = ".";
+	atp.flags = torrent_flags::paused;
+	return write_resume_data_buf(atp);
+}
+
+struct result
+{
+	std::int64_t total_us;
+	std::int64_t max_stall_us;
+	int added;
+};
+
+template <typename Fun>
+result run(int const num_torrents, Fun add)
+{
+	settings_pack pack;
+	pack.set_int(settings_pack::alert_mask, alert_category::status | alert_category::error);
+	pack.set_int(settings_pack::alert_queue_size, num_torrents * 2);
+	pack.set_bool(settings_pack::enable_dht, false);
+	pack.set_bool(settings_pack::enable_lsd, false);
+	pack.set_bool(settings_pack::enable_upnp, false);
+	pack.set_bool(settings_pack::enable_natpmp, false);
+	pack.set_str(settings_pack::listen_interfaces, "127.0.0.1:0");
+	session_params params(pack);
+	params.disk_io_constructor = disabled_disk_io_constructor;
+	session ses(std::move(params));
+
+	// keep calling into the session from another thread, recording the
+	// longest time a call had to wait for the network thread
+	std::atomic<bool> done{false};
+	std::int64_t max_stall_us = 0;
+	std::thread probe([&] {
+		while (!done)
+		{
+			time_point const start = clock_type::now();
+			ses.is_paused();
+			max_stall_us = std::max(max_stall_us
+				, total_microseconds(clock_type::now() - start));
+			std::this_thread::sleep_for(milliseconds(1));
+		}
+	});
+
+	time_point const start = clock_type::now();
+	add(ses);
+
+	int added = 0;
+	std::vector<alert*> alerts;
+	while (added < num_torrents)
+	{
+		ses.wait_for_alert(seconds(10));
+		ses.pop_alerts(&alerts);
+		if (alerts.empty()) break;
+		for (alert* a : alerts)
+		{
+			auto const* at = alert_cast<add_torrent_alert>(a);
+			if (at == nullptr) continue;
+			if (at->error) std::fprintf(stderr, "failed to add torrent: %s\n"
+				, at->error.message().c_str());
+			else ++added;
+		}
+	}
+	std::int64_t const total_us = total_microseconds(clock_type::now() - start);
+	done = true;
+	probe.join();
+	return {total_us, max_stall_us, added};
+}
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: session_startup_benchmark [num-torrents] [threads]\n\n"
+		"num-torrents defaults to 10000 and threads to the number of cores\n");
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	int num_torrents = 10000;
+	int num_threads = std::max(1, int(std::thread::hardware_concurrency()));
+	if (argc > 3)
+	{
+		print_usage();
+		return 1;
+	}
+	if (argc > 1) num_torrents = std::atoi(argv[1]);
+	if (argc > 2) num_threads = std::atoi(argv[2]);
+	if (num_torrents < 1 || num_threads < 1)
+	{
+		print_usage();
+		return 1;
+	}
+
+	std::printf("generating resume data for %d torrents\n", num_torrents);
+	std::vector<std::vector<char>> resume_data;
+	resume_data.reserve(std::size_t(num_torrents));
+	for (int i = 0; i < num_torrents; ++i)
+		resume_data.push_back(make_resume_data(i));
+
+	result const serial = run(num_torrents, [&](session& ses) {
+		for (auto const& rd : resume_data)
+		{
+			add_torrent_params atp = read_resume_data(rd);
+			ses.async_add_torrent(std::move(atp));
+		}
+	});
+
+	result const bulk = run(num_torrents, [&](session& ses) {
+		// every thread parses a contiguous range of the resume files and adds
+		// them in chunks, so the session can start adding torrents while the
+		// rest are still being parsed
+		std::size_t const chunk = 1000;
+		std::vector<std::thread> workers;
+		for (int t = 0; t < num_threads; ++t)
+		{
+			workers.emplace_back([&, t] {
+				std::size_t const begin = resume_data.size() * std::size_t(t) / std::size_t(num_threads);
+				std::size_t const end = resume_data.size() * std::size_t(t + 1) / std::size_t(num_threads);
+				std::vector<add_torrent_params> batch;
+				for (std::size_t i = begin; i < end; ++i)
+				{
+					batch.push_back(read_resume_data(resume_data[i]));
+					if (batch.size() < chunk && i + 1 < end) continue;
+					ses.async_add_torrents(std::move(batch));
+					batch.clear();
+				}
+			});
+		}
+		for (auto& w : workers) w.join();
+	});
+
+	std::printf("%-28s %12s %14s %16s\n", "", "total (ms)", "torrents/s", "max stall (ms)");
+	for (auto const& r : {std::make_pair("async_add_torrent", serial)
+		, std::make_pair("async_add_torrents", bulk)})
+	{
+		std::printf("%-28s %12.1f %14.0f %16.1f\n", r.first
+			, double(r.second.total_us) / 1000.0
+			, double(r.second.added) * 1000000.0 / std::max(double(r.second.total_us), 1.0)
+			, double(r.second.max_stall_us) / 1000.0);
+		if (r.second.added != num_torrents)
+		{
+			std::fprintf(stderr, "only %d of %d torrents were added\n"
+				, r.second.added, num_torrents);
+			return 1;
+		}
+	}
+	std::printf("(%d parser threads)\n", num_threads);
+}